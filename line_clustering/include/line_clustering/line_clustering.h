@@ -30,6 +30,7 @@ class KMeansCluster {
   void setNumberOfClusters(unsigned int num_clusters);
   void setLines(const std::vector<cv::Vec6f>& lines3D);
   void setLines(const std::vector<line_detection::LineWithPlanes>& lines3D);
+  void setLines(const line_detection::LineSet& lines3D);
   // Computes the means of the lines that are used to cluster them.
   void computeLineMeans();
   // Performs the clustering on the means of lines.
@@ -89,6 +89,9 @@ void KMeansCluster::setLines(
   lines_.resize(lines3D.size());
   hessians_.resize(lines3D.size());
   int n;
+  // The lines always have at least one plane. For unclassified lines (of which
+  // only the endpoints were computed), both planes are zero, so they are only
+  // clustered by their endpoints.
   for (size_t i = 0; i < lines3D.size(); ++i) {
     lines_[i] = lines3D[i].line;
     if (lines3D[i].hessians.size() == 2) {
@@ -105,6 +108,23 @@ void KMeansCluster::setLines(
   hessians_set_ = true;
 }
 
+void KMeansCluster::setLines(const line_detection::LineSet& lines3D) {
+  // Only the lines and the planes are read, from their contiguous arrays. As
+  // above, the planes of unclassified lines are zero.
+  lines_ = lines3D.getLines();
+  const std::vector<line_detection::LineHessians>& hessians =
+      lines3D.getHessians();
+  hessians_.resize(hessians.size());
+  for (size_t i = 0; i < hessians.size(); ++i) {
+    const size_t n = hessians[i].size() == 2 ? 1 : 0;
+    hessians_[i] = {hessians[i][0][0], hessians[i][0][1], hessians[i][0][2],
+                    hessians[i][0][3], hessians[i][n][0], hessians[i][n][1],
+                    hessians[i][n][2], hessians[i][n][3]};
+  }
+  lines_set_ = true;
+  hessians_set_ = true;
+}
+
 void KMeansCluster::computeLineMeans() {
   CHECK(lines_set_)
       << "You have to set the lines before computing their means.";
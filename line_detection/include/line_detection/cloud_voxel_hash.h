@@ -0,0 +1,60 @@
+#ifndef LINE_DETECTION_CLOUD_VOXEL_HASH_H_
+#define LINE_DETECTION_CLOUD_VOXEL_HASH_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+// Per-frame spatial hash of the points of an organized point cloud: the points
+// are grouped by the cubic voxel in which they lie, so that the points close
+// to a 3D location can be found without visiting the whole cloud. Points with
+// NaN coordinates are not stored.
+class CloudVoxelHash {
+ public:
+  CloudVoxelHash();
+
+  // Builds the hash for a new cloud.
+  // Input: cloud:      Point cloud of type CV_32FC3.
+  //
+  //        voxel_size: Edge length of the voxels.
+  void setCloud(const cv::Mat& cloud, double voxel_size);
+
+  // Returns true if the hash was built for the given cloud and voxel size.
+  bool isSetTo(const cv::Mat& cloud, double voxel_size) const;
+
+  // Finds the points that might be closer than voxel_size / 2 to the segment
+  // from start to end. All such points are returned, together with the other
+  // points in the voxels around the segment, which can be farther. Not
+  // thread-safe (an internal buffer is used).
+  // Input: start/end:  Endpoints of the segment.
+  //
+  // Output: pixel_indices: Indices (row * cols + col) of the pixels of the
+  //                        points found, each returned only once. The vector
+  //                        is not cleared, the indices are appended.
+  void findPointsNearSegment(const cv::Vec3f& start, const cv::Vec3f& end,
+                             std::vector<int>* pixel_indices);
+
+ private:
+  // Returns the key of the voxel with the given integer coordinates. Keys of
+  // voxels very far apart can collide, which only adds candidates.
+  static uint64_t voxelKey(int64_t x, int64_t y, int64_t z);
+  // Returns the integer coordinate of the voxel containing the coordinate c.
+  int64_t voxelCoordinate(float c) const;
+
+  const uchar* cloud_data_;
+  int rows_;
+  int cols_;
+  double voxel_size_;
+  // Pairs (voxel key, pixel index), sorted by key.
+  std::vector<std::pair<uint64_t, int>> entries_;
+  // Buffer for the keys of the voxels visited by findPointsNearSegment.
+  std::vector<uint64_t> keys_buffer_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_CLOUD_VOXEL_HASH_H_
@@ -0,0 +1,109 @@
+#ifndef LINE_DETECTION_CLUSTER_DISTANCE_HISTOGRAM_H_
+#define LINE_DETECTION_CLUSTER_DISTANCE_HISTOGRAM_H_
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+// Same check as ClusterDistanceFromMean, without sorting the distances from
+// the mean point: they are bucketed in a histogram with bins of half the
+// threshold, so that two consecutive distances within a bin are never
+// separated, and only the gaps between consecutive non-empty bins have to be
+// compared with the threshold. The cost is linear in the number of points and
+// the buffers are kept between calls, so that the same instance should be
+// reused.
+class ClusterDistanceHistogram {
+ public:
+   explicit ClusterDistanceHistogram(double distance_threshold = 0.0) {
+     distance_threshold_ = distance_threshold;
+   }
+   // Sets the threshold for two distances to still identify the same cluster.
+   void setDistanceThreshold(double distance_threshold) {
+     distance_threshold_ = distance_threshold;
+   }
+   // Clears the entire structure.
+   void clear() {
+     distances_.clear();
+   }
+
+   // Adds the points to the data structure.
+   void addPoints(const std::vector<cv::Vec3f>& points) {
+     // Compute mean point, in the same way as ClusterDistanceFromMean.
+     cv::Vec3f mean = {0.0f, 0.0f, 0.0f};
+     for (auto& point : points) {
+       mean += (point / float(points.size()));
+     }
+     for (auto& point : points) {
+       distances_.push_back(cv::norm(mean - point));
+     }
+   }
+
+   // True if the points form a single connected component, false otherwise.
+   bool singleConnectedComponent() {
+     if (distances_.empty()) {
+       return false;
+     }
+     const auto min_max_distance =
+         std::minmax_element(distances_.begin(), distances_.end());
+     const double min_distance = *min_max_distance.first;
+     const double range = *min_max_distance.second - min_distance;
+     // If the smallest distance from the mean point is more than 10 cm, then
+     // the points do not form a single connected component.
+     if (min_distance > 0.1) {
+       return false;
+     }
+     const size_t num_distances = distances_.size();
+     if (distance_threshold_ <= 0.0) {
+       return num_distances == 1 ||
+              (range == 0.0 && distance_threshold_ == 0.0);
+     }
+     // The num_distances - 1 gaps cannot cover a larger range without one of
+     // them being larger than the threshold.
+     if (range > (num_distances - 1) * distance_threshold_) {
+       return false;
+     }
+     const double bin_width = 0.5 * distance_threshold_;
+     const size_t num_bins = static_cast<size_t>(range / bin_width) + 1;
+     bin_min_.assign(num_bins, std::numeric_limits<double>::max());
+     bin_max_.assign(num_bins, std::numeric_limits<double>::lowest());
+     for (const double distance : distances_) {
+       const size_t bin = std::min(
+           num_bins - 1,
+           static_cast<size_t>((distance - min_distance) / bin_width));
+       bin_min_[bin] = std::min(bin_min_[bin], distance);
+       bin_max_[bin] = std::max(bin_max_[bin], distance);
+     }
+     // The first bin contains the smallest distance.
+     double previous_distance = bin_max_[0];
+     for (size_t bin = 1; bin < num_bins; ++bin) {
+       if (bin_min_[bin] > bin_max_[bin]) {
+         // Empty bin.
+         continue;
+       }
+       if (bin_min_[bin] - previous_distance > distance_threshold_) {
+         // The difference in distance is such that they identify two separated
+         // components.
+         return false;
+       }
+       previous_distance = bin_max_[bin];
+     }
+     return true;
+   }
+
+ private:
+   // Stores the distances from the mean point, unsorted.
+   std::vector<double> distances_;
+   // Smallest and largest distance in each bin of the histogram.
+   std::vector<double> bin_min_;
+   std::vector<double> bin_max_;
+   // Threshold for two distances to still identify the same cluster.
+   double distance_threshold_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_CLUSTER_DISTANCE_HISTOGRAM_H_
@@ -0,0 +1,63 @@
+#ifndef LINE_DETECTION_COVARIANCE_PLANE_FITTER_H_
+#define LINE_DETECTION_COVARIANCE_PLANE_FITTER_H_
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+// Least-squares plane fitting from the first and second moments of a set of
+// points. The moments are accumulated in one pass and the normal of the plane
+// is the eigenvector of the smallest eigenvalue of the 3x3 covariance matrix,
+// computed with the Jacobi method. Points can be added and removed, so that a
+// refit only costs the points that changed. The moments are accumulated
+// relative to the first point added, to limit the loss of precision when the
+// points are far from the origin.
+class CovariancePlaneFitter {
+ public:
+  CovariancePlaneFitter();
+
+  // Removes all the points.
+  void clear();
+
+  void addPoint(const cv::Vec3f& point);
+  void addPoints(const std::vector<cv::Vec3f>& points);
+  // Removes a point that was previously added.
+  void removePoint(const cv::Vec3f& point);
+
+  size_t getNumPoints() const { return num_points_; }
+
+  // Returns the mean and the covariance matrix of the points. There must be
+  // at least one point.
+  cv::Vec3d getMean() const;
+  cv::Matx33d getCovariance() const;
+
+  // Fits a plane in least-squares sense to the points.
+  // Output: hessian_normal_form:   Hessian normal form of the plane.
+  //
+  //         mean_squared_residual: Mean of the squared orthogonal distances
+  //                                of the points from the plane. Can be
+  //                                nullptr.
+  //
+  //         return: False if there are less than 3 points, true otherwise.
+  bool fit(cv::Vec4f* hessian_normal_form,
+           double* mean_squared_residual = nullptr) const;
+
+  // Computes the smallest eigenvalue of a symmetric 3x3 matrix and its
+  // eigenvector (with unit norm), with the cyclic Jacobi method.
+  static void smallestEigenvector(const cv::Matx33d& matrix,
+                                  cv::Vec3d* eigenvector, double* eigenvalue);
+
+ private:
+  size_t num_points_;
+  // Point relative to which the moments are accumulated.
+  cv::Vec3d origin_;
+  // Sum of the points and sum of their outer products, relative to origin_.
+  cv::Vec3d sum_;
+  cv::Matx33d sum_outer_products_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_COVARIANCE_PLANE_FITTER_H_
@@ -0,0 +1,83 @@
+#ifndef LINE_DETECTION_DEPTH_CLOUD_H_
+#define LINE_DETECTION_DEPTH_CLOUD_H_
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+// Organized point cloud (CV_32FC3) obtained by back-projecting a depth image
+// with the camera intrinsics. The points are only computed when they are
+// accessed, one image row at a time, and are kept until the next frame is set.
+// Pixels without depth (depth = 0) give the point (0, 0, 0), as in the clouds
+// of the datasets. Not thread-safe, since the access functions can compute the
+// points, except for computeRows.
+class DepthCloud {
+ public:
+  DepthCloud();
+
+  // Sets the depth image of a new frame. The depth image is referenced, not
+  // copied, and must therefore stay valid until the next call.
+  // Input: depth:              Depth image, of type CV_16UC1 or CV_32FC1.
+  //
+  //        camera_P:           Camera projection matrix (3x4), from which the
+  //                            intrinsics are taken. The camera frame must be
+  //                            the one of the cloud (no baseline).
+  //
+  //        depth_to_meters:    Factor to convert the depth values to meters
+  //                            (e.g. 1e-3 for depth in millimeters).
+  //
+  //        depth_is_distance:  If true, the depth values are the distances of
+  //                            the points from the camera center, otherwise
+  //                            they are the z coordinates of the points.
+  void setDepth(const cv::Mat& depth, const cv::Mat& camera_P,
+                double depth_to_meters, bool depth_is_distance);
+
+  int rows() const { return depth_.rows; }
+  int cols() const { return depth_.cols; }
+
+  // Returns a pointer to the points of the given row, computing them if
+  // needed.
+  const cv::Vec3f* ptr(int row);
+
+  // Returns the point of the given pixel.
+  const cv::Vec3f& at(int row, int col) { return ptr(row)[col]; }
+
+  // Returns the whole cloud, computing the points that were not accessed yet.
+  const cv::Mat& getCloud();
+
+  // Computes the rows from first_row to last_row (both included, clamped to
+  // the image) that were not computed yet. Unlike ptr, at and getCloud, it can
+  // be called concurrently from several threads.
+  void computeRows(int first_row, int last_row);
+
+  // Returns the cloud without computing anything: only the rows computed so far
+  // (e.g. with computeRows) are valid.
+  const cv::Mat& getPartialCloud() const { return cloud_; }
+
+  // Returns the number of rows that were computed for the current frame.
+  size_t getNumComputedRows() const { return num_computed_rows_; }
+
+ private:
+  void computeRow(int row);
+
+  cv::Mat depth_;
+  double depth_to_meters_;
+  bool depth_is_distance_;
+  // x / z of the ray of each column and y / z of the ray of each row.
+  std::vector<float> x_over_z_;
+  std::vector<float> y_over_z_;
+  // Memoized points and flag telling, for each row, if it was computed.
+  cv::Mat cloud_;
+  std::vector<uint8_t> row_is_computed_;
+  size_t num_computed_rows_;
+  // Guards the rows computed in computeRows.
+  std::mutex mutex_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_DEPTH_CLOUD_H_
@@ -0,0 +1,89 @@
+#ifndef LINE_DETECTION_DEPTH_EDGE_DETECTOR_H_
+#define LINE_DETECTION_DEPTH_EDGE_DETECTOR_H_
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+struct DepthEdgeDetectorParams {
+  // Minimum difference in depth between two neighbouring pixels for them to be
+  // on the two sides of a discontinuity, in meters.
+  double min_depth_jump = 0.1;
+  // Same, relative to the depth of the nearer pixel. The larger of the two
+  // thresholds is used, so that the noise of the sensor, which grows with the
+  // depth, is not detected as discontinuities.
+  double min_relative_depth_jump = 0.03;
+  // Factor to convert the values of depth images of type CV_16UC1 to meters.
+  double depth_to_meters = 0.001;
+  // Parameters of cv::HoughLinesP on the mask of the discontinuities.
+  double hough_rho = 1.0;
+  double hough_theta = 3.141592653589793 / 180.0;
+  int hough_threshold = 20;
+  double hough_min_line_length = 20.0;
+  double hough_max_line_gap = 3.0;
+  // Minimum fraction of the samples along a line that must be across a
+  // discontinuity, all with the same side in front, for the line to be on a
+  // discontinuity (cf. findForegroundSide).
+  double min_fraction_of_jumps = 0.8;
+};
+
+// Detector of the lines along the discontinuities of a depth image (or of an
+// organized point cloud). The pixels that are in front of a neighbour by more
+// than the depth-jump threshold form a mask of the occluding contours, on
+// which straight segments are extracted with a probabilistic Hough transform.
+// These lines are by construction discontinuity lines, for which only the
+// plane of the side in front needs to be fitted.
+class DepthEdgeDetector {
+ public:
+  DepthEdgeDetector() {}
+
+  void setParams(const DepthEdgeDetectorParams& params) { params_ = params; }
+  const DepthEdgeDetectorParams& getParams() const { return params_; }
+
+  // Detects the lines on the discontinuities.
+  // Input: depth: Depth image of type CV_16UC1 (cf. depth_to_meters) or
+  //               CV_32FC1 (in meters), or point cloud of type CV_32FC3 whose
+  //               third coordinate is the depth. Zero or NaN depths are
+  //               invalid.
+  //
+  // Output: lines: The lines, in the format {start.x, start.y, end.x, end.y}.
+  void detect(const cv::Mat& depth, std::vector<cv::Vec4f>* lines);
+
+  // Returns the mask (CV_8UC1, 255 on the discontinuities) computed by the
+  // last call of detect.
+  const cv::Mat& getEdgeMask() const { return edge_mask_; }
+
+  // Determines whether a 2D line lies on a discontinuity, by comparing the
+  // depths at both sides of the line at regular intervals along it.
+  // Input: depth:  Cf. detect.
+  //
+  //        line:   The 2D line.
+  //
+  //        offset: Distance in pixels from the line at which the depths are
+  //                compared.
+  //
+  // Output: left_in_front: If return is true, true if the side on the left of
+  //                        the line (cf. LineDetector::getRectanglesFromLine)
+  //                        is in front, false if the right side is.
+  //
+  //         return:        True if at least min_fraction_of_jumps of the
+  //                        samples with valid depths are across a
+  //                        discontinuity with the same side in front.
+  bool findForegroundSide(const cv::Mat& depth, const cv::Vec4f& line,
+                          double offset, bool* left_in_front) const;
+
+ private:
+  // Returns the depth in meters at a pixel, 0 if it is invalid.
+  float depthAt(const cv::Mat& depth, int row, int col) const;
+  // Returns true if the depths differ by more than the thresholds.
+  bool isJump(float depth_1, float depth_2) const;
+
+  DepthEdgeDetectorParams params_;
+  cv::Mat edge_mask_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_DEPTH_EDGE_DETECTOR_H_
@@ -0,0 +1,75 @@
+#ifndef LINE_DETECTION_FIXED_CAPACITY_VECTOR_H_
+#define LINE_DETECTION_FIXED_CAPACITY_VECTOR_H_
+
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace line_detection {
+
+// Vector with a maximum size fixed at compile time, whose elements are stored
+// inline (no heap allocation). It implements the subset of the interface of
+// std::vector used for the planes and colors of the lines, so that it can
+// replace the latter in LineWithPlanes. Exceeding the capacity is an error.
+template <typename T, size_t kCapacity>
+class FixedCapacityVector {
+ public:
+  typedef T value_type;
+  typedef T* iterator;
+  typedef const T* const_iterator;
+
+  FixedCapacityVector() : size_(0) {}
+  FixedCapacityVector(std::initializer_list<T> elements) : size_(0) {
+    for (const T& element : elements) push_back(element);
+  }
+  // Conversion from and to std::vector, for the interfaces that still use it.
+  FixedCapacityVector(const std::vector<T>& elements) : size_(0) {
+    for (const T& element : elements) push_back(element);
+  }
+  operator std::vector<T>() const { return std::vector<T>(begin(), end()); }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  static constexpr size_t capacity() { return kCapacity; }
+
+  void clear() { size_ = 0; }
+  // New elements are value-initialized.
+  void resize(size_t size) {
+    CHECK_LE(size, kCapacity);
+    for (size_t i = size_; i < size; ++i) elements_[i] = T();
+    size_ = size;
+  }
+  void push_back(const T& element) {
+    CHECK_LT(size_, kCapacity);
+    elements_[size_++] = element;
+  }
+
+  T& operator[](size_t i) { return elements_[i]; }
+  const T& operator[](size_t i) const { return elements_[i]; }
+  T& at(size_t i) {
+    CHECK_LT(i, size_);
+    return elements_[i];
+  }
+  const T& at(size_t i) const {
+    CHECK_LT(i, size_);
+    return elements_[i];
+  }
+  T& back() { return elements_[size_ - 1]; }
+  const T& back() const { return elements_[size_ - 1]; }
+
+  iterator begin() { return elements_.data(); }
+  iterator end() { return elements_.data() + size_; }
+  const_iterator begin() const { return elements_.data(); }
+  const_iterator end() const { return elements_.data() + size_; }
+
+ private:
+  std::array<T, kCapacity> elements_;
+  size_t size_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_FIXED_CAPACITY_VECTOR_H_
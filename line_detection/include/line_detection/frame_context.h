@@ -0,0 +1,115 @@
+#ifndef LINE_DETECTION_FRAME_CONTEXT_H_
+#define LINE_DETECTION_FRAME_CONTEXT_H_
+
+#include <memory>
+
+#include <opencv2/core.hpp>
+
+#include "line_detection/cloud_voxel_hash.h"
+#include "line_detection/depth_cloud.h"
+#include "line_detection/integral_plane_fitter.h"
+#include "line_detection/plane_segmentation.h"
+#include "line_detection/projection.h"
+
+namespace line_detection {
+
+// Input data of one frame (image, point cloud or depth image, and camera
+// projection matrix) together with the products derived from it. Each derived
+// product is computed on first request and then reused until the next frame is
+// set. The inputs are referenced, not copied, and must stay valid until the
+// next frame is set. The getters are not thread-safe.
+class FrameContext {
+ public:
+  // Bits of the validity mask.
+  // The point has non-NaN coordinates that are not all zero.
+  static constexpr uchar kValidPoint = 1;
+  // The point has coordinates {0, 0, 0}, i.e. there is no depth information.
+  static constexpr uchar kPointWithoutDepth = 2;
+
+  FrameContext();
+
+  // Sets a new frame given by an organized point cloud.
+  // Input: image:    RGB (or grayscale) image of the frame.
+  //
+  //        cloud:    Point cloud of type CV_32FC3, with the same size as the
+  //                  image.
+  //
+  //        camera_P: Camera projection matrix (3x4).
+  void setFrame(const cv::Mat& image, const cv::Mat& cloud,
+                const cv::Mat& camera_P);
+  // Sets a new frame given by a depth image, from which the point cloud is
+  // computed when needed. Input: cf. DepthCloud::setDepth.
+  void setFrameFromDepth(const cv::Mat& image, const cv::Mat& depth,
+                         const cv::Mat& camera_P, double depth_to_meters,
+                         bool depth_is_distance);
+
+  int rows() const { return image_.rows; }
+  int cols() const { return image_.cols; }
+
+  const cv::Mat& getImage() const { return image_; }
+  // Returns the image converted to grayscale (CV_8UC1).
+  const cv::Mat& getGrayImage();
+  // Returns the point cloud (CV_32FC3), back-projecting the depth image if the
+  // frame was set from one.
+  const cv::Mat& getCloud();
+  // Returns the lazily back-projected cloud, nullptr if the frame was not set
+  // from a depth image.
+  DepthCloud* getDepthCloud();
+
+  // Returns the camera projection matrix, of type CV_32FC1.
+  const cv::Mat& getCameraP() const { return camera_P_; }
+  // Returns the camera projection matrix, for the kernels in projection.h.
+  const cv::Matx34f& getProjectionMatx() const { return projection_; }
+  // Returns the inverse of the left 3x3 block of the projection matrix, which
+  // maps homogeneous pixel coordinates to rays.
+  const cv::Matx33f& getInverseIntrinsics();
+  // Projects a point in camera coordinates to pixel coordinates.
+  cv::Point2f project(const cv::Vec3f& point) const;
+
+  // Returns a mask of type CV_8UC1 with the validity bits of each point of
+  // the cloud (0 for points with NaN coordinates).
+  const cv::Mat& getValidityMask();
+  // Returns the normal of the surface at each point (CV_32FC3), computed from
+  // the neighbouring points and oriented towards the camera. The normals of
+  // the points on the border or with invalid neighbours are NaN.
+  const cv::Mat& getNormals();
+
+  // Returns the integral images of the cloud used for plane fitting.
+  std::shared_ptr<IntegralPlaneFitter> getIntegralPlaneFitter();
+  // Returns the segmentation of the cloud into planar regions, computed with
+  // the given parameters.
+  std::shared_ptr<PlaneSegmentation> getPlaneSegmentation(
+      const PlaneSegmentationParams& params);
+  // Returns the voxel hash of the cloud, for the given voxel size.
+  std::shared_ptr<CloudVoxelHash> getVoxelHash(double voxel_size);
+
+ private:
+  // Invalidates all the derived products.
+  void resetDerivedProducts();
+
+  cv::Mat image_;
+  cv::Mat cloud_;
+  cv::Mat camera_P_;
+  cv::Matx34f projection_;
+  bool from_depth_;
+  DepthCloud depth_cloud_;
+
+  cv::Mat gray_image_;
+  bool gray_image_computed_;
+  cv::Matx33f inverse_intrinsics_;
+  bool inverse_intrinsics_computed_;
+  cv::Mat validity_mask_;
+  bool validity_mask_computed_;
+  cv::Mat normals_;
+  bool normals_computed_;
+  std::shared_ptr<IntegralPlaneFitter> integral_plane_fitter_;
+  bool integral_plane_fitter_computed_;
+  std::shared_ptr<PlaneSegmentation> plane_segmentation_;
+  bool plane_segmentation_computed_;
+  std::shared_ptr<CloudVoxelHash> voxel_hash_;
+  double voxel_size_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_FRAME_CONTEXT_H_
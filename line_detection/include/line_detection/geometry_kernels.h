@@ -0,0 +1,110 @@
+#ifndef LINE_DETECTION_GEOMETRY_KERNELS_H_
+#define LINE_DETECTION_GEOMETRY_KERNELS_H_
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+// Set of 3D points stored as a structure of arrays (one array per coordinate),
+// so that the kernels below can process several points at once. The buffers
+// are kept on clear(), so that a PointBuffer reused across calls stops
+// allocating after the first calls.
+class PointBuffer {
+ public:
+  PointBuffer() {}
+
+  void clear() {
+    x_.clear();
+    y_.clear();
+    z_.clear();
+  }
+  void reserve(size_t num_points) {
+    x_.reserve(num_points);
+    y_.reserve(num_points);
+    z_.reserve(num_points);
+  }
+  void push_back(const cv::Vec3f& point) {
+    x_.push_back(point[0]);
+    y_.push_back(point[1]);
+    z_.push_back(point[2]);
+  }
+  // Replaces the content of the buffer with the given points.
+  void assign(const std::vector<cv::Vec3f>& points);
+
+  size_t size() const { return x_.size(); }
+  bool empty() const { return x_.empty(); }
+  cv::Vec3f operator[](size_t i) const {
+    return cv::Vec3f(x_[i], y_[i], z_[i]);
+  }
+
+  const float* x() const { return x_.data(); }
+  const float* y() const { return y_.data(); }
+  const float* z() const { return z_.data(); }
+
+ private:
+  std::vector<float> x_;
+  std::vector<float> y_;
+  std::vector<float> z_;
+};
+
+// Batch versions of the geometric helpers of line_detection.h
+// (errorPointToPlane, distPointToLine, ...), in single precision.
+// Each kernel has a SIMD implementation, written with the universal intrinsics
+// of OpenCV (and therefore compiled to SSE, NEON, ... depending on the
+// target), and a scalar implementation. The SIMD implementation is chosen at
+// run time if the CPU supports it and cv::useOptimized() is true. The two
+// implementations give the same results up to rounding.
+
+// Returns true if the SIMD implementations of the kernels are used.
+bool useSimdGeometryKernels();
+
+// Finds the points whose distance from a plane is smaller than max_error
+// (cf. errorPointToPlane).
+// Input: points:    Points to test.
+//
+//        begin/end: Range of the points to test (all points if not given).
+//
+//        hessian:   Plane in Hessian normal form.
+//
+//        max_error: Maximum distance of an inlier from the plane.
+//
+// Output: inlier_mask: 1 for the inliers, 0 for the other points. For the
+//                      range version it has end - begin entries, the i-th
+//                      being for the point begin + i.
+//
+//         return:      Number of inliers.
+size_t markPlaneInliers(const PointBuffer& points, size_t begin, size_t end,
+                        const cv::Vec4f& hessian, float max_error,
+                        uchar* inlier_mask);
+size_t markPlaneInliers(const PointBuffer& points, const cv::Vec4f& hessian,
+                        float max_error, std::vector<uchar>* inlier_mask);
+// Counts the points whose distance from a plane is smaller than max_error.
+size_t countPlaneInliers(const PointBuffer& points, const cv::Vec4f& hessian,
+                         float max_error);
+
+// Computes the distance of each point from the (infinite) line through start
+// and end (cf. distPointToLine).
+// Output: distances: distances[i] is the distance of the i-th point.
+void distancesToLine(const PointBuffer& points, const cv::Vec3f& start,
+                     const cv::Vec3f& end, std::vector<float>* distances);
+
+// Finds the points whose distance from the (infinite) line through start and
+// end is not larger than max_distance.
+// Output: inlier_mask: 1 for the inliers, 0 for the other points.
+//
+//         return:      Number of inliers.
+size_t markLineInliers(const PointBuffer& points, const cv::Vec3f& start,
+                       const cv::Vec3f& end, float max_distance,
+                       std::vector<uchar>* inlier_mask);
+
+// Computes the position of the projection of each point on the line from start
+// to end, as a fraction of the length of the segment (0 at start, 1 at end).
+// Output: positions: positions[i] is the position of the i-th point.
+void positionsOnLine(const PointBuffer& points, const cv::Vec3f& start,
+                     const cv::Vec3f& end, std::vector<float>* positions);
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_GEOMETRY_KERNELS_H_
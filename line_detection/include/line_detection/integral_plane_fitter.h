@@ -0,0 +1,84 @@
+#ifndef LINE_DETECTION_INTEGRAL_PLANE_FITTER_H_
+#define LINE_DETECTION_INTEGRAL_PLANE_FITTER_H_
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+// First and second moments of the points of the cloud that lie in a region of
+// the image.
+struct PlaneMoments {
+  // Number of points with valid depth in the region.
+  size_t num_points = 0;
+  // Number of points without depth information (i.e., with coordinates
+  // {0, 0, 0}) in the region.
+  size_t num_points_without_depth = 0;
+  // Sum of the coordinates of the points with valid depth.
+  cv::Vec3d sum = cv::Vec3d(0.0, 0.0, 0.0);
+  // Sum of the outer products p * p^T of the points with valid depth.
+  cv::Matx33d sum_outer_products = cv::Matx33d::zeros();
+};
+
+// Per-frame engine that precomputes row-wise integral images of the moments of
+// an organized point cloud, so that the least-squares plane through the points
+// in any line-aligned rectangle (cf. getRectanglesFromLine) can be obtained by
+// summing one prefix-sum difference per image row, instead of visiting every
+// point in the rectangle. Points with NaN coordinates are ignored.
+class IntegralPlaneFitter {
+ public:
+  IntegralPlaneFitter();
+
+  // Computes the integral images for a new cloud.
+  // Input: cloud: Point cloud of type CV_32FC3.
+  void setCloud(const cv::Mat& cloud);
+
+  // Returns true if the integral images were computed for the given cloud.
+  bool isSetTo(const cv::Mat& cloud) const;
+
+  // Computes the moments of the points in a rectangle. The pixels considered
+  // are exactly those returned by findPointsInRectangle, restricted to the
+  // image.
+  // Input: corners: The 4 corners of the rectangle.
+  //
+  // Output: moments: Moments of the points in the rectangle.
+  void computeMomentsInRectangle(const std::vector<cv::Point2f>& corners,
+                                 PlaneMoments* moments) const;
+
+  // Fits a plane in least-squares sense to the points described by moments.
+  // Input: moments:  Moments of the points.
+  //
+  // Output: hessian_normal_form: Hessian normal form of the plane.
+  //
+  //         mean_squared_residual: Mean of the squared orthogonal distances
+  //                                of the points from the plane.
+  //
+  //         return: False if there are less than 3 points, true otherwise.
+  static bool fitPlane(const PlaneMoments& moments,
+                       cv::Vec4f* hessian_normal_form,
+                       double* mean_squared_residual);
+
+ private:
+  // Number of channels of the integral images: number of points with valid
+  // depth, number of points without depth, x, y, z, xx, xy, xz, yy, yz, zz.
+  static constexpr size_t kNumChannels = 11;
+
+  // Adds the moments of the points in row between columns x_start and x_end
+  // (both included) to moments.
+  void addRowToMoments(int row, int x_start, int x_end,
+                       PlaneMoments* moments) const;
+
+  // Cloud for which the integral images were computed.
+  const uchar* cloud_data_;
+  int rows_;
+  int cols_;
+  // Row-wise prefix sums of the channels, stored as rows_ x (cols_ + 1) x
+  // kNumChannels values. Entry (r, c) contains the sum over the pixels of row
+  // r with column smaller than c.
+  std::vector<double> prefix_sums_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_INTEGRAL_PLANE_FITTER_H_
@@ -1,12 +1,24 @@
 #ifndef LINE_DETECTION_LINE_DETECTION_H_
 #define LINE_DETECTION_LINE_DETECTION_H_
 
+#include "line_detection/cluster_distance_histogram.h"
 #include "line_detection/common.h"
-
+#include "line_detection/depth_cloud.h"
+#include "line_detection/depth_edge_detector.h"
+#include "line_detection/fixed_capacity_vector.h"
+#include "line_detection/geometry_kernels.h"
+#include "line_detection/plane_hypothesis_cache.h"
+#include "line_detection/plane_ransac.h"
+#include "line_detection/projection.h"
+#include "line_detection/wedge_estimator.h"
+
+#include <array>
 #include <chrono>
 #include <cmath>
 #include <fstream>
+#include <functional>
 #include <limits>
+#include <memory>
 #include <random>
 #include <utility>
 #include <vector>
@@ -34,7 +46,10 @@ enum class DetectorType : unsigned int {
   LSD = 0,
   EDL = 1,
   FAST = 2,
-  HOUGH = 3
+  HOUGH = 3,
+  // Lines on the discontinuities of the depth (cf. DepthEdgeDetector). The
+  // input of the detector is the point cloud or the depth image.
+  DEPTH = 4
 };
 
 // Meaning of line types:
@@ -63,28 +78,107 @@ enum class DetectorType : unsigned int {
 //              cause the line to disappear (e.g., removing the box causes the
 //              line to disappear, whereas if the surface on which the box lies
 //              is removed the line is still present).
+// - UNCLASSIFIED: line whose planes were not fitted, because only its
+//                 endpoints were requested (cf. kLineOutputEndpoints). Both of
+//                 its planes are zero.
 
 enum class LineType : unsigned int {
   DISCONT = 0,
   PLANE = 1,
   EDGE = 2,
-  INTERSECT = 3
+  INTERSECT = 3,
+  UNCLASSIFIED = 4
 };
 
+// Hessian normal forms of the planes around a line and colors of the two sides
+// of a line. There are at most two of each, which are stored inline.
+typedef FixedCapacityVector<cv::Vec4f, 2> LineHessians;
+typedef FixedCapacityVector<cv::Vec3b, 2> LineColors;
+
 struct Line2D3DWithPlanes {
   cv::Vec4f line2D;
   cv::Vec6f line3D;
-  std::vector<cv::Vec4f> hessians;
+  LineHessians hessians;
   LineType type;
 };
 
+// Outputs of LineDetector::project2Dto3DwithPlanes, to be combined in
+// LineDetectionParams::line_outputs. The stages whose outputs are not
+// requested are skipped:
+// - Endpoints: the 3D endpoints of the lines (LineWithPlanes::line), always
+//              computed. If only the endpoints are requested, they are those
+//              of the initial guess of find3DlinesRated and no plane is fitted
+//              around the lines, which are returned with type UNCLASSIFIED and
+//              two zero planes. The consumers that read the planes or the type
+//              of the lines (e.g., the labelling of line_ros_utility, the
+//              clustering, or LineTracker) therefore need at least Planes.
+// - Planes: the planes around the lines (LineWithPlanes::hessians), to which
+//           the endpoints are then fitted, and the type of line as far as it
+//           follows from the planes: DISCONT, PLANE, or EDGE if the planes are
+//           convex. Concave lines are assigned INTERSECT without the test of
+//           the prolonged planes of assignEdgeOrIntersectionLineType.
+// - Type: the full classification of the lines, including the test of the
+//         prolonged planes. Implies Planes.
+// - Colors: the colors of the two sides of the lines, if they are also
+//           requested with set_colors.
+constexpr unsigned int kLineOutputEndpoints = 1u << 0;
+constexpr unsigned int kLineOutputPlanes = 1u << 1;
+constexpr unsigned int kLineOutputType = 1u << 2;
+constexpr unsigned int kLineOutputColors = 1u << 3;
+constexpr unsigned int kLineOutputAll = kLineOutputEndpoints |
+                                        kLineOutputPlanes | kLineOutputType |
+                                        kLineOutputColors;
+
+class CloudVoxelHash;
+class FrameContext;
+class IntegralPlaneFitter;
+class PlaneSegmentation;
+struct PlaneSegmentationParams;
+
 struct LineWithPlanes {
   cv::Vec6f line;
-  std::vector<cv::Vec4f> hessians;
-  std::vector<cv::Vec3b> colors;
+  LineHessians hessians;
+  LineColors colors;
   LineType type;
 };
 
+// Structure-of-arrays container of lines: each member of LineWithPlanes is
+// stored in its own contiguous array, so that algorithms that only need some
+// of them (e.g., only the lines, or only the planes) can stream over them.
+// Since the members of LineWithPlanes have a fixed size, adding a line does
+// not allocate memory once enough space is reserved.
+class LineSet {
+ public:
+  LineSet() {}
+  // Adapter from the array-of-structures representation.
+  explicit LineSet(const std::vector<LineWithPlanes>& lines);
+
+  size_t size() const { return lines_.size(); }
+  bool empty() const { return lines_.empty(); }
+  void clear();
+  void reserve(size_t num_lines);
+  void push_back(const LineWithPlanes& line);
+
+  // Returns/sets the i-th line as a LineWithPlanes.
+  LineWithPlanes get(size_t i) const;
+  void set(size_t i, const LineWithPlanes& line);
+
+  // Adapter to the array-of-structures representation.
+  // Output: lines: The lines in the set. The vector is cleared first.
+  void toVector(std::vector<LineWithPlanes>* lines) const;
+
+  const std::vector<cv::Vec6f>& getLines() const { return lines_; }
+  const std::vector<LineHessians>& getHessians() const { return hessians_; }
+  const std::vector<LineColors>& getColors() const { return colors_; }
+  const std::vector<LineType>& getTypes() const { return types_; }
+
+ private:
+  std::vector<cv::Vec6f> lines_;
+  std::vector<LineHessians> hessians_;
+  std::vector<LineColors> colors_;
+  std::vector<LineType> types_;
+};
+
 struct LineDetectionParams {
   // default = 0.3: find3DLineOnPlanes
   double max_dist_between_planes = 0.3;
@@ -110,6 +204,11 @@ struct LineDetectionParams {
   double max_pairwise_point_distance_connected_components = 0.05;
   // default = 0.05: LineDetector::planeRANSAC
   double max_discont_in_point_to_mean_distance_connected_components = 0.05;
+  // default = false: LineDetector::planeRANSAC. If true, whether the inliers
+  // of a plane form a single connected component is checked with
+  // ClusterDistanceHistogram, in linear time, instead of
+  // ClusterDistanceFromMean. Both give the same result.
+  bool use_histogram_connectivity_check = false;
   // default = 0.1: LineDetector::project2Dto3DwithPlanes
   double min_inlier_ransac = 0.1;
   // default = 10: LineDetector::checkIfValidLineBruteForce
@@ -146,12 +245,250 @@ struct LineDetectionParams {
   double hough_detector_minLineLength = 10.0;
   // default = 5: hough line detector
   double hough_detector_maxLineGap = 5.0;
+  // default = 1: LineDetector::project2Dto3DwithPlanes. Number of threads
+  // among which the 2D lines are distributed when projecting them to 3D. With
+  // 0 or 1 the lines are processed serially in the calling thread. Ignored if
+  // use_plane_hypothesis_cache is true.
+  unsigned int num_threads_projection = 1;
+  // default = false: LineDetector::project2Dto3DwithPlanes. If true, the lines
+  // first go through a cascade of checks whose cost is linear in their length
+  // (cf. LineDetector::prefilterLine and prefilterLineRectangles), so that the
+  // lines that would be rejected after gathering the points around them and
+  // fitting the planes are rejected before.
+  bool use_line_prefilters = false;
+  // default = 0.5: LineDetector::prefilterLine. Lines whose initial 3D guess is
+  // shorter than this fraction of min_length_line_3D are rejected.
+  double prefilter_min_relative_length_3D = 0.5;
+  // default = 0: LineDetector::findPlaneInliersInRectangle. If larger than 0
+  // and a rectangle around a line contains more points, planeRANSAC is run on
+  // this many points sampled along and across the rectangle (cf.
+  // sampleStratifiedPointsInRectangle), and the inliers are then taken among
+  // all the points of the rectangle, so that the cost of RANSAC does not grow
+  // with the length of the lines and their proximity to the camera.
+  unsigned int max_points_per_rect = 0;
+  // default = kLineOutputAll: LineDetector::project2Dto3DwithPlanes. Outputs
+  // that are computed for each line (cf. kLineOutputEndpoints).
+  unsigned int line_outputs = kLineOutputAll;
+  // default = 0: LineDetector::project2Dto3DwithPlanes. Time budget in
+  // milliseconds for projecting the lines of a frame to 3D. If larger than 0,
+  // the lines are processed best-first (cf. min_relative_iter_ransac), and
+  // those not started when the budget runs out are skipped and reported (cf.
+  // LineDetector::get_projection_report). With 0 all the lines are processed,
+  // in their input order.
+  double projection_time_budget_ms = 0.0;
+  // default = 0.2: LineDetector::planeRANSAC. With a time budget, the number
+  // of RANSAC iterations is reduced, down to this fraction of num_iter_ransac,
+  // when the lines left would not be processed in time at the current pace.
+  double min_relative_iter_ransac = 0.2;
+  // default = 0: LineDetector::detectLines. If larger than 0, the LSD, EDL and
+  // FAST detectors run on square tiles of the image of this size (in pixels),
+  // overlapping by detection_tile_overlap pixels, and the segments cut at the
+  // borders of the tiles are stitched back together. With 0 the detectors run
+  // once over the whole image.
+  unsigned int detection_tile_size = 0;
+  // default = 16: LineDetector::detectLines.
+  unsigned int detection_tile_overlap = 16;
+  // default = 1: LineDetector::detectLines. Number of threads among which the
+  // tiles are distributed, each with its own detector instances.
+  unsigned int num_threads_detection = 1;
+  // default = 0: LineDetector::detectLines. If larger than 0, the LSD, EDL and
+  // FAST detectors run on the image downsampled this many times by a factor
+  // of 2 (cf. cv::pyrDown), and the lines found are refined on the full
+  // resolution image (cf. refineLine2D), searching up to 2^level pixels
+  // across and along each line.
+  unsigned int detection_pyramid_level = 0;
+  // default = false: LineDetector::project2Dto3DwithPlanes. If true, the
+  // least-squares planes of the rectangles around the lines are computed from
+  // integral images of the cloud (cf. IntegralPlaneFitter) and planeRANSAC is
+  // only run if the residual indicates outliers.
+  bool use_integral_plane_fitting = false;
+  // default = 0.5: LineDetector::findPlaneInliersInRectangle. Maximum root mean
+  // square residual of the least-squares plane, relative to
+  // max_error_inlier_ransac, for which planeRANSAC is skipped.
+  double max_relative_residual_integral_plane_fitting = 0.5;
+  // default = false: LineDetector::project2Dto3DwithPlanes. If true, the cloud
+  // is segmented into planar regions once per frame (cf. PlaneSegmentation)
+  // and the plane of a rectangle around a line is the dominant region under
+  // it. planeRANSAC is only run for the rectangles that are not mostly covered
+  // by a single region.
+  bool use_plane_segmentation = false;
+  // default = 0.9: LineDetector::findPlaneInliersInRectangle. Minimum fraction
+  // of the points of a rectangle that must belong to the dominant region for
+  // planeRANSAC to be skipped.
+  double min_dominant_plane_fraction = 0.9;
+  // default = 2: PlaneSegmentation
+  int plane_segmentation_normal_window_radius = 2;
+  // default = 0.05: PlaneSegmentation
+  double plane_segmentation_max_distance_between_neighbours = 0.05;
+  // default = 500: PlaneSegmentation
+  unsigned int plane_segmentation_min_region_size = 500;
+  // default = 0.97: PlaneSegmentation
+  double plane_segmentation_min_cos_angle_normals = 0.97;
+  // default = 0.02: PlaneSegmentation
+  double plane_segmentation_max_distance_from_plane = 0.02;
+  // default = false: LineDetector::findPlaneInliersInRectangle. If true, the
+  // planes found by planeRANSAC are cached for the current frame (cf.
+  // PlaneHypothesisCache) and the cached planes of the region of a rectangle
+  // are scored before running planeRANSAC. The best of them is taken if more
+  // than inlier_max_ransac of the points are its inliers.
+  bool use_plane_hypothesis_cache = false;
+  // default = 40: PlaneHypothesisCache. Size in pixels of the cells of the
+  // cache.
+  unsigned int plane_hypothesis_cache_cell_size = 40;
+  // default = false: LineDetector::project2DLineTo3DWithPlanes. If true, the
+  // two planes around a line are first fitted jointly by WedgeEstimator,
+  // constrained to intersect on a 3D line that projects onto the 2D line. If
+  // they form an edge or an intersection, the 3D line is taken from the joint
+  // model. Otherwise (planar and discontinuity lines) the planes are fitted
+  // separately on each side as usual.
+  bool use_wedge_estimator = false;
+  // default = false: LineDetector::detectLines and
+  // LineDetector::project2DLineTo3DWithPlanes. If true, the lines on the
+  // discontinuities of the depth (cf. DetectorType::DEPTH) are detected
+  // together with those of the image when the lines are detected on a
+  // FrameContext, so that they are merged by the fusion step. When projecting
+  // to 3D, the lines across which the depth jumps are then directly made
+  // discontinuity lines, with only the plane of the side in front fitted.
+  bool detect_depth_edge_lines = false;
+  // default = 0.1: DepthEdgeDetector
+  double depth_edge_min_jump = 0.1;
+  // default = 0.03: DepthEdgeDetector
+  double depth_edge_min_relative_jump = 0.03;
+  // default = 20: DepthEdgeDetector
+  unsigned int depth_edge_hough_threshold = 20;
+  // default = 20: DepthEdgeDetector
+  double depth_edge_min_line_length = 20.0;
+  // default = 3: DepthEdgeDetector
+  double depth_edge_max_line_gap = 3.0;
+  // default = false: LineDetector::planeRANSAC. If true, the planes are fitted
+  // with the adaptive RANSAC engine PlaneRansac, which stops as soon as
+  // ransac_confidence is reached, instead of always running up to
+  // num_iter_ransac iterations.
+  bool use_adaptive_ransac = false;
+  // default = 0.99: PlaneRansac
+  double ransac_confidence = 0.99;
+  // default = true: PlaneRansac
+  bool ransac_use_sprt = true;
+  // default = false: PlaneRansac
+  bool ransac_use_prosac = false;
+};
+
+// Statistics about the lines projected to 3D by the LineDetector. They are
+// collected separately by each worker thread of project2Dto3DwithPlanes and
+// merged at the end of the projection.
+struct LineDetectionStatistics {
+  int num_discontinuity_lines;
+  int num_planar_lines;
+  int num_intersection_lines;
+  int num_edge_lines;
+
+  int num_lines_discarded_for_convexity_concavity;
+
+  // The following matrix stores the number of occurrences for each
+  // configuration of points in the 'prolonged planes', i.e., the planes around
+  // the prolonged lines.
+  // The correspondence between indices and configurations is as follows
+  // (0 in the configuration means "no points" (or not enough), 1 means
+  //  "(enough) points"):
+  //  _________________________________________________________________________
+  // |   |   |   |   | Configurations associated to indices i, j, m, n:        |
+  // |   |   |   |   |                   before start | after end              |
+  // | i | j | m | n |             Left            [ ]|[ ]                     |
+  // |   |   |   |   |             Right           [ ]|[ ]                     |
+  // |___|___|___|___|_________________________________________________________|
+  // |   |   |   |   |    [0]|[0]                                              |
+  // | 0 | 0 | 0 | 0 |    [0]|[0]                                              |
+  // |___|___|___|___|_________________________________________________________|
+  // |   |   |   |   |    [1]|[0]  [0]|[0]  [0]|[1]  [0]|[0]                   |
+  // | 1 | 0 | 0 | 0 |    [0]|[0], [1]|[0], [0]|[0], [0]|[1]                   |
+  // |___|___|___|___|_________________________________________________________|
+  // |   |   |   |   |    [1]|[0]  [0]|[1]                                     |
+  // | 1 | 1 | 0 | 0 |    [1]|[0], [0]|[1]                                     |
+  // |___|___|___|___|_________________________________________________________|
+  // |   |   |   |   |    [1]|[1]  [0]|[0]                                     |
+  // | 1 | 0 | 1 | 0 |    [0]|[0], [1]|[1]                                     |
+  // |___|___|___|___|_________________________________________________________|
+  // |   |   |   |   |    [1]|[0]  [0]|[1]                                     |
+  // | 1 | 0 | 0 | 1 |    [0]|[1], [1]|[0]                                     |
+  // |___|___|___|___|_________________________________________________________|
+  // |   |   |   |   |    [1]|[1]  [1]|[1]  [0]|[1]  [1]|[0]                   |
+  // | 1 | 1 | 1 | 0 |    [1]|[0], [0]|[1], [1]|[1], [1]|[1]                   |
+  // |___|___|___|___|_________________________________________________________|
+  // |   |   |   |   |    [1]|[1]                                              |
+  // | 1 | 1 | 1 | 1 |    [1]|[1]                                              |
+  // |___|___|___|___|_________________________________________________________|
+  // | All other     |                                                         |
+  // | indices       |    None.                                                |
+  // |_______________|_________________________________________________________|
+  int occurrences_config_prolonged_plane[2][2][2][2];
+
+  // Index for the lines successfully projected from 2D to 3D (makes mapping
+  // with the line labelled by line_ros_utility easier).
+  int num_lines_successfully_projected_to_3D;
+
+  // Number of rectangles for which a cached plane was taken (hits) or
+  // planeRANSAC had to be run (misses), if the plane hypothesis cache is used.
+  int num_plane_hypothesis_cache_hits;
+  int num_plane_hypothesis_cache_misses;
+
+  // Number of lines rejected before the points around them are gathered:
+  // because no valid 3D guess was found for them (cf. find3DlinesRated) and,
+  // if use_line_prefilters is true, by each check of
+  // LineDetector::prefilterLine and prefilterLineRectangles.
+  int num_lines_rejected_by_rating;
+  int num_lines_rejected_by_length_3D;
+  int num_lines_rejected_by_length_2D;
+  int num_lines_rejected_by_rectangle_size;
+  int num_lines_rejected_by_missing_depth;
+
+  LineDetectionStatistics() { reset(); }
+
+  // Sets all the counters to zero.
+  void reset();
+
+  // Adds the counters of other to the ones of this object.
+  void merge(const LineDetectionStatistics& other);
 };
 
+// Report of the last projection of lines to 3D by the LineDetector with a
+// time budget (cf. LineDetectionParams::projection_time_budget_ms).
+struct ProjectionBudgetReport {
+  // True if the budget ran out before all the lines were started.
+  bool deadline_reached;
+  // Time spent projecting the lines, in milliseconds.
+  double elapsed_ms;
+  // Number of 2D lines that were processed.
+  size_t num_processed_lines;
+  // Smallest factor by which the RANSAC iterations of a line were reduced to
+  // process the lines left in time (1 if they were never reduced).
+  double min_ransac_iteration_scale;
+  // The 2D lines (fitted to the image bounds) that were skipped, from the one
+  // with the highest priority to the one with the lowest.
+  std::vector<cv::Vec4f> skipped_lines2D;
+
+  ProjectionBudgetReport() { reset(); }
+
+  void reset();
+};
+
+// Thresholds of areLinesEqual2D: maximum squared distance between the closest
+// endpoints of the two lines (in pixels^2) and minimum value of the squared
+// cosine of the angle between them.
+constexpr double kMaxSqEndpointDistanceEqualLines2D = 2;
+constexpr double kMinCosSqAngleDifferenceEqualLines2D = 0.98;
+
 // Returns true if lines are nearby and could be equal (low difference in angle
 // and start or end point).
 bool areLinesEqual2D(const cv::Vec4f line1, const cv::Vec4f line2);
 
+// Returns true if two lines are pieces of the same line, i.e. if they have
+// similar directions (cf. kMinCosSqAngleDifferenceEqualLines2D), the endpoints
+// of the shorter one are closer than max_distance to the longer one (extended
+// to infinity), and their extents along the longer one overlap or are less
+// than max_gap apart.
+bool areLinesCollinear2D(const cv::Vec4f& line1, const cv::Vec4f& line2,
+                         double max_distance, double max_gap);
+
 // Returns value if: lower < value < upper
 // Returns lower if: value < lower
 // Returns upper if: upper < value
@@ -451,6 +788,130 @@ void findPointsInRectangle(std::vector<cv::Point2f>* corners,
                            std::vector<cv::Point2i>* points,
                            bool verbose = false);
 
+// Scanline description of a rectangle: the pixels within or on the border of
+// the rectangle are described as one horizontal span per image row, computed
+// on the fly from the edges of the rectangle, without allocating memory. The
+// pixels are the same as those returned by findPointsInRectangle.
+class RectangleScanlines {
+ public:
+  // Input: corners: cf. findPointsInRectangle.
+  //        verbose: cf. findPointsInRectangle.
+  RectangleScanlines(const std::vector<cv::Point2f>& corners,
+                     bool verbose = false);
+
+  // Corners of the rectangle, rotated by 0.1 degrees if two of them had the
+  // same y coordinate (cf. findPointsInRectangle).
+  std::vector<cv::Point2f> getCorners() const {
+    return std::vector<cv::Point2f>(corners_.begin(), corners_.end());
+  }
+  // Row (y coordinate) of the first span.
+  int getFirstRow() const { return first_row_; }
+  // Number of spans, i.e., of rows.
+  size_t getNumRows() const { return num_rows_; }
+  // Returns the x coordinates of the first and of the last pixel of the i-th
+  // span (row getFirstRow() + i). The span might exceed the image.
+  void getSpan(size_t i, int* x_start, int* x_end) const;
+
+ private:
+  // Edge of the rectangle from start to end (start.y < end.y), cf.
+  // findXCoordOfPixelsOnVector.
+  struct Edge {
+    Edge() {}
+    Edge(const cv::Point2f& start, const cv::Point2f& end, bool left_side);
+    // x coordinate of the pixel on the edge in its i-th row.
+    int x(int i) const {
+      if (height == 1) return x_single_row;
+      return int(x_start + i * width / (height - 1));
+    }
+    int height;
+    float x_start;
+    float width;
+    int x_single_row;
+  };
+
+  std::array<cv::Point2f, 4> corners_;
+  Edge upper_left_, lower_left_, upper_right_, lower_right_;
+  int first_row_;
+  size_t num_rows_;
+};
+
+// Calls visit(row, col, point) for each pixel of the cloud that is within or
+// on the border of a rectangle (the same pixels as findPointsInRectangle,
+// clipped to the cloud) and whose point does not have NaN coordinates. The
+// points are read directly from the cloud, span by span.
+// Input: corners:  cf. findPointsInRectangle.
+//        cloud:    Point cloud of type CV_32FC3.
+//        visit:    Callable with signature
+//                  bool(int row, int col, const cv::Vec3f& point). If it
+//                  returns false the iteration stops.
+//
+// Output: return:  False if the iteration was stopped by visit, true otherwise.
+template <typename Visitor>
+bool forEachValidPointInRectangle(const std::vector<cv::Point2f>& corners,
+                                  const cv::Mat& cloud, Visitor visit);
+
+// Overload: The points are taken from a DepthCloud, so that only the rows
+// within the rectangle are back-projected.
+template <typename Visitor>
+bool forEachValidPointInRectangle(const std::vector<cv::Point2f>& corners,
+                                  DepthCloud* cloud, Visitor visit);
+
+// Gathers the points of the cloud that are within or on the border of a
+// rectangle, skipping those with NaN coordinates.
+// Input: corners:  cf. findPointsInRectangle.
+//        cloud:    Point cloud of type CV_32FC3.
+//        stop_at_point_without_depth: If true, the gathering stops as soon as
+//                  a point without depth information (i.e., with coordinates
+//                  {0, 0, 0}) is found.
+//
+// Output: points:  The points gathered. The vector is cleared first, so that
+//                  its memory can be reused across calls.
+//         pixels:  If not nullptr, the pixel (column, row) of each point
+//                  gathered. The vector is cleared first.
+//         return:  False if a point without depth information stopped the
+//                  gathering, true otherwise.
+bool gatherPointsInRectangle(const std::vector<cv::Point2f>& corners,
+                             const cv::Mat& cloud,
+                             bool stop_at_point_without_depth,
+                             std::vector<cv::Vec3f>* points,
+                             std::vector<cv::Point2i>* pixels = nullptr);
+// Overload: The points are taken from a DepthCloud.
+bool gatherPointsInRectangle(const std::vector<cv::Point2f>& corners,
+                             DepthCloud* cloud,
+                             bool stop_at_point_without_depth,
+                             std::vector<cv::Vec3f>* points,
+                             std::vector<cv::Point2i>* pixels = nullptr);
+// Overload: The points are taken from the cloud of the frame, their validity
+// being read from its validity mask. If the frame was set from a depth image,
+// the points are taken from its DepthCloud instead, so that only the rows of
+// the rectangle are computed.
+bool gatherPointsInRectangle(const std::vector<cv::Point2f>& corners,
+                             FrameContext* frame,
+                             bool stop_at_point_without_depth,
+                             std::vector<cv::Vec3f>* points);
+
+// Samples at most max_points of the points gathered in a rectangle, stratified
+// along and across it: the rectangle is divided into at most max_points cells
+// of equal size, and the point whose pixel is nearest to the center of each
+// cell is taken. Points without depth information are skipped. The cloud is
+// not read again.
+// Input: corners:    Corners of the rectangle, in the order of
+//                    LineDetector::getRectanglesFromLine: corners[0] to
+//                    corners[2] is parallel to the line, corners[0] to
+//                    corners[1] perpendicular to it.
+//        points:     Points of the rectangle (cf. gatherPointsInRectangle).
+//        pixels:     Pixels of the points, as given by
+//                    gatherPointsInRectangle.
+//        max_points: Maximum number of points sampled.
+//
+// Output: samples:   The points sampled, one per cell that contains valid
+//                    points. The vector is cleared first.
+void sampleStratifiedPointsInRectangle(const std::vector<cv::Point2f>& corners,
+                                       const std::vector<cv::Vec3f>& points,
+                                       const std::vector<cv::Point2i>& pixels,
+                                       size_t max_points,
+                                       std::vector<cv::Vec3f>* samples);
+
 // Takes two planes and computes the intersection line. This function takes
 // already the direction of the line (which could be computed from the two
 // planes as well), because you can save computation time with it, if you
@@ -534,12 +995,25 @@ class LineDetector {
     return *params_;
   }
 
+  // Returns the statistics about the lines projected to 3D in the last call of
+  // project2Dto3DwithPlanes.
+  inline const LineDetectionStatistics& get_statistics() const {
+    return statistics_;
+  }
+
+  // Returns the report about the time budget of the last call of
+  // project2Dto3DwithPlanes.
+  inline const ProjectionBudgetReport& get_projection_report() const {
+    return projection_report_;
+  }
+
   // detectLines:
   // Input: image:    The image on which the lines should be detected.
   //
-  //        detector: 0-> LSD, 1->EDL, 2->FAST, 3-> HOUGH
+  //        detector: 0-> LSD, 1->EDL, 2->FAST, 3-> HOUGH, 4-> DEPTH
   //                  Default is LSD. It is chosen even if an invalid number is
-  //                  given.
+  //                  given. For DEPTH, image is the point cloud or the depth
+  //                  image (cf. DepthEdgeDetector::detect).
   //
   // Output: lines:   The lines are stored in the following format:
   //                  {start.x, start.y, end.x, end.y}.
@@ -551,6 +1025,11 @@ class LineDetector {
 // Overload for the EDL detector (returns EDL KeyLines).
   void detectLines(const cv::Mat& image,
                    std::vector<cv::line_descriptor::KeyLine>* keylines);
+  // Overload: Detects the lines on the grayscale image of the frame (on its
+  // cloud for DEPTH). If params_->detect_depth_edge_lines is true, the lines on
+  // the discontinuities of the depth are appended to those of the image.
+  void detectLines(FrameContext* frame, int detector,
+                   std::vector<cv::Vec4f>* lines);
 
   // This function computes the Hessian Normal Form of a plane given points on
   // that plane.
@@ -586,9 +1065,16 @@ class LineDetector {
   void fuseLines2DAtTheEnd(const std::vector<cv::Vec4f>& lines_in,
                            std::vector<cv::Vec4f>* lines_out);
   // * Merge each input line into the matching previously-formed clusters, as
-  //   soon as the match is found.
+  //   soon as the match is found. The clusters that can match are found with a
+  //   LineFusionIndex.
   void fuseLines2DOnTheFly(const std::vector<cv::Vec4f>& lines_in,
                            std::vector<cv::Vec4f>* lines_out);
+  // Merges the pieces of the lines that were cut at the borders of the tiles
+  // by detectLines (cf. detection_tile_size), i.e. the lines that are
+  // collinear and overlap (cf. areLinesCollinear2D), in the same way as
+  // fuseLines2DOnTheFly.
+  void stitchLines2DAtTileSeams(const std::vector<cv::Vec4f>& lines_in,
+                                std::vector<cv::Vec4f>* lines_out);
 
   // Returns the 2D line obtained by merging the two input 2D lines.
   cv::Vec4f mergeLines2D(const cv::Vec4f& line_1, const cv::Vec4f& line_2);
@@ -648,6 +1134,8 @@ class LineDetector {
   //
   // Output:  rect_left: A rectangle defined by the 4 corner points.
   //          rect_right: Same as rect_left.
+  //          return:     False if the line has zero length, in which case all
+  //                      the corners are the start of the line.
   bool getRectanglesFromLine(const cv::Vec4f& line,
                              std::vector<cv::Point2f>* rect_left,
                              std::vector<cv::Point2f>* rect_right);
@@ -658,6 +1146,11 @@ class LineDetector {
   void assignColorToLines(const cv::Mat& image,
                           const std::vector<cv::Point2i>& points,
                           LineWithPlanes* line3D);
+  // Overload: the pixels are those within the rectangle rect (cf.
+  // findPointsInRectangle), which are not stored.
+  void assignColorToLines(const cv::Mat& image,
+                          const std::vector<cv::Point2f>& rect,
+                          LineWithPlanes* line3D);
 
   // (The two following functions are deprecated.They remain here just for
   // back compatibility concerns.)
@@ -678,6 +1171,11 @@ class LineDetector {
                           const cv::Vec6f& line_guess,
                           LineWithPlanes* line);
 
+  // Cosine of the angle between the normals of two planes above which the
+  // planes are considered parallel, i.e. the line between them is a planar
+  // line rather than an edge or an intersection.
+  static constexpr double kMinCosAngleParallelPlanes = 0.95;
+
   // Find 3D line using the points on the planes found by planeRANSAC.
   // Input:  points1/2:          Two sets of points.
   //
@@ -702,6 +1200,43 @@ class LineDetector {
                           const cv::Mat& cloud, const cv::Mat& camera_P,
                           const bool planes_found, LineWithPlanes* line);
 
+  // Finds the 3D line of an edge or an intersection between two planes,
+  // given a first estimate of the line (cf. find3DlineOnPlanes). The
+  // endpoints are found from the inliers of both planes, unless they are
+  // given, and the type of the line is assigned by
+  // assignEdgeOrIntersectionLineType.
+  // Input: points1/2:          Inliers of the two planes, in line->hessians.
+  //
+  //        start/end_guess:    Two points of the line, or its endpoints if
+  //                            adjust_endpoints is false.
+  //
+  //        adjust_endpoints:   If true, the endpoints are found by
+  //                            adjustLineUsingInliers, which also requires
+  //                            min_points_in_line inliers of the line.
+  //                            Otherwise start/end_guess are the endpoints.
+  //
+  //        line_guess:         Initial guess of the line (only displayed).
+  //
+  //        reference_line_2D:  Cf. find3DlineOnPlanes.
+  //
+  //        cloud:              Point cloud as CV_32FC3.
+  //
+  //        camera_P:           Camera projection matrix.
+  //
+  // Output: line:              The 3D line found.
+  //
+  //         return:            True if the line is valid, false otherwise.
+  bool find3DEdgeOrIntersectionLine(const std::vector<cv::Vec3f>& points1,
+                                    const std::vector<cv::Vec3f>& points2,
+                                    const cv::Vec3f& start_guess,
+                                    const cv::Vec3f& end_guess,
+                                    bool adjust_endpoints,
+                                    const cv::Vec6f& line_guess,
+                                    const cv::Vec4f& reference_line_2D,
+                                    const cv::Mat& cloud,
+                                    const cv::Mat& camera_P,
+                                    LineWithPlanes* line);
+
   // Assign the type of line to be either edge or intersection.
   // Input: cloud:               Point cloud as CV_32FC3.
   //
@@ -787,7 +1322,7 @@ class LineDetector {
   void checkIfValidPointsOnPlanesGivenProlongedLine(
       const cv::Mat& cloud, const cv::Mat& camera_P,
       const cv::Vec3f& start, const cv::Vec3f& end,
-      const std::vector<cv::Vec4f>& hessians,
+      const LineHessians& hessians,
       bool* right_plane_enough_valid_points,
       bool* left_plane_enough_valid_points);
 
@@ -826,6 +1361,16 @@ class LineDetector {
   //
   //          lines3D:  3D lines found.
   //
+  // If params.num_threads_projection > 1 (and neither visualization mode nor
+  // the plane hypothesis cache is on) the lines are distributed among that
+  // many worker threads. The output is the same as the one of the serial
+  // processing, both in content and in order.
+  //
+  // If params.use_plane_segmentation (resp. use_integral_plane_fitting) is
+  // true, the whole cloud is segmented (resp. its integral images are
+  // computed) again at every call, since the cloud can change between calls
+  // while keeping its buffer. To project several sets of lines of the same
+  // frame, use the FrameContext overload, which does it once per frame.
   //
   // Overload: Add output lines2D_out that correspond to lines3D
   void project2Dto3DwithPlanes(const cv::Mat& cloud, const cv::Mat& image,
@@ -834,8 +1379,27 @@ class LineDetector {
                                const bool set_colors,
                                std::vector<cv::Vec4f>* lines2D_out,
                                std::vector<LineWithPlanes>* lines3D);
+  // Overload: The cloud, image and projection matrix are taken from the frame,
+  // and the integral images of the frame are used (and only computed once per
+  // frame). If the frame was set from a depth image, only the rows of the
+  // cloud around the lines are computed (cf. depth_cloud_), unless
+  // params.detect_depth_edge_lines is true.
+  void project2Dto3DwithPlanes(FrameContext* frame,
+                               const std::vector<cv::Vec4f>& lines2D_in,
+                               const bool set_colors,
+                               std::vector<cv::Vec4f>* lines2D_out,
+                               std::vector<LineWithPlanes>* lines3D);
+  // Overload: The lines are projected within the time budget time_budget_ms
+  // (in milliseconds, 0 for none) instead of projection_time_budget_ms.
+  void project2Dto3DwithPlanes(FrameContext* frame,
+                               const std::vector<cv::Vec4f>& lines2D_in,
+                               const bool set_colors, double time_budget_ms,
+                               std::vector<cv::Vec4f>* lines2D_out,
+                               std::vector<LineWithPlanes>* lines3D);
 
-  // Given a point in 3D and a projection matrix returns a point in 2D.
+  // Given a point in 3D and a projection matrix returns a point in 2D. When
+  // projecting many points with the same matrix, prefer converting the matrix
+  // once with toProjectionMatx and using the kernels in projection.h.
   // Input: point_3D:  3D point.
   //
   //        camera_P:  Projection matrix.
@@ -889,7 +1453,8 @@ class LineDetector {
 
   // Projects 2D to 3D lines with a shortest is the best approach. Works in
   // general better than naive approach, but lines that lie on surfaces tend to
-  // be drawn towards the camera.
+  // be drawn towards the camera. The endpoints are searched in 3x3 patches
+  // (cf. LineEndpointSearch::findShortestLine).
   // Input: cloud:    A point cloud of type CV_32FC3. Does not need to be dense.
   //
   //        lines2D:  A vector containing lines in 2D. A line:
@@ -915,7 +1480,8 @@ class LineDetector {
   // procedure for every one: Compute inliers to line model given by start/end
   // points by computing the distance to all points on the line. Use the mean
   // distance of all inliers as the rating. Then the line with the lowest rating
-  // is chosen as the best.
+  // is chosen as the best. The three lines are rated in a single pass (cf.
+  // LineEndpointSearch::findRatedLine).
   // Input: cloud:    Point cloud in the format CV_32FC3.
   //
   //        lines2D:  2D lines defined in pixel coordinates.
@@ -961,6 +1527,33 @@ class LineDetector {
                          const std::vector<LineWithPlanes>& lines3D_in,
                          std::vector<cv::Vec4f>* lines2D_out,
                          std::vector<LineWithPlanes>* lines3D_out);
+  // Overload: The cloud and projection matrix are taken from the frame. Only
+  // the size of the cloud is used, so the cloud of a frame set from a depth
+  // image is not computed.
+  void runCheckOn3DLines(FrameContext* frame,
+                         const std::vector<cv::Vec4f>& lines2D_in,
+                         const std::vector<LineWithPlanes>& lines3D_in,
+                         std::vector<cv::Vec4f>* lines2D_out,
+                         std::vector<LineWithPlanes>* lines3D_out);
+
+  // Overload: Does the same check using checkIfValidLineInCorridor, which is
+  // cheap enough to be run on every frame. The voxel hash of the cloud is
+  // built at most once per call, and only if some line needs it.
+  // Input: cloud:       Point cloud in the format CV_32FC3.
+  //
+  //        camera_P:    Camera projection matrix.
+  //
+  //        lines3D_in:  3D lines to be checked.
+  //
+  // Output: lines3D_out: All 3D lines that are considered as valid.
+  void runCheckOn3DLines(const cv::Mat& cloud, const cv::Mat& camera_P,
+                         const std::vector<LineWithPlanes>& lines3D_in,
+                         std::vector<LineWithPlanes>* lines3D_out);
+  // Overload: The cloud and projection matrix are taken from the frame, and
+  // the voxel hash of the frame is used.
+  void runCheckOn3DLines(FrameContext* frame,
+                         const std::vector<LineWithPlanes>& lines3D_in,
+                         std::vector<LineWithPlanes>* lines3D_out);
 
   // Does a check by applying checkIfValidLineDiscont on every line. This
   // check was mostly to try it out, it has shown that this way to check if
@@ -992,6 +1585,24 @@ class LineDetector {
   // Output: return: True if it is a possible line, false otherwise.
   bool checkIfValidLineBruteForce(const cv::Mat& cloud, cv::Vec6f* line);
 
+  // Performs the same check as checkIfValidLineBruteForce, but only inspects
+  // the points whose pixels lie in a thin corridor around the projection of
+  // the line, instead of every point in the cloud. This assumes that the cloud
+  // is organized according to camera_P, i.e., that each point projects to its
+  // own pixel. The parts of the line that project outside the image (or that
+  // are behind or too close to the camera) are checked by looking up the
+  // points around them in a voxel hash of the cloud, built by this call if
+  // needed.
+  // Input: cloud:    Point cloud as CV_32FC3.
+  //
+  //        camera_P: Camera projection matrix (3x4, CV_32FC1).
+  //
+  //        line:     Line in 3D defined by (start, end).
+  //
+  // Output: return:  True if it is a possible line, false otherwise.
+  bool checkIfValidLineInCorridor(const cv::Mat& cloud, const cv::Mat& camera_P,
+                                  cv::Vec6f* line);
+
   // Checks if a line is valid by looking for discontinuities. It computes the
   // mean of a patch around a pixel and looks for jumps when this mean is given
   // with respect to the line.
@@ -1163,6 +1774,14 @@ private:
   cv::Ptr<cv::LineSegmentDetector> lsd_detector_;
   cv::Ptr<cv::line_descriptor::BinaryDescriptor> edl_detector_;
   cv::Ptr<cv::ximgproc::FastLineDetector> fast_detector_;
+  // Detector instances of the threads that detect the lines on the tiles of
+  // the image (cf. detection_tile_size), created when first needed.
+  struct TileDetectors {
+    cv::Ptr<cv::LineSegmentDetector> lsd;
+    cv::Ptr<cv::line_descriptor::BinaryDescriptor> edl;
+    cv::Ptr<cv::ximgproc::FastLineDetector> fast;
+  };
+  std::vector<TileDetectors> tile_detectors_;
   LineDetectionParams* params_;
   bool params_is_mine_;
 
@@ -1175,58 +1794,369 @@ private:
   // with rectangles overlapped on the original image.
   cv::Mat background_image_;
 
-  int num_discontinuity_lines, num_planar_lines, num_intersection_lines,
-      num_edge_lines;
-
-  int num_lines_discarded_for_convexity_concavity;
-
-  // The following matrix stores the number of occurrences for each
-  // configuration of points in the 'prolonged planes', i.e., the planes around
-  // the prolonged lines.
-  // The correspondence between indices and configurations is as follows
-  // (0 in the configuration means "no points" (or not enough), 1 means
-  //  "(enough) points"):
-  //  _________________________________________________________________________
-  // |   |   |   |   | Configurations associated to indices i, j, m, n:        |
-  // |   |   |   |   |                   before start | after end              |
-  // | i | j | m | n |             Left            [ ]|[ ]                     |
-  // |   |   |   |   |             Right           [ ]|[ ]                     |
-  // |___|___|___|___|_________________________________________________________|
-  // |   |   |   |   |    [0]|[0]                                              |
-  // | 0 | 0 | 0 | 0 |    [0]|[0]                                              |
-  // |___|___|___|___|_________________________________________________________|
-  // |   |   |   |   |    [1]|[0]  [0]|[0]  [0]|[1]  [0]|[0]                   |
-  // | 1 | 0 | 0 | 0 |    [0]|[0], [1]|[0], [0]|[0], [0]|[1]                   |
-  // |___|___|___|___|_________________________________________________________|
-  // |   |   |   |   |    [1]|[0]  [0]|[1]                                     |
-  // | 1 | 1 | 0 | 0 |    [1]|[0], [0]|[1]                                     |
-  // |___|___|___|___|_________________________________________________________|
-  // |   |   |   |   |    [1]|[1]  [0]|[0]                                     |
-  // | 1 | 0 | 1 | 0 |    [0]|[0], [1]|[1]                                     |
-  // |___|___|___|___|_________________________________________________________|
-  // |   |   |   |   |    [1]|[0]  [0]|[1]                                     |
-  // | 1 | 0 | 0 | 1 |    [0]|[1], [1]|[0]                                     |
-  // |___|___|___|___|_________________________________________________________|
-  // |   |   |   |   |    [1]|[1]  [1]|[1]  [0]|[1]  [1]|[0]                   |
-  // | 1 | 1 | 1 | 0 |    [1]|[0], [0]|[1], [1]|[1], [1]|[1]                   |
-  // |___|___|___|___|_________________________________________________________|
-  // |   |   |   |   |    [1]|[1]                                              |
-  // | 1 | 1 | 1 | 1 |    [1]|[1]                                              |
-  // |___|___|___|___|_________________________________________________________|
-  // | All other     |                                                         |
-  // | indices       |    None.                                                |
-  // |_______________|_________________________________________________________|
-  int occurrences_config_prolonged_plane[2][2][2][2];
-
-  // Index for the lines successfully projected from 2D to 3D (makes mapping
-  // with the line labelled by line_ros_utility easier).
-  int num_lines_successfully_projected_to_3D;
+  // Statistics about the lines projected to 3D in the current frame.
+  LineDetectionStatistics statistics_;
+  // Report about the time budget of the last projection to 3D.
+  ProjectionBudgetReport projection_report_;
+  // Fraction of num_iter_ransac run by planeRANSAC, reduced when the time
+  // budget of the projection gets short.
+  double ransac_iteration_scale_ = 1.0;
+
+  // Buffers for the points in the rectangles around a line (cf.
+  // findInliersGiven2DLine and checkIfValidPointsOnPlanesGivenProlongedLine),
+  // kept so that their memory is reused across lines.
+  std::vector<cv::Vec3f> points_in_rect_left_, points_in_rect_right_;
+  // Pixels of these points, recorded only if they are sampled (cf.
+  // planeRANSACInRectangle).
+  std::vector<cv::Point2i> pixels_in_rect_left_, pixels_in_rect_right_;
+  PointBuffer prolonged_points_left_, prolonged_points_right_;
+  // Buffers for the geometry kernels used by planeRANSAC and by the checks of
+  // the lines against their inliers.
+  PointBuffer point_buffer_;
+  std::vector<uchar> inlier_mask_;
+  std::vector<float> distances_;
+  std::vector<float> positions_on_line_;
+  // Buffers for the points sampled in a rectangle and their inliers (cf.
+  // max_points_per_rect).
+  std::vector<cv::Vec3f> sampled_points_, sampled_inliers_;
+  // Connectivity check of the inliers of planeRANSAC and takeInliersOfPlane,
+  // if use_histogram_connectivity_check.
+  ClusterDistanceHistogram cluster_distance_histogram_;
+
+  // Voxel hash of the cloud, used by checkIfValidLineInCorridor for the parts
+  // of the lines that do not project into the image. It is built lazily, at
+  // most once per call of the public overloads of runCheckOn3DLines and
+  // checkIfValidLineInCorridor, since the cloud passed as cv::Mat can change
+  // between calls while keeping its buffer. Across calls, the voxel hash is
+  // only reused through a FrameContext, which owns it.
+  std::shared_ptr<CloudVoxelHash> voxel_hash_;
+  bool voxel_hash_is_set_ = false;
+  // Buffer for the pixels inspected by checkIfValidLineInCorridor.
+  std::vector<int> corridor_pixel_indices_;
+  // Buffers for the batch reprojections in runCheckOn3DLines and
+  // fitDiscontLineToInliers.
+  std::vector<cv::Vec6f> lines3D_to_reproject_;
+  std::vector<cv::Vec4f> reprojected_lines_;
+  std::vector<cv::Vec2f> points_2D_buffer_;
+
+  // Performs the checks of checkIfValidLineWith2DInfo given the reprojection
+  // of the 3D line, so that the reprojections of several lines can be
+  // computed in one batch.
+  bool checkIfValidReprojectedLine(const cv::Mat& cloud,
+                                   const cv::Vec4f& line_2D,
+                                   const cv::Vec4f& line_3D_reprojected,
+                                   cv::Vec6f* line);
+
+  // Adds point to the histogram point_density of the line from start to end if
+  // it is an inlier of the line (cf. checkIfValidLineBruteForce).
+  void addPointToLineDensity(const cv::Vec3f& start, const cv::Vec3f& end,
+                             const cv::Vec3f& point,
+                             std::vector<int>* point_density,
+                             int* count_inliers);
+
+  // Truncates the line where the histogram point_density is zero at its ends
+  // (cf. checkIfValidLineBruteForce). Returns false if the line does not have
+  // enough inliers.
+  bool truncateLineUsingPointDensity(const std::vector<int>& point_density,
+                                     int count_inliers, cv::Vec6f* line);
+
+  // Engine used by planeRANSAC if params_->use_adaptive_ransac is true. Each
+  // (worker) detector has its own, since the engine keeps its buffers.
+  PlaneRansac plane_ransac_;
+
+  // Joint estimator of the two planes around a line, used if
+  // params_->use_wedge_estimator is true. Each (worker) detector has its own.
+  WedgeEstimator wedge_estimator_;
+
+  // Detector of the lines on the discontinuities of the depth. Each (worker)
+  // detector has its own.
+  DepthEdgeDetector depth_edge_detector_;
+
+  // Planes found by planeRANSAC in the current frame, used if
+  // params_->use_plane_hypothesis_cache is true, in which case the lines are
+  // always processed serially (cf. project2Dto3DwithPlanes).
+  PlaneHypothesisCache plane_hypothesis_cache_;
+  // Buffer for the planes taken from plane_hypothesis_cache_.
+  std::vector<cv::Vec4f> cached_planes_;
+
+  // Integral images of the current cloud, used to fit planes to the rectangles
+  // around the lines if params_->use_integral_plane_fitting is true. Shared
+  // with the worker detectors, which only read it, and possibly with a
+  // FrameContext.
+  std::shared_ptr<IntegralPlaneFitter> integral_plane_fitter_;
+  // Segmentation of the current cloud into planar regions, used if
+  // params_->use_plane_segmentation is true. Shared in the same way as
+  // integral_plane_fitter_.
+  std::shared_ptr<PlaneSegmentation> plane_segmentation_;
+  // Lazily computed cloud of the frame being projected, set by
+  // project2Dto3DwithPlanes(FrameContext*, ...) if the frame was set from a
+  // depth image, nullptr otherwise. The cloud passed to the functions is then
+  // its partial cloud, and the functions reading points compute the rows they
+  // need with computeCloudRows first. Shared with the worker detectors.
+  DepthCloud* depth_cloud_ = nullptr;
+  // If depth_cloud_ is set, computes the rows of the cloud covered by the
+  // rectangle (resp. the 2D line), plus one row above and below for the
+  // rounding of the pixel coordinates and the lines shifted by one pixel.
+  void computeCloudRows(const std::vector<cv::Point2f>& corners);
+  void computeCloudRows(const cv::Vec4f& line2D);
+
+  // Returns the parameters of plane_segmentation_ taken from params_.
+  PlaneSegmentationParams getPlaneSegmentationParams() const;
+  // Returns the parameters of the depth edge detector, taken from params_.
+  DepthEdgeDetectorParams getDepthEdgeDetectorParams() const;
+
+  // Implementation of project2Dto3DwithPlanes, once integral_plane_fitter_ is
+  // set for the cloud (if used), with the time budget time_budget_ms (0 for
+  // none).
+  void project2Dto3DwithPlanesGivenFitter(
+      const cv::Mat& cloud, const cv::Mat& image, const cv::Mat& camera_P,
+      const std::vector<cv::Vec4f>& lines2D_in, const bool set_colors,
+      double time_budget_ms, std::vector<cv::Vec4f>* lines2D_out,
+      std::vector<LineWithPlanes>* lines3D);
 
   // Resets the statistics about the number of lines of each type detected and
   // the number of occurrences of each case of the prolonged lines. (Done at
   // every new frame).
   void resetStatistics();
 
+  // Finds the inliers of the plane fitted to the points in one of the
+  // rectangles around a line. If the cloud was segmented into planar regions,
+  // the plane of the dominant region under the rectangle is used when the
+  // region covers enough of the rectangle. Otherwise, if the integral images
+  // were computed for cloud, the least-squares plane of the rectangle is used
+  // when its residual is small enough. Otherwise the plane is found by
+  // planeRANSAC.
+  // Input: cloud:    Point cloud of type CV_32FC3.
+  //
+  //        rect:     Corners of the rectangle.
+  //
+  //        points:   Points of the cloud in the rectangle (with valid depth).
+  //
+  //        pixels:   Pixels of the points (cf. gatherPointsInRectangle), only
+  //                  read if max_points_per_rect is larger than 0.
+  //
+  // Output: inliers: Inliers of the plane found.
+  void findPlaneInliersInRectangle(const cv::Mat& cloud,
+                                   const std::vector<cv::Point2f>& rect,
+                                   const std::vector<cv::Vec3f>& points,
+                                   const std::vector<cv::Point2i>& pixels,
+                                   std::vector<cv::Vec3f>* inliers);
+  // Finds the plane of one side of a line with findPlaneInliersInRectangle, as
+  // findInliersGiven2DLine does once the points of its rectangle are gathered.
+  // Output: inliers: Inliers of the plane found.
+  //
+  //         return:  True if the plane is found, i.e. if at least a fraction
+  //                  min_inlier_ransac of the points are its inliers.
+  bool findPlaneInliersOfSide(const cv::Mat& cloud,
+                              const std::vector<cv::Point2f>& rect,
+                              const std::vector<cv::Vec3f>& points,
+                              const std::vector<cv::Point2i>& pixels,
+                              std::vector<cv::Vec3f>* inliers);
+
+  // Runs planeRANSAC on the points of a rectangle, on a sample of at most
+  // max_points_per_rect of them if there are more (cf. max_points_per_rect),
+  // stratified from their pixels.
+  void planeRANSACInRectangle(const std::vector<cv::Point2f>& rect,
+                              const std::vector<cv::Vec3f>& points,
+                              const std::vector<cv::Point2i>& pixels,
+                              std::vector<cv::Vec3f>* inliers);
+
+  // Takes as inliers the points that planeRANSAC would accept for a given
+  // plane, i.e. those closer to the plane than max_error_inlier_ransac.
+  // Output: inliers: Inliers of the plane.
+  //
+  //         return:  True if there are at least min_num_inliers inliers and
+  //                  they form a single connected component, false otherwise
+  //                  (inliers is then cleared).
+  bool takeInliersOfPlane(const cv::Vec4f& hessian,
+                          const std::vector<cv::Vec3f>& points,
+                          std::vector<cv::Vec3f>* inliers);
+
+  // Returns true if two planes form an edge or an intersection, with the
+  // criteria of find3DlineOnPlanes: the means of the points of the two sides
+  // are closer than max_dist_between_planes along both normals, and the
+  // planes are not parallel (cf. kMinCosAngleParallelPlanes).
+  bool planesFormWedge(const cv::Vec4f& hessian_right,
+                       const cv::Vec4f& hessian_left,
+                       const cv::Vec3f& mean_right,
+                       const cv::Vec3f& mean_left) const;
+
+  // Fits the two planes around a 2D line jointly with wedge_estimator_. The
+  // joint fit is skipped if the least-squares planes of the two rectangles
+  // already show that the line is a planar or a discontinuity line, whose
+  // planes are then found separately among the points gathered here (cf.
+  // findPlaneInliersOfSide).
+  // Input: line_2D:          The 2D line.
+  //
+  //        cloud:            Point cloud of type CV_32FC3.
+  //
+  //        camera_P:         Camera projection matrix.
+  //
+  // Output: inliers_right/left: Inliers of the two planes, valid if
+  //                             wedge_found is true.
+  //
+  //         rect_right/left:    Rectangles around the line, whose points are
+  //                             in points_in_rect_right_/left_ if the return
+  //                             value is true.
+  //
+  //         wedge_found:        True if the two planes were found and form an
+  //                             edge or an intersection, i.e. if the line can
+  //                             be taken from the model of wedge_estimator_.
+  //
+  //         return:             False if the line must be discarded, for the
+  //                             same reasons as in findInliersGiven2DLine,
+  //                             true otherwise.
+  bool findWedgeInliersGiven2DLine(const cv::Vec4f& line_2D,
+                                   const cv::Mat& cloud,
+                                   const cv::Mat& camera_P,
+                                   std::vector<cv::Vec3f>* inliers_right,
+                                   std::vector<cv::Vec3f>* inliers_left,
+                                   std::vector<cv::Point2f>* rect_right,
+                                   std::vector<cv::Point2f>* rect_left,
+                                   bool* wedge_found);
+
+  // Checks with depth_edge_detector_ whether the depth jumps across a 2D line
+  // and, if so, fits only the plane of the side in front.
+  // Input: line_2D:  The 2D line.
+  //
+  //        cloud:    Point cloud of type CV_32FC3.
+  //
+  // Output: inliers:          Inliers of the plane of the side in front,
+  //                           valid if depth_edge_found is true.
+  //
+  //         rect_right/left:  Rectangles around the line.
+  //
+  //         depth_edge_found: True if the line is on a discontinuity and the
+  //                           plane of the side in front was found.
+  //
+  //         return:           False if the line must be discarded, for the
+  //                           same reasons as in findInliersGiven2DLine,
+  //                           true otherwise.
+  bool findDepthEdgeInliersGiven2DLine(const cv::Vec4f& line_2D,
+                                       const cv::Mat& cloud,
+                                       std::vector<cv::Vec3f>* inliers,
+                                       std::vector<cv::Point2f>* rect_right,
+                                       std::vector<cv::Point2f>* rect_left,
+                                       bool* depth_edge_found);
+
+  // Cascade of checks run on a line before the planes around it are fitted
+  // (cf. use_line_prefilters), from the cheapest to the most expensive. A line
+  // is only rejected if fitting the planes would discard it as well, and each
+  // rejection is counted in statistics_.
+  // prefilterLine is run first, on the initial 3D guess:
+  // 1. The guess is too short (cf. prefilter_min_relative_length_3D).
+  // prefilterLineRectangles is run before the points of both rectangles around
+  // the line are gathered, i.e., unless the line is found on a depth edge,
+  // whose background side is not gathered (cf.
+  // findDepthEdgeInliersGiven2DLine):
+  // 2. The 2D line has zero length, so that its rectangles are undefined.
+  // 3. One of the rectangles covers fewer than min_points_in_rect pixels of
+  //    the cloud, so that it cannot contain enough valid points.
+  // 4. A point without depth information is found on the middle line of one
+  //    of the rectangles, sampled at every pixel that the rasterization of the
+  //    rectangle visits (cf. RectangleScanlines). Gathering the points of the
+  //    rectangle would stop at it and discard the line (cf.
+  //    findInliersGiven2DLine and findWedgeInliersGiven2DLine).
+  // Input: line3D_guess: Initial guess of the 3D line (cf. find3DlinesRated).
+  //
+  //        cloud:        Point cloud of type CV_32FC3.
+  //
+  //        line2D:       2D line, fitted to the image bounds.
+  //
+  // Output: return:      True if the line passes the checks.
+  bool prefilterLine(const cv::Vec6f& line3D_guess);
+  bool prefilterLineRectangles(const cv::Mat& cloud, const cv::Vec4f& line2D);
+
+  // Same as the public overloads of runCheckOn3DLines and
+  // checkIfValidLineInCorridor. The voxel hash is taken from frame if it is
+  // not nullptr (cf. getCorridorVoxelHash).
+  void runCheckOn3DLinesInCorridor(
+      const cv::Mat& cloud, const cv::Mat& camera_P, FrameContext* frame,
+      const std::vector<LineWithPlanes>& lines3D_in,
+      std::vector<LineWithPlanes>* lines3D_out);
+  bool checkIfValidLineInCorridor(const cv::Mat& cloud, const cv::Mat& camera_P,
+                                  FrameContext* frame, cv::Vec6f* line);
+
+  // Returns the voxel hash of the cloud used by checkIfValidLineInCorridor:
+  // the one of frame if it is not nullptr, otherwise voxel_hash_, which is
+  // built for cloud unless voxel_hash_is_set_ is true.
+  CloudVoxelHash* getCorridorVoxelHash(const cv::Mat& cloud,
+                                       FrameContext* frame);
+
+  // Detects the lines with the given detector at the resolution of image, on
+  // tiles if params_->detection_tile_size is set.
+  void detectLinesAtScale(const cv::Mat& image, DetectorType detector,
+                          std::vector<cv::Vec4f>* lines);
+
+  // Detects the lines on a downsampled version of the image and refines them
+  // at full resolution (cf. detection_pyramid_level). Only for LSD, EDL and
+  // FAST.
+  void detectLinesOnPyramid(const cv::Mat& image, DetectorType detector,
+                            std::vector<cv::Vec4f>* lines);
+
+  // Detects the lines on overlapping tiles of the image, in parallel, and
+  // stitches the segments cut at the borders of the tiles (cf.
+  // detection_tile_size). Only for LSD, EDL and FAST.
+  void detectLinesOnTiles(const cv::Mat& image, DetectorType detector,
+                          std::vector<cv::Vec4f>* lines);
+
+  // Clusters the lines in the same way as fuseLines2DOnTheFly, two lines being
+  // merged if are_lines_equal returns true for them. max_endpoint_distance is
+  // the threshold of the LineFusionIndex used to find the lines that can be
+  // merged (cf. LineFusionIndex::LineFusionIndex).
+  void fuseLines2DOnTheFly(
+      const std::vector<cv::Vec4f>& lines_in, double max_endpoint_distance,
+      const std::function<bool(const cv::Vec4f&, const cv::Vec4f&)>&
+          are_lines_equal,
+      std::vector<cv::Vec4f>* lines_out);
+
+  // Scores the planes of plane_hypothesis_cache_ in the region of a rectangle
+  // and takes the inliers of the best one, if more than inlier_max_ransac of
+  // the points are its inliers.
+  // Input: rect:     Corners of the rectangle.
+  //
+  //        points:   Points of the cloud in the rectangle (with valid depth).
+  //
+  // Output: inliers: Inliers of the cached plane taken.
+  //
+  //         return:  True if a cached plane was taken, false otherwise.
+  bool findInliersOfCachedPlane(const std::vector<cv::Point2f>& rect,
+                                const std::vector<cv::Vec3f>& points,
+                                std::vector<cv::Vec3f>* inliers);
+
+  // Tag to select the constructor of the worker detectors.
+  struct WorkerTag {};
+  // Constructs a detector to be used by a worker thread of
+  // project2Dto3DwithPlanes. The worker shares the parameters and the modes of
+  // parent, but owns its statistics and its background image, so that the
+  // workers never write to shared state. No 2D detectors are created.
+  LineDetector(const LineDetector& parent, WorkerTag);
+
+  // Projects a single 2D line to 3D. This is the body of the loop over the
+  // lines in project2Dto3DwithPlanes (camera_P overload).
+  // Input: cloud:        Point cloud of type CV_32FC3.
+  //
+  //        image:        RGB image, used if set_colors = True.
+  //
+  //        camera_P:     Camera projection matrix.
+  //
+  //        line2D:       2D line to project, fitted to the image bounds.
+  //
+  //        line3D_guess: Initial guess of the 3D line (cf. find3DlinesRated).
+  //
+  //        set_colors:   True if assigning color to the line.
+  //
+  // Output: line3D:      3D line found.
+  //
+  //         return:      True if the line was successfully projected to 3D,
+  //                      false otherwise.
+  bool project2DLineTo3DWithPlanes(const cv::Mat& cloud, const cv::Mat& image,
+                                   const cv::Mat& camera_P,
+                                   const cv::Vec4f& line2D,
+                                   const cv::Vec6f& line3D_guess,
+                                   const bool set_colors,
+                                   LineWithPlanes* line3D);
+
   // Working principle of the function: It starts at the starting point of the
   // 2D line and looks if the values in the point_cloud are not NaN there. If
   // they are not, this value is stored as the starting point. If they are NaN,
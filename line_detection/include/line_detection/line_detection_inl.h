@@ -3,9 +3,7 @@
 
 #include "line_detection/line_detection.h"
 
-#include <pcl/point_cloud.h>
-#include <pcl/octree/octree_search.h>
-
+#include <algorithm>
 #include <functional>
 #include <queue>
 #include <set>
@@ -34,20 +32,20 @@ void getNUniqueRandomElements(const std::vector<T>& in, size_t num_samples,
   // The algorithm uses the Fisher-Yates Shuffle to guarantee that no element is
   // sampled twice.
   size_t max = in.size();
-  int idx;
+  size_t idx;
   // From this array the indices of an element is sampled.
-  int indices[max];
+  std::vector<size_t> indices(max);
   for (size_t i = 0; i < max; ++i) {
     indices[i] = i;
   }
-  std::uniform_int_distribution<int>* distribution;
+  // A single distribution is used, its range being set at every draw.
+  std::uniform_int_distribution<size_t> distribution;
+  typedef std::uniform_int_distribution<size_t>::param_type Range;
   for (size_t i = max; i > max - num_samples; --i) {
-    distribution = new std::uniform_int_distribution<int>(0, i - 1);
-    idx = (*distribution)(*generator);
+    idx = distribution(*generator, Range(0, i - 1));
     out->push_back(in[indices[idx]]);
     indices[idx] = indices[i - 1];
   }
-  delete distribution;
 }
 
 // An overload, that allows the use without specifyng an random engine. Be
@@ -62,6 +60,49 @@ void getNUniqueRandomElements(const std::vector<T>& in, size_t num_samples,
   getNUniqueRandomElements(in, num_samples, &generator, out);
 }
 
+// Common implementation of the overloads of forEachValidPointInRectangle:
+// get_row(row) returns a pointer to the points of the given row.
+template <typename RowAccessor, typename Visitor>
+bool forEachValidPointInRectangleRows(const std::vector<cv::Point2f>& corners,
+                                      int rows, int cols, RowAccessor get_row,
+                                      Visitor visit) {
+  const RectangleScanlines scanlines(corners);
+  int x_start, x_end;
+  for (size_t i = 0; i < scanlines.getNumRows(); ++i) {
+    const int row = scanlines.getFirstRow() + i;
+    if (row < 0 || row >= rows) continue;
+    scanlines.getSpan(i, &x_start, &x_end);
+    // Clip the span to the cloud.
+    x_start = std::max(x_start, 0);
+    x_end = std::min(x_end, cols - 1);
+    if (x_start > x_end) continue;
+    const cv::Vec3f* cloud_row = get_row(row);
+    for (int col = x_start; col <= x_end; ++col) {
+      if (std::isnan(cloud_row[col][0])) continue;
+      if (!visit(row, col, cloud_row[col])) return false;
+    }
+  }
+  return true;
+}
+
+template <typename Visitor>
+bool forEachValidPointInRectangle(const std::vector<cv::Point2f>& corners,
+                                  const cv::Mat& cloud, Visitor visit) {
+  CHECK_EQ(cloud.type(), CV_32FC3);
+  return forEachValidPointInRectangleRows(
+      corners, cloud.rows, cloud.cols,
+      [&cloud](int row) { return cloud.ptr<cv::Vec3f>(row); }, visit);
+}
+
+template <typename Visitor>
+bool forEachValidPointInRectangle(const std::vector<cv::Point2f>& corners,
+                                  DepthCloud* cloud, Visitor visit) {
+  CHECK_NOTNULL(cloud);
+  return forEachValidPointInRectangleRows(
+      corners, cloud->rows(), cloud->cols(),
+      [cloud](int row) { return cloud->ptr(row); }, visit);
+}
+
 // Union-find data structure for efficient clustering of the points used in
 // planeRANSAC.
 class ClusterUnionFind {
@@ -204,92 +245,6 @@ class ClusterPriorityQueue {
    double distance_threshold_;
 };
 
-// Octree structure to cluster the points based on their pairwise distances.
-class ClusterOctree {
- public:
-   ClusterOctree(double distance_threshold) {
-     distance_threshold_ = distance_threshold;
-     // Initialize the point cloud.
-     cloud_ = pcl::PointCloud<pcl::PointXYZ>::Ptr(
-         new pcl::PointCloud<pcl::PointXYZ>);
-     // Initialize the octree.
-     octree_ = new pcl::octree::OctreePointCloudSearch<pcl::PointXYZ> (
-         distance_threshold_);
-   }
-   ~ClusterOctree() {
-     delete octree_;
-   }
-   // Clears the entire structure.
-   void clear() {
-     cloud_->clear();
-     octree_->deleteTree();
-   }
-
-   // Adds a point to the union-find data structure.
-   void addPoints(std::vector<cv::Vec3f>& points) {
-     // Clear the point cloud.
-     cloud_->clear();
-     // Resize the point cloud.
-     cloud_->width = points.size();
-     cloud_->height = 1;
-     cloud_->points.resize(cloud_->width * cloud_->height);
-     // Add the points to the cloud.
-     for (size_t i = 0; i < points.size(); ++i) {
-       cloud_->points[i].x = points[i][0];
-       cloud_->points[i].y = points[i][1];
-       cloud_->points[i].z = points[i][2];
-     }
-     // Add points to octree.
-     octree_->setInputCloud(cloud_);
-     octree_->addPointsFromInputCloud();
-   }
-
-   // True if the points form a single connected component, false otherwise.
-   bool singleConnectedComponent() {
-     // Partly based on
-     // http://www.pointclouds.org/documentation/tutorials/octree.php.
-
-     // Set each point to be non-visited yet.
-     std::vector<bool> visited(cloud_->points.size(), false);
-     size_t num_non_visited_points = cloud_->points.size();
-     std::queue<size_t> queue;
-     std::vector<int> point_indices;
-     std::vector<float> point_distances;
-     size_t current_point_index;
-     // Start visiting trasversing the tree from any point in the cloud and keep
-     // doing so until nearby points are found.
-     queue.push(0);
-     while(!queue.empty()) {
-       current_point_index = queue.front();
-       queue.pop();
-       if (!visited[current_point_index]) {
-         visited[current_point_index] = true;
-         num_non_visited_points--;
-         // Find neighbouring points and push them into the queue if they have
-         // not been visited.
-         if (octree_->radiusSearch(cloud_->points[current_point_index],
-                                  distance_threshold_, point_indices,
-                                  point_distances) > 0) {
-           for (auto& index : point_indices) {
-             if (!visited[index]) {
-               queue.push(index);
-             }
-           }
-         }
-       }
-     }
-     return num_non_visited_points == 0;
-   }
-
- private:
-   // Stores the octree.
-   pcl::octree::OctreePointCloudSearch<pcl::PointXYZ>* octree_;
-   // Stores the points.
-   pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_;
-   // Threshold for two distances to still identify the same cluster.
-   double distance_threshold_;
-};
-
 // Priority-queue-like structure to cluster the points based on their
 // distances from their mean point.
 class ClusterDistanceFromMean {
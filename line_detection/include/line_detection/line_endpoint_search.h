@@ -0,0 +1,84 @@
+#ifndef LINE_DETECTION_LINE_ENDPOINT_SEARCH_H_
+#define LINE_DETECTION_LINE_ENDPOINT_SEARCH_H_
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+// Finds initial guesses of 3D lines from 2D lines and an organized point
+// cloud, with a bounded cost per line. Not thread-safe (internal buffers are
+// used), one instance should be used per thread.
+class LineEndpointSearch {
+ public:
+  // Rating returned if no valid 3D line is found.
+  static constexpr double kInvalidRating = 1e9;
+
+  LineEndpointSearch();
+
+  // Searches the 3D line for the 2D line and for the two lines shifted by one
+  // pixel orthogonally to it, and returns the one with the lowest rating. For
+  // each of these lines, the endpoints are the first and last non-NaN points
+  // on the rasterized line and the rating is the mean distance of the
+  // non-NaN points between them from the 3D line through the endpoints. The
+  // pixels of the three lines are visited in a single pass over the
+  // rasterized 2D line.
+  // Input: cloud:  Point cloud of type CV_32FC3.
+  //
+  //        line2D: 2D line in pixel coordinates, within the image.
+  //
+  // Output: line3D: The best 3D line, if one was found.
+  //
+  //         return: Rating of the best line, kInvalidRating if none of the
+  //                 three lines has valid endpoints.
+  double findRatedLine(const cv::Mat& cloud, const cv::Vec4f& line2D,
+                       cv::Vec6f* line3D);
+
+  // Searches the pair of non-NaN points, one in a square patch around each
+  // endpoint of the 2D line, that are closest to each other in 3D.
+  // Input: cloud:      Point cloud of type CV_32FC3.
+  //
+  //        line2D:     2D line in pixel coordinates.
+  //
+  //        patch_size: Half size of the patches, which contain
+  //                    (2 * patch_size + 1)^2 pixels.
+  //
+  // Output: line3D: 3D line between the two points found.
+  //
+  //         return: False if one of the patches only contains NaN points.
+  bool findShortestLine(const cv::Mat& cloud, const cv::Vec4f& line2D,
+                        int patch_size, cv::Vec6f* line3D);
+
+ private:
+  // Candidate line, given by a pixel offset with respect to the path on which
+  // it is evaluated.
+  struct Candidate {
+    cv::Point offset;
+    // Indices in the path of the endpoints.
+    int start;
+    int end;
+    double rating;
+    cv::Vec6f line3D;
+  };
+
+  // Rasterizes the line from start to end (8-connected) into path.
+  static void rasterize(const cv::Mat& cloud, const cv::Point& start,
+                        const cv::Point& end, std::vector<cv::Point>* path);
+
+  // Finds the endpoints of all the candidates and rates them, all candidates
+  // being evaluated on the same path.
+  void rateCandidates(const cv::Mat& cloud, const std::vector<cv::Point>& path,
+                      std::vector<Candidate>* candidates) const;
+
+  std::vector<cv::Point> path_;
+  std::vector<cv::Point> clamped_path_;
+  std::vector<Candidate> candidates_;
+  std::vector<Candidate> clamped_candidates_;
+  std::vector<cv::Vec3f> start_patch_;
+  std::vector<cv::Vec3f> end_patch_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_LINE_ENDPOINT_SEARCH_H_
@@ -0,0 +1,55 @@
+#ifndef LINE_DETECTION_LINE_FUSION_INDEX_H_
+#define LINE_DETECTION_LINE_FUSION_INDEX_H_
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+// Spatial index of 2D lines used to fuse lines: the lines are bucketed by
+// orientation and by the grid cells of their endpoints, so that the lines that
+// might be fused with a given line can be found without comparing it with all
+// the others. A line is inserted under an identifier chosen by the caller; the
+// same identifier can be inserted again when the line changes (e.g., after
+// being merged with another line), the old entries are then left in the index
+// and are returned as (spurious) candidates too.
+class LineFusionIndex {
+ public:
+  // Input: max_endpoint_distance: Two lines can only be fused if the distance
+  //                               between one endpoint of each line is less
+  //                               than this value (in pixels).
+  //
+  //        max_angle_difference:  Two lines can only be fused if the angle
+  //                               between them is less than this value (in
+  //                               radians).
+  LineFusionIndex(double max_endpoint_distance, double max_angle_difference);
+
+  // Removes all the lines.
+  void clear();
+
+  // Adds line with identifier id to the index.
+  void insert(size_t id, const cv::Vec4f& line);
+
+  // Finds the identifiers of the lines that can be fused with line according to
+  // the thresholds given to the constructor. Other lines can be returned too.
+  // Output: ids: Identifiers found, sorted in ascending order and unique. The
+  //              vector is cleared first.
+  void findCandidates(const cv::Vec4f& line, std::vector<size_t>* ids) const;
+
+ private:
+  // Returns the orientation bin of line, in [0, num_orientation_bins_).
+  int orientationBin(const cv::Vec4f& line) const;
+  // Returns the key of the bucket for the given orientation bin and cell.
+  static uint64_t bucketKey(int orientation_bin, int cell_x, int cell_y);
+
+  double cell_size_;
+  int num_orientation_bins_;
+  std::unordered_map<uint64_t, std::vector<size_t>> buckets_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_LINE_FUSION_INDEX_H_
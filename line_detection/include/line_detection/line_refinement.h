@@ -0,0 +1,40 @@
+#ifndef LINE_DETECTION_LINE_REFINEMENT_H_
+#define LINE_DETECTION_LINE_REFINEMENT_H_
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+struct LineRefinementParams {
+  // Maximum distance in pixels by which the line is moved across itself.
+  int search_radius = 2;
+  // Distance in pixels between two samples along the line.
+  double sample_step = 2.0;
+  // Maximum distance in pixels by which each endpoint is moved along the line.
+  int max_endpoint_shift = 2;
+  // The line ends where the gradient across it falls below this fraction of
+  // the median gradient of the samples.
+  double min_relative_response = 0.5;
+};
+
+// Refines a 2D line detected on a downsampled image at the full resolution of
+// the image. At regular samples along the line, the position across the line
+// with the largest image gradient normal to the line is searched within
+// search_radius, and the line is fitted to these positions in least-squares
+// sense. The endpoints are then moved along the refined line, by at most
+// max_endpoint_shift, to where the gradient across the line ends.
+// Input: image:        Grayscale image (CV_8UC1) at full resolution.
+//
+//        line:         Line to refine, in full resolution coordinates.
+//
+// Output: refined_line: The refined line.
+//
+//         return:       False if the line could not be refined (too short or
+//                       no gradient found), in which case refined_line is not
+//                       set, true otherwise.
+bool refineLine2D(const cv::Mat& image, const cv::Vec4f& line,
+                  const LineRefinementParams& params, cv::Vec4f* refined_line);
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_LINE_REFINEMENT_H_
@@ -0,0 +1,119 @@
+#ifndef LINE_DETECTION_LINE_TRACKER_H_
+#define LINE_DETECTION_LINE_TRACKER_H_
+
+#include "line_detection/frame_context.h"
+#include "line_detection/line_detection.h"
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+struct LineTrackerParams {
+  // Maximum distance of a point from a predicted plane for it to support the
+  // plane, relative to max_error_inlier_ransac of the line detector. It is
+  // larger than 1 to absorb the error of the relative pose.
+  double max_relative_residual = 3.0;
+  // Minimum fraction of the points of the rectangle next to a predicted line
+  // that must support the predicted plane for the plane to be verified.
+  double min_supporting_fraction = 0.6;
+  // A 2D line detected in the current frame is considered to be already
+  // tracked if it is collinear with a tracked line (cf. areLinesCollinear2D),
+  // with this maximum distance in pixels.
+  double max_distance_to_tracked_line = 3.0;
+};
+
+// Tracks the 3D lines of a sequence of frames. The lines of the previous frame
+// are predicted into the current frame with the relative pose of the camera
+// and verified with a cheap residual check of the points next to them against
+// their predicted planes, whose fit is then refined on the supporting points.
+// The endpoints are then moved onto the refitted planes, so that the error of
+// the relative pose does not accumulate over the frames.
+// The full projection and check of the line detector are only run on the 2D
+// lines that are not covered by a verified line, i.e. on the new lines and on
+// the lines whose prediction failed.
+class LineTracker {
+ public:
+  // The line detector, whose parameters are also used by the tracker, must
+  // outlive the tracker.
+  explicit LineTracker(LineDetector* line_detector);
+
+  void setParams(const LineTrackerParams& params) { params_ = params; }
+  const LineTrackerParams& getParams() const { return params_; }
+
+  // Forgets the lines of the previous frame, so that the next frame is
+  // processed from scratch.
+  void reset();
+
+  // Processes the next frame of the sequence.
+  // Input: frame:              The current frame.
+  //
+  //        detector:           Cf. LineDetector::detectLines.
+  //
+  //        T_current_previous: Rigid transformation from the camera frame of
+  //                            the previous frame to that of the current one.
+  //                            Ignored for the first frame after construction
+  //                            or reset.
+  //
+  // Output: lines2D: The 2D lines corresponding to lines3D.
+  //
+  //         lines3D: The verified lines of the previous frame followed by the
+  //                  new lines.
+  // Lines can only be tracked through their planes: if the line detector does
+  // not fit them (cf. kLineOutputEndpoints), all the lines are UNCLASSIFIED and
+  // are detected and fitted anew in every frame.
+  void track(FrameContext* frame, int detector,
+             const cv::Matx44f& T_current_previous,
+             std::vector<cv::Vec4f>* lines2D,
+             std::vector<LineWithPlanes>* lines3D);
+
+  // Returns the number of lines of the last call of track that were predicted
+  // from the previous frame, and of those that were detected and fitted anew.
+  size_t getNumTrackedLines() const { return num_tracked_lines_; }
+  size_t getNumNewLines() const { return num_new_lines_; }
+
+ private:
+  // Transforms a line of the previous frame and its planes into the camera
+  // frame of the current one and projects it on the image. Returns false if
+  // the line is behind the camera or not entirely inside the image.
+  bool predictLine(const LineWithPlanes& line,
+                   const cv::Matx44f& T_current_previous, FrameContext* frame,
+                   LineWithPlanes* predicted_line, cv::Vec4f* line2D) const;
+  // Verifies the planes of a predicted line against the points of the
+  // rectangles next to its 2D line, refits them on the supporting points and
+  // corrects the line with correctLine. Returns false if one of the planes is
+  // not verified or if the line cannot be corrected.
+  bool verifyLine(FrameContext* frame, double max_residual,
+                  size_t min_num_points, cv::Vec4f* line2D,
+                  LineWithPlanes* line);
+  // Moves the endpoints of a line onto its (refitted) planes, as
+  // find3DlineOnPlanes places them: onto the intersection of the two planes
+  // for EDGE and INTERSECT lines, onto the plane for the other types. line2D is
+  // updated to the projection of the corrected line. Returns false if the
+  // planes do not intersect or if the corrected line is behind the camera.
+  bool correctLine(FrameContext* frame, cv::Vec4f* line2D,
+                   LineWithPlanes* line) const;
+  // Verifies a plane against the points within a rectangle, of which there
+  // must be at least min_num_points. If it is verified, refitted_hessian is the
+  // plane fitted to the supporting points.
+  bool verifyPlane(FrameContext* frame, const std::vector<cv::Point2f>& rect,
+                   const cv::Vec4f& hessian, double max_residual,
+                   size_t min_num_points, cv::Vec4f* refitted_hessian);
+
+  LineDetector* line_detector_;
+  LineTrackerParams params_;
+  bool has_previous_frame_;
+  std::vector<LineWithPlanes> previous_lines3D_;
+  size_t num_tracked_lines_;
+  size_t num_new_lines_;
+  // Buffers reused across lines.
+  std::vector<cv::Point2f> rect_left_;
+  std::vector<cv::Point2f> rect_right_;
+  std::vector<cv::Vec3f> points_;
+  std::vector<cv::Vec3f> supporting_points_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_LINE_TRACKER_H_
@@ -0,0 +1,61 @@
+#ifndef LINE_DETECTION_PLANE_HYPOTHESIS_CACHE_H_
+#define LINE_DETECTION_PLANE_HYPOTHESIS_CACHE_H_
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+// Per-frame cache of the planes found in the rectangles around the lines,
+// indexed by a regular grid of cells over the image. Lines that border the
+// same surface have rectangles with the same plane, so that the planes found
+// for previous lines are good hypotheses for the rectangles of the next lines
+// in the same region of the image.
+class PlaneHypothesisCache {
+ public:
+  PlaneHypothesisCache();
+
+  // Empties the cache and sets the size of the image and of the cells.
+  void reset(int rows, int cols, int cell_size);
+
+  // Adds the plane found in a rectangle. The plane is registered in all the
+  // cells that overlap the bounding box of the rectangle.
+  // Input: corners: The 4 corners of the rectangle.
+  //
+  //        hessian: Plane in Hessian normal form.
+  void addPlane(const std::vector<cv::Point2f>& corners,
+                const cv::Vec4f& hessian);
+
+  // Finds the planes registered in the cells that overlap the bounding box of
+  // a rectangle.
+  // Input: corners: The 4 corners of the rectangle.
+  //
+  // Output: planes: The planes found, each reported once. The vector is
+  //                 cleared first.
+  void findPlanes(const std::vector<cv::Point2f>& corners,
+                  std::vector<cv::Vec4f>* planes);
+
+  size_t size() const { return planes_.size(); }
+  bool empty() const { return planes_.empty(); }
+
+ private:
+  // Computes the range of the cells (all included) that overlap the bounding
+  // box of a rectangle. Returns false if the rectangle is outside the image.
+  bool getCellRange(const std::vector<cv::Point2f>& corners, int* first_row,
+                    int* first_col, int* last_row, int* last_col) const;
+
+  int cell_size_;
+  int grid_rows_;
+  int grid_cols_;
+  std::vector<cv::Vec4f> planes_;
+  // Indices of the planes registered in each cell, stored row by row.
+  std::vector<std::vector<int>> cells_;
+  // Index of the last query that reported each plane, to report it once.
+  std::vector<unsigned int> last_query_;
+  unsigned int query_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_PLANE_HYPOTHESIS_CACHE_H_
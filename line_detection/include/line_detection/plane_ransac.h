@@ -0,0 +1,133 @@
+#ifndef LINE_DETECTION_PLANE_RANSAC_H_
+#define LINE_DETECTION_PLANE_RANSAC_H_
+
+#include <random>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "line_detection/cluster_distance_histogram.h"
+#include "line_detection/geometry_kernels.h"
+
+namespace line_detection {
+
+struct PlaneRansacParams {
+  // Maximum number of hypotheses tested.
+  unsigned int max_iterations = 300;
+  // Maximum distance of an inlier from the plane.
+  double max_deviation = 0.005;
+  // The search stops as soon as a model with more than this fraction of
+  // inliers is found.
+  double inlier_fraction_max = 0.8;
+  // Minimum number of inliers of a valid model.
+  unsigned int min_num_inliers = 10;
+  // Cf. ClusterDistanceFromMean.
+  double max_discont_in_point_to_mean_distance_connected_components = 0.05;
+  // If true, ClusterDistanceHistogram is used instead of
+  // ClusterDistanceFromMean.
+  bool use_histogram_connectivity_check = false;
+  // Cf. LineDetector::hessianNormalFormOfPlane.
+  double min_distance_between_points_hessian = 1e-6;
+  double max_cos_theta_hessian_computation = 0.994;
+  // Probability that the returned model is the one with all the inliers. It
+  // is used to adapt the number of hypotheses to the inlier fraction found.
+  double confidence = 0.99;
+  // If true, the hypotheses are verified with the Sequential Probability Ratio
+  // Test (Matas and Chum, 2005) and bad ones are rejected after having seen
+  // only a few points.
+  bool use_sprt = true;
+  // If true, the samples are drawn progressively from the points sorted by
+  // their quality (PROSAC, Chum and Matas, 2005), cf. PlaneRansac::run.
+  bool use_prosac = false;
+};
+
+// RANSAC engine to fit a plane to a set of 3D points. The engine is meant to
+// be reused: all the buffers are kept between calls, so that after the first
+// calls no allocation takes place. Not thread-safe, each thread should use its
+// own instance.
+// Compared to the plain loop in LineDetector::planeRANSAC it stops as soon as
+// the requested confidence is reached, rejects bad hypotheses early with SPRT
+// and optionally samples with PROSAC. As in LineDetector::planeRANSAC, the
+// random engine is seeded in the same way at every call, so that the result
+// only depends on the input.
+class PlaneRansac {
+ public:
+  PlaneRansac();
+
+  void setParams(const PlaneRansacParams& params) { params_ = params; }
+  const PlaneRansacParams& getParams() const { return params_; }
+
+  // Fits a plane to the points.
+  // Input: points:  Points to which the plane is fitted. There must be more
+  //                 than 3 points.
+  //
+  //        quality: If PROSAC is used, the points are sampled in descending
+  //                 order of quality. If nullptr, the points closest to the
+  //                 median depth (i.e., z coordinate) are preferred, since
+  //                 they are more likely to lie on the dominant plane.
+  //
+  // Output: inliers: Inliers of the best model found (empty if no model with
+  //                  enough inliers forming a single connected component was
+  //                  found).
+  void run(const std::vector<cv::Vec3f>& points,
+           const std::vector<float>* quality,
+           std::vector<cv::Vec3f>* inliers);
+
+  // Number of hypotheses generated in the last call of run.
+  unsigned int getNumIterations() const { return num_iterations_; }
+
+ private:
+  // Number of points whose distance from the plane is computed at once when
+  // verifying a hypothesis. The SPRT is still evaluated after every point, so
+  // at most one block is computed in vain when a hypothesis is rejected.
+  static constexpr size_t kVerificationBlockSize = 32;
+
+  // Computes the plane through three points. Returns false if the points are
+  // (almost) collinear or too close to each other.
+  bool planeFromSample(const cv::Vec3f& p1, const cv::Vec3f& p2,
+                       const cv::Vec3f& p3, cv::Vec4f* hessian) const;
+
+  // Draws 3 distinct indices in [0, num_points), the last one being
+  // forced_index if it is non-negative (PROSAC).
+  void drawSample(size_t num_points, int forced_index, size_t sample[3]);
+
+  // Verifies a hypothesis and stores its inliers in inlier_candidates_.
+  // Returns false if the hypothesis was rejected before having tested all the
+  // points, either by the SPRT (rejected_by_sprt = true) or because it can no
+  // longer have more than best_num_inliers inliers.
+  bool verifyHypothesis(const cv::Vec4f& hessian, double epsilon,
+                        double delta, size_t best_num_inliers,
+                        size_t* num_points_tested, bool* rejected_by_sprt);
+
+  // Computes the SPRT decision threshold A (Matas and Chum, 2005) for the
+  // given estimates of the inlier fractions of good and bad models.
+  static double computeSprtThreshold(double epsilon, double delta);
+
+  // Updates the maximum number of iterations given the current fraction of
+  // inliers.
+  unsigned int adaptiveNumIterations(double inlier_fraction) const;
+
+  PlaneRansacParams params_;
+  std::default_random_engine generator_;
+  std::uniform_int_distribution<size_t> distribution_;
+
+  // Shuffled copy of the points, in the order in which they are verified.
+  std::vector<cv::Vec3f> ordered_points_;
+  // Same points, as structure of arrays for the geometry kernels.
+  PointBuffer ordered_buffer_;
+  // Inlier mask of the block of points being verified.
+  uchar block_inlier_mask_[kVerificationBlockSize];
+  // Buffers used for the PROSAC ordering.
+  std::vector<size_t> order_;
+  std::vector<float> scores_;
+  // Inliers of the hypothesis being verified.
+  std::vector<cv::Vec3f> inlier_candidates_;
+  // Connectivity check of the inliers, if use_histogram_connectivity_check.
+  ClusterDistanceHistogram cluster_distance_histogram_;
+
+  unsigned int num_iterations_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_PLANE_RANSAC_H_
@@ -0,0 +1,105 @@
+#ifndef LINE_DETECTION_PLANE_SEGMENTATION_H_
+#define LINE_DETECTION_PLANE_SEGMENTATION_H_
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+struct PlaneSegmentationParams {
+  // Half size of the windows over which the points are averaged to compute
+  // the normals.
+  int normal_window_radius = 2;
+  // Maximum distance between two neighbouring points for them to be in the
+  // same region. The normals are not computed across larger distances.
+  double max_distance_between_neighbours = 0.05;
+  // Minimum cosine of the angle between the normal of a point and the normal
+  // of a region for the point to be added to the region.
+  double min_cos_angle_normals = 0.97;
+  // Maximum distance of a point from the plane of a region for the point to
+  // be added to the region.
+  double max_distance_from_plane = 0.02;
+  // Regions with fewer points are not considered planar.
+  unsigned int min_region_size = 500;
+};
+
+// Per-frame segmentation of an organized point cloud into planar regions, so
+// that the planes of the rectangles around the lines can be looked up instead
+// of being fitted with RANSAC for every line. The normals are obtained from
+// the mean points of windows around each point, computed with integral images
+// of the cloud, and the regions are grown from seed points over the
+// 4-neighbourhood, the plane of each region being refitted as it grows.
+class PlaneSegmentation {
+ public:
+  // Label of the points that do not belong to any planar region.
+  static constexpr int kNoPlane = -1;
+
+  struct Plane {
+    // Least-squares plane of the points of the region, in Hessian normal form.
+    cv::Vec4f hessian;
+    size_t num_points;
+  };
+
+  PlaneSegmentation();
+
+  void setParams(const PlaneSegmentationParams& params) { params_ = params; }
+  const PlaneSegmentationParams& getParams() const { return params_; }
+
+  // Segments a new cloud. Points with NaN coordinates or without depth
+  // information (coordinates {0, 0, 0}) are not assigned to any plane.
+  // Input: cloud: Point cloud of type CV_32FC3.
+  void segment(const cv::Mat& cloud);
+
+  // Returns true if the segmentation was computed for the given cloud with
+  // the given parameters.
+  bool isSetTo(const cv::Mat& cloud,
+               const PlaneSegmentationParams& params) const;
+
+  // Returns the index of the plane of each point (CV_32SC1), kNoPlane for the
+  // points that are not in a planar region.
+  const cv::Mat& getLabels() const { return labels_; }
+  const std::vector<Plane>& getPlanes() const { return planes_; }
+
+  // Finds the plane to which most of the points in a rectangle belong and
+  // fits it to these points only.
+  // Input: corners: The 4 corners of the rectangle (cf.
+  //                 forEachValidPointInRectangle).
+  //
+  // Output: hessian:  Least-squares plane of the points of the rectangle that
+  //                   belong to the dominant plane.
+  //
+  //         fraction: Fraction of the points with valid depth in the
+  //                   rectangle that belong to the dominant plane.
+  //
+  //         return:   Index of the dominant plane, kNoPlane if none of the
+  //                   points in the rectangle belongs to a plane.
+  int findDominantPlane(const std::vector<cv::Point2f>& corners,
+                        cv::Vec4f* hessian, double* fraction) const;
+
+ private:
+  // Computes the normals of the cloud (NaN where they cannot be computed).
+  void computeNormals();
+
+  // Grows a region from a seed point, labelling its points with label. Returns
+  // the number of points in the region.
+  size_t growRegion(int seed_row, int seed_col, int label);
+
+  PlaneSegmentationParams params_;
+  PlaneSegmentationParams params_of_segmentation_;
+
+  cv::Mat cloud_;
+  // Integral images of the points with valid depth (x, y, z and count),
+  // stored as (rows + 1) x (cols + 1) x 4 values.
+  std::vector<double> integral_;
+  cv::Mat normals_;
+  cv::Mat labels_;
+  std::vector<Plane> planes_;
+  // Buffers for the region growing.
+  std::vector<cv::Point> queue_;
+  std::vector<cv::Point> region_points_;
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_PLANE_SEGMENTATION_H_
@@ -0,0 +1,68 @@
+#ifndef LINE_DETECTION_PROJECTION_H_
+#define LINE_DETECTION_PROJECTION_H_
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+// Projection of points in camera coordinates to pixel coordinates with a fixed
+// size 3x4 camera projection matrix. All the arithmetic is done on the stack,
+// so none of these functions allocate (apart from resizing the output vectors
+// of the batch versions).
+
+// Converts a 3x4 camera projection matrix of any floating point type to a
+// cv::Matx34f. Should be done once per frame, not once per point.
+cv::Matx34f toProjectionMatx(const cv::Mat& camera_P);
+
+// Projects a single point.
+inline cv::Vec2f projectPoint(const cv::Matx34f& P, const cv::Vec3f& point) {
+  const float u = P(0, 0) * point[0] + P(0, 1) * point[1] +
+                  P(0, 2) * point[2] + P(0, 3);
+  const float v = P(1, 0) * point[0] + P(1, 1) * point[1] +
+                  P(1, 2) * point[2] + P(1, 3);
+  const float w = P(2, 0) * point[0] + P(2, 1) * point[1] +
+                  P(2, 2) * point[2] + P(2, 3);
+  return cv::Vec2f(u / w, v / w);
+}
+
+// Projects a single segment given as (start, end).
+// Output: return: (start_2D, end_2D).
+inline cv::Vec4f projectSegment(const cv::Matx34f& P, const cv::Vec3f& start,
+                                const cv::Vec3f& end) {
+  const cv::Vec2f start_2D = projectPoint(P, start);
+  const cv::Vec2f end_2D = projectPoint(P, end);
+  return cv::Vec4f(start_2D[0], start_2D[1], end_2D[0], end_2D[1]);
+}
+inline cv::Vec4f projectSegment(const cv::Matx34f& P,
+                                const cv::Vec6f& segment) {
+  return projectSegment(P, cv::Vec3f(segment[0], segment[1], segment[2]),
+                        cv::Vec3f(segment[3], segment[4], segment[5]));
+}
+
+// Projects N points in one pass. The loop has no branches and works on
+// contiguous memory, so that the compiler can vectorize it.
+// Input: P:      Camera projection matrix.
+//
+//        points: Points in camera coordinates.
+//
+// Output: points_2D: Projections of the points, in the same order (resized to
+//                    the number of points).
+void projectPoints(const cv::Matx34f& P, const std::vector<cv::Vec3f>& points,
+                   std::vector<cv::Vec2f>* points_2D);
+
+// Projects N segments in one pass, cf. projectPoints.
+// Input: P:        Camera projection matrix.
+//
+//        segments: Segments (start, end) in camera coordinates.
+//
+// Output: segments_2D: Projections (start_2D, end_2D) of the segments, in the
+//                      same order (resized to the number of segments).
+void projectSegments(const cv::Matx34f& P,
+                     const std::vector<cv::Vec6f>& segments,
+                     std::vector<cv::Vec4f>* segments_2D);
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_PROJECTION_H_
@@ -0,0 +1,139 @@
+#ifndef LINE_DETECTION_WEDGE_ESTIMATOR_H_
+#define LINE_DETECTION_WEDGE_ESTIMATOR_H_
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace line_detection {
+
+struct WedgeEstimatorParams {
+  // Maximum distance of an inlier from its plane.
+  double max_deviation = 0.005;
+  // Maximum number of hypotheses sampled.
+  unsigned int max_hypotheses = 100;
+  // Probability of having sampled at least one all-inlier hypothesis, after
+  // which the sampling stops.
+  double confidence = 0.99;
+  // Inlier threshold of the first refinement iteration, relative to
+  // max_deviation. The threshold is halved at each iteration, down to
+  // max_deviation.
+  double initial_relative_threshold = 4.0;
+  // Maximum number of refinement iterations.
+  unsigned int max_iterations = 10;
+};
+
+// Joint robust estimation of the two planes around an edge or intersection
+// line. The two planes are constrained to intersect on a 3D line that lies on
+// the viewing plane of the 2D line, i.e. that projects onto the 2D line, so
+// that the model has 4 degrees of freedom: 2 for the 3D line on the viewing
+// plane and 1 for the rotation of each plane about the line. The model is
+// first estimated by sampling over the combined set of points: 3 points of one
+// side give its plane, whose intersection with the viewing plane is the line,
+// and 1 point of the other side gives the other plane. The best hypothesis is
+// then refined in least-squares sense on its inliers: for a given line the best
+// planes have a closed form, obtained from the moments of the points, so that
+// only the 2 parameters of the line are optimized (with a pattern search). The
+// inlier threshold decreases at each refinement iteration.
+class WedgeEstimator {
+ public:
+  WedgeEstimator();
+
+  void setParams(const WedgeEstimatorParams& params) { params_ = params; }
+  const WedgeEstimatorParams& getParams() const { return params_; }
+
+  // Computes the viewing plane of a 2D line, i.e. the plane through the camera
+  // center that contains all the 3D points that project onto the line.
+  // Input: P:       Camera projection matrix.
+  //
+  //        line_2D: The 2D line.
+  //
+  // Output: hessian: Viewing plane in Hessian normal form.
+  //
+  //         return:  False if the line is degenerate, true otherwise.
+  static bool viewingPlane(const cv::Matx34f& P, const cv::Vec4f& line_2D,
+                           cv::Vec4f* hessian);
+
+  // Fits the two planes.
+  // Input: points_1/points_2: Points on the two sides of the line.
+  //
+  //        viewing_plane:     Plane on which the line must lie (cf.
+  //                           viewingPlane).
+  //
+  // Output: return: False if no valid hypothesis was found or if one of the
+  //                 sides has less than 3 inliers, true otherwise.
+  bool fit(const std::vector<cv::Vec3f>& points_1,
+           const std::vector<cv::Vec3f>& points_2,
+           const cv::Vec4f& viewing_plane);
+
+  // Returns the plane of the points of side 0 (points_1) or 1 (points_2), in
+  // Hessian normal form.
+  const cv::Vec4f& getPlane(size_t side) const { return planes_[side]; }
+  // Returns a point of the line (the projection on the line of the mean of
+  // the inliers) and its direction (with unit norm).
+  const cv::Vec3f& getLinePoint() const { return line_point_; }
+  const cv::Vec3f& getLineDirection() const { return line_direction_; }
+  // Returns the number of inliers of each side.
+  size_t getNumInliers(size_t side) const { return num_inliers_[side]; }
+
+  // Computes the endpoints of the fitted line, i.e. its points that project
+  // onto the endpoints of the 2D line whose viewing plane was passed to fit.
+  // Input: P:       Camera projection matrix.
+  //
+  //        line_2D: The 2D line.
+  //
+  // Output: start/end: The endpoints of the 3D line.
+  //
+  //         return:    False if the line is degenerate or if one of the
+  //                    endpoints is at infinity, true otherwise.
+  bool getLineEndpoints(const cv::Matx34f& P, const cv::Vec4f& line_2D,
+                        cv::Vec3f* start, cv::Vec3f* end) const;
+
+ private:
+  // Moments of the points taken into account on one side.
+  struct Moments {
+    double num_points;
+    cv::Vec3d sum;
+    cv::Matx33d sum_outer_products;
+  };
+
+  // Samples hypotheses of the model and returns the one with the most
+  // inliers. Returns false if no valid hypothesis was found.
+  bool sampleModel(const std::vector<cv::Vec3f>& points_1,
+                   const std::vector<cv::Vec3f>& points_2,
+                   const cv::Vec4d& viewing_plane, cv::Vec3d* point,
+                   cv::Vec3d* direction, cv::Vec4d* plane_1,
+                   cv::Vec4d* plane_2) const;
+
+  // Computes the moments of the points whose distance from plane is smaller
+  // than threshold.
+  static void computeMoments(const std::vector<cv::Vec3f>& points,
+                             const cv::Vec4d& plane, double threshold,
+                             Moments* moments);
+
+  // Fits the plane through a line that minimizes the sum of the squared
+  // distances of the points described by moments.
+  // Output: plane:  The plane, in Hessian normal form.
+  //
+  //         return: The sum of the squared distances.
+  static double fitPlaneThroughLine(const Moments& moments,
+                                    const cv::Vec3d& point,
+                                    const cv::Vec3d& direction,
+                                    cv::Vec4d* plane);
+
+  // Moves the line on the viewing plane so as to minimize the sum of the
+  // costs of the two sides, for fixed moments.
+  void optimizeLine(const Moments& moments_1, const Moments& moments_2,
+                    const cv::Vec3d& viewing_normal, cv::Vec3d* point,
+                    cv::Vec3d* direction) const;
+
+  WedgeEstimatorParams params_;
+  cv::Vec4f planes_[2];
+  cv::Vec3f line_point_;
+  cv::Vec3f line_direction_;
+  size_t num_inliers_[2];
+};
+
+}  // namespace line_detection
+
+#endif  // LINE_DETECTION_WEDGE_ESTIMATOR_H_
@@ -0,0 +1,80 @@
+// Compares the running time and the number of inliers found by the different
+// variants of LineDetector::planeRANSAC on synthetic sets of points, similar to
+// those found in the rectangles around the lines (a plane with noise and a
+// fraction of outliers).
+#include <line_detection/line_detection.h>
+
+#include <ros/ros.h>
+
+int main(int argc, char** argv) {
+  ros::init(argc, argv, "plane_ransac_benchmark");
+
+  int num_sets = 1000;
+  int num_points = 200;
+  double outlier_fraction = 0.3;
+  if (argc > 4) {
+    ROS_INFO("usage: plane_ransac_benchmark [<num_sets> [<num_points> "
+             "[<outlier_fraction>]]]");
+    return -1;
+  }
+  if (argc > 1) num_sets = atoi(argv[1]);
+  if (argc > 2) num_points = atoi(argv[2]);
+  if (argc > 3) outlier_fraction = atof(argv[3]);
+
+  // Generate the point sets.
+  std::default_random_engine generator(42);
+  std::uniform_real_distribution<float> coordinate(-0.1f, 0.1f);
+  std::uniform_real_distribution<float> outlier_offset(-0.3f, 0.3f);
+  std::normal_distribution<float> noise(0.0f, 0.001f);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  std::vector<std::vector<cv::Vec3f>> point_sets(num_sets);
+  for (auto& points : point_sets) {
+    const cv::Vec3f normal = cv::normalize(
+        cv::Vec3f(coordinate(generator), coordinate(generator), 1.0f));
+    const float d = -2.0f - uniform(generator);
+    for (int i = 0; i < num_points; ++i) {
+      const float x = coordinate(generator);
+      const float y = coordinate(generator);
+      float z = -(d + normal[0] * x + normal[1] * y) / normal[2];
+      if (uniform(generator) < outlier_fraction) {
+        z += outlier_offset(generator);
+      } else {
+        z += noise(generator);
+      }
+      points.push_back(cv::Vec3f(x, y, z));
+    }
+  }
+
+  struct Variant {
+    std::string name;
+    bool adaptive, sprt, prosac;
+  };
+  const std::vector<Variant> variants{{"fixed iterations", false, false, false},
+                                      {"adaptive", true, false, false},
+                                      {"adaptive + SPRT", true, true, false},
+                                      {"adaptive + SPRT + PROSAC", true, true,
+                                       true}};
+
+  std::chrono::time_point<std::chrono::system_clock> start, end;
+  std::chrono::duration<double> elapsed_seconds;
+  line_detection::LineDetectionParams params;
+  line_detection::LineDetector line_detector(&params);
+  std::vector<cv::Vec3f> inliers;
+  for (const Variant& variant : variants) {
+    params.use_adaptive_ransac = variant.adaptive;
+    params.ransac_use_sprt = variant.sprt;
+    params.ransac_use_prosac = variant.prosac;
+    size_t total_num_inliers = 0;
+    start = std::chrono::system_clock::now();
+    for (const auto& points : point_sets) {
+      line_detector.planeRANSAC(points, &inliers);
+      total_num_inliers += inliers.size();
+    }
+    end = std::chrono::system_clock::now();
+    elapsed_seconds = end - start;
+    ROS_INFO("%s: %f ms per set, %f inliers per set on average.",
+             variant.name.c_str(), 1e3 * elapsed_seconds.count() / num_sets,
+             static_cast<double>(total_num_inliers) / num_sets);
+  }
+  return 0;
+}
@@ -0,0 +1,79 @@
+// Compares the running time and the accuracy of the detection of the lines on
+// a downsampled image, refined at full resolution (cf.
+// LineDetectionParams::detection_pyramid_level), with the detection at full
+// resolution. The accuracy is measured by the fraction of the lines detected
+// at full resolution (longer than min_length pixels) that are covered by a
+// line of the pyramid mode, and by the mean distance of their endpoints from
+// the covering line.
+#include <line_detection/line_detection.h>
+
+#include <ros/ros.h>
+
+int main(int argc, char** argv) {
+  ros::init(argc, argv, "pyramid_detection_benchmark");
+
+  if (argc < 2 || argc > 5) {
+    ROS_INFO("usage: pyramid_detection_benchmark <image> [<detector> "
+             "[<num_runs> [<min_length>]]]");
+    return -1;
+  }
+  cv::Mat image = cv::imread(argv[1], CV_LOAD_IMAGE_GRAYSCALE);
+  if (image.empty()) {
+    ROS_ERROR("Could not read image %s.", argv[1]);
+    return -1;
+  }
+  int detector = 0;
+  int num_runs = 20;
+  double min_length = 20.0;
+  if (argc > 2) detector = atoi(argv[2]);
+  if (argc > 3) num_runs = atoi(argv[3]);
+  if (argc > 4) min_length = atof(argv[4]);
+
+  std::chrono::time_point<std::chrono::system_clock> start, end;
+  std::chrono::duration<double> elapsed_seconds;
+  line_detection::LineDetectionParams params;
+  line_detection::LineDetector line_detector(&params);
+  std::vector<cv::Vec4f> lines_full_resolution, lines;
+  for (unsigned int level = 0; level <= 2; ++level) {
+    params.detection_pyramid_level = level;
+    start = std::chrono::system_clock::now();
+    for (int run = 0; run < num_runs; ++run) {
+      line_detector.detectLines(image, detector, &lines);
+    }
+    end = std::chrono::system_clock::now();
+    elapsed_seconds = end - start;
+    if (level == 0) lines_full_resolution = lines;
+
+    size_t num_long_lines = 0, num_covered = 0;
+    double sum_endpoint_distances = 0.0;
+    for (const cv::Vec4f& reference : lines_full_resolution) {
+      const cv::Point2f reference_start(reference[0], reference[1]);
+      const cv::Point2f reference_end(reference[2], reference[3]);
+      if (cv::norm(reference_end - reference_start) < min_length) continue;
+      ++num_long_lines;
+      for (const cv::Vec4f& line : lines) {
+        if (!line_detection::areLinesCollinear2D(line, reference, 2.0, 0.0)) {
+          continue;
+        }
+        ++num_covered;
+        // Distances of the endpoints of the reference from the line.
+        const cv::Point2f line_start(line[0], line[1]);
+        const cv::Point2f direction =
+            (cv::Point2f(line[2], line[3]) - line_start) *
+            (1.0 / cv::norm(cv::Point2f(line[2], line[3]) - line_start));
+        sum_endpoint_distances +=
+            0.5 * (fabs(direction.cross(reference_start - line_start)) +
+                   fabs(direction.cross(reference_end - line_start)));
+        break;
+      }
+    }
+    ROS_INFO("Level %u: %f ms per image, %lu lines, %f%% of the %lu long "
+             "lines at full resolution covered, mean endpoint distance %f "
+             "pixels.",
+             level, 1e3 * elapsed_seconds.count() / num_runs, lines.size(),
+             num_long_lines > 0 ? 100.0 * num_covered / num_long_lines : 0.0,
+             num_long_lines,
+             num_covered > 0 ? sum_endpoint_distances / num_covered : 0.0);
+  }
+  return 0;
+}
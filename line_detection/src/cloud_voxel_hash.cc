@@ -0,0 +1,96 @@
+#include "line_detection/cloud_voxel_hash.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glog/logging.h>
+
+namespace line_detection {
+
+CloudVoxelHash::CloudVoxelHash()
+    : cloud_data_(nullptr), rows_(0), cols_(0), voxel_size_(0.0) {}
+
+uint64_t CloudVoxelHash::voxelKey(int64_t x, int64_t y, int64_t z) {
+  // 21 bits per coordinate.
+  constexpr uint64_t kMask = (1u << 21) - 1u;
+  return ((static_cast<uint64_t>(x) & kMask) << 42) |
+         ((static_cast<uint64_t>(y) & kMask) << 21) |
+         (static_cast<uint64_t>(z) & kMask);
+}
+
+int64_t CloudVoxelHash::voxelCoordinate(float c) const {
+  return static_cast<int64_t>(std::floor(c / voxel_size_));
+}
+
+void CloudVoxelHash::setCloud(const cv::Mat& cloud, double voxel_size) {
+  CHECK_EQ(cloud.type(), CV_32FC3);
+  CHECK_GT(voxel_size, 0.0);
+  cloud_data_ = cloud.data;
+  rows_ = cloud.rows;
+  cols_ = cloud.cols;
+  voxel_size_ = voxel_size;
+  entries_.clear();
+  entries_.reserve(rows_ * cols_);
+  for (int r = 0; r < rows_; ++r) {
+    const cv::Vec3f* cloud_row = cloud.ptr<cv::Vec3f>(r);
+    for (int c = 0; c < cols_; ++c) {
+      const cv::Vec3f& point = cloud_row[c];
+      if (std::isnan(point[0]) || std::isnan(point[1]) ||
+          std::isnan(point[2])) {
+        continue;
+      }
+      entries_.emplace_back(voxelKey(voxelCoordinate(point[0]),
+                                     voxelCoordinate(point[1]),
+                                     voxelCoordinate(point[2])),
+                            r * cols_ + c);
+    }
+  }
+  std::sort(entries_.begin(), entries_.end());
+}
+
+bool CloudVoxelHash::isSetTo(const cv::Mat& cloud, double voxel_size) const {
+  return cloud_data_ != nullptr && cloud.data == cloud_data_ &&
+         cloud.rows == rows_ && cloud.cols == cols_ &&
+         voxel_size == voxel_size_;
+}
+
+void CloudVoxelHash::findPointsNearSegment(const cv::Vec3f& start,
+                                           const cv::Vec3f& end,
+                                           std::vector<int>* pixel_indices) {
+  CHECK_NOTNULL(pixel_indices);
+  CHECK(cloud_data_ != nullptr) << "No cloud was set.";
+  // The segment is sampled with a step of half the voxel size. A point closer
+  // than voxel_size / 2 to the segment is then closer than 3/4 * voxel_size to
+  // one of the samples, and therefore lies in one of the 27 voxels around the
+  // voxel of that sample.
+  const double length = cv::norm(end - start);
+  const size_t num_steps =
+      static_cast<size_t>(std::ceil(length / (0.5 * voxel_size_)));
+  keys_buffer_.clear();
+  for (size_t i = 0; i <= num_steps; ++i) {
+    const cv::Vec3f sample =
+        num_steps == 0 ? start : start + (end - start) * (float(i) / num_steps);
+    const int64_t x = voxelCoordinate(sample[0]);
+    const int64_t y = voxelCoordinate(sample[1]);
+    const int64_t z = voxelCoordinate(sample[2]);
+    for (int64_t dx = -1; dx <= 1; ++dx) {
+      for (int64_t dy = -1; dy <= 1; ++dy) {
+        for (int64_t dz = -1; dz <= 1; ++dz) {
+          keys_buffer_.push_back(voxelKey(x + dx, y + dy, z + dz));
+        }
+      }
+    }
+  }
+  std::sort(keys_buffer_.begin(), keys_buffer_.end());
+  keys_buffer_.erase(std::unique(keys_buffer_.begin(), keys_buffer_.end()),
+                     keys_buffer_.end());
+  for (const uint64_t key : keys_buffer_) {
+    auto it = std::lower_bound(
+        entries_.begin(), entries_.end(), std::make_pair(key, -1));
+    for (; it != entries_.end() && it->first == key; ++it) {
+      pixel_indices->push_back(it->second);
+    }
+  }
+}
+
+}  // namespace line_detection
@@ -0,0 +1,131 @@
+#include "line_detection/covariance_plane_fitter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glog/logging.h>
+
+namespace line_detection {
+
+CovariancePlaneFitter::CovariancePlaneFitter() { clear(); }
+
+void CovariancePlaneFitter::clear() {
+  num_points_ = 0;
+  origin_ = cv::Vec3d(0.0, 0.0, 0.0);
+  sum_ = cv::Vec3d(0.0, 0.0, 0.0);
+  sum_outer_products_ = cv::Matx33d::zeros();
+}
+
+void CovariancePlaneFitter::addPoint(const cv::Vec3f& point) {
+  if (num_points_ == 0) {
+    clear();
+    origin_ = cv::Vec3d(point[0], point[1], point[2]);
+  }
+  const cv::Vec3d p = cv::Vec3d(point[0], point[1], point[2]) - origin_;
+  sum_ += p;
+  sum_outer_products_ += p * p.t();
+  ++num_points_;
+}
+
+void CovariancePlaneFitter::addPoints(const std::vector<cv::Vec3f>& points) {
+  for (const cv::Vec3f& point : points) {
+    addPoint(point);
+  }
+}
+
+void CovariancePlaneFitter::removePoint(const cv::Vec3f& point) {
+  CHECK_GT(num_points_, 0u) << "There are no points to remove.";
+  const cv::Vec3d p = cv::Vec3d(point[0], point[1], point[2]) - origin_;
+  sum_ -= p;
+  sum_outer_products_ -= p * p.t();
+  --num_points_;
+}
+
+cv::Vec3d CovariancePlaneFitter::getMean() const {
+  CHECK_GT(num_points_, 0u);
+  return origin_ + sum_ * (1.0 / num_points_);
+}
+
+cv::Matx33d CovariancePlaneFitter::getCovariance() const {
+  CHECK_GT(num_points_, 0u);
+  const cv::Vec3d mean = sum_ * (1.0 / num_points_);
+  return sum_outer_products_ * (1.0 / num_points_) - mean * mean.t();
+}
+
+bool CovariancePlaneFitter::fit(cv::Vec4f* hessian_normal_form,
+                                double* mean_squared_residual) const {
+  CHECK_NOTNULL(hessian_normal_form);
+  if (num_points_ < 3) return false;
+  cv::Vec3d normal;
+  double smallest_eigenvalue;
+  smallestEigenvector(getCovariance(), &normal, &smallest_eigenvalue);
+  *hessian_normal_form = cv::Vec4f(normal[0], normal[1], normal[2],
+                                   -normal.dot(getMean()));
+  if (mean_squared_residual != nullptr) {
+    *mean_squared_residual = std::max(smallest_eigenvalue, 0.0);
+  }
+  return true;
+}
+
+void CovariancePlaneFitter::smallestEigenvector(const cv::Matx33d& matrix,
+                                                cv::Vec3d* eigenvector,
+                                                double* eigenvalue) {
+  CHECK_NOTNULL(eigenvector);
+  CHECK_NOTNULL(eigenvalue);
+  // Each Jacobi rotation sets one off-diagonal element to zero; the matrix
+  // converges quadratically to a diagonal one, the eigenvalues, and the
+  // product of the rotations to the eigenvectors.
+  constexpr size_t kMaxSweeps = 20;
+  double a[3][3], v[3][3];
+  for (size_t i = 0; i < 3; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      a[i][j] = 0.5 * (matrix(i, j) + matrix(j, i));
+      v[i][j] = i == j ? 1.0 : 0.0;
+    }
+  }
+  const double scale = fabs(a[0][0]) + fabs(a[1][1]) + fabs(a[2][2]) +
+                       fabs(a[0][1]) + fabs(a[0][2]) + fabs(a[1][2]);
+  for (size_t sweep = 0; sweep < kMaxSweeps; ++sweep) {
+    const double off_diagonal =
+        fabs(a[0][1]) + fabs(a[0][2]) + fabs(a[1][2]);
+    if (off_diagonal <= 1e-15 * scale) break;
+    for (size_t p = 0; p < 2; ++p) {
+      for (size_t q = p + 1; q < 3; ++q) {
+        if (a[p][q] == 0.0) continue;
+        const double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+        const double t = (theta >= 0.0 ? 1.0 : -1.0) /
+                         (fabs(theta) + sqrt(theta * theta + 1.0));
+        const double c = 1.0 / sqrt(t * t + 1.0);
+        const double s = t * c;
+        // a = J^T * a * J, v = v * J, with J the rotation in the plane (p, q).
+        for (size_t k = 0; k < 3; ++k) {
+          const double a_kp = a[k][p];
+          const double a_kq = a[k][q];
+          a[k][p] = c * a_kp - s * a_kq;
+          a[k][q] = s * a_kp + c * a_kq;
+        }
+        for (size_t k = 0; k < 3; ++k) {
+          const double a_pk = a[p][k];
+          const double a_qk = a[q][k];
+          a[p][k] = c * a_pk - s * a_qk;
+          a[q][k] = s * a_pk + c * a_qk;
+        }
+        for (size_t k = 0; k < 3; ++k) {
+          const double v_kp = v[k][p];
+          const double v_kq = v[k][q];
+          v[k][p] = c * v_kp - s * v_kq;
+          v[k][q] = s * v_kp + c * v_kq;
+        }
+      }
+    }
+  }
+  size_t smallest = 0;
+  for (size_t i = 1; i < 3; ++i) {
+    if (a[i][i] < a[smallest][smallest]) smallest = i;
+  }
+  *eigenvalue = a[smallest][smallest];
+  *eigenvector = cv::Vec3d(v[0][smallest], v[1][smallest], v[2][smallest]);
+  *eigenvector *= 1.0 / cv::norm(*eigenvector);
+}
+
+}  // namespace line_detection
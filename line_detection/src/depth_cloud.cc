@@ -0,0 +1,90 @@
+#include "line_detection/depth_cloud.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glog/logging.h>
+
+namespace line_detection {
+
+DepthCloud::DepthCloud()
+    : depth_to_meters_(1.0), depth_is_distance_(false), num_computed_rows_(0) {}
+
+void DepthCloud::setDepth(const cv::Mat& depth, const cv::Mat& camera_P,
+                          double depth_to_meters, bool depth_is_distance) {
+  CHECK(depth.type() == CV_16UC1 || depth.type() == CV_32FC1);
+  CHECK_EQ(camera_P.rows, 3);
+  CHECK_EQ(camera_P.cols, 4);
+  CHECK_GT(depth_to_meters, 0.0);
+  depth_ = depth;
+  depth_to_meters_ = depth_to_meters;
+  depth_is_distance_ = depth_is_distance;
+  cv::Matx34d P;
+  camera_P.convertTo(P, CV_64F);
+  const double fx = P(0, 0), fy = P(1, 1), cx = P(0, 2), cy = P(1, 2);
+  CHECK_GT(fx, 0.0);
+  CHECK_GT(fy, 0.0);
+  x_over_z_.resize(depth.cols);
+  for (int col = 0; col < depth.cols; ++col) {
+    x_over_z_[col] = (col - cx) / fx;
+  }
+  y_over_z_.resize(depth.rows);
+  for (int row = 0; row < depth.rows; ++row) {
+    y_over_z_[row] = (row - cy) / fy;
+  }
+  // The memory of the cloud is reused if the size does not change. Its content
+  // is not initialized, the rows are written when they are computed.
+  cloud_.create(depth.rows, depth.cols, CV_32FC3);
+  row_is_computed_.assign(depth.rows, 0);
+  num_computed_rows_ = 0;
+}
+
+void DepthCloud::computeRow(int row) {
+  cv::Vec3f* cloud_row = cloud_.ptr<cv::Vec3f>(row);
+  const float y_over_z = y_over_z_[row];
+  const float scale = depth_to_meters_;
+  auto store_point = [this, cloud_row, y_over_z](int col, float depth) {
+    const float x_over_z = x_over_z_[col];
+    if (depth_is_distance_) {
+      depth /= std::sqrt(1.0f + x_over_z * x_over_z + y_over_z * y_over_z);
+    }
+    cloud_row[col] = cv::Vec3f(x_over_z * depth, y_over_z * depth, depth);
+  };
+  if (depth_.type() == CV_16UC1) {
+    const uint16_t* depth_row = depth_.ptr<uint16_t>(row);
+    for (int col = 0; col < depth_.cols; ++col) {
+      store_point(col, depth_row[col] * scale);
+    }
+  } else {
+    const float* depth_row = depth_.ptr<float>(row);
+    for (int col = 0; col < depth_.cols; ++col) {
+      store_point(col, depth_row[col] * scale);
+    }
+  }
+  row_is_computed_[row] = 1;
+  ++num_computed_rows_;
+}
+
+const cv::Vec3f* DepthCloud::ptr(int row) {
+  CHECK(row >= 0 && row < depth_.rows);
+  if (!row_is_computed_[row]) computeRow(row);
+  return cloud_.ptr<cv::Vec3f>(row);
+}
+
+void DepthCloud::computeRows(int first_row, int last_row) {
+  first_row = std::max(first_row, 0);
+  last_row = std::min(last_row, depth_.rows - 1);
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (int row = first_row; row <= last_row; ++row) {
+    if (!row_is_computed_[row]) computeRow(row);
+  }
+}
+
+const cv::Mat& DepthCloud::getCloud() {
+  for (int row = 0; row < depth_.rows; ++row) {
+    if (!row_is_computed_[row]) computeRow(row);
+  }
+  return cloud_;
+}
+
+}  // namespace line_detection
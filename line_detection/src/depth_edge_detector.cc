@@ -0,0 +1,131 @@
+#include "line_detection/depth_edge_detector.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glog/logging.h>
+#include <opencv2/imgproc.hpp>
+
+namespace line_detection {
+
+namespace {
+// Distance in pixels between two samples of findForegroundSide.
+constexpr double kSampleStep = 2.0;
+}  // namespace
+
+float DepthEdgeDetector::depthAt(const cv::Mat& depth, int row,
+                                 int col) const {
+  float value;
+  switch (depth.type()) {
+    case CV_16UC1:
+      value = depth.at<uint16_t>(row, col) * params_.depth_to_meters;
+      break;
+    case CV_32FC1:
+      value = depth.at<float>(row, col);
+      break;
+    default:
+      value = depth.at<cv::Vec3f>(row, col)[2];
+  }
+  // NaN and non-positive depths are invalid.
+  return value > 0.0f ? value : 0.0f;
+}
+
+bool DepthEdgeDetector::isJump(float depth_1, float depth_2) const {
+  const double threshold =
+      std::max(params_.min_depth_jump,
+               params_.min_relative_depth_jump * std::min(depth_1, depth_2));
+  return std::fabs(depth_1 - depth_2) > threshold;
+}
+
+void DepthEdgeDetector::detect(const cv::Mat& depth,
+                               std::vector<cv::Vec4f>* lines) {
+  CHECK_NOTNULL(lines);
+  CHECK(depth.type() == CV_16UC1 || depth.type() == CV_32FC1 ||
+        depth.type() == CV_32FC3);
+  lines->clear();
+  edge_mask_.create(depth.rows, depth.cols, CV_8UC1);
+  edge_mask_.setTo(0);
+  // Compare each pixel with its right and lower neighbours and mark the one in
+  // front, which is on the occluding contour.
+  for (int row = 0; row < depth.rows; ++row) {
+    uchar* mask_row = edge_mask_.ptr<uchar>(row);
+    uchar* next_mask_row =
+        row + 1 < depth.rows ? edge_mask_.ptr<uchar>(row + 1) : nullptr;
+    for (int col = 0; col < depth.cols; ++col) {
+      const float z = depthAt(depth, row, col);
+      if (z == 0.0f) continue;
+      if (col + 1 < depth.cols) {
+        const float z_right = depthAt(depth, row, col + 1);
+        if (z_right != 0.0f && isJump(z, z_right)) {
+          mask_row[z < z_right ? col : col + 1] = 255;
+        }
+      }
+      if (next_mask_row != nullptr) {
+        const float z_below = depthAt(depth, row + 1, col);
+        if (z_below != 0.0f && isJump(z, z_below)) {
+          (z < z_below ? mask_row : next_mask_row)[col] = 255;
+        }
+      }
+    }
+  }
+  std::vector<cv::Vec4i> segments;
+  cv::HoughLinesP(edge_mask_, segments, params_.hough_rho,
+                  params_.hough_theta, params_.hough_threshold,
+                  params_.hough_min_line_length, params_.hough_max_line_gap);
+  lines->reserve(segments.size());
+  for (const cv::Vec4i& segment : segments) {
+    lines->push_back(cv::Vec4f(segment[0], segment[1], segment[2],
+                               segment[3]));
+  }
+}
+
+bool DepthEdgeDetector::findForegroundSide(const cv::Mat& depth,
+                                           const cv::Vec4f& line,
+                                           double offset,
+                                           bool* left_in_front) const {
+  CHECK_NOTNULL(left_in_front);
+  const cv::Point2f start(line[0], line[1]);
+  const cv::Point2f direction(line[2] - line[0], line[3] - line[1]);
+  const double length = cv::norm(direction);
+  if (length < 1e-6) return false;
+  // Same orientation of the left side as in getRectanglesFromLine.
+  const cv::Point2f go_left(-direction.y / length * offset,
+                            direction.x / length * offset);
+  const int num_samples = std::max(2, static_cast<int>(length / kSampleStep));
+  int num_valid = 0, num_left_in_front = 0, num_right_in_front = 0;
+  for (int i = 0; i < num_samples; ++i) {
+    const cv::Point2f point =
+        start + direction * ((i + 0.5f) / static_cast<float>(num_samples));
+    const cv::Point left = point + go_left;
+    const cv::Point right = point - go_left;
+    if (left.x < 0 || left.x >= depth.cols || left.y < 0 ||
+        left.y >= depth.rows || right.x < 0 || right.x >= depth.cols ||
+        right.y < 0 || right.y >= depth.rows) {
+      continue;
+    }
+    const float z_left = depthAt(depth, left.y, left.x);
+    const float z_right = depthAt(depth, right.y, right.x);
+    if (z_left == 0.0f || z_right == 0.0f) continue;
+    ++num_valid;
+    if (isJump(z_left, z_right)) {
+      if (z_left < z_right) {
+        ++num_left_in_front;
+      } else {
+        ++num_right_in_front;
+      }
+    }
+  }
+  if (num_valid == 0) return false;
+  const double min_num_jumps = params_.min_fraction_of_jumps * num_valid;
+  if (num_left_in_front >= min_num_jumps) {
+    *left_in_front = true;
+    return true;
+  }
+  if (num_right_in_front >= min_num_jumps) {
+    *left_in_front = false;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace line_detection
@@ -0,0 +1,187 @@
+#include "line_detection/frame_context.h"
+
+#include <cmath>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "line_detection/line_detection.h"
+
+namespace line_detection {
+
+constexpr uchar FrameContext::kValidPoint;
+constexpr uchar FrameContext::kPointWithoutDepth;
+
+FrameContext::FrameContext()
+    : from_depth_(false),
+      integral_plane_fitter_(std::make_shared<IntegralPlaneFitter>()),
+      plane_segmentation_(std::make_shared<PlaneSegmentation>()),
+      voxel_hash_(std::make_shared<CloudVoxelHash>()),
+      voxel_size_(0.0) {
+  resetDerivedProducts();
+}
+
+void FrameContext::resetDerivedProducts() {
+  gray_image_computed_ = false;
+  inverse_intrinsics_computed_ = false;
+  validity_mask_computed_ = false;
+  normals_computed_ = false;
+  integral_plane_fitter_computed_ = false;
+  plane_segmentation_computed_ = false;
+  voxel_size_ = 0.0;
+}
+
+void FrameContext::setFrame(const cv::Mat& image, const cv::Mat& cloud,
+                            const cv::Mat& camera_P) {
+  CHECK_EQ(cloud.type(), CV_32FC3);
+  CHECK_EQ(cloud.rows, image.rows);
+  CHECK_EQ(cloud.cols, image.cols);
+  CHECK_EQ(camera_P.rows, 3);
+  CHECK_EQ(camera_P.cols, 4);
+  image_ = image;
+  cloud_ = cloud;
+  projection_ = toProjectionMatx(camera_P);
+  camera_P_ = cv::Mat(projection_);
+  from_depth_ = false;
+  resetDerivedProducts();
+}
+
+void FrameContext::setFrameFromDepth(const cv::Mat& image,
+                                     const cv::Mat& depth,
+                                     const cv::Mat& camera_P,
+                                     double depth_to_meters,
+                                     bool depth_is_distance) {
+  CHECK_EQ(depth.rows, image.rows);
+  CHECK_EQ(depth.cols, image.cols);
+  CHECK_EQ(camera_P.rows, 3);
+  CHECK_EQ(camera_P.cols, 4);
+  image_ = image;
+  cloud_ = cv::Mat();
+  projection_ = toProjectionMatx(camera_P);
+  camera_P_ = cv::Mat(projection_);
+  depth_cloud_.setDepth(depth, camera_P_, depth_to_meters, depth_is_distance);
+  from_depth_ = true;
+  resetDerivedProducts();
+}
+
+const cv::Mat& FrameContext::getGrayImage() {
+  if (!gray_image_computed_) {
+    if (image_.channels() == 1) {
+      gray_image_ = image_;
+    } else if (image_.channels() == 4) {
+      cv::cvtColor(image_, gray_image_, CV_RGBA2GRAY);
+    } else {
+      CHECK_EQ(image_.channels(), 3);
+      cv::cvtColor(image_, gray_image_, CV_RGB2GRAY);
+    }
+    gray_image_computed_ = true;
+  }
+  return gray_image_;
+}
+
+const cv::Mat& FrameContext::getCloud() {
+  if (from_depth_) return depth_cloud_.getCloud();
+  return cloud_;
+}
+
+DepthCloud* FrameContext::getDepthCloud() {
+  return from_depth_ ? &depth_cloud_ : nullptr;
+}
+
+const cv::Matx33f& FrameContext::getInverseIntrinsics() {
+  if (!inverse_intrinsics_computed_) {
+    const cv::Matx33f intrinsics = projection_.get_minor<3, 3>(0, 0);
+    inverse_intrinsics_ = intrinsics.inv();
+    inverse_intrinsics_computed_ = true;
+  }
+  return inverse_intrinsics_;
+}
+
+cv::Point2f FrameContext::project(const cv::Vec3f& point) const {
+  const cv::Vec2f point_2D = projectPoint(projection_, point);
+  return cv::Point2f(point_2D[0], point_2D[1]);
+}
+
+const cv::Mat& FrameContext::getValidityMask() {
+  if (!validity_mask_computed_) {
+    const cv::Mat& cloud = getCloud();
+    validity_mask_.create(cloud.rows, cloud.cols, CV_8UC1);
+    for (int r = 0; r < cloud.rows; ++r) {
+      const cv::Vec3f* cloud_row = cloud.ptr<cv::Vec3f>(r);
+      uchar* mask_row = validity_mask_.ptr<uchar>(r);
+      for (int c = 0; c < cloud.cols; ++c) {
+        if (std::isnan(cloud_row[c][0])) {
+          mask_row[c] = 0;
+        } else if (checkEqualPoints(cloud_row[c], {0.0f, 0.0f, 0.0f})) {
+          mask_row[c] = kPointWithoutDepth;
+        } else {
+          mask_row[c] = kValidPoint;
+        }
+      }
+    }
+    validity_mask_computed_ = true;
+  }
+  return validity_mask_;
+}
+
+const cv::Mat& FrameContext::getNormals() {
+  if (!normals_computed_) {
+    const cv::Mat& cloud = getCloud();
+    const cv::Mat& mask = getValidityMask();
+    normals_.create(cloud.rows, cloud.cols, CV_32FC3);
+    normals_.setTo(cv::Scalar::all(NAN));
+    for (int r = 1; r < cloud.rows - 1; ++r) {
+      const cv::Vec3f* above = cloud.ptr<cv::Vec3f>(r - 1);
+      const cv::Vec3f* row = cloud.ptr<cv::Vec3f>(r);
+      const cv::Vec3f* below = cloud.ptr<cv::Vec3f>(r + 1);
+      const uchar* mask_above = mask.ptr<uchar>(r - 1);
+      const uchar* mask_row = mask.ptr<uchar>(r);
+      const uchar* mask_below = mask.ptr<uchar>(r + 1);
+      cv::Vec3f* normals_row = normals_.ptr<cv::Vec3f>(r);
+      for (int c = 1; c < cloud.cols - 1; ++c) {
+        if (!(mask_row[c] & kValidPoint) || !(mask_row[c - 1] & kValidPoint) ||
+            !(mask_row[c + 1] & kValidPoint) ||
+            !(mask_above[c] & kValidPoint) || !(mask_below[c] & kValidPoint)) {
+          continue;
+        }
+        // Central differences along the rows and the columns.
+        cv::Vec3f normal = (row[c + 1] - row[c - 1]).cross(below[c] - above[c]);
+        const float norm = cv::norm(normal);
+        if (norm < 1e-12f) continue;
+        normal /= norm;
+        if (normal.dot(row[c]) > 0.0f) normal = -normal;
+        normals_row[c] = normal;
+      }
+    }
+    normals_computed_ = true;
+  }
+  return normals_;
+}
+
+std::shared_ptr<IntegralPlaneFitter> FrameContext::getIntegralPlaneFitter() {
+  if (!integral_plane_fitter_computed_) {
+    integral_plane_fitter_->setCloud(getCloud());
+    integral_plane_fitter_computed_ = true;
+  }
+  return integral_plane_fitter_;
+}
+
+std::shared_ptr<PlaneSegmentation> FrameContext::getPlaneSegmentation(
+    const PlaneSegmentationParams& params) {
+  if (!plane_segmentation_computed_ ||
+      !plane_segmentation_->isSetTo(getCloud(), params)) {
+    plane_segmentation_->setParams(params);
+    plane_segmentation_->segment(getCloud());
+    plane_segmentation_computed_ = true;
+  }
+  return plane_segmentation_;
+}
+
+std::shared_ptr<CloudVoxelHash> FrameContext::getVoxelHash(double voxel_size) {
+  if (voxel_size != voxel_size_) {
+    voxel_hash_->setCloud(getCloud(), voxel_size);
+    voxel_size_ = voxel_size;
+  }
+  return voxel_hash_;
+}
+
+}  // namespace line_detection
@@ -0,0 +1,266 @@
+#include "line_detection/geometry_kernels.h"
+
+#include <cmath>
+
+#include <glog/logging.h>
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace line_detection {
+
+namespace {
+
+#if CV_SIMD128
+// Number of points processed at once by the SIMD implementations.
+constexpr size_t kSimdWidth = 4;
+
+// Writes the 4 bits of a sign mask (cf. cv::v_signmask) to 4 mask entries and
+// returns the number of bits set.
+inline size_t storeSignMask(int sign_mask, uchar* mask) {
+  mask[0] = sign_mask & 1;
+  mask[1] = (sign_mask >> 1) & 1;
+  mask[2] = (sign_mask >> 2) & 1;
+  mask[3] = (sign_mask >> 3) & 1;
+  return mask[0] + mask[1] + mask[2] + mask[3];
+}
+
+// Squared norm of the cross product of (dx, dy, dz) with (ux, uy, uz).
+inline cv::v_float32x4 squaredNormOfCross(const cv::v_float32x4& dx,
+                                          const cv::v_float32x4& dy,
+                                          const cv::v_float32x4& dz,
+                                          const cv::v_float32x4& ux,
+                                          const cv::v_float32x4& uy,
+                                          const cv::v_float32x4& uz) {
+  const cv::v_float32x4 cx = dy * uz - dz * uy;
+  const cv::v_float32x4 cy = dz * ux - dx * uz;
+  const cv::v_float32x4 cz = dx * uy - dy * ux;
+  return cx * cx + cy * cy + cz * cz;
+}
+#endif
+
+inline float squaredNormOfCross(const cv::Vec3f& d, float ux, float uy,
+                                float uz) {
+  const float cx = d[1] * uz - d[2] * uy;
+  const float cy = d[2] * ux - d[0] * uz;
+  const float cz = d[0] * uy - d[1] * ux;
+  return cx * cx + cy * cy + cz * cz;
+}
+
+}  // namespace
+
+void PointBuffer::assign(const std::vector<cv::Vec3f>& points) {
+  const size_t num_points = points.size();
+  x_.resize(num_points);
+  y_.resize(num_points);
+  z_.resize(num_points);
+  for (size_t i = 0; i < num_points; ++i) {
+    x_[i] = points[i][0];
+    y_[i] = points[i][1];
+    z_[i] = points[i][2];
+  }
+}
+
+bool useSimdGeometryKernels() {
+#if CV_SIMD128
+  return cv::useOptimized() && (cv::checkHardwareSupport(CV_CPU_SSE2) ||
+                                cv::checkHardwareSupport(CV_CPU_NEON));
+#else
+  return false;
+#endif
+}
+
+size_t markPlaneInliers(const PointBuffer& points, size_t begin, size_t end,
+                        const cv::Vec4f& hessian, float max_error,
+                        uchar* inlier_mask) {
+  CHECK_LE(begin, end);
+  CHECK_LE(end, points.size());
+  CHECK(begin == end || inlier_mask != nullptr);
+  const float* x = points.x();
+  const float* y = points.y();
+  const float* z = points.z();
+  size_t num_inliers = 0;
+  size_t i = begin;
+#if CV_SIMD128
+  if (useSimdGeometryKernels()) {
+    const cv::v_float32x4 a = cv::v_setall_f32(hessian[0]);
+    const cv::v_float32x4 b = cv::v_setall_f32(hessian[1]);
+    const cv::v_float32x4 c = cv::v_setall_f32(hessian[2]);
+    const cv::v_float32x4 d = cv::v_setall_f32(hessian[3]);
+    const cv::v_float32x4 threshold = cv::v_setall_f32(max_error);
+    for (; i + kSimdWidth <= end; i += kSimdWidth) {
+      const cv::v_float32x4 error =
+          cv::v_abs(a * cv::v_load(x + i) + b * cv::v_load(y + i) +
+                    c * cv::v_load(z + i) + d);
+      num_inliers += storeSignMask(cv::v_signmask(error < threshold),
+                                   inlier_mask + (i - begin));
+    }
+  }
+#endif
+  for (; i < end; ++i) {
+    const float error = std::fabs(hessian[0] * x[i] + hessian[1] * y[i] +
+                                  hessian[2] * z[i] + hessian[3]);
+    inlier_mask[i - begin] = error < max_error ? 1 : 0;
+    num_inliers += inlier_mask[i - begin];
+  }
+  return num_inliers;
+}
+
+size_t markPlaneInliers(const PointBuffer& points, const cv::Vec4f& hessian,
+                        float max_error, std::vector<uchar>* inlier_mask) {
+  CHECK_NOTNULL(inlier_mask);
+  inlier_mask->resize(points.size());
+  return markPlaneInliers(points, 0, points.size(), hessian, max_error,
+                          inlier_mask->data());
+}
+
+size_t countPlaneInliers(const PointBuffer& points, const cv::Vec4f& hessian,
+                         float max_error) {
+  const float* x = points.x();
+  const float* y = points.y();
+  const float* z = points.z();
+  const size_t num_points = points.size();
+  size_t num_inliers = 0;
+  size_t i = 0;
+#if CV_SIMD128
+  if (useSimdGeometryKernels()) {
+    const cv::v_float32x4 a = cv::v_setall_f32(hessian[0]);
+    const cv::v_float32x4 b = cv::v_setall_f32(hessian[1]);
+    const cv::v_float32x4 c = cv::v_setall_f32(hessian[2]);
+    const cv::v_float32x4 d = cv::v_setall_f32(hessian[3]);
+    const cv::v_float32x4 threshold = cv::v_setall_f32(max_error);
+    uchar mask[kSimdWidth];
+    for (; i + kSimdWidth <= num_points; i += kSimdWidth) {
+      const cv::v_float32x4 error =
+          cv::v_abs(a * cv::v_load(x + i) + b * cv::v_load(y + i) +
+                    c * cv::v_load(z + i) + d);
+      num_inliers += storeSignMask(cv::v_signmask(error < threshold), mask);
+    }
+  }
+#endif
+  for (; i < num_points; ++i) {
+    if (std::fabs(hessian[0] * x[i] + hessian[1] * y[i] + hessian[2] * z[i] +
+                  hessian[3]) < max_error) {
+      ++num_inliers;
+    }
+  }
+  return num_inliers;
+}
+
+void distancesToLine(const PointBuffer& points, const cv::Vec3f& start,
+                     const cv::Vec3f& end, std::vector<float>* distances) {
+  CHECK_NOTNULL(distances);
+  const float* x = points.x();
+  const float* y = points.y();
+  const float* z = points.z();
+  const size_t num_points = points.size();
+  distances->resize(num_points);
+  float* distance = distances->data();
+  // |(p - start) x (p - end)| = |(end - start) x (p - start)|.
+  const cv::Vec3f direction = end - start;
+  const float inverse_length = 1.0f / cv::norm(direction);
+  size_t i = 0;
+#if CV_SIMD128
+  if (useSimdGeometryKernels()) {
+    const cv::v_float32x4 dx = cv::v_setall_f32(direction[0]);
+    const cv::v_float32x4 dy = cv::v_setall_f32(direction[1]);
+    const cv::v_float32x4 dz = cv::v_setall_f32(direction[2]);
+    const cv::v_float32x4 sx = cv::v_setall_f32(start[0]);
+    const cv::v_float32x4 sy = cv::v_setall_f32(start[1]);
+    const cv::v_float32x4 sz = cv::v_setall_f32(start[2]);
+    const cv::v_float32x4 scale = cv::v_setall_f32(inverse_length);
+    for (; i + kSimdWidth <= num_points; i += kSimdWidth) {
+      const cv::v_float32x4 squared_norm = squaredNormOfCross(
+          dx, dy, dz, cv::v_load(x + i) - sx, cv::v_load(y + i) - sy,
+          cv::v_load(z + i) - sz);
+      cv::v_store(distance + i, cv::v_sqrt(squared_norm) * scale);
+    }
+  }
+#endif
+  for (; i < num_points; ++i) {
+    distance[i] = std::sqrt(squaredNormOfCross(direction, x[i] - start[0],
+                                               y[i] - start[1],
+                                               z[i] - start[2])) *
+                  inverse_length;
+  }
+}
+
+size_t markLineInliers(const PointBuffer& points, const cv::Vec3f& start,
+                       const cv::Vec3f& end, float max_distance,
+                       std::vector<uchar>* inlier_mask) {
+  CHECK_NOTNULL(inlier_mask);
+  const float* x = points.x();
+  const float* y = points.y();
+  const float* z = points.z();
+  const size_t num_points = points.size();
+  inlier_mask->resize(num_points);
+  uchar* mask = inlier_mask->data();
+  // The squared distances are compared, scaled by the squared length of the
+  // segment, so that neither square roots nor divisions are needed.
+  const cv::Vec3f direction = end - start;
+  const float max_scaled_squared_distance =
+      max_distance * max_distance * direction.dot(direction);
+  size_t num_inliers = 0;
+  size_t i = 0;
+#if CV_SIMD128
+  if (useSimdGeometryKernels()) {
+    const cv::v_float32x4 dx = cv::v_setall_f32(direction[0]);
+    const cv::v_float32x4 dy = cv::v_setall_f32(direction[1]);
+    const cv::v_float32x4 dz = cv::v_setall_f32(direction[2]);
+    const cv::v_float32x4 sx = cv::v_setall_f32(start[0]);
+    const cv::v_float32x4 sy = cv::v_setall_f32(start[1]);
+    const cv::v_float32x4 sz = cv::v_setall_f32(start[2]);
+    const cv::v_float32x4 threshold =
+        cv::v_setall_f32(max_scaled_squared_distance);
+    for (; i + kSimdWidth <= num_points; i += kSimdWidth) {
+      const cv::v_float32x4 squared_norm = squaredNormOfCross(
+          dx, dy, dz, cv::v_load(x + i) - sx, cv::v_load(y + i) - sy,
+          cv::v_load(z + i) - sz);
+      num_inliers += storeSignMask(
+          cv::v_signmask(squared_norm <= threshold), mask + i);
+    }
+  }
+#endif
+  for (; i < num_points; ++i) {
+    mask[i] = squaredNormOfCross(direction, x[i] - start[0], y[i] - start[1],
+                                 z[i] - start[2]) <=
+                      max_scaled_squared_distance
+                  ? 1
+                  : 0;
+    num_inliers += mask[i];
+  }
+  return num_inliers;
+}
+
+void positionsOnLine(const PointBuffer& points, const cv::Vec3f& start,
+                     const cv::Vec3f& end, std::vector<float>* positions) {
+  CHECK_NOTNULL(positions);
+  const float* x = points.x();
+  const float* y = points.y();
+  const float* z = points.z();
+  const size_t num_points = points.size();
+  positions->resize(num_points);
+  float* position = positions->data();
+  // position = (end - start).dot(p - start) / |end - start|^2.
+  const cv::Vec3f direction = end - start;
+  const cv::Vec3f scaled_direction = direction / direction.dot(direction);
+  const float offset = -scaled_direction.dot(start);
+  size_t i = 0;
+#if CV_SIMD128
+  if (useSimdGeometryKernels()) {
+    const cv::v_float32x4 dx = cv::v_setall_f32(scaled_direction[0]);
+    const cv::v_float32x4 dy = cv::v_setall_f32(scaled_direction[1]);
+    const cv::v_float32x4 dz = cv::v_setall_f32(scaled_direction[2]);
+    const cv::v_float32x4 o = cv::v_setall_f32(offset);
+    for (; i + kSimdWidth <= num_points; i += kSimdWidth) {
+      cv::v_store(position + i, dx * cv::v_load(x + i) +
+                                    dy * cv::v_load(y + i) +
+                                    dz * cv::v_load(z + i) + o);
+    }
+  }
+#endif
+  for (; i < num_points; ++i) {
+    position[i] = scaled_direction[0] * x[i] + scaled_direction[1] * y[i] +
+                  scaled_direction[2] * z[i] + offset;
+  }
+}
+
+}  // namespace line_detection
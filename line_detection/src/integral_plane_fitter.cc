@@ -0,0 +1,121 @@
+#include "line_detection/integral_plane_fitter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "line_detection/covariance_plane_fitter.h"
+#include "line_detection/line_detection.h"
+
+namespace line_detection {
+
+constexpr size_t IntegralPlaneFitter::kNumChannels;
+
+IntegralPlaneFitter::IntegralPlaneFitter()
+    : cloud_data_(nullptr), rows_(0), cols_(0) {}
+
+void IntegralPlaneFitter::setCloud(const cv::Mat& cloud) {
+  CHECK_EQ(cloud.type(), CV_32FC3);
+  cloud_data_ = cloud.data;
+  rows_ = cloud.rows;
+  cols_ = cloud.cols;
+  const size_t row_stride = (cols_ + 1) * kNumChannels;
+  prefix_sums_.assign(rows_ * row_stride, 0.0);
+  for (int r = 0; r < rows_; ++r) {
+    const cv::Vec3f* cloud_row = cloud.ptr<cv::Vec3f>(r);
+    double* prefix = &prefix_sums_[r * row_stride];
+    for (int c = 0; c < cols_; ++c) {
+      const cv::Vec3f& point = cloud_row[c];
+      double* next_prefix = prefix + kNumChannels;
+      std::copy(prefix, prefix + kNumChannels, next_prefix);
+      if (!std::isnan(point[0])) {
+        if (checkEqualPoints(point, {0.0f, 0.0f, 0.0f})) {
+          next_prefix[1] += 1.0;
+        } else {
+          const double x = point[0], y = point[1], z = point[2];
+          next_prefix[0] += 1.0;
+          next_prefix[2] += x;
+          next_prefix[3] += y;
+          next_prefix[4] += z;
+          next_prefix[5] += x * x;
+          next_prefix[6] += x * y;
+          next_prefix[7] += x * z;
+          next_prefix[8] += y * y;
+          next_prefix[9] += y * z;
+          next_prefix[10] += z * z;
+        }
+      }
+      prefix = next_prefix;
+    }
+  }
+}
+
+bool IntegralPlaneFitter::isSetTo(const cv::Mat& cloud) const {
+  return cloud_data_ != nullptr && cloud.data == cloud_data_ &&
+         cloud.rows == rows_ && cloud.cols == cols_;
+}
+
+void IntegralPlaneFitter::addRowToMoments(int row, int x_start, int x_end,
+                                          PlaneMoments* moments) const {
+  const size_t row_stride = (cols_ + 1) * kNumChannels;
+  const double* end = &prefix_sums_[row * row_stride +
+                                    (x_end + 1) * kNumChannels];
+  const double* start = &prefix_sums_[row * row_stride +
+                                      x_start * kNumChannels];
+  moments->num_points += static_cast<size_t>(end[0] - start[0]);
+  moments->num_points_without_depth += static_cast<size_t>(end[1] - start[1]);
+  moments->sum += cv::Vec3d(end[2] - start[2], end[3] - start[3],
+                            end[4] - start[4]);
+  const double xx = end[5] - start[5];
+  const double xy = end[6] - start[6];
+  const double xz = end[7] - start[7];
+  const double yy = end[8] - start[8];
+  const double yz = end[9] - start[9];
+  const double zz = end[10] - start[10];
+  moments->sum_outer_products += cv::Matx33d(xx, xy, xz,
+                                             xy, yy, yz,
+                                             xz, yz, zz);
+}
+
+void IntegralPlaneFitter::computeMomentsInRectangle(
+    const std::vector<cv::Point2f>& corners, PlaneMoments* moments) const {
+  CHECK_NOTNULL(moments);
+  CHECK(cloud_data_ != nullptr) << "No cloud was set.";
+  *moments = PlaneMoments();
+  const RectangleScanlines scanlines(corners);
+  int x_start, x_end;
+  for (size_t i = 0; i < scanlines.getNumRows(); ++i) {
+    const int row = scanlines.getFirstRow() + i;
+    if (row < 0 || row >= rows_) continue;
+    scanlines.getSpan(i, &x_start, &x_end);
+    x_start = std::max(x_start, 0);
+    x_end = std::min(x_end, cols_ - 1);
+    if (x_start > x_end) continue;
+    addRowToMoments(row, x_start, x_end, moments);
+  }
+}
+
+bool IntegralPlaneFitter::fitPlane(const PlaneMoments& moments,
+                                   cv::Vec4f* hessian_normal_form,
+                                   double* mean_squared_residual) {
+  CHECK_NOTNULL(hessian_normal_form);
+  CHECK_NOTNULL(mean_squared_residual);
+  if (moments.num_points < 3) return false;
+  const double num_points = moments.num_points;
+  const cv::Vec3d mean = moments.sum / num_points;
+  const cv::Matx33d covariance =
+      moments.sum_outer_products * (1.0 / num_points) - mean * mean.t();
+  // The normal of the plane is the eigenvector of the smallest eigenvalue,
+  // which is also the mean squared distance of the points from the plane.
+  cv::Vec3d eigenvector;
+  double smallest_eigenvalue;
+  CovariancePlaneFitter::smallestEigenvector(covariance, &eigenvector,
+                                             &smallest_eigenvalue);
+  const cv::Vec3f normal(eigenvector);
+  *hessian_normal_form =
+      cv::Vec4f(normal[0], normal[1], normal[2],
+                computeDfromPlaneNormal(normal, cv::Vec3f(mean)));
+  *mean_squared_residual = std::max(smallest_eigenvalue, 0.0);
+  return true;
+}
+
+}  // namespace line_detection
@@ -1,9 +1,55 @@
 #include "line_detection/line_detection.h"
+#include "line_detection/cloud_voxel_hash.h"
+#include "line_detection/covariance_plane_fitter.h"
+#include "line_detection/frame_context.h"
+#include "line_detection/integral_plane_fitter.h"
+#include "line_detection/line_endpoint_search.h"
+#include "line_detection/line_fusion_index.h"
+#include "line_detection/line_refinement.h"
+#include "line_detection/plane_segmentation.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
 
 namespace line_detection {
+
+namespace {
+// Returns true for the detectors that extract segments from the grayscale
+// image on their own, and can therefore run on tiles or on a downsampled
+// image.
+bool isSegmentDetector(DetectorType detector) {
+  return detector == DetectorType::LSD || detector == DetectorType::EDL ||
+         detector == DetectorType::FAST;
+}
+
+// Expected value of projecting a 2D line to 3D, used to order the lines when
+// projecting them within a time budget: the length of the line in pixels,
+// weighted by the fraction of the points sampled along it that have a valid
+// depth.
+double computeLinePriority(const cv::Mat& cloud, const cv::Vec4f& line) {
+  constexpr int kNumSamples = 16;
+  const cv::Point2f start(line[0], line[1]);
+  const cv::Point2f direction(line[2] - line[0], line[3] - line[1]);
+  int num_valid = 0;
+  for (int i = 0; i < kNumSamples; ++i) {
+    const cv::Point point =
+        start + direction * ((i + 0.5f) / static_cast<float>(kNumSamples));
+    if (point.x < 0 || point.x >= cloud.cols || point.y < 0 ||
+        point.y >= cloud.rows) {
+      continue;
+    }
+    const float depth = cloud.at<cv::Vec3f>(point)[2];
+    if (depth > 0.0f) ++num_valid;
+  }
+  return cv::norm(direction) * num_valid / kNumSamples;
+}
+}  // namespace
+
 cv::Vec3f projectPointOnPlane(const cv::Vec4f& hessian,
                               const cv::Vec3f& point) {
   cv::Vec3f x_0, normal;
@@ -92,16 +138,52 @@ bool areLinesEqual2D(const cv::Vec4f line1, const cv::Vec4f line2) {
   // If angle difference and minimum distance are less than the thresholds,
   // return true. Note that since we want angle_difference ~= 0 it must hold
   // that cos(angle_difference) ~= 1 => cos^2(angle_difference) ~= 1.
-  constexpr double kMinDistance = 2;
-  constexpr double kCosSqAngleDifference = 0.98;
-  if (cos_sq_angle_difference > kCosSqAngleDifference &&
-      min_dist < kMinDistance) {
+  if (cos_sq_angle_difference > kMinCosSqAngleDifferenceEqualLines2D &&
+      min_dist < kMaxSqEndpointDistanceEqualLines2D) {
     return true;
   } else {
     return false;
   }
 }
 
+bool areLinesCollinear2D(const cv::Vec4f& line1, const cv::Vec4f& line2,
+                         double max_distance, double max_gap) {
+  // The longer line is taken as reference.
+  const cv::Vec4f* reference = &line1;
+  const cv::Vec4f* other = &line2;
+  cv::Point2f direction(line1[2] - line1[0], line1[3] - line1[1]);
+  cv::Point2f other_direction(line2[2] - line2[0], line2[3] - line2[1]);
+  double length = cv::norm(direction);
+  double other_length = cv::norm(other_direction);
+  if (other_length > length) {
+    std::swap(reference, other);
+    std::swap(direction, other_direction);
+    std::swap(length, other_length);
+  }
+  if (length < 1e-6) return false;
+  direction *= 1.0 / length;
+  if (other_length > 1e-6) {
+    const double cos_angle = direction.dot(other_direction) / other_length;
+    if (cos_angle * cos_angle <= kMinCosSqAngleDifferenceEqualLines2D) {
+      return false;
+    }
+  }
+  // Positions of the endpoints of the other line across and along the
+  // reference line.
+  const cv::Point2f start((*reference)[0], (*reference)[1]);
+  double min_along = std::numeric_limits<double>::max();
+  double max_along = -std::numeric_limits<double>::max();
+  for (size_t i = 0; i < 2; ++i) {
+    const cv::Point2f offset =
+        cv::Point2f((*other)[2 * i], (*other)[2 * i + 1]) - start;
+    if (fabs(direction.cross(offset)) > max_distance) return false;
+    const double along = direction.dot(offset);
+    min_along = std::min(min_along, along);
+    max_along = std::max(max_along, along);
+  }
+  return max_along >= -max_gap && min_along <= length + max_gap;
+}
+
 void findXCoordOfPixelsOnVector(const cv::Point2f& start,
                                 const cv::Point2f& end, bool left_side,
                                 std::vector<int>* x_coord) {
@@ -140,11 +222,43 @@ void findPointsInRectangle(std::vector<cv::Point2f>* corners,
                            std::vector<cv::Point2i>* points, bool verbose) {
   CHECK_NOTNULL(points);
   CHECK_NOTNULL(corners);
-  CHECK_EQ(corners->size(), 4)
+  RectangleScanlines scanlines(*corners, verbose);
+  *corners = scanlines.getCorners();
+  // Iterate over all pixels in the rectangle.
+  points->clear();
+  int x_start, x_end;
+  for (size_t i = 0; i < scanlines.getNumRows(); ++i) {
+    scanlines.getSpan(i, &x_start, &x_end);
+    for (int x = x_start; x <= x_end; ++x) {
+      points->push_back(cv::Point2i(x, scanlines.getFirstRow() + i));
+    }
+  }
+}
+
+RectangleScanlines::Edge::Edge(const cv::Point2f& start,
+                               const cv::Point2f& end, bool left_side) {
+  // Same as findXCoordOfPixelsOnVector, but without storing the coordinates.
+  int top = floor(start.y);
+  int bottom = ceil(end.y);
+  height = bottom - top;
+  x_start = floor(start.x) + 0.5;
+  width = floor(end.x) - floor(start.x);
+  CHECK(height > 0) << "Important: the following statement must hold: start.y "
+                       "< end.y. We have bottom = " << end.y << " -> "
+                    << bottom << ", top = " << start.y << " -> " << top
+                    << " and therefore height = bottom - top = " << height;
+  if (left_side) {
+    x_single_row = floor(start.x);
+  } else {
+    x_single_row = ceil(end.x);
+  }
+}
+
+RectangleScanlines::RectangleScanlines(const std::vector<cv::Point2f>& corners,
+                                       bool verbose) {
+  CHECK_EQ(corners.size(), 4)
       << "The rectangle must be defined by exactly 4 corner points.";
-  // Find the relative positions of the points.
-  // int upper, lower, left, right, store_i;
-  std::vector<int> idx{0, 1, 2, 3};
+  std::copy(corners.begin(), corners.end(), corners_.begin());
   // This part finds out if two of the points have equal y values. This may
   // not be very likely for some data, but if it happens it can produce
   // unpredictable outcome. If this is the case, the rectangle is rotated by
@@ -155,7 +269,7 @@ void findPointsInRectangle(std::vector<cv::Point2f>* corners,
   // Check all y values against all others.
   for (size_t i = 0; i < 4; ++i) {
     for(size_t j = i+1; j < 4; ++j) {
-      if (checkEqualFloats(corners->at(i).y, corners->at(j).y)){
+      if (checkEqualFloats(corners_.at(i).y, corners_.at(j).y)){
         some_points_have_equal_height = true;
         break;
       }
@@ -172,19 +286,19 @@ void findPointsInRectangle(std::vector<cv::Point2f>* corners,
                 << " and the sine of which is " << sin(rotation_rad) << ".";
       LOG(INFO) << "Before rotation:";
       for (size_t i = 0u; i < 4u; ++i) {
-        LOG(INFO) << "* (" << corners->at(i).x << ", " << corners->at(i).y
+        LOG(INFO) << "* (" << corners_.at(i).x << ", " << corners_.at(i).y
                   << ").";
       }
     }
     for (size_t i = 0u; i < 4u; ++i)
-      corners->at(i) = {
-          cos(rotation_rad) * corners->at(i).x - sin(rotation_rad) *
-          corners->at(i).y, sin(rotation_rad) * corners->at(i).x +
-          cos(rotation_rad) * corners->at(i).y};
+      corners_.at(i) = {
+          cos(rotation_rad) * corners_.at(i).x - sin(rotation_rad) *
+          corners_.at(i).y, sin(rotation_rad) * corners_.at(i).x +
+          cos(rotation_rad) * corners_.at(i).y};
     if(verbose) {
       LOG(INFO) << "After rotation:";
       for (size_t i = 0u; i < 4u; ++i) {
-        LOG(INFO) << "* (" << corners->at(i).x << ", " << corners->at(i).y
+        LOG(INFO) << "* (" << corners_.at(i).x << ", " << corners_.at(i).y
                   << ").";
       }
     }
@@ -194,29 +308,29 @@ void findPointsInRectangle(std::vector<cv::Point2f>* corners,
   // order. It does work because the preprocessing done guarantees that no two
   // points have the same y coordinate.
   cv::Point2f upper, lower, left, right;
-  upper = corners->at(0);
+  upper = corners_.at(0);
   for (int i = 1; i < 4; ++i) {
-    if (upper.y > corners->at(i).y) {
-      upper = corners->at(i);
+    if (upper.y > corners_.at(i).y) {
+      upper = corners_.at(i);
     }
   }
   lower.y = -1e6;
   for (int i = 0; i < 4; ++i) {
-    if (lower.y < corners->at(i).y && corners->at(i) != upper) {
-      lower = corners->at(i);
+    if (lower.y < corners_.at(i).y && corners_.at(i) != upper) {
+      lower = corners_.at(i);
     }
   }
   left.x = 1e6;
   for (int i = 0; i < 4; ++i) {
-    if (left.x > corners->at(i).x && corners->at(i) != upper &&
-        corners->at(i) != lower) {
-      left = corners->at(i);
+    if (left.x > corners_.at(i).x && corners_.at(i) != upper &&
+        corners_.at(i) != lower) {
+      left = corners_.at(i);
     }
   }
   for (int i = 0; i < 4; ++i) {
-    if (corners->at(i) != left && corners->at(i) != upper &&
-        corners->at(i) != lower) {
-      right = corners->at(i);
+    if (corners_.at(i) != left && corners_.at(i) != upper &&
+        corners_.at(i) != lower) {
+      right = corners_.at(i);
     }
   }
   if (verbose) {
@@ -226,33 +340,156 @@ void findPointsInRectangle(std::vector<cv::Point2f>* corners,
               << "Rightmost point is (" << right.x << ", " << right.y << ").";
   }
   // With the ordering given, the border pixels can be found as pixels, that
-  // lie on the border vectors.
-  std::vector<int> left_border;
-  std::vector<int> right_border;
-  findXCoordOfPixelsOnVector(upper, left, true, &left_border);
-  findXCoordOfPixelsOnVector(upper, right, false, &right_border);
-  // Pop_back is used because otherwise the corners [left/right] pixels would
-  // be counted twice.
-  left_border.pop_back();
-  right_border.pop_back();
-  findXCoordOfPixelsOnVector(left, lower, true, &left_border);
-  findXCoordOfPixelsOnVector(right, lower, false, &right_border);
-  if (left_border.size() > right_border.size()) {
-    left_border.pop_back();
-  } else if (left_border.size() < right_border.size()) {
-    right_border.pop_back();
-  }
-  CHECK_EQ(left_border.size(), right_border.size());
-  // Iterate over all pixels in the rectangle.
+  // lie on the border vectors. The corners [left/right] pixels are only
+  // counted once, i.e., on the lower edges.
+  upper_left_ = Edge(upper, left, true);
+  lower_left_ = Edge(left, lower, true);
+  upper_right_ = Edge(upper, right, false);
+  lower_right_ = Edge(right, lower, false);
+  const int num_rows_left = upper_left_.height - 1 + lower_left_.height;
+  const int num_rows_right = upper_right_.height - 1 + lower_right_.height;
+  CHECK_LE(abs(num_rows_left - num_rows_right), 1);
+  num_rows_ = std::min(num_rows_left, num_rows_right);
+  first_row_ = floor(upper.y);
+}
+
+void RectangleScanlines::getSpan(size_t i, int* x_start, int* x_end) const {
+  CHECK_LT(i, num_rows_);
+  const int row = i;
+  *x_start = row < upper_left_.height - 1 ?
+      upper_left_.x(row) : lower_left_.x(row - (upper_left_.height - 1));
+  *x_end = row < upper_right_.height - 1 ?
+      upper_right_.x(row) : lower_right_.x(row - (upper_right_.height - 1));
+  // Each row contains at least the pixel on the left border.
+  *x_end = std::max(*x_start, *x_end);
+}
+
+bool gatherPointsInRectangle(const std::vector<cv::Point2f>& corners,
+                             const cv::Mat& cloud,
+                             bool stop_at_point_without_depth,
+                             std::vector<cv::Vec3f>* points,
+                             std::vector<cv::Point2i>* pixels) {
+  CHECK_NOTNULL(points);
   points->clear();
-  int x, y;
-  for (size_t i = 0; i < left_border.size(); ++i) {
-    y = floor(upper.y) + i;
-    x = left_border[i];
-    do {
-      points->push_back(cv::Point2i(x, y));
-      ++x;
-    } while (x <= right_border[i]);
+  if (pixels != nullptr) pixels->clear();
+  return forEachValidPointInRectangle(
+      corners, cloud, [&](int row, int col, const cv::Vec3f& point) {
+        if (stop_at_point_without_depth &&
+            checkEqualPoints(point, {0.0f, 0.0f, 0.0f})) {
+          return false;
+        }
+        points->push_back(point);
+        if (pixels != nullptr) pixels->push_back(cv::Point2i(col, row));
+        return true;
+      });
+}
+
+bool gatherPointsInRectangle(const std::vector<cv::Point2f>& corners,
+                             DepthCloud* cloud,
+                             bool stop_at_point_without_depth,
+                             std::vector<cv::Vec3f>* points,
+                             std::vector<cv::Point2i>* pixels) {
+  CHECK_NOTNULL(points);
+  points->clear();
+  if (pixels != nullptr) pixels->clear();
+  return forEachValidPointInRectangle(
+      corners, cloud, [&](int row, int col, const cv::Vec3f& point) {
+        if (stop_at_point_without_depth &&
+            checkEqualPoints(point, {0.0f, 0.0f, 0.0f})) {
+          return false;
+        }
+        points->push_back(point);
+        if (pixels != nullptr) pixels->push_back(cv::Point2i(col, row));
+        return true;
+      });
+}
+
+bool gatherPointsInRectangle(const std::vector<cv::Point2f>& corners,
+                             FrameContext* frame,
+                             bool stop_at_point_without_depth,
+                             std::vector<cv::Vec3f>* points) {
+  CHECK_NOTNULL(frame);
+  CHECK_NOTNULL(points);
+  DepthCloud* depth_cloud = frame->getDepthCloud();
+  if (depth_cloud != nullptr) {
+    // The validity mask would require the whole cloud.
+    return gatherPointsInRectangle(corners, depth_cloud,
+                                   stop_at_point_without_depth, points);
+  }
+  points->clear();
+  const cv::Mat& cloud = frame->getCloud();
+  const cv::Mat& validity_mask = frame->getValidityMask();
+  const RectangleScanlines scanlines(corners);
+  int x_start, x_end;
+  for (size_t i = 0; i < scanlines.getNumRows(); ++i) {
+    const int row = scanlines.getFirstRow() + i;
+    if (row < 0 || row >= cloud.rows) continue;
+    scanlines.getSpan(i, &x_start, &x_end);
+    x_start = std::max(x_start, 0);
+    x_end = std::min(x_end, cloud.cols - 1);
+    const cv::Vec3f* cloud_row = cloud.ptr<cv::Vec3f>(row);
+    const uchar* mask_row = validity_mask.ptr<uchar>(row);
+    for (int col = x_start; col <= x_end; ++col) {
+      if (mask_row[col] == 0) continue;
+      if (stop_at_point_without_depth &&
+          (mask_row[col] & FrameContext::kPointWithoutDepth)) {
+        return false;
+      }
+      points->push_back(cloud_row[col]);
+    }
+  }
+  return true;
+}
+
+void sampleStratifiedPointsInRectangle(const std::vector<cv::Point2f>& corners,
+                                       const std::vector<cv::Vec3f>& points,
+                                       const std::vector<cv::Point2i>& pixels,
+                                       size_t max_points,
+                                       std::vector<cv::Vec3f>* samples) {
+  CHECK_NOTNULL(samples);
+  CHECK_EQ(corners.size(), 4);
+  CHECK_EQ(points.size(), pixels.size());
+  CHECK_GT(max_points, 0);
+  samples->clear();
+  const cv::Point2f along = corners[2] - corners[0];
+  const cv::Point2f across = corners[1] - corners[0];
+  const double length = cv::norm(along);
+  const double width = cv::norm(across);
+  if (length < 1e-6 || width < 1e-6) return;
+  // Square cells, as many as possible up to max_points.
+  const double cell_size = std::sqrt(length * width / max_points);
+  const size_t num_cells_along = std::min<size_t>(
+      max_points, std::max<size_t>(1, static_cast<size_t>(length / cell_size)));
+  const size_t num_cells_across = std::max<size_t>(
+      1, std::min<size_t>(static_cast<size_t>(width / cell_size),
+                          max_points / num_cells_along));
+  std::vector<float> distances(num_cells_along * num_cells_across,
+                               std::numeric_limits<float>::max());
+  std::vector<size_t> nearest(distances.size());
+  const cv::Point2f along_normalized = along * (1.0f / (length * length));
+  const cv::Point2f across_normalized = across * (1.0f / (width * width));
+  for (size_t k = 0; k < points.size(); ++k) {
+    if (checkEqualPoints(points[k], {0.0f, 0.0f, 0.0f})) continue;
+    // Coordinates of the pixel in cells.
+    const cv::Point2f pixel = cv::Point2f(pixels[k]) - corners[0];
+    const float u = pixel.dot(along_normalized) * num_cells_along;
+    const float v = pixel.dot(across_normalized) * num_cells_across;
+    const size_t i = std::min<size_t>(
+        num_cells_along - 1, static_cast<size_t>(std::max(u, 0.0f)));
+    const size_t j = std::min<size_t>(
+        num_cells_across - 1, static_cast<size_t>(std::max(v, 0.0f)));
+    const float du = u - i - 0.5f;
+    const float dv = v - j - 0.5f;
+    const size_t cell = i * num_cells_across + j;
+    if (du * du + dv * dv < distances[cell]) {
+      distances[cell] = du * du + dv * dv;
+      nearest[cell] = k;
+    }
+  }
+  for (size_t cell = 0; cell < nearest.size(); ++cell) {
+    if (distances[cell] < std::numeric_limits<float>::max()) {
+      samples->push_back(points[nearest[cell]]);
+    }
   }
 }
 
@@ -425,6 +662,16 @@ LineDetector::LineDetector(LineDetectionParams* params) {
   params_ = params;
   params_is_mine_ = false;
 }
+LineDetector::LineDetector(const LineDetector& parent, WorkerTag) {
+  params_ = parent.params_;
+  params_is_mine_ = false;
+  visualization_mode_on_ = parent.visualization_mode_on_;
+  verbose_mode_on_ = parent.verbose_mode_on_;
+  integral_plane_fitter_ = parent.integral_plane_fitter_;
+  plane_segmentation_ = parent.plane_segmentation_;
+  depth_cloud_ = parent.depth_cloud_;
+  depth_edge_detector_.setParams(parent.depth_edge_detector_.getParams());
+}
 LineDetector::~LineDetector() {
   if (params_is_mine_) {
     delete params_;
@@ -441,6 +688,8 @@ void LineDetector::detectLines(const cv::Mat& image, int detector,
     detectLines(image, DetectorType::FAST, lines);
   else if (detector == 3)
     detectLines(image, DetectorType::HOUGH, lines);
+  else if (detector == 4)
+    detectLines(image, DetectorType::DEPTH, lines);
   else {
     LOG(WARNING)
         << "LineDetector::detectLines: DetectorType choice not valid, LSD was "
@@ -452,7 +701,54 @@ void LineDetector::detectLines(const cv::Mat& image, int detector,
 void LineDetector::detectLines(const cv::Mat& image, DetectorType detector,
                                std::vector<cv::Vec4f>* lines) {
   CHECK_NOTNULL(lines);
+  if (params_->detection_pyramid_level > 0 && isSegmentDetector(detector)) {
+    detectLinesOnPyramid(image, detector, lines);
+  } else {
+    detectLinesAtScale(image, detector, lines);
+  }
+}
+
+void LineDetector::detectLinesOnPyramid(const cv::Mat& image,
+                                        DetectorType detector,
+                                        std::vector<cv::Vec4f>* lines) {
+  CHECK_NOTNULL(lines);
+  CHECK_EQ(image.type(), CV_8UC1);
+  cv::Mat downsampled_image = image;
+  int scale = 1;
+  for (unsigned int level = 0; level < params_->detection_pyramid_level;
+       ++level) {
+    if (downsampled_image.cols < 2 || downsampled_image.rows < 2) break;
+    cv::pyrDown(downsampled_image, downsampled_image);
+    scale *= 2;
+  }
+  detectLinesAtScale(downsampled_image, detector, lines);
+  // The error of the lines is up to about one pixel of the downsampled image,
+  // i.e. scale pixels of the image.
+  LineRefinementParams refinement_params;
+  refinement_params.search_radius = scale;
+  refinement_params.max_endpoint_shift = scale;
+  cv::Vec4f refined_line;
+  for (cv::Vec4f& line : *lines) {
+    // cv::pyrDown centers pixel (i, j) of the downsampled image on pixel
+    // (2 * i, 2 * j) of the image.
+    line *= static_cast<float>(scale);
+    if (refineLine2D(image, line, refinement_params, &refined_line)) {
+      line = refined_line;
+    }
+  }
+}
+
+void LineDetector::detectLinesAtScale(const cv::Mat& image,
+                                      DetectorType detector,
+                                      std::vector<cv::Vec4f>* lines) {
+  CHECK_NOTNULL(lines);
   lines->clear();
+  const int tile_size = params_->detection_tile_size;
+  if (tile_size > 0 && (image.cols > tile_size || image.rows > tile_size) &&
+      isSegmentDetector(detector)) {
+    detectLinesOnTiles(image, detector, lines);
+    return;
+  }
   // Check which detector is chosen by user. If an invalid number is given the
   // default (LSD) is chosen without a warning.
   if (detector == DetectorType::LSD) {
@@ -484,6 +780,9 @@ void LineDetector::detectLines(const cv::Mat& image, DetectorType detector,
                     params_->hough_detector_threshold,
                     params_->hough_detector_minLineLength,
                     params_->hough_detector_maxLineGap);
+  } else if (detector == DetectorType::DEPTH) {
+    depth_edge_detector_.setParams(getDepthEdgeDetectorParams());
+    depth_edge_detector_.detect(image, lines);
   }
 }
 void LineDetector::detectLines(const cv::Mat& image,
@@ -491,6 +790,114 @@ void LineDetector::detectLines(const cv::Mat& image,
   detectLines(image, DetectorType::LSD, lines);
 }
 
+void LineDetector::detectLinesOnTiles(const cv::Mat& image,
+                                      DetectorType detector,
+                                      std::vector<cv::Vec4f>* lines) {
+  CHECK_NOTNULL(lines);
+  lines->clear();
+  const int tile_size = params_->detection_tile_size;
+  const int overlap = params_->detection_tile_overlap;
+  const cv::Rect image_rect(0, 0, image.cols, image.rows);
+  // The cores of the tiles form a partition of the image. Each tile extends
+  // its core by the overlap on every side.
+  std::vector<cv::Rect> cores;
+  for (int y = 0; y < image.rows; y += tile_size) {
+    for (int x = 0; x < image.cols; x += tile_size) {
+      cores.emplace_back(x, y, std::min(tile_size, image.cols - x),
+                         std::min(tile_size, image.rows - y));
+    }
+  }
+  const size_t num_threads = std::max<size_t>(
+      1u, std::min<size_t>(params_->num_threads_detection, cores.size()));
+  if (tile_detectors_.size() < num_threads) {
+    tile_detectors_.resize(num_threads);
+  }
+  std::vector<std::vector<cv::Vec4f>> lines_per_tile(cores.size());
+  std::atomic<size_t> next_tile(0);
+  auto detect_on_tiles = [&](TileDetectors* detectors) {
+    size_t i;
+    std::vector<cv::line_descriptor::KeyLine> edl_lines;
+    while ((i = next_tile.fetch_add(1)) < cores.size()) {
+      const cv::Rect tile(cores[i].x - overlap, cores[i].y - overlap,
+                          cores[i].width + 2 * overlap,
+                          cores[i].height + 2 * overlap);
+      const cv::Rect clipped_tile = tile & image_rect;
+      const cv::Mat tile_image = image(clipped_tile);
+      std::vector<cv::Vec4f>& tile_lines = lines_per_tile[i];
+      if (detector == DetectorType::LSD) {
+        if (!detectors->lsd) {
+          detectors->lsd = cv::createLineSegmentDetector(cv::LSD_REFINE_STD);
+        }
+        detectors->lsd->detect(tile_image, tile_lines);
+      } else if (detector == DetectorType::EDL) {
+        if (!detectors->edl) {
+          detectors->edl =
+              cv::line_descriptor::BinaryDescriptor::createBinaryDescriptor();
+        }
+        detectors->edl->detect(tile_image, edl_lines);
+        tile_lines.clear();
+        for (const cv::line_descriptor::KeyLine& edl_line : edl_lines) {
+          tile_lines.push_back(cv::Vec4f(
+              edl_line.getStartPoint().x, edl_line.getStartPoint().y,
+              edl_line.getEndPoint().x, edl_line.getEndPoint().y));
+        }
+      } else {
+        if (!detectors->fast) {
+          detectors->fast = cv::ximgproc::createFastLineDetector();
+        }
+        detectors->fast->detect(tile_image, tile_lines);
+      }
+      for (cv::Vec4f& line : tile_lines) {
+        line[0] += clipped_tile.x;
+        line[1] += clipped_tile.y;
+        line[2] += clipped_tile.x;
+        line[3] += clipped_tile.y;
+      }
+    }
+  };
+  if (num_threads == 1) {
+    detect_on_tiles(&tile_detectors_[0]);
+  } else {
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (size_t t = 0; t < num_threads; ++t) {
+      threads.emplace_back(detect_on_tiles, &tile_detectors_[t]);
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+
+  // The lines that lie in the core of their tile, farther than the overlap
+  // from the borders shared with other tiles, are not seen by any other tile
+  // and are kept as they are. The others can be duplicated or cut at the
+  // borders of the tiles and are stitched.
+  std::vector<cv::Vec4f> lines_at_seams;
+  for (size_t i = 0; i < cores.size(); ++i) {
+    const cv::Rect& core = cores[i];
+    const float margin = overlap + 1.0f;
+    const float x_min = core.x == 0 ? 0.0f : core.x + margin;
+    const float y_min = core.y == 0 ? 0.0f : core.y + margin;
+    const float x_max =
+        core.br().x == image.cols ? image.cols : core.br().x - margin;
+    const float y_max =
+        core.br().y == image.rows ? image.rows : core.br().y - margin;
+    for (const cv::Vec4f& line : lines_per_tile[i]) {
+      if (std::min(line[0], line[2]) >= x_min &&
+          std::max(line[0], line[2]) <= x_max &&
+          std::min(line[1], line[3]) >= y_min &&
+          std::max(line[1], line[3]) <= y_max) {
+        lines->push_back(line);
+      } else {
+        lines_at_seams.push_back(line);
+      }
+    }
+  }
+  std::vector<cv::Vec4f> stitched_lines;
+  stitchLines2DAtTileSeams(lines_at_seams, &stitched_lines);
+  lines->insert(lines->end(), stitched_lines.begin(), stitched_lines.end());
+}
+
 void LineDetector::detectLines(
     const cv::Mat& image,
     std::vector<cv::line_descriptor::KeyLine>* keylines) {
@@ -502,6 +909,23 @@ void LineDetector::detectLines(
   *keylines = edl_lines;
 }
 
+void LineDetector::detectLines(FrameContext* frame, int detector,
+                               std::vector<cv::Vec4f>* lines) {
+  CHECK_NOTNULL(frame);
+  CHECK_NOTNULL(lines);
+  if (detector == static_cast<int>(DetectorType::DEPTH)) {
+    detectLines(frame->getCloud(), DetectorType::DEPTH, lines);
+    return;
+  }
+  detectLines(frame->getGrayImage(), detector, lines);
+  if (params_->detect_depth_edge_lines) {
+    std::vector<cv::Vec4f> depth_edge_lines;
+    detectLines(frame->getCloud(), DetectorType::DEPTH, &depth_edge_lines);
+    lines->insert(lines->end(), depth_edge_lines.begin(),
+                  depth_edge_lines.end());
+  }
+}
+
 bool LineDetector::hessianNormalFormOfPlane(
     const std::vector<cv::Vec3f>& points, cv::Vec4f* hessian_normal_form) {
   CHECK_NOTNULL(hessian_normal_form);
@@ -527,28 +951,11 @@ bool LineDetector::hessianNormalFormOfPlane(
     *hessian_normal_form = (*hessian_normal_form) / cv::norm(normal);
     return true;
   } else {  // If there are more than 3 points, the solution is approximate.
-    cv::Vec3f mean(0.0f, 0.0f, 0.0f);
-    for (int i = 0; i < num_points; ++i) {
-      mean += points[i] / num_points;
-    }
-    cv::Mat A(3, num_points, CV_64FC1);
-    for (size_t i = 0u; i < static_cast<size_t>(num_points); ++i) {
-      A.at<double>(0, i) = points[i][0] - mean[0];
-      A.at<double>(1, i) = points[i][1] - mean[1];
-      A.at<double>(2, i) = points[i][2] - mean[2];
-    }
-    cv::Mat U, W, Vt;
-    cv::SVD::compute(A, W, U, Vt);
-    cv::Vec3f normal;
-    if (U.type() == CV_64FC1) {
-      normal =
-          cv::Vec3f(U.at<double>(0, 2), U.at<double>(1, 2), U.at<double>(2, 2));
-    } else if (U.type() == CV_32FC1) {
-      normal =
-          cv::Vec3f(U.at<float>(0, 2), U.at<float>(1, 2), U.at<float>(2, 2));
-    }
-    *hessian_normal_form = cv::Vec4f(normal[0], normal[1], normal[2],
-                                     computeDfromPlaneNormal(normal, mean));
+    // Least-squares fit: the normal is the eigenvector of the smallest
+    // eigenvalue of the covariance matrix of the points.
+    CovariancePlaneFitter plane_fitter;
+    plane_fitter.addPoints(points);
+    plane_fitter.fit(hessian_normal_form);
     return true;
   }
 }
@@ -654,61 +1061,114 @@ void LineDetector::fuseLines2DAtTheEnd(const std::vector<cv::Vec4f>& lines_in,
 
 void LineDetector::fuseLines2DOnTheFly(const std::vector<cv::Vec4f>& lines_in,
                                        std::vector<cv::Vec4f>* lines_out) {
+  fuseLines2DOnTheFly(lines_in, sqrt(kMaxSqEndpointDistanceEqualLines2D),
+                      areLinesEqual2D, lines_out);
+}
+
+void LineDetector::stitchLines2DAtTileSeams(
+    const std::vector<cv::Vec4f>& lines_in,
+    std::vector<cv::Vec4f>* lines_out) {
+  // Maximum distance (in pixels) of the endpoints of a piece from the line of
+  // the other piece, and maximum gap between the pieces along the line.
+  constexpr double kMaxDistanceFromLine = 1.5;
+  constexpr double kMaxGap = 2.0;
+  // Two pieces of a line cut at a border are detected in the overlap of the
+  // tiles, on both sides of the border, and a duplicated line has the same
+  // endpoints in both tiles.
+  const double max_endpoint_distance =
+      params_->detection_tile_size + 2.0 * params_->detection_tile_overlap;
+  fuseLines2DOnTheFly(
+      lines_in, max_endpoint_distance,
+      [](const cv::Vec4f& line_1, const cv::Vec4f& line_2) {
+        return areLinesCollinear2D(line_1, line_2, kMaxDistanceFromLine,
+                                   kMaxGap);
+      },
+      lines_out);
+}
+
+void LineDetector::fuseLines2DOnTheFly(
+    const std::vector<cv::Vec4f>& lines_in, double max_endpoint_distance,
+    const std::function<bool(const cv::Vec4f&, const cv::Vec4f&)>&
+        are_lines_equal,
+    std::vector<cv::Vec4f>* lines_out) {
   CHECK_NOTNULL(lines_out);
   lines_out->clear();
 
-  std::list<cv::Vec4f> line_cluster;
-  // Iterate over all lines.
-  std::list<cv::Vec4f>::iterator old_line_it, current_line_it;
-  cv::Vec4f old_line, current_line;
-  bool current_line_is_in_cluster;
   // The principle is the following: at each iteration we keep so-called
   // "clusters", that represent either a single input line or the line obtained
   // by merging several lines that have close endpoints and similar directions.
   // At the start of each iteration the clusters are such that none of them can
   // be merged with any other cluster. At each iteration, a line "current_line"
-  // is compared with all the previously-formed clusters and either immediately
-  // merged into the matching clusters (therefore updating the 'receiving'
-  // cluster) or set to be a new cluster (if no matches with the previous
-  // clusters are found).
+  // is compared with all the previously-formed clusters, in the order in which
+  // they were formed, and either immediately merged into the matching clusters
+  // (therefore updating the 'receiving' cluster) or set to be a new cluster
+  // (if no matches with the previous clusters are found).
+  // The clusters are stored in the order in which they were formed, and only
+  // the ones returned by the spatial index (i.e., with nearby endpoints and a
+  // similar orientation) are actually compared with current_line.
+  std::vector<cv::Vec4f> line_cluster;
+  // False for the clusters that were merged into another cluster.
+  std::vector<bool> cluster_is_active;
+  LineFusionIndex index(max_endpoint_distance,
+                        acos(sqrt(kMinCosSqAngleDifferenceEqualLines2D)));
+  std::vector<size_t> candidates;
+  cv::Vec4f current_line;
   for (size_t line_idx = 0; line_idx < lines_in.size(); ++line_idx) {
     // At first, current_line is initialized to the input line considered at
     // this iteration.
     current_line = lines_in[line_idx];
-    current_line_is_in_cluster = false;
-    for (old_line_it = line_cluster.begin(); old_line_it != line_cluster.end();
-         ++old_line_it) {
-      old_line = *old_line_it;
-      // Compare current_line with each previously-formed cluster.
-      if (areLinesEqual2D(current_line, old_line)) {
+    bool current_line_is_in_cluster = false;
+    size_t current_cluster = 0;
+    // Only the clusters formed after the one into which current_line was last
+    // merged are compared with it.
+    size_t first_cluster_to_compare = 0;
+    bool merged;
+    do {
+      merged = false;
+      index.findCandidates(current_line, &candidates);
+      for (const size_t cluster : candidates) {
+        if (cluster < first_cluster_to_compare ||
+            !cluster_is_active[cluster]) {
+          continue;
+        }
+        // Compare current_line with each previously-formed cluster.
+        if (!are_lines_equal(current_line, line_cluster[cluster])) continue;
         // Merge current line into the previously-formed cluster.
-        *old_line_it = mergeLines2D(current_line, old_line);
-        current_line = *old_line_it;
+        line_cluster[cluster] =
+            mergeLines2D(current_line, line_cluster[cluster]);
+        current_line = line_cluster[cluster];
+        index.insert(cluster, current_line);
         // If current_line is a cluster, i.e., the input line was already merged
-        // to another cluster old_line in the same iteration, remove the cluster
-        // to which the line was previously merged (old_line), since it has now
-        // itself been merged into the newly found cluster.
+        // to another cluster in the same iteration, remove the cluster to which
+        // the line was previously merged, since it has now itself been merged
+        // into the newly found cluster.
         if (current_line_is_in_cluster) {
-          line_cluster.erase(current_line_it);
+          cluster_is_active[current_cluster] = false;
         }
-        // Update current_line to be the cluster into which the input line/the
-        // older cluster was merged.
         current_line_is_in_cluster = true;
-        current_line_it = old_line_it;
+        current_cluster = cluster;
+        first_cluster_to_compare = cluster + 1;
+        // The merged line can match clusters that were not candidates before.
+        merged = true;
+        break;
       }
-    }
-    // The input line cannot be merged into any of the previoùsly-found
+    } while (merged);
+    // The input line cannot be merged into any of the previously-found
     // clusters.
     if (!current_line_is_in_cluster) {
       // Add the input line as a new cluster.
+      index.insert(line_cluster.size(), current_line);
       line_cluster.push_back(current_line);
+      cluster_is_active.push_back(true);
     }
   }
   // Return the clusters left, that by construction are all disconnected
   // components, in the sense that they cannot be merged into one another.
-  *lines_out = std::vector<cv::Vec4f> (
-      std::make_move_iterator(std::begin(line_cluster)),
-      std::make_move_iterator(std::end(line_cluster)));
+  for (size_t i = 0; i < line_cluster.size(); ++i) {
+    if (cluster_is_active[i]) {
+      lines_out->push_back(line_cluster[i]);
+    }
+  }
 }
 
 cv::Vec4f LineDetector::mergeLines2D(const cv::Vec4f& line_1,
@@ -1212,6 +1672,12 @@ bool LineDetector::getRectanglesFromLine(const cv::Vec4f& line,
   cv::Point2f go_left(-line_dir.y, line_dir.x);
   cv::Point2f go_right(line_dir.y, -line_dir.x);
   double norm = cv::norm(line_dir);
+  if (norm == 0.0) {
+    // The rectangles are undefined, collapse them onto the single point.
+    rect_left->assign(4, start);
+    rect_right->assign(4, start);
+    return false;
+  }
   if (eff_rect_size > norm * relative_rect_size)
     eff_rect_size = norm * relative_rect_size;
   rect_left->resize(4);
@@ -1224,7 +1690,7 @@ bool LineDetector::getRectanglesFromLine(const cv::Vec4f& line,
   (*rect_right)[1] = start + (offset + eff_rect_size) / norm * go_right;
   (*rect_right)[2] = end + offset / norm * go_right;
   (*rect_right)[3] = end + (offset + eff_rect_size) / norm * go_right;
-  // TODO(ff): Check if function needs to be of non void return type.
+  return true;
 }
 
 void LineDetector::assignColorToLines(const cv::Mat& image,
@@ -1248,6 +1714,35 @@ void LineDetector::assignColorToLines(const cv::Mat& image,
                             static_cast<unsigned char>(x3 / num_points)});
 }
 
+void LineDetector::assignColorToLines(const cv::Mat& image,
+                                      const std::vector<cv::Point2f>& rect,
+                                      LineWithPlanes* line3D) {
+  CHECK_NOTNULL(line3D);
+  CHECK_EQ(image.type(), CV_8UC3);
+  const RectangleScanlines scanlines(rect);
+  long long x1 = 0, x2 = 0, x3 = 0;
+  int num_points = 0;
+  int x_start, x_end;
+  for (size_t i = 0; i < scanlines.getNumRows(); ++i) {
+    scanlines.getSpan(i, &x_start, &x_end);
+    // As in the overload above, the average is taken over all the pixels in
+    // the rectangle, also those outside the image.
+    num_points += x_end - x_start + 1;
+    const int row = scanlines.getFirstRow() + i;
+    if (row < 0 || row >= image.rows) continue;
+    const cv::Vec3b* image_row = image.ptr<cv::Vec3b>(row);
+    for (int x = std::max(x_start, 0); x <= std::min(x_end, image.cols - 1);
+         ++x) {
+      x1 += image_row[x][0];
+      x2 += image_row[x][1];
+      x3 += image_row[x][2];
+    }
+  }
+  line3D->colors.push_back({static_cast<unsigned char>(x1 / num_points),
+                            static_cast<unsigned char>(x2 / num_points),
+                            static_cast<unsigned char>(x3 / num_points)});
+}
+
 // DEPRECATED
 bool LineDetector::find3DlineOnPlanes(const std::vector<cv::Vec3f>& points1,
                                       const std::vector<cv::Vec3f>& points2,
@@ -1433,22 +1928,20 @@ bool LineDetector::find3DlineOnPlanes(const std::vector<cv::Vec3f>& points1,
   if (fabs((mean1 - mean2).dot(normal1)) < params_->max_dist_between_planes &&
       fabs((mean1 - mean2).dot(normal2)) < params_->max_dist_between_planes &&
       planes_found) {
-    // Concatenate the two sets of points. For surface and intersection line,
-    // points1 and points2 are different and thus no repetition of points. The
-    // latter is also ensured by the fact that planes_found is True.
-    std::vector<cv::Vec3f> points;
-    points.reserve(points1.size() + points2.size());
-    points.insert(points.end(), points1.begin(), points1.end());
-    points.insert(points.end(), points2.begin(), points2.end());
-
     // Checks if the planes are parallel. If the angle between the two planes'
     // normal vectors is small, they are parallel and the line is surface
     // line.
-    constexpr double kAngleDifference = 0.95;
     // NOTE: since the two normal vectors have unitary norm by definition of
     // Hessian normal form, their dot product is the cosine of the angle between
     // them.
-    if (fabs(normal1.dot(normal2)) > kAngleDifference) {
+    if (fabs(normal1.dot(normal2)) > kMinCosAngleParallelPlanes) {
+      // Concatenate the two sets of points. For surface and intersection line,
+      // points1 and points2 are different and thus no repetition of points.
+      // The latter is also ensured by the fact that planes_found is True.
+      std::vector<cv::Vec3f> points;
+      points.reserve(points1.size() + points2.size());
+      points.insert(points.end(), points1.begin(), points1.end());
+      points.insert(points.end(), points2.begin(), points2.end());
       enough_num_inliers =
           adjustLineUsingInliers(points, start_init_guess, end_init_guess,
                                  &start_readjusted_line, &end_readjusted_line);
@@ -1487,7 +1980,7 @@ bool LineDetector::find3DlineOnPlanes(const std::vector<cv::Vec3f>& points1,
         if (verbose_mode_on_) {
           LOG(INFO) << "* Line is assigned PLANE type.";
         }
-        num_planar_lines++;
+        statistics_.num_planar_lines++;
         return true;
       } else {
         if (verbose_mode_on_) {
@@ -1506,77 +1999,10 @@ bool LineDetector::find3DlineOnPlanes(const std::vector<cv::Vec3f>& points1,
       cv::Vec3f x_0;
       getPointOnPlaneIntersectionLine(line->hessians[0], line->hessians[1],
                                       direction, &x_0);
-      cv::Vec3f start_guess = x_0;
-      cv::Vec3f end_guess = x_0 + direction;
-
-      enough_num_inliers =
-          adjustLineUsingInliers(points, start_guess, end_guess,
-                                 &start_readjusted_line, &end_readjusted_line);
-      // Fix orientation w.r.t. reference line if needed.
-      adjustLineOrientationGiven2DReferenceLine(reference_line_2D, camera_P,
-                                                &start_readjusted_line,
-                                                &end_readjusted_line);
-
-      if (!enough_num_inliers) {
-        if (verbose_mode_on_) {
-          LOG(INFO) << "* Line is discarded because too few inliers were "
-                    << "found.";
-        }
-        return false;
-      }
-      enough_inliers_around_center =
-          checkIfValidLineUsingInliers(points, start_readjusted_line,
-                                       end_readjusted_line);
-      if (!enough_inliers_around_center){
-        if (verbose_mode_on_) {
-          LOG(INFO) << "* Line is discarded because too few inliers were found "
-                    << "around the center.";
-        }
-        return false;
-      }
-
-      line->line = {start_readjusted_line[0], start_readjusted_line[1],
-                    start_readjusted_line[2], end_readjusted_line[0],
-                    end_readjusted_line[1], end_readjusted_line[2]};
-
-      if (visualization_mode_on_) {
-        // Project line re-adjusted through inliers in 2D and add it to the
-        // background image.
-        project3DLineTo2D(*line, camera_P, &readjusted_line_reprojected);
-        readjusted_line_reprojected = fitLineToBounds(
-            readjusted_line_reprojected, cloud.cols, cloud.rows);
-       // Update background image.
-        background_image_ = getImageOfLine(readjusted_line_reprojected,
-                                           background_image_, 1);
-        LOG(INFO) << "* Displaying candidate edge/intersection line in 3D with "
-                  << "inliers.";
-        displayLineWithPointsAndPlanes(start_readjusted_line,
-                                       end_readjusted_line, start_init_guess,
-                                       end_init_guess, points1, points2,
-                                       line->hessians[0], line->hessians[1]);
-      }
-
-      // Line can now be either an edge or on an intersection line.
-      if (!assignEdgeOrIntersectionLineType(cloud, camera_P, points1, points2,
-                                            line)) {
-        if (verbose_mode_on_) {
-          LOG(ERROR) << "Could not assign neither edge- nor intersection- line "
-                     << "type to line (" << line->line[0] << ", "
-                     << line->line[1] << ", " << line->line[2] << ") -- ("
-                     << line->line[3] << ", " << line->line[4] << ", "
-                     << line->line[5] << ")";
-        }
-        return false;
-      } else {
-        if (verbose_mode_on_) {
-          LOG(INFO) << "Successfully determined type "
-                    << (line->type==LineType::EDGE ? "EDGE " : "INTERSECT ")
-                    << "for line (" << line->line[0] << ", " << line->line[1]
-                    << ", " << line->line[2] << ") -- (" << line->line[3]
-                    << ", " << line->line[4] << ", " << line->line[5] << ")";
-        }
-        return true;
-      }
+      return find3DEdgeOrIntersectionLine(points1, points2, x_0,
+                                          x_0 + direction, true, line_guess,
+                                          reference_line_2D, cloud, camera_P,
+                                          line);
     }
   } else {
     // If we reach this point, we have a discontinuity. We then try to fit a
@@ -1648,7 +2074,7 @@ bool LineDetector::find3DlineOnPlanes(const std::vector<cv::Vec3f>& points1,
       if (verbose_mode_on_) {
         LOG(INFO) << "* Line is assigned DISCONT type.";
       }
-      num_discontinuity_lines++;
+      statistics_.num_discontinuity_lines++;
       return true;
     } else {
       if (verbose_mode_on_) {
@@ -1660,6 +2086,102 @@ bool LineDetector::find3DlineOnPlanes(const std::vector<cv::Vec3f>& points1,
   }
 }
 
+bool LineDetector::find3DEdgeOrIntersectionLine(
+    const std::vector<cv::Vec3f>& points1,
+    const std::vector<cv::Vec3f>& points2, const cv::Vec3f& start_guess,
+    const cv::Vec3f& end_guess, bool adjust_endpoints,
+    const cv::Vec6f& line_guess, const cv::Vec4f& reference_line_2D,
+    const cv::Mat& cloud, const cv::Mat& camera_P, LineWithPlanes* line) {
+  CHECK_NOTNULL(line);
+  bool enough_num_inliers = true;
+  bool enough_inliers_around_center;
+  cv::Vec3f start_readjusted_line, end_readjusted_line;
+  cv::Vec4f readjusted_line_reprojected;
+  const cv::Vec3f start_init_guess = {line_guess[0], line_guess[1],
+                                      line_guess[2]};
+  const cv::Vec3f end_init_guess = {line_guess[3], line_guess[4],
+                                    line_guess[5]};
+  // Concatenate the two sets of points (cf. find3DlineOnPlanes).
+  std::vector<cv::Vec3f> points;
+  points.reserve(points1.size() + points2.size());
+  points.insert(points.end(), points1.begin(), points1.end());
+  points.insert(points.end(), points2.begin(), points2.end());
+
+  if (adjust_endpoints) {
+    enough_num_inliers =
+        adjustLineUsingInliers(points, start_guess, end_guess,
+                               &start_readjusted_line, &end_readjusted_line);
+  } else {
+    start_readjusted_line = start_guess;
+    end_readjusted_line = end_guess;
+  }
+  // Fix orientation w.r.t. reference line if needed.
+  adjustLineOrientationGiven2DReferenceLine(reference_line_2D, camera_P,
+                                            &start_readjusted_line,
+                                            &end_readjusted_line);
+
+  if (!enough_num_inliers) {
+    if (verbose_mode_on_) {
+      LOG(INFO) << "* Line is discarded because too few inliers were "
+                << "found.";
+    }
+    return false;
+  }
+  enough_inliers_around_center =
+      checkIfValidLineUsingInliers(points, start_readjusted_line,
+                                   end_readjusted_line);
+  if (!enough_inliers_around_center){
+    if (verbose_mode_on_) {
+      LOG(INFO) << "* Line is discarded because too few inliers were found "
+                << "around the center.";
+    }
+    return false;
+  }
+
+  line->line = {start_readjusted_line[0], start_readjusted_line[1],
+                start_readjusted_line[2], end_readjusted_line[0],
+                end_readjusted_line[1], end_readjusted_line[2]};
+
+  if (visualization_mode_on_) {
+    // Project line re-adjusted through inliers in 2D and add it to the
+    // background image.
+    project3DLineTo2D(*line, camera_P, &readjusted_line_reprojected);
+    readjusted_line_reprojected = fitLineToBounds(
+        readjusted_line_reprojected, cloud.cols, cloud.rows);
+    // Update background image.
+    background_image_ = getImageOfLine(readjusted_line_reprojected,
+                                       background_image_, 1);
+    LOG(INFO) << "* Displaying candidate edge/intersection line in 3D with "
+              << "inliers.";
+    displayLineWithPointsAndPlanes(start_readjusted_line,
+                                   end_readjusted_line, start_init_guess,
+                                   end_init_guess, points1, points2,
+                                   line->hessians[0], line->hessians[1]);
+  }
+
+  // Line can now be either an edge or on an intersection line.
+  if (!assignEdgeOrIntersectionLineType(cloud, camera_P, points1, points2,
+                                        line)) {
+    if (verbose_mode_on_) {
+      LOG(ERROR) << "Could not assign neither edge- nor intersection- line "
+                 << "type to line (" << line->line[0] << ", "
+                 << line->line[1] << ", " << line->line[2] << ") -- ("
+                 << line->line[3] << ", " << line->line[4] << ", "
+                 << line->line[5] << ")";
+    }
+    return false;
+  } else {
+    if (verbose_mode_on_) {
+      LOG(INFO) << "Successfully determined type "
+                << (line->type==LineType::EDGE ? "EDGE " : "INTERSECT ")
+                << "for line (" << line->line[0] << ", " << line->line[1]
+                << ", " << line->line[2] << ") -- (" << line->line[3]
+                << ", " << line->line[4] << ", " << line->line[5] << ")";
+    }
+    return true;
+  }
+}
+
 bool LineDetector::assignEdgeOrIntersectionLineType(const cv::Mat& cloud,
     const cv::Mat& camera_P, const std::vector<cv::Vec3f>& inliers_right,
     const std::vector<cv::Vec3f>& inliers_left, LineWithPlanes* line) {
@@ -1683,7 +2205,13 @@ bool LineDetector::assignEdgeOrIntersectionLineType(const cv::Mat& cloud,
       if (convex_true_concave_false) {
         // Convex => Edge.
         line->type = LineType::EDGE;
-        num_edge_lines++;
+        statistics_.num_edge_lines++;
+        return true;
+      }
+      if (!(params_->line_outputs & kLineOutputType)) {
+        // The full classification is not requested.
+        line->type = LineType::INTERSECT;
+        statistics_.num_intersection_lines++;
         return true;
       }
   } else {
@@ -1788,12 +2316,12 @@ bool LineDetector::assignEdgeOrIntersectionLineType(const cv::Mat& cloud,
   // - All other cases -> Intersection line.
   if (point_planes_config == "0000") {
     line->type = LineType::EDGE;
-    num_edge_lines++;
-    occurrences_config_prolonged_plane[0][0][0][0]++;
+    statistics_.num_edge_lines++;
+    statistics_.occurrences_config_prolonged_plane[0][0][0][0]++;
   } else if (point_planes_config == "1111") {
     line->type = LineType::EDGE;
-    num_edge_lines++;
-    occurrences_config_prolonged_plane[1][1][1][1]++;
+    statistics_.num_edge_lines++;
+    statistics_.occurrences_config_prolonged_plane[1][1][1][1]++;
   } else {
     if (verbose_mode_on_) {
       LOG(INFO) << "The current line (of intersection type) has the following "
@@ -1802,26 +2330,26 @@ bool LineDetector::assignEdgeOrIntersectionLineType(const cv::Mat& cloud,
     }
     if (point_planes_config == "0001" || point_planes_config == "0010" ||
         point_planes_config == "0100" || point_planes_config == "1000") {
-      occurrences_config_prolonged_plane[1][0][0][0]++;
+      statistics_.occurrences_config_prolonged_plane[1][0][0][0]++;
     } else if (point_planes_config == "1100" || point_planes_config == "0011") {
-      occurrences_config_prolonged_plane[1][1][0][0]++;
+      statistics_.occurrences_config_prolonged_plane[1][1][0][0]++;
     } else if (point_planes_config == "1010" || point_planes_config == "0101") {
-      occurrences_config_prolonged_plane[1][0][1][0]++;
+      statistics_.occurrences_config_prolonged_plane[1][0][1][0]++;
     } else if (point_planes_config == "1001" || point_planes_config == "0110") {
-      occurrences_config_prolonged_plane[1][0][0][1]++;
+      statistics_.occurrences_config_prolonged_plane[1][0][0][1]++;
       if (verbose_mode_on_) {
         LOG(WARNING) << "Note: The configuration is one of the strange ones.";
       }
     } else if (point_planes_config == "1110" || point_planes_config == "1101" ||
                point_planes_config == "1011" || point_planes_config == "0111") {
-      occurrences_config_prolonged_plane[1][1][1][0]++;
+      statistics_.occurrences_config_prolonged_plane[1][1][1][0]++;
     } else {
       LOG(ERROR) << "Found a case for the configuration valid points/prolonged "
                  << "planes that should be impossible.";
       return false;
     }
     line->type = LineType::INTERSECT;
-    num_intersection_lines++;
+    statistics_.num_intersection_lines++;
   }
   return true;
 }
@@ -1897,7 +2425,7 @@ bool LineDetector::determineConvexityFromViewpointGivenLineAndInlierPoints(
                  << hessians[1][0] << ", " << hessians[1][1] << ", "
                  << hessians[1][2] << ", " << hessians[1][3] << "].";
     }
-    num_lines_discarded_for_convexity_concavity++;
+    statistics_.num_lines_discarded_for_convexity_concavity++;
     return false;
   }
 }
@@ -1959,7 +2487,7 @@ bool LineDetector::determineConvexityFromViewpointGivenLineAndMeanPoints(
 
 void LineDetector::checkIfValidPointsOnPlanesGivenProlongedLine(
     const cv::Mat& cloud, const cv::Mat& camera_P, const cv::Vec3f& start,
-    const cv::Vec3f& end, const std::vector<cv::Vec4f>& hessians,
+    const cv::Vec3f& end, const LineHessians& hessians,
     bool* right_plane_enough_valid_points,
     bool* left_plane_enough_valid_points) {
   CHECK_NOTNULL(left_plane_enough_valid_points);
@@ -1975,9 +2503,11 @@ void LineDetector::checkIfValidPointsOnPlanesGivenProlongedLine(
   // the inlier plane of the original line that is on the same side of the line
   // as it is.
   std::vector<cv::Point2f> rect_left, rect_right;
-  std::vector<cv::Point2i> points_in_rect;
-  std::vector<cv::Vec3f> points_left_plane, points_right_plane;
+  PointBuffer& points_left_plane = prolonged_points_left_;
+  PointBuffer& points_right_plane = prolonged_points_right_;
   getRectanglesFromLine(prolonged_line, &rect_left, &rect_right);
+  computeCloudRows(rect_left);
+  computeCloudRows(rect_right);
 
 
   if (visualization_mode_on_) {
@@ -1988,32 +2518,24 @@ void LineDetector::checkIfValidPointsOnPlanesGivenProlongedLine(
   }
 
   // Find points for the left side.
-  findPointsInRectangle(rect_left, &points_in_rect);
   points_left_plane.clear();
-  for (size_t j = 0; j < points_in_rect.size(); ++j) {
-    if (points_in_rect[j].x < 0 || points_in_rect[j].x >= cloud.cols ||
-        points_in_rect[j].y < 0 || points_in_rect[j].y >= cloud.rows) {
-      continue;
-    }
-    if (std::isnan(cloud.at<cv::Vec3f>(points_in_rect[j])[0])) continue;
-    points_left_plane.push_back(cloud.at<cv::Vec3f>(points_in_rect[j]));
-  }
+  forEachValidPointInRectangle(
+      rect_left, cloud, [&](int /*row*/, int /*col*/, const cv::Vec3f& point) {
+        points_left_plane.push_back(point);
+        return true;
+      });
   if (verbose_mode_on_) {
     LOG(INFO) << "Left rectangle contains " << points_left_plane.size()
               << " points.";
   }
 
   // Find points for the right side.
-  findPointsInRectangle(rect_right, &points_in_rect);
   points_right_plane.clear();
-  for (size_t j = 0; j < points_in_rect.size(); ++j) {
-    if (points_in_rect[j].x < 0 || points_in_rect[j].x >= cloud.cols ||
-        points_in_rect[j].y < 0 || points_in_rect[j].y >= cloud.rows) {
-      continue;
-    }
-    if (std::isnan(cloud.at<cv::Vec3f>(points_in_rect[j])[0])) continue;
-    points_right_plane.push_back(cloud.at<cv::Vec3f>(points_in_rect[j]));
-  }
+  forEachValidPointInRectangle(
+      rect_right, cloud, [&](int /*row*/, int /*col*/, const cv::Vec3f& point) {
+        points_right_plane.push_back(point);
+        return true;
+      });
   if (verbose_mode_on_) {
     LOG(INFO) << "Right rectangle contains " << points_right_plane.size()
               << " points.";
@@ -2044,7 +2566,6 @@ void LineDetector::checkIfValidPointsOnPlanesGivenProlongedLine(
   // are consistent with the hessians of the original line.
   int valid_points_left_plane = 0, valid_points_right_plane = 0;
   cv::Vec4f hessian_left_plane, hessian_right_plane;
-  std::vector<cv::Vec3f>::iterator it;
   // According to the way hessians were assigned to the lines in
   // project2Dto3DwithPlanes, the map between hessians and side is
   // hessians[0] -> right, hessians[1] -> left.
@@ -2054,10 +2575,8 @@ void LineDetector::checkIfValidPointsOnPlanesGivenProlongedLine(
   hessian_right_plane = hessians[0];
 
   if (enough_left_points_to_count) {
-    for (it = points_left_plane.begin(); it != points_left_plane.end(); ++it) {
-      if (errorPointToPlane(hessian_left_plane, *it) < max_deviation)
-        ++valid_points_left_plane;
-    }
+    valid_points_left_plane = countPlaneInliers(
+        points_left_plane, hessian_left_plane, max_deviation);
     // Determine if enough valid points are found for the left plane.
     if (valid_points_left_plane < params_-> max_points_for_empty_rectangle)
       *left_plane_enough_valid_points = false;
@@ -2065,11 +2584,8 @@ void LineDetector::checkIfValidPointsOnPlanesGivenProlongedLine(
       *left_plane_enough_valid_points = true;
   }
   if (enough_right_points_to_count) {
-    for (it = points_right_plane.begin(); it != points_right_plane.end();
-         ++it) {
-      if (errorPointToPlane(hessian_right_plane, *it) < max_deviation)
-        ++valid_points_right_plane;
-    }
+    valid_points_right_plane = countPlaneInliers(
+        points_right_plane, hessian_right_plane, max_deviation);
     // Determine if enough valid points are found for the right plane.
     if (valid_points_right_plane < params_-> max_points_for_empty_rectangle)
       *right_plane_enough_valid_points = false;
@@ -2096,13 +2612,81 @@ bool LineDetector::planeRANSAC(const std::vector<cv::Vec3f>& points,
   // Now we compute the final model parameters with all the inliers.
   return hessianNormalFormOfPlane(inliers, hessian_normal_form);
 }
+void LineDetector::computeCloudRows(const std::vector<cv::Point2f>& corners) {
+  if (depth_cloud_ == nullptr || corners.empty()) return;
+  float min_y = corners[0].y;
+  float max_y = corners[0].y;
+  for (const cv::Point2f& corner : corners) {
+    min_y = std::min(min_y, corner.y);
+    max_y = std::max(max_y, corner.y);
+  }
+  depth_cloud_->computeRows(static_cast<int>(floor(min_y)) - 1,
+                            static_cast<int>(ceil(max_y)) + 1);
+}
+void LineDetector::computeCloudRows(const cv::Vec4f& line2D) {
+  if (depth_cloud_ == nullptr) return;
+  depth_cloud_->computeRows(
+      static_cast<int>(floor(std::min(line2D[1], line2D[3]))) - 1,
+      static_cast<int>(ceil(std::max(line2D[1], line2D[3]))) + 1);
+}
+
+PlaneSegmentationParams LineDetector::getPlaneSegmentationParams() const {
+  PlaneSegmentationParams segmentation_params;
+  segmentation_params.normal_window_radius =
+      params_->plane_segmentation_normal_window_radius;
+  segmentation_params.max_distance_between_neighbours =
+      params_->plane_segmentation_max_distance_between_neighbours;
+  segmentation_params.min_cos_angle_normals =
+      params_->plane_segmentation_min_cos_angle_normals;
+  segmentation_params.max_distance_from_plane =
+      params_->plane_segmentation_max_distance_from_plane;
+  segmentation_params.min_region_size =
+      params_->plane_segmentation_min_region_size;
+  return segmentation_params;
+}
+DepthEdgeDetectorParams LineDetector::getDepthEdgeDetectorParams() const {
+  DepthEdgeDetectorParams depth_edge_params;
+  depth_edge_params.min_depth_jump = params_->depth_edge_min_jump;
+  depth_edge_params.min_relative_depth_jump =
+      params_->depth_edge_min_relative_jump;
+  depth_edge_params.hough_threshold = params_->depth_edge_hough_threshold;
+  depth_edge_params.hough_min_line_length =
+      params_->depth_edge_min_line_length;
+  depth_edge_params.hough_max_line_gap = params_->depth_edge_max_line_gap;
+  return depth_edge_params;
+}
+
 void LineDetector::planeRANSAC(const std::vector<cv::Vec3f>& points,
                                std::vector<cv::Vec3f>* inliers) {
   CHECK_NOTNULL(inliers);
+  if (params_->use_adaptive_ransac) {
+    PlaneRansacParams ransac_params;
+    ransac_params.max_iterations = std::max(
+        1, static_cast<int>(params_->num_iter_ransac *
+                            ransac_iteration_scale_));
+    ransac_params.max_deviation = params_->max_error_inlier_ransac;
+    ransac_params.inlier_fraction_max = params_->inlier_max_ransac;
+    ransac_params.min_num_inliers = params_->min_num_inliers;
+    ransac_params.max_discont_in_point_to_mean_distance_connected_components =
+        params_->max_discont_in_point_to_mean_distance_connected_components;
+    ransac_params.use_histogram_connectivity_check =
+        params_->use_histogram_connectivity_check;
+    ransac_params.min_distance_between_points_hessian =
+        params_->min_distance_between_points_hessian;
+    ransac_params.max_cos_theta_hessian_computation =
+        params_->max_cos_theta_hessian_computation;
+    ransac_params.confidence = params_->ransac_confidence;
+    ransac_params.use_sprt = params_->ransac_use_sprt;
+    ransac_params.use_prosac = params_->ransac_use_prosac;
+    plane_ransac_.setParams(ransac_params);
+    plane_ransac_.run(points, nullptr, inliers);
+    return;
+  }
   // Set parameters and do a sanity check.
   const int N = points.size();
   inliers->clear();
-  const int max_it = params_->num_iter_ransac;
+  const int max_it = std::max(
+      1, static_cast<int>(params_->num_iter_ransac * ransac_iteration_scale_));
   constexpr int number_of_model_params = 3;
   double max_deviation = params_->max_error_inlier_ransac;
   double inlier_fraction_max = params_->inlier_max_ransac;
@@ -2118,9 +2702,16 @@ void LineDetector::planeRANSAC(const std::vector<cv::Vec3f>& points,
   // component.
   ClusterDistanceFromMean cluster_distance_from_mean(
       max_discont_in_point_to_mean_distance_connected_components);
+  cluster_distance_histogram_.setDistanceThreshold(
+      max_discont_in_point_to_mean_distance_connected_components);
+  const bool use_histogram_connectivity_check =
+      params_->use_histogram_connectivity_check;
+  bool single_connected_component;
   // Set a random seed.
   unsigned seed = 1;
   std::default_random_engine generator(seed);
+  // The points are tested against each hypothesis with the geometry kernels.
+  point_buffer_.assign(points);
   // Start RANSAC.
   for (int iter = 0; iter < max_it; ++iter) {
     // Get number_of_model_params unique elements from points.
@@ -2134,10 +2725,10 @@ void LineDetector::planeRANSAC(const std::vector<cv::Vec3f>& points,
                        hessian_normal_form[2]);
     // Check which of the points are inlier with the current plane model.
     inlier_candidates.clear();
+    markPlaneInliers(point_buffer_, hessian_normal_form, max_deviation,
+                     &inlier_mask_);
     for (int j = 0; j < N; ++j) {
-      if (errorPointToPlane(hessian_normal_form, points[j]) < max_deviation) {
-        inlier_candidates.push_back(points[j]);
-      }
+      if (inlier_mask_[j]) inlier_candidates.push_back(points[j]);
     }
 
     // If we found more inliers than in any previous run, if the inliers form a
@@ -2147,10 +2738,19 @@ void LineDetector::planeRANSAC(const std::vector<cv::Vec3f>& points,
         inlier_candidates.size() >= min_num_inliers) {
       // Clear data structure that retrieves the connected components among the
       // inliers.
-      cluster_distance_from_mean.clear();
-      cluster_distance_from_mean.addPoints(inlier_candidates);
+      if (use_histogram_connectivity_check) {
+        cluster_distance_histogram_.clear();
+        cluster_distance_histogram_.addPoints(inlier_candidates);
+        single_connected_component =
+            cluster_distance_histogram_.singleConnectedComponent();
+      } else {
+        cluster_distance_from_mean.clear();
+        cluster_distance_from_mean.addPoints(inlier_candidates);
+        single_connected_component =
+            cluster_distance_from_mean.singleConnectedComponent();
+      }
 
-      if (cluster_distance_from_mean.singleConnectedComponent()) {
+      if (single_connected_component) {
         *inliers = inlier_candidates;
       }
     }
@@ -2213,6 +2813,7 @@ void LineDetector::project2Dto3DwithPlanes(
   // Loop over all 2D lines.
   for (size_t i = 0; i < lines2D.size(); ++i) {
     found_point_with_no_depth_info = false;
+    line3D_true.colors.clear();
     // If the rating is so high, no valid 3d line was found by the
     // find3DlinesRated function.
     if (rating[i] > max_rating) continue;
@@ -2316,23 +2917,91 @@ void LineDetector::project2Dto3DwithPlanes(
     const cv::Mat& cloud, const cv::Mat& image, const cv::Mat& camera_P,
     const std::vector<cv::Vec4f>& lines2D_in, const bool set_colors,
     std::vector<cv::Vec4f>* lines2D_out, std::vector<LineWithPlanes>* lines3D) {
-  CHECK_NOTNULL(lines2D_out);
-  CHECK_NOTNULL(lines3D);
   CHECK_EQ(cloud.type(), CV_32FC3);
-  lines3D->clear();
-  lines2D_out->clear();
-  resetStatistics();
-  // Declare all variables before the main loop.
-  std::vector<cv::Point2f> rect_left, rect_right;
-  std::vector<cv::Vec3f> inliers_left, inliers_right;
-  std::vector<cv::Vec6f> lines3D_cand;
-  std::vector<double> rating;
-  cv::Point2i start, end;
-  LineWithPlanes line3D_true;
-
-  double max_rating = params_->max_rating_valid_line;
-  bool right_found, left_found;
-
+  if (params_->use_integral_plane_fitting) {
+    // The integral images taken from a FrameContext belong to the frame.
+    if (!integral_plane_fitter_ || integral_plane_fitter_.use_count() > 1) {
+      integral_plane_fitter_.reset(new IntegralPlaneFitter());
+    }
+    integral_plane_fitter_->setCloud(cloud);
+  }
+  if (params_->use_plane_segmentation) {
+    // Same for the segmentation.
+    if (!plane_segmentation_ || plane_segmentation_.use_count() > 1) {
+      plane_segmentation_.reset(new PlaneSegmentation());
+    }
+    plane_segmentation_->setParams(getPlaneSegmentationParams());
+    plane_segmentation_->segment(cloud);
+  }
+  project2Dto3DwithPlanesGivenFitter(cloud, image, camera_P, lines2D_in,
+                                     set_colors,
+                                     params_->projection_time_budget_ms,
+                                     lines2D_out, lines3D);
+}
+
+void LineDetector::project2Dto3DwithPlanes(
+    FrameContext* frame, const std::vector<cv::Vec4f>& lines2D_in,
+    const bool set_colors, std::vector<cv::Vec4f>* lines2D_out,
+    std::vector<LineWithPlanes>* lines3D) {
+  project2Dto3DwithPlanes(frame, lines2D_in, set_colors,
+                          params_->projection_time_budget_ms, lines2D_out,
+                          lines3D);
+}
+
+void LineDetector::project2Dto3DwithPlanes(
+    FrameContext* frame, const std::vector<cv::Vec4f>& lines2D_in,
+    const bool set_colors, double time_budget_ms,
+    std::vector<cv::Vec4f>* lines2D_out,
+    std::vector<LineWithPlanes>* lines3D) {
+  CHECK_NOTNULL(frame);
+  if (params_->use_integral_plane_fitting) {
+    integral_plane_fitter_ = frame->getIntegralPlaneFitter();
+  }
+  if (params_->use_plane_segmentation) {
+    plane_segmentation_ =
+        frame->getPlaneSegmentation(getPlaneSegmentationParams());
+  }
+  // The depth edge detector reads the cloud without computeCloudRows.
+  DepthCloud* depth_cloud = frame->getDepthCloud();
+  if (depth_cloud != nullptr && !params_->detect_depth_edge_lines) {
+    depth_cloud_ = depth_cloud;
+    project2Dto3DwithPlanesGivenFitter(
+        depth_cloud->getPartialCloud(), frame->getImage(), frame->getCameraP(),
+        lines2D_in, set_colors, time_budget_ms, lines2D_out, lines3D);
+    depth_cloud_ = nullptr;
+    return;
+  }
+  project2Dto3DwithPlanesGivenFitter(frame->getCloud(), frame->getImage(),
+                                     frame->getCameraP(), lines2D_in,
+                                     set_colors, time_budget_ms, lines2D_out,
+                                     lines3D);
+}
+
+void LineDetector::project2Dto3DwithPlanesGivenFitter(
+    const cv::Mat& cloud, const cv::Mat& image, const cv::Mat& camera_P,
+    const std::vector<cv::Vec4f>& lines2D_in, const bool set_colors,
+    double time_budget_ms, std::vector<cv::Vec4f>* lines2D_out,
+    std::vector<LineWithPlanes>* lines3D) {
+  CHECK_NOTNULL(lines2D_out);
+  CHECK_NOTNULL(lines3D);
+  CHECK_EQ(cloud.type(), CV_32FC3);
+  const auto start_time = std::chrono::steady_clock::now();
+  lines3D->clear();
+  lines2D_out->clear();
+  resetStatistics();
+  projection_report_.reset();
+  if (params_->detect_depth_edge_lines) {
+    depth_edge_detector_.setParams(getDepthEdgeDetectorParams());
+  }
+  if (params_->use_plane_hypothesis_cache) {
+    plane_hypothesis_cache_.reset(cloud.rows, cloud.cols,
+                                  params_->plane_hypothesis_cache_cell_size);
+  }
+  std::vector<cv::Vec6f> lines3D_cand;
+  std::vector<double> rating;
+
+  double max_rating = params_->max_rating_valid_line;
+
   // This is a first guess of the 3D lines. They are used in some cases, where
   // the lines cannot be found by intersecting planes.
   std::vector<cv::Vec4f> lines2D =
@@ -2347,24 +3016,259 @@ void LineDetector::project2Dto3DwithPlanes(
 
   find3DlinesRated(cloud, lines2D_shrunk, &lines3D_cand, &rating);
 
-  // Initialize the number of lines successfully projected to 3D to 0.
-  num_lines_successfully_projected_to_3D = 0;
+  // Order in which the lines are processed: with a time budget, best-first,
+  // so that the lines skipped when the budget runs out are the least valuable
+  // ones. The lines without valid 3D start and end points are never
+  // processed.
+  std::vector<size_t> order(lines2D.size());
+  std::iota(order.begin(), order.end(), 0);
+  const bool use_budget = time_budget_ms > 0.0;
+  if (use_budget) {
+    std::vector<double> priority(lines2D.size(), -1.0);
+    for (size_t i = 0; i < lines2D.size(); ++i) {
+      if (rating[i] <= max_rating) {
+        computeCloudRows(lines2D[i]);
+        priority[i] = computeLinePriority(cloud, lines2D[i]);
+      }
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&priority](size_t a, size_t b) {
+                       return priority[a] > priority[b];
+                     });
+  }
+  const auto deadline =
+      start_time +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double, std::milli>(time_budget_ms));
+  // Only the lines with a valid guess are started.
+  const size_t num_valid_lines =
+      std::count_if(rating.begin(), rating.end(),
+                    [max_rating](double r) { return r <= max_rating; });
+  std::atomic<size_t> num_started(0);
+  // The pace of the lines is measured from the start of the first one, so that
+  // the time spent on the guesses and the priorities is not counted in it.
+  std::once_flag pacing_started;
+  std::chrono::steady_clock::time_point pacing_start_time;
+  // Factor of the RANSAC iterations of each line started.
+  std::vector<double> iteration_scale(lines2D.size(), 1.0);
+  // Returns false if line i cannot be started before the deadline. Otherwise,
+  // if the lines left would not be processed in time at the pace of the lines
+  // started so far, reduces the RANSAC iterations of detector accordingly.
+  auto start_line = [&](LineDetector* detector, size_t i) {
+    if (!use_budget) return true;
+    std::call_once(pacing_started, [&pacing_start_time]() {
+      pacing_start_time = std::chrono::steady_clock::now();
+    });
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) return false;
+    const size_t num_previous = num_started.fetch_add(1);
+    double scale = 1.0;
+    if (num_previous > 0) {
+      const double elapsed =
+          std::chrono::duration<double>(now - pacing_start_time).count();
+      const double remaining =
+          std::chrono::duration<double>(deadline - now).count();
+      const double needed =
+          elapsed / num_previous * (num_valid_lines - num_previous);
+      if (needed > remaining) {
+        scale = std::max(params_->min_relative_iter_ransac,
+                         remaining / needed);
+      }
+    }
+    detector->ransac_iteration_scale_ = scale;
+    iteration_scale[i] = scale;
+    return true;
+  };
+
+  // Visualization waits for user input after every line and therefore always
+  // runs serially. So does the plane hypothesis cache, whose content depends on
+  // the lines previously processed.
+  size_t num_threads = visualization_mode_on_ ? 1u :
+      std::min<size_t>(params_->num_threads_projection, lines2D.size());
+  if (num_threads > 1 && params_->use_plane_hypothesis_cache) {
+    LOG(WARNING) << "project2Dto3DwithPlanes: the plane hypothesis cache is "
+                    "used, the lines are processed serially.";
+    num_threads = 1;
+  }
 
-  bool planes_found;
+  std::vector<char> line_skipped(lines2D.size(), 0);
+  if (num_threads <= 1) {
+    // Loop over all 2D lines.
+    for (size_t i : order) {
+      // If cannot find valid 3D start and end points for the 2D line.
+      if (rating[i] > max_rating) {
+        statistics_.num_lines_rejected_by_rating++;
+        continue;
+      }
+      if (!start_line(this, i)) {
+        line_skipped[i] = 1;
+        continue;
+      }
+      LineWithPlanes line3D;
+      if (project2DLineTo3DWithPlanes(cloud, image, camera_P, lines2D[i],
+                                      lines3D_cand[i], set_colors, &line3D)) {
+        lines3D->push_back(line3D);
+        lines2D_out->push_back(lines2D[i]);
+      }
+    }
+  } else {
+    // Each line is processed independently of the others (planeRANSAC seeds
+    // its own random engine at every call), therefore the lines can be
+    // distributed among the threads in any order. The results are stored per
+    // input index and gathered afterwards, so that the output has the same
+    // order as in the serial case.
+    std::vector<LineWithPlanes> lines3D_per_index(lines2D.size());
+    std::vector<char> line_found(lines2D.size(), 0);
+    std::vector<std::unique_ptr<LineDetector>> workers;
+    workers.reserve(num_threads);
+    for (size_t t = 0; t < num_threads; ++t) {
+      workers.emplace_back(new LineDetector(*this, WorkerTag()));
+    }
+    std::atomic<size_t> next_line(0);
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (size_t t = 0; t < num_threads; ++t) {
+      LineDetector* worker = workers[t].get();
+      threads.emplace_back([&, worker]() {
+        size_t k;
+        while ((k = next_line.fetch_add(1)) < order.size()) {
+          const size_t i = order[k];
+          if (rating[i] > max_rating) {
+            worker->statistics_.num_lines_rejected_by_rating++;
+            continue;
+          }
+          if (!start_line(worker, i)) {
+            line_skipped[i] = 1;
+            continue;
+          }
+          line_found[i] = worker->project2DLineTo3DWithPlanes(
+              cloud, image, camera_P, lines2D[i], lines3D_cand[i], set_colors,
+              &lines3D_per_index[i]);
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    for (const std::unique_ptr<LineDetector>& worker : workers) {
+      statistics_.merge(worker->statistics_);
+    }
+    for (size_t i : order) {
+      if (line_found[i]) {
+        lines3D->push_back(lines3D_per_index[i]);
+        lines2D_out->push_back(lines2D[i]);
+      }
+    }
+  }
+  ransac_iteration_scale_ = 1.0;
+
+  for (size_t i : order) {
+    if (line_skipped[i]) {
+      projection_report_.skipped_lines2D.push_back(lines2D[i]);
+    } else if (rating[i] <= max_rating) {
+      ++projection_report_.num_processed_lines;
+    }
+  }
+  projection_report_.deadline_reached =
+      !projection_report_.skipped_lines2D.empty();
+  for (double scale : iteration_scale) {
+    projection_report_.min_ransac_iteration_scale =
+        std::min(projection_report_.min_ransac_iteration_scale, scale);
+  }
+  projection_report_.elapsed_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start_time).count();
+}
+
+bool LineDetector::project2DLineTo3DWithPlanes(
+    const cv::Mat& cloud, const cv::Mat& image, const cv::Mat& camera_P,
+    const cv::Vec4f& line2D, const cv::Vec6f& line3D_guess,
+    const bool set_colors_in, LineWithPlanes* line3D) {
+  CHECK_NOTNULL(line3D);
+  std::vector<cv::Point2f> rect_left, rect_right;
+  std::vector<cv::Vec3f> inliers_left, inliers_right;
+  bool right_found, left_found;
+  bool planes_found = false;
   cv::Mat image_of_line_with_rectangles;
   cv::Vec4f reprojected_line;
   cv::Vec3f start_3D, end_3D;
-  // Loop over all 2D lines.
-  for (size_t i = 0; i < lines2D.size(); ++i) {
-    // If cannot find valid 3D start and end points for the 2D line.
-    if (rating[i] > max_rating) continue;
+  const bool set_colors =
+      set_colors_in && (params_->line_outputs & kLineOutputColors);
+
+  // If only the endpoints are requested, the initial guess is taken as is.
+  if (!(params_->line_outputs & (kLineOutputPlanes | kLineOutputType))) {
+    line3D->line = line3D_guess;
+    line3D->hessians = {cv::Vec4f(0.0f, 0.0f, 0.0f, 0.0f),
+                        cv::Vec4f(0.0f, 0.0f, 0.0f, 0.0f)};
+    line3D->type = LineType::UNCLASSIFIED;
+    if (set_colors && getRectanglesFromLine(line2D, &rect_left, &rect_right)) {
+      assignColorToLines(image, rect_left, line3D);
+      assignColorToLines(image, rect_right, line3D);
+    }
+    statistics_.num_lines_successfully_projected_to_3D++;
+    return true;
+  }
+  if (params_->use_line_prefilters && !prefilterLine(line3D_guess)) {
+    return false;
+  }
 
-    findInliersGiven2DLine(lines2D[i], cloud, image, set_colors, &line3D_true,
-                          &inliers_right, &inliers_left, &rect_right,
-                          &rect_left, &right_found, &left_found);
-    planes_found = false;
+  // If the depth jumps across the line, only the plane of the side in front
+  // is fitted and the line is a discontinuity line.
+  bool depth_edge_found = false;
+  if (params_->detect_depth_edge_lines &&
+      !findDepthEdgeInliersGiven2DLine(line2D, cloud, &inliers_right,
+                                       &rect_right, &rect_left,
+                                       &depth_edge_found)) {
+    return false;
+  }
+  // Otherwise the points of both rectangles are gathered.
+  if (!depth_edge_found && params_->use_line_prefilters &&
+      !prefilterLineRectangles(cloud, line2D)) {
+    return false;
+  }
+  // If the two planes form an edge or an intersection, they are fitted
+  // jointly and the line is taken from their model.
+  bool wedge_found = false;
+  if (!depth_edge_found && params_->use_wedge_estimator &&
+      !findWedgeInliersGiven2DLine(line2D, cloud, camera_P, &inliers_right,
+                                   &inliers_left, &rect_right, &rect_left,
+                                   &wedge_found)) {
+    return false;
+  }
+  if (depth_edge_found) {
+    // As when only one of the planes is found by findInliersGiven2DLine,
+    // find3DlineOnPlanes then fits the line on this plane.
+    inliers_left = inliers_right;
+    if (set_colors) {
+      assignColorToLines(image, rect_left, line3D);
+      assignColorToLines(image, rect_right, line3D);
+    }
+  } else if (wedge_found) {
+    if (set_colors) {
+      assignColorToLines(image, rect_left, line3D);
+      assignColorToLines(image, rect_right, line3D);
+    }
+  } else {
+    if (params_->use_wedge_estimator) {
+      // The points of both rectangles were already gathered by
+      // findWedgeInliersGiven2DLine.
+      if (set_colors) {
+        assignColorToLines(image, rect_left, line3D);
+        assignColorToLines(image, rect_right, line3D);
+      }
+      left_found = findPlaneInliersOfSide(cloud, rect_left,
+                                          points_in_rect_left_,
+                                          pixels_in_rect_left_, &inliers_left);
+      right_found = findPlaneInliersOfSide(cloud, rect_right,
+                                           points_in_rect_right_,
+                                           pixels_in_rect_right_,
+                                           &inliers_right);
+    } else {
+      findInliersGiven2DLine(line2D, cloud, image, set_colors, line3D,
+                             &inliers_right, &inliers_left, &rect_right,
+                             &rect_left, &right_found, &left_found);
+    }
     if ((!right_found) && (!left_found)) {
-      continue;
+      return false;
     } else if (!right_found) {
       inliers_right = inliers_left;
     } else if (!left_found) {
@@ -2373,87 +3277,176 @@ void LineDetector::project2Dto3DwithPlanes(
       // Both left and right planes are found.
       planes_found = true;
     }
+  }
 
-    if (visualization_mode_on_) {
-      background_image_ = image;
-      // Display 2D image with rectangles.
-      LOG(INFO) << "* Displaying new candidate line in 2D.";
-      image_of_line_with_rectangles = getImageOfLineWithRectangles(lines2D[i],
-                                          rect_left, rect_right,
-                                          background_image_);
-      cv::imshow("Line with rectangles", image_of_line_with_rectangles);
-      cv::waitKey();
+  if (visualization_mode_on_) {
+    background_image_ = image;
+    // Display 2D image with rectangles.
+    LOG(INFO) << "* Displaying new candidate line in 2D.";
+    image_of_line_with_rectangles = getImageOfLineWithRectangles(line2D,
+                                        rect_left, rect_right,
+                                        background_image_);
+    cv::imshow("Line with rectangles", image_of_line_with_rectangles);
+    cv::waitKey();
+  }
+
+  // Find 3D line on planes.
+  if (wedge_found) {
+    // The planes are in the same order as in find3DlineOnPlanes. The endpoints
+    // are those of the model, which projects onto the 2D line, so that they
+    // are not readjusted on the inliers. The line is still checked for
+    // inliers around its center and classified as in find3DlineOnPlanes,
+    // since the model does not tell an edge from an intersection.
+    line3D->hessians.resize(2);
+    line3D->hessians[0] = wedge_estimator_.getPlane(0);
+    line3D->hessians[1] = wedge_estimator_.getPlane(1);
+    cv::Vec3f start_on_line, end_on_line;
+    if (!wedge_estimator_.getLineEndpoints(toProjectionMatx(camera_P), line2D,
+                                           &start_on_line, &end_on_line) ||
+        !find3DEdgeOrIntersectionLine(inliers_right, inliers_left,
+                                      start_on_line, end_on_line, false,
+                                      line3D_guess, line2D, cloud, camera_P,
+                                      line3D)) {
+      return false;
     }
+  } else if (!find3DlineOnPlanes(inliers_right, inliers_left, line3D_guess,
+                                 line2D, cloud, camera_P, planes_found,
+                                 line3D)) {
+    return false;
+  }
+  // Only the reliably found lines are returned as found, but only those that
+  // also have a length similar to the initial guess are counted.
+  if (!linesHaveSimilarLength(line3D_guess, line3D->line)) {
+    return true;
+  }
+  start_3D = {line3D->line[0], line3D->line[1], line3D->line[2]};
+  end_3D = {line3D->line[3], line3D->line[4], line3D->line[5]};
+  if (verbose_mode_on_) {
+    project3DLineTo2D(start_3D, end_3D, camera_P, &reprojected_line);
+    LOG(INFO) << "** Candidate line was successfully projected to 3D with "
+              << "index " << statistics_.num_lines_successfully_projected_to_3D
+              << ":\n   - 2D: (" << line2D[0]  << ", " << line2D[1]
+              << ") -- (" << line2D[2] << ", " << line2D[3]
+              << ").\n   - 3D before adjustment: (" << line3D_guess[0]
+              << ", " << line3D_guess[1] << ", " << line3D_guess[2]
+              << ") -- (" << line3D_guess[3] << ", " << line3D_guess[4]
+              << ", " << line3D_guess[5]
+              << ").\n   - 3D after adjustment: (" << line3D->line[0]
+              << ", " << line3D->line[1] << ", " << line3D->line[2]
+              << ") -- (" << line3D->line[3] << ", " << line3D->line[4]
+              << ", " << line3D->line[5]
+              << ").\n   - 2D after reprojection: (" << reprojected_line[0]
+              << ", " << reprojected_line[1] << ") -- ("
+              << reprojected_line[2] << ", " << reprojected_line[3] << ").";
+  }
 
-    // Find 3D line on planes.
-    if (find3DlineOnPlanes(inliers_right, inliers_left, lines3D_cand[i],
-                           lines2D[i], cloud, camera_P, planes_found,
-                           &line3D_true)) {
+  if (visualization_mode_on_) {
+    // Display original line/rectangles overlapped with the reprojection
+    // of the line adjusted with inliers and the prolonged line/
+    // rectangles (if any).
+    image_of_line_with_rectangles = getImageOfLineWithRectangles(line2D,
+                                        rect_left, rect_right,
+                                        background_image_);
+    cv::imshow("Line with rectangles + reprojected line + prolonged line ("
+               "if any)", image_of_line_with_rectangles);
+    cv::waitKey();
+    try {
+      cv::destroyWindow("Line with rectangles + reprojected line + "
+                        "prolonged line (if any)");
+    }
+    catch (cv::Exception& e) {
+      if (verbose_mode_on_) {
+        LOG(INFO) << "Did not close window"
+                  << """Line with rectangles + reprojected line etc."" "
+                  << "because it was not open.";
+      }
+    }
+  }
+  statistics_.num_lines_successfully_projected_to_3D++;
+  return true;
+}
 
-      // Only push back the reliably found lines.
-      lines3D->push_back(line3D_true);
-      lines2D_out->push_back(lines2D[i]);
-      start_3D = {line3D_true.line[0], line3D_true.line[1],
-                  line3D_true.line[2]};
-      end_3D = {line3D_true.line[3], line3D_true.line[4], line3D_true.line[5]};
+bool LineDetector::prefilterLine(const cv::Vec6f& line3D_guess) {
+  // 1. Length of the initial 3D guess.
+  const double length_3D =
+      cv::norm(cv::Vec3f(line3D_guess[3], line3D_guess[4], line3D_guess[5]) -
+               cv::Vec3f(line3D_guess[0], line3D_guess[1], line3D_guess[2]));
+  if (length_3D < params_->prefilter_min_relative_length_3D *
+                      params_->min_length_line_3D) {
+    statistics_.num_lines_rejected_by_length_3D++;
+    return false;
+  }
+  return true;
+}
 
-      if (!linesHaveSimilarLength(lines3D_cand[i], line3D_true.line)) {
+bool LineDetector::prefilterLineRectangles(const cv::Mat& cloud,
+                                           const cv::Vec4f& line2D) {
+  // 2. Length of the 2D line.
+  std::vector<cv::Point2f> rects[2];
+  if (!getRectanglesFromLine(line2D, &rects[0], &rects[1])) {
+    statistics_.num_lines_rejected_by_length_2D++;
+    return false;
+  }
+  // 3. Number of pixels of the cloud in each rectangle, an upper bound of the
+  // number of points gathered from it.
+  int x_start, x_end;
+  for (size_t side = 0; side < 2; ++side) {
+    const RectangleScanlines scanlines(rects[side]);
+    size_t num_pixels = 0;
+    for (size_t i = 0; i < scanlines.getNumRows(); ++i) {
+      const int row = scanlines.getFirstRow() + i;
+      if (row < 0 || row >= cloud.rows) continue;
+      scanlines.getSpan(i, &x_start, &x_end);
+      x_start = std::max(x_start, 0);
+      x_end = std::min(x_end, cloud.cols - 1);
+      if (x_start <= x_end) num_pixels += x_end - x_start + 1;
+    }
+    if (num_pixels < params_->min_points_in_rect) {
+      statistics_.num_lines_rejected_by_rectangle_size++;
+      return false;
+    }
+  }
+  // 4. Depth sampled at every pixel of the middle line of each rectangle.
+  for (size_t side = 0; side < 2; ++side) {
+    const std::vector<cv::Point2f>& rect = rects[side];
+    computeCloudRows(rect);
+    const RectangleScanlines scanlines(rect);
+    const cv::Point2f start = 0.5f * (rect[0] + rect[1]);
+    const cv::Point2f direction = 0.5f * (rect[2] + rect[3]) - start;
+    const int num_samples =
+        std::max(2, static_cast<int>(cv::norm(direction)));
+    for (int i = 0; i < num_samples; ++i) {
+      const cv::Point2f sample =
+          start + direction * ((i + 0.5f) / static_cast<float>(num_samples));
+      // The pixel containing the sample is only tested if the points of the
+      // rectangle are gathered from it (cf. forEachValidPointInRectangle).
+      const int row = floor(sample.y);
+      const int col = floor(sample.x);
+      if (col < 0 || col >= cloud.cols || row < 0 || row >= cloud.rows) {
         continue;
       }
-      if (verbose_mode_on_) {
-        project3DLineTo2D(start_3D, end_3D, camera_P, &reprojected_line);
-        LOG(INFO) << "** Candidate line was successfully projected to 3D with "
-                  << "index " << num_lines_successfully_projected_to_3D
-                  << ":\n   - 2D: (" << lines2D[i][0]  << ", " << lines2D[i][1]
-                  << ") -- (" << lines2D[i][2] << ", " << lines2D[i][3]
-                  << ").\n   - 3D before adjustment: (" << lines3D_cand[i][0]
-                  << ", " << lines3D_cand[i][1] << ", " << lines3D_cand[i][2]
-                  << ") -- (" << lines3D_cand[i][3] << ", "
-                  << lines3D_cand[i][4] << ", " << lines3D_cand[i][5]
-                  << ").\n   - 3D after adjustment: (" << line3D_true.line[0]
-                  << ", " << line3D_true.line[1] << ", " << line3D_true.line[2]
-                  << ") -- (" << line3D_true.line[3] << ", "
-                  << line3D_true.line[4] << ", " << line3D_true.line[5]
-                  << ").\n   - 2D after reprojection: (" << reprojected_line[0]
-                  << ", " << reprojected_line[1] << ") -- ("
-                  << reprojected_line[2] << ", " << reprojected_line[3] << ").";
+      const int span = row - scanlines.getFirstRow();
+      if (span < 0 || span >= static_cast<int>(scanlines.getNumRows())) {
+        continue;
       }
-
-      if (visualization_mode_on_) {
-        // Display original line/rectangles overlapped with the reprojection
-        // of the line adjusted with inliers and the prolonged line/
-        // rectangles (if any).
-        image_of_line_with_rectangles = getImageOfLineWithRectangles(lines2D[i],
-                                            rect_left, rect_right,
-                                            background_image_);
-        cv::imshow("Line with rectangles + reprojected line + prolonged line ("
-                   "if any)", image_of_line_with_rectangles);
-        cv::waitKey();
-        try {
-          cv::destroyWindow("Line with rectangles + reprojected line + "
-                            "prolonged line (if any)");
-        }
-        catch (cv::Exception& e) {
-          if (verbose_mode_on_) {
-            LOG(INFO) << "Did not close window"
-                      << """Line with rectangles + reprojected line etc."" "
-                      << "because it was not open.";
-          }
-        }
+      scanlines.getSpan(span, &x_start, &x_end);
+      if (col < x_start || col > x_end) continue;
+      const cv::Vec3f& point_3D = cloud.ptr<cv::Vec3f>(row)[col];
+      if (std::isnan(point_3D[0])) continue;
+      if (checkEqualPoints(point_3D, {0.0f, 0.0f, 0.0f})) {
+        statistics_.num_lines_rejected_by_missing_depth++;
+        return false;
       }
-      num_lines_successfully_projected_to_3D++;
     }
   }
+  return true;
 }
 
 void LineDetector::project3DPointTo2D(const cv::Vec3f& point_3D,
                                       const cv::Mat& camera_P,
                                       cv::Vec2f* point_2D) {
   CHECK_NOTNULL(point_2D);
-  cv::Vec4f point_3D_homo = {point_3D[0], point_3D[1], point_3D[2], 1.0};
-  cv::Mat point_2D_homo = camera_P * cv::Mat(point_3D_homo);
-  *point_2D = {point_2D_homo.at<float>(0, 0) / point_2D_homo.at<float>(2, 0),
-              point_2D_homo.at<float>(1, 0) / point_2D_homo.at<float>(2, 0)};
+  *point_2D = projectPoint(toProjectionMatx(camera_P), point_3D);
 }
 
 void LineDetector::project3DLineTo2D(const cv::Vec3f& start_3D,
@@ -2461,22 +3454,14 @@ void LineDetector::project3DLineTo2D(const cv::Vec3f& start_3D,
                                      const cv::Mat& camera_P,
                                      cv::Vec4f* line_2D) {
   CHECK_NOTNULL(line_2D);
-  cv::Vec2f start_2D, end_2D;
-
-  project3DPointTo2D(start_3D, camera_P, &start_2D);
-  project3DPointTo2D(end_3D, camera_P, &end_2D);
-
-  *line_2D = cv::Vec4f({start_2D[0], start_2D[1], end_2D[0], end_2D[1]});
+  *line_2D = projectSegment(toProjectionMatx(camera_P), start_3D, end_3D);
 }
 
 void LineDetector::project3DLineTo2D(const LineWithPlanes& line_3D,
                                      const cv::Mat& camera_P,
                                      cv::Vec4f* line_2D) {
   CHECK_NOTNULL(line_2D);
-  cv::Vec3f start_3D({line_3D.line[0], line_3D.line[1], line_3D.line[2]});
-  cv::Vec3f end_3D({line_3D.line[3], line_3D.line[4], line_3D.line[5]});
-
-  project3DLineTo2D(start_3D, end_3D, camera_P, line_2D);
+  *line_2D = projectSegment(toProjectionMatx(camera_P), line_3D.line);
 }
 
 
@@ -2514,8 +3499,6 @@ void LineDetector::findInliersGiven2DLine(const cv::Vec4f& line_2D,
   CHECK_NOTNULL(right_found);
   CHECK_NOTNULL(left_found);
 
-  std::vector<cv::Point2i> points_in_rect;
-  std::vector<cv::Vec3f> plane_point_cand;
   // Some points in the point cloud might have no depth information. In
   // SceneNetRGBD these are encoded with corresponding {0, 0, 0} coordinates in
   // the point cloud. If a line is on the edge of a region containing such
@@ -2529,10 +3512,6 @@ void LineDetector::findInliersGiven2DLine(const cv::Vec4f& line_2D,
   // wrong line type or have remaining inliers that are not descriptive of the
   // actual plane.
   bool found_point_with_no_depth_info;
-  constexpr size_t min_points_for_ransac = 3;
-  // Parameter: Fraction of inlier that must be found for the plane model to
-  // be valid.
-  double min_inliers = params_->min_inlier_ransac;
 
   found_point_with_no_depth_info = false;
   // Clear inliers.
@@ -2543,65 +3522,39 @@ void LineDetector::findInliersGiven2DLine(const cv::Vec4f& line_2D,
   // defining a patch, find all points within the patch and try to fit a plane
   // to these points.
   getRectanglesFromLine(line_2D, rect_left, rect_right);
+  computeCloudRows(*rect_left);
+  computeCloudRows(*rect_right);
   // Find points for the left side.
-  findPointsInRectangle(*rect_left, &points_in_rect);
   if (set_colors) {
-    assignColorToLines(image, points_in_rect, line_3D);
-  }
-  plane_point_cand.clear();
-  for (size_t j = 0; j < points_in_rect.size(); ++j) {
-    if (points_in_rect[j].x < 0 || points_in_rect[j].x >= cloud.cols ||
-        points_in_rect[j].y < 0 || points_in_rect[j].y >= cloud.rows) {
-      continue;
-    }
-    if (std::isnan(cloud.at<cv::Vec3f>(points_in_rect[j])[0])) continue;
-    if (checkEqualPoints(cloud.at<cv::Vec3f>(points_in_rect[j]),
-        {0.0f, 0.0f, 0.0f})) {
-        found_point_with_no_depth_info = true;
-        break;
-    }
-    plane_point_cand.push_back(cloud.at<cv::Vec3f>(points_in_rect[j]));
+    assignColorToLines(image, *rect_left, line_3D);
   }
+  const bool record_pixels = params_->max_points_per_rect > 0;
+  found_point_with_no_depth_info = !gatherPointsInRectangle(
+      *rect_left, cloud, true, &points_in_rect_left_,
+      record_pixels ? &pixels_in_rect_left_ : nullptr);
   // Point with no depth info => Discard line.
   if (found_point_with_no_depth_info) {
     *right_found = false;
     *left_found = false;
     return;
   }
-  // If the size of plane_point_cand is too small, either the line is too short
-  // or the line is near the edge of the image, reject it.
-  if (plane_point_cand.size() < params_->min_points_in_rect) {
+  // If the size of points_in_rect_left_ is too small, either the line is too
+  // short or the line is near the edge of the image, reject it.
+  if (points_in_rect_left_.size() < params_->min_points_in_rect) {
     *right_found = false;
     *left_found = false;
     return;
   }
   // See if left plane is found by RANSAC.
-  *left_found = false;
-  if (plane_point_cand.size() > min_points_for_ransac) {
-    planeRANSAC(plane_point_cand, inliers_left);
-    if (inliers_left->size() >= min_inliers * plane_point_cand.size()) {
-      *left_found = true;
-    }
-  }
+  *left_found = findPlaneInliersOfSide(cloud, *rect_left, points_in_rect_left_,
+                                       pixels_in_rect_left_, inliers_left);
   // Find points for the right side.
-  findPointsInRectangle(*rect_right, &points_in_rect);
   if (set_colors) {
-    assignColorToLines(image, points_in_rect, line_3D);
-  }
-  plane_point_cand.clear();
-  for (size_t j = 0; j < points_in_rect.size(); ++j) {
-    if (points_in_rect[j].x < 0 || points_in_rect[j].x >= cloud.cols ||
-        points_in_rect[j].y < 0 || points_in_rect[j].y >= cloud.rows) {
-      continue;
-    }
-    if (std::isnan(cloud.at<cv::Vec3f>(points_in_rect[j])[0])) continue;
-    if (checkEqualPoints(cloud.at<cv::Vec3f>(points_in_rect[j]),
-        {0.0f, 0.0f, 0.0f})) {
-        found_point_with_no_depth_info = true;
-        break;
-    }
-    plane_point_cand.push_back(cloud.at<cv::Vec3f>(points_in_rect[j]));
+    assignColorToLines(image, *rect_right, line_3D);
   }
+  found_point_with_no_depth_info = !gatherPointsInRectangle(
+      *rect_right, cloud, true, &points_in_rect_right_,
+      record_pixels ? &pixels_in_rect_right_ : nullptr);
   // Point with no depth info => Discard line.
   if (found_point_with_no_depth_info) {
     *right_found = false;
@@ -2609,19 +3562,293 @@ void LineDetector::findInliersGiven2DLine(const cv::Vec4f& line_2D,
     return;
   }
 
-  if (plane_point_cand.size() < params_->min_points_in_rect) {
+  if (points_in_rect_right_.size() < params_->min_points_in_rect) {
     *right_found = false;
     *left_found = false;
     return;
   }
   // See if right plane is found by RANSAC.
-  *right_found = false;
-  if (plane_point_cand.size() > min_points_for_ransac) {
-    planeRANSAC(plane_point_cand, inliers_right);
-    if (inliers_right->size() >= min_inliers * plane_point_cand.size()) {
-      *right_found = true;
+  *right_found = findPlaneInliersOfSide(cloud, *rect_right,
+                                        points_in_rect_right_,
+                                        pixels_in_rect_right_, inliers_right);
+}
+
+bool LineDetector::findPlaneInliersOfSide(
+    const cv::Mat& cloud, const std::vector<cv::Point2f>& rect,
+    const std::vector<cv::Vec3f>& points,
+    const std::vector<cv::Point2i>& pixels, std::vector<cv::Vec3f>* inliers) {
+  CHECK_NOTNULL(inliers);
+  constexpr size_t min_points_for_ransac = 3;
+  // Parameter: Fraction of inlier that must be found for the plane model to
+  // be valid.
+  const double min_inliers = params_->min_inlier_ransac;
+  inliers->clear();
+  if (points.size() <= min_points_for_ransac) return false;
+  findPlaneInliersInRectangle(cloud, rect, points, pixels, inliers);
+  return inliers->size() >= min_inliers * points.size();
+}
+
+bool LineDetector::findWedgeInliersGiven2DLine(
+    const cv::Vec4f& line_2D, const cv::Mat& cloud, const cv::Mat& camera_P,
+    std::vector<cv::Vec3f>* inliers_right, std::vector<cv::Vec3f>* inliers_left,
+    std::vector<cv::Point2f>* rect_right, std::vector<cv::Point2f>* rect_left,
+    bool* wedge_found) {
+  CHECK_NOTNULL(inliers_right);
+  CHECK_NOTNULL(inliers_left);
+  CHECK_NOTNULL(rect_right);
+  CHECK_NOTNULL(rect_left);
+  CHECK_NOTNULL(wedge_found);
+  *wedge_found = false;
+  // Same criteria as in findInliersGiven2DLine to discard the line.
+  getRectanglesFromLine(line_2D, rect_left, rect_right);
+  computeCloudRows(*rect_left);
+  computeCloudRows(*rect_right);
+  const bool record_pixels = params_->max_points_per_rect > 0;
+  if (!gatherPointsInRectangle(
+          *rect_left, cloud, true, &points_in_rect_left_,
+          record_pixels ? &pixels_in_rect_left_ : nullptr) ||
+      points_in_rect_left_.size() < params_->min_points_in_rect ||
+      !gatherPointsInRectangle(
+          *rect_right, cloud, true, &points_in_rect_right_,
+          record_pixels ? &pixels_in_rect_right_ : nullptr) ||
+      points_in_rect_right_.size() < params_->min_points_in_rect) {
+    return false;
+  }
+  // The joint fit would be discarded if the line is a planar or a
+  // discontinuity line, which the least-squares planes of the rectangles
+  // already show in most cases.
+  cv::Vec4f hessian_right_guess, hessian_left_guess;
+  if (points_in_rect_right_.size() < 3 || points_in_rect_left_.size() < 3 ||
+      !hessianNormalFormOfPlane(points_in_rect_right_, &hessian_right_guess) ||
+      !hessianNormalFormOfPlane(points_in_rect_left_, &hessian_left_guess) ||
+      !planesFormWedge(hessian_right_guess, hessian_left_guess,
+                       computeMean(points_in_rect_right_),
+                       computeMean(points_in_rect_left_))) {
+    return true;
+  }
+  cv::Vec4f viewing_plane;
+  if (!WedgeEstimator::viewingPlane(toProjectionMatx(camera_P), line_2D,
+                                    &viewing_plane)) {
+    return true;
+  }
+  WedgeEstimatorParams wedge_params = wedge_estimator_.getParams();
+  wedge_params.max_deviation = params_->max_error_inlier_ransac;
+  wedge_estimator_.setParams(wedge_params);
+  if (!wedge_estimator_.fit(points_in_rect_right_, points_in_rect_left_,
+                            viewing_plane)) {
+    return true;
+  }
+  // The planes must be found as planeRANSAC would find them.
+  const cv::Vec4f& hessian_right = wedge_estimator_.getPlane(0);
+  const cv::Vec4f& hessian_left = wedge_estimator_.getPlane(1);
+  const double min_inliers = params_->min_inlier_ransac;
+  if (!takeInliersOfPlane(hessian_right, points_in_rect_right_,
+                          inliers_right) ||
+      inliers_right->size() < min_inliers * points_in_rect_right_.size() ||
+      !takeInliersOfPlane(hessian_left, points_in_rect_left_, inliers_left) ||
+      inliers_left->size() < min_inliers * points_in_rect_left_.size()) {
+    return true;
+  }
+  // Planar and discontinuity lines are left to find3DlineOnPlanes.
+  *wedge_found = planesFormWedge(hessian_right, hessian_left,
+                                 computeMean(*inliers_right),
+                                 computeMean(*inliers_left));
+  return true;
+}
+
+bool LineDetector::planesFormWedge(const cv::Vec4f& hessian_right,
+                                   const cv::Vec4f& hessian_left,
+                                   const cv::Vec3f& mean_right,
+                                   const cv::Vec3f& mean_left) const {
+  const cv::Vec3f normal_right(hessian_right[0], hessian_right[1],
+                               hessian_right[2]);
+  const cv::Vec3f normal_left(hessian_left[0], hessian_left[1],
+                              hessian_left[2]);
+  const cv::Vec3f mean_difference = mean_right - mean_left;
+  return fabs(mean_difference.dot(normal_right)) <
+             params_->max_dist_between_planes &&
+         fabs(mean_difference.dot(normal_left)) <
+             params_->max_dist_between_planes &&
+         fabs(normal_right.dot(normal_left)) <= kMinCosAngleParallelPlanes;
+}
+
+bool LineDetector::findDepthEdgeInliersGiven2DLine(
+    const cv::Vec4f& line_2D, const cv::Mat& cloud,
+    std::vector<cv::Vec3f>* inliers, std::vector<cv::Point2f>* rect_right,
+    std::vector<cv::Point2f>* rect_left, bool* depth_edge_found) {
+  CHECK_NOTNULL(inliers);
+  CHECK_NOTNULL(rect_right);
+  CHECK_NOTNULL(rect_left);
+  CHECK_NOTNULL(depth_edge_found);
+  *depth_edge_found = false;
+  getRectanglesFromLine(line_2D, rect_left, rect_right);
+  // The depths are compared at the middle of the rectangles.
+  const double offset = params_->rectangle_offset_pixels +
+      0.5 * cv::norm((*rect_left)[1] - (*rect_left)[0]);
+  bool left_in_front;
+  if (!depth_edge_detector_.findForegroundSide(cloud, line_2D, offset,
+                                               &left_in_front)) {
+    return true;
+  }
+  const std::vector<cv::Point2f>& rect = left_in_front ? *rect_left
+                                                       : *rect_right;
+  std::vector<cv::Vec3f>& points =
+      left_in_front ? points_in_rect_left_ : points_in_rect_right_;
+  std::vector<cv::Point2i>& pixels =
+      left_in_front ? pixels_in_rect_left_ : pixels_in_rect_right_;
+  // Same criteria as in findInliersGiven2DLine to discard the line.
+  if (!gatherPointsInRectangle(
+          rect, cloud, true, &points,
+          params_->max_points_per_rect > 0 ? &pixels : nullptr) ||
+      points.size() < params_->min_points_in_rect) {
+    return false;
+  }
+  findPlaneInliersInRectangle(cloud, rect, points, pixels, inliers);
+  *depth_edge_found =
+      inliers->size() >= params_->min_inlier_ransac * points.size();
+  return true;
+}
+
+void LineDetector::findPlaneInliersInRectangle(
+    const cv::Mat& cloud, const std::vector<cv::Point2f>& rect,
+    const std::vector<cv::Vec3f>& points,
+    const std::vector<cv::Point2i>& pixels, std::vector<cv::Vec3f>* inliers) {
+  CHECK_NOTNULL(inliers);
+  inliers->clear();
+  if (params_->use_plane_segmentation && plane_segmentation_ &&
+      plane_segmentation_->isSetTo(cloud,
+                                   getPlaneSegmentationParams())) {
+    cv::Vec4f hessian_normal_form;
+    double fraction;
+    if (plane_segmentation_->findDominantPlane(rect, &hessian_normal_form,
+                                               &fraction) !=
+            PlaneSegmentation::kNoPlane &&
+        fraction >= params_->min_dominant_plane_fraction &&
+        takeInliersOfPlane(hessian_normal_form, points, inliers)) {
+      return;
     }
   }
+  if (params_->use_integral_plane_fitting && integral_plane_fitter_ &&
+      integral_plane_fitter_->isSetTo(cloud)) {
+    const double max_residual =
+        params_->max_relative_residual_integral_plane_fitting *
+        params_->max_error_inlier_ransac;
+    PlaneMoments moments;
+    cv::Vec4f hessian_normal_form;
+    double mean_squared_residual;
+    integral_plane_fitter_->computeMomentsInRectangle(rect, &moments);
+    // If the points are (almost) all on the least-squares plane, use it.
+    if (IntegralPlaneFitter::fitPlane(moments, &hessian_normal_form,
+                                      &mean_squared_residual) &&
+        mean_squared_residual < max_residual * max_residual &&
+        takeInliersOfPlane(hessian_normal_form, points, inliers)) {
+      return;
+    }
+  }
+  // The rectangle is not planar enough (or no per-frame products are
+  // available).
+  if (!params_->use_plane_hypothesis_cache) {
+    planeRANSACInRectangle(rect, points, pixels, inliers);
+    return;
+  }
+  if (findInliersOfCachedPlane(rect, points, inliers)) {
+    statistics_.num_plane_hypothesis_cache_hits++;
+    return;
+  }
+  statistics_.num_plane_hypothesis_cache_misses++;
+  planeRANSACInRectangle(rect, points, pixels, inliers);
+  // Cache the least-squares plane of the inliers for the next lines.
+  CovariancePlaneFitter fitter;
+  fitter.addPoints(*inliers);
+  cv::Vec4f hessian_normal_form;
+  if (fitter.fit(&hessian_normal_form)) {
+    plane_hypothesis_cache_.addPlane(rect, hessian_normal_form);
+  }
+}
+
+void LineDetector::planeRANSACInRectangle(
+    const std::vector<cv::Point2f>& rect, const std::vector<cv::Vec3f>& points,
+    const std::vector<cv::Point2i>& pixels, std::vector<cv::Vec3f>* inliers) {
+  CHECK_NOTNULL(inliers);
+  constexpr size_t min_points_for_ransac = 3;
+  const size_t max_points = params_->max_points_per_rect;
+  if (max_points == 0 || points.size() <= max_points) {
+    planeRANSAC(points, inliers);
+    return;
+  }
+  sampleStratifiedPointsInRectangle(rect, points, pixels, max_points,
+                                    &sampled_points_);
+  if (sampled_points_.size() <= min_points_for_ransac) {
+    planeRANSAC(points, inliers);
+    return;
+  }
+  planeRANSAC(sampled_points_, &sampled_inliers_);
+  // The plane of the inliers of the sample is refined on all the points.
+  cv::Vec4f hessian_normal_form;
+  if (sampled_inliers_.size() < min_points_for_ransac ||
+      !hessianNormalFormOfPlane(sampled_inliers_, &hessian_normal_form)) {
+    inliers->clear();
+    return;
+  }
+  takeInliersOfPlane(hessian_normal_form, points, inliers);
+}
+
+bool LineDetector::findInliersOfCachedPlane(
+    const std::vector<cv::Point2f>& rect, const std::vector<cv::Vec3f>& points,
+    std::vector<cv::Vec3f>* inliers) {
+  CHECK_NOTNULL(inliers);
+  plane_hypothesis_cache_.findPlanes(rect, &cached_planes_);
+  if (cached_planes_.empty()) return false;
+  point_buffer_.assign(points);
+  const float max_deviation = params_->max_error_inlier_ransac;
+  size_t best_num_inliers = 0;
+  const cv::Vec4f* best_plane = nullptr;
+  for (const cv::Vec4f& plane : cached_planes_) {
+    const size_t num_inliers =
+        countPlaneInliers(point_buffer_, plane, max_deviation);
+    if (num_inliers > best_num_inliers) {
+      best_num_inliers = num_inliers;
+      best_plane = &plane;
+    }
+  }
+  // Same criterion as for the early stop of planeRANSAC.
+  if (best_plane == nullptr ||
+      best_num_inliers <= params_->inlier_max_ransac * points.size()) {
+    return false;
+  }
+  return takeInliersOfPlane(*best_plane, points, inliers);
+}
+
+bool LineDetector::takeInliersOfPlane(const cv::Vec4f& hessian,
+                                      const std::vector<cv::Vec3f>& points,
+                                      std::vector<cv::Vec3f>* inliers) {
+  CHECK_NOTNULL(inliers);
+  inliers->clear();
+  for (const cv::Vec3f& point : points) {
+    if (errorPointToPlane(hessian, point) < params_->max_error_inlier_ransac) {
+      inliers->push_back(point);
+    }
+  }
+  if (inliers->size() >= params_->min_num_inliers) {
+    const double max_discont =
+        params_->max_discont_in_point_to_mean_distance_connected_components;
+    if (params_->use_histogram_connectivity_check) {
+      cluster_distance_histogram_.setDistanceThreshold(max_discont);
+      cluster_distance_histogram_.clear();
+      cluster_distance_histogram_.addPoints(*inliers);
+      if (cluster_distance_histogram_.singleConnectedComponent()) {
+        return true;
+      }
+    } else {
+      ClusterDistanceFromMean cluster_distance_from_mean(max_discont);
+      cluster_distance_from_mean.addPoints(*inliers);
+      if (cluster_distance_from_mean.singleConnectedComponent()) {
+        return true;
+      }
+    }
+  }
+  inliers->clear();
+  return false;
 }
 
 void LineDetector::find3DlinesByShortest(const cv::Mat& cloud,
@@ -2637,72 +3864,18 @@ void LineDetector::find3DlinesByShortest(const cv::Mat& cloud,
   CHECK_NOTNULL(lines3D);
   CHECK_NOTNULL(correspondences);
   CHECK_EQ(cloud.type(), CV_32FC3);
-  int cols = cloud.cols;
-  int rows = cloud.rows;
-  // The actual patch size wil be bigger. The number of pixels within a patch
-  // is equal to (2*patch_size + 1)^2. And because for every pixel in the
-  // start patch the distance to every pixel in the end patch is computed, the
-  // complexity is proportional to (2*patch_size + 1)^4.
-  int patch_size = 1;
-  int x_opt_start, y_opt_start, x_min_start, x_max_start, y_min_start,
-      y_max_start, x_opt_end, y_opt_end, x_min_end, x_max_end, y_min_end,
-      y_max_end;
-  float dist, dist_opt;
-  cv::Vec3f start, end;
+  // The number of pixels within a patch is equal to (2*patch_size + 1)^2.
+  constexpr int kPatchSize = 1;
+  LineEndpointSearch endpoint_search;
+  cv::Vec6f line3D;
   correspondences->clear();
   lines3D->clear();
   for (size_t i = 0u; i < lines2D.size(); ++i) {
-    dist_opt = 1e20;
-    x_opt_start = lines2D[i][0];
-    y_opt_start = lines2D[i][1];
-    x_opt_end = lines2D[i][2];
-    y_opt_end = lines2D[i][3];
-    // This checks are used to make sure, that we do not try to access a
-    // point not within the image.
-    x_min_start = fitToBoundaryInt(x_opt_start - patch_size, 0, rows - 1);
-    x_max_start = fitToBoundaryInt(x_opt_start + patch_size, 0, rows - 1);
-    y_min_start = fitToBoundaryInt(y_opt_start - patch_size, 0, cols - 1);
-    y_max_start = fitToBoundaryInt(y_opt_start + patch_size, 0, cols - 1);
-    x_min_end = fitToBoundaryInt(x_opt_end - patch_size, 0, rows - 1);
-    x_max_end = fitToBoundaryInt(x_opt_end + patch_size, 0, rows - 1);
-    y_min_end = fitToBoundaryInt(y_opt_end - patch_size, 0, cols - 1);
-    y_max_end = fitToBoundaryInt(y_opt_end + patch_size, 0, cols - 1);
-    // For every pixel in start patch.
-    for (int x_start = x_min_start; x_start <= x_max_start; ++x_start) {
-      for (int y_start = y_min_start; y_start <= y_max_start; ++y_start) {
-        // For every pixel in end patch.
-        for (int x_end = x_min_end; x_end <= x_max_end; ++x_end) {
-          for (int y_end = y_min_end; y_end <= y_max_end; ++y_end) {
-            // Check that the corresponding 3D point is not NaN.
-            if (std::isnan(cloud.at<cv::Vec3f>(y_start, x_start)[0]) ||
-                std::isnan(cloud.at<cv::Vec3f>(y_end, x_end)[0])) {
-              continue;
-            }
-            // Compute distance and compare it to the optimal distance found
-            // so far.
-            start = cloud.at<cv::Vec3f>(y_start, x_start);
-            end = cloud.at<cv::Vec3f>(y_end, x_end);
-            dist = pow(start[0] - end[0], 2) + pow(start[1] - end[1], 2) +
-                   pow(start[2] - end[2], 2);
-            if (dist < dist_opt) {
-              dist_opt = dist;
-              x_opt_end = x_end;
-              x_opt_start = x_start;
-              y_opt_end = y_end;
-              y_opt_start = y_start;
-            }
-          }
-        }
-      }
+    if (!endpoint_search.findShortestLine(cloud, lines2D[i], kPatchSize,
+                                          &line3D)) {
+      continue;
     }
-    // Assuming that distances are in meters, we can safely assume that if our
-    // optimal distance is still 1e20, no non-NaN points were found.
-    if (dist_opt == 1e20) continue;
-    // Otherwise, a line was found.
-    start = cloud.at<cv::Vec3f>(y_opt_start, x_opt_start);
-    end = cloud.at<cv::Vec3f>(y_opt_end, x_opt_end);
-    lines3D->push_back(
-        cv::Vec6f(start[0], start[1], start[2], end[0], end[1], end[2]));
+    lines3D->push_back(line3D);
     correspondences->push_back(i);
   }
 }
@@ -2714,58 +3887,17 @@ void LineDetector::find3DlinesRated(const cv::Mat& cloud,
   CHECK_NOTNULL(lines3D);
   CHECK_NOTNULL(rating);
   CHECK_EQ(cloud.type(), CV_32FC3);
-  int cols = cloud.cols;
-  int rows = cloud.rows;
-  cv::Vec4f upper_line2D, lower_line2D;
-  cv::Point2f line;
-  cv::Vec6f lower_line3D, line3D, upper_line3D;
-  double rate_low, rate_mid, rate_up;
+  LineEndpointSearch endpoint_search;
+  cv::Vec6f line3D;
   lines3D->clear();
   lines3D->reserve(lines2D.size());
   rating->clear();
   rating->reserve(lines2D.size());
   for (size_t i = 0; i < lines2D.size(); ++i) {
-    line.x = lines2D[i][2] - lines2D[i][0];
-    line.y = lines2D[i][3] - lines2D[i][1];
-    double line_normalizer = sqrt(line.x * line.x + line.y * line.y);
-    upper_line2D[0] = fitToBoundary(
-        floor(lines2D[i][0]) + floor(line.y / line_normalizer + 0.5), 0.0,
-        cols - 1);
-    upper_line2D[1] = fitToBoundary(
-        floor(lines2D[i][1]) + floor(-line.x / line_normalizer + 0.5), 0.0,
-        rows - 1);
-    upper_line2D[2] = fitToBoundary(
-        floor(lines2D[i][2]) + floor(line.y / line_normalizer + 0.5), 0.0,
-        cols - 1);
-    upper_line2D[3] = fitToBoundary(
-        floor(lines2D[i][3]) + floor(-line.x / line_normalizer + 0.5), 0.0,
-        rows - 1);
-    lower_line2D[0] = fitToBoundary(
-        floor(lines2D[i][0]) + floor(-line.y / line_normalizer + 0.5), 0.0,
-        cols - 1);
-    lower_line2D[1] = fitToBoundary(
-        floor(lines2D[i][1]) + floor(line.x / line_normalizer + 0.5), 0.0,
-        rows - 1);
-    lower_line2D[2] = fitToBoundary(
-        floor(lines2D[i][2]) + floor(-line.y / line_normalizer + 0.5), 0.0,
-        cols - 1);
-    lower_line2D[3] = fitToBoundary(
-        floor(lines2D[i][3]) + floor(line.x / line_normalizer + 0.5), 0.0,
-        rows - 1);
-    rate_low = findAndRate3DLine(cloud, lower_line2D, &lower_line3D);
-    rate_mid = findAndRate3DLine(cloud, lines2D[i], &line3D);
-    rate_up = findAndRate3DLine(cloud, upper_line2D, &upper_line3D);
-
-    if (rate_up < rate_mid && rate_up < rate_low) {
-      lines3D->push_back(upper_line3D);
-      rating->push_back(rate_up);
-    } else if (rate_low < rate_mid) {
-      lines3D->push_back(lower_line3D);
-      rating->push_back(rate_low);
-    } else {
-      lines3D->push_back(line3D);
-      rating->push_back(rate_mid);
-    }
+    computeCloudRows(lines2D[i]);
+    rating->push_back(
+        endpoint_search.findRatedLine(cloud, lines2D[i], &line3D));
+    lines3D->push_back(line3D);
   }
 }
 void LineDetector::find3DlinesRated(const cv::Mat& cloud,
@@ -2796,6 +3928,33 @@ void LineDetector::runCheckOn3DLines(
   }
 }
 
+void LineDetector::runCheckOn3DLines(
+    const cv::Mat& cloud, const cv::Mat& camera_P,
+    const std::vector<LineWithPlanes>& lines3D_in,
+    std::vector<LineWithPlanes>* lines3D_out) {
+  // The cloud can have changed since the last call, even if it is stored in
+  // the same buffer.
+  voxel_hash_is_set_ = false;
+  runCheckOn3DLinesInCorridor(cloud, camera_P, nullptr, lines3D_in,
+                              lines3D_out);
+}
+
+void LineDetector::runCheckOn3DLinesInCorridor(
+    const cv::Mat& cloud, const cv::Mat& camera_P, FrameContext* frame,
+    const std::vector<LineWithPlanes>& lines3D_in,
+    std::vector<LineWithPlanes>* lines3D_out) {
+  CHECK_NOTNULL(lines3D_out);
+  lines3D_out->clear();
+  LineWithPlanes line_cand;
+  for (size_t i = 0; i < lines3D_in.size(); ++i) {
+    line_cand = lines3D_in[i];
+    if (checkIfValidLineInCorridor(cloud, camera_P, frame,
+                                   &(line_cand.line))) {
+      lines3D_out->push_back(line_cand);
+    }
+  }
+}
+
 void LineDetector::runCheckOn3DLines(
     const cv::Mat& cloud, const cv::Mat& camera_P,
     const std::vector<cv::Vec4f>& lines2D_in,
@@ -2804,15 +3963,25 @@ void LineDetector::runCheckOn3DLines(
     std::vector<LineWithPlanes>* lines3D_out) {
   CHECK_NOTNULL(lines2D_out);
   CHECK_NOTNULL(lines3D_out);
+  CHECK_EQ(cloud.type(), CV_32FC3);
+  CHECK_EQ(camera_P.type(), CV_32FC1);
+  CHECK_EQ(lines2D_in.size(), lines3D_in.size());
   lines3D_out->clear();
   lines2D_out->clear();
+  // Reproject all the lines in one pass.
+  lines3D_to_reproject_.resize(lines3D_in.size());
+  for (size_t i = 0; i < lines3D_in.size(); ++i) {
+    lines3D_to_reproject_[i] = lines3D_in[i].line;
+  }
+  projectSegments(toProjectionMatx(camera_P), lines3D_to_reproject_,
+                  &reprojected_lines_);
   LineWithPlanes line_cand;
   cv::Vec4f line_cand_2D;
   for (size_t i = 0; i < lines3D_in.size(); ++i) {
     line_cand = lines3D_in[i];
     line_cand_2D = lines2D_in[i];
-    if (checkIfValidLineWith2DInfo(cloud, camera_P, line_cand_2D,
-                                   &(line_cand.line))) {
+    if (checkIfValidReprojectedLine(cloud, line_cand_2D, reprojected_lines_[i],
+                                    &(line_cand.line))) {
       lines3D_out->push_back(line_cand);
       lines2D_out->push_back(line_cand_2D);
     } else {
@@ -2823,6 +3992,27 @@ void LineDetector::runCheckOn3DLines(
   }
 }
 
+void LineDetector::runCheckOn3DLines(
+    FrameContext* frame, const std::vector<cv::Vec4f>& lines2D_in,
+    const std::vector<LineWithPlanes>& lines3D_in,
+    std::vector<cv::Vec4f>* lines2D_out,
+    std::vector<LineWithPlanes>* lines3D_out) {
+  CHECK_NOTNULL(frame);
+  DepthCloud* depth_cloud = frame->getDepthCloud();
+  runCheckOn3DLines(
+      depth_cloud != nullptr ? depth_cloud->getPartialCloud()
+                             : frame->getCloud(),
+      frame->getCameraP(), lines2D_in, lines3D_in, lines2D_out, lines3D_out);
+}
+
+void LineDetector::runCheckOn3DLines(
+    FrameContext* frame, const std::vector<LineWithPlanes>& lines3D_in,
+    std::vector<LineWithPlanes>* lines3D_out) {
+  CHECK_NOTNULL(frame);
+  runCheckOn3DLinesInCorridor(frame->getCloud(), frame->getCameraP(), frame,
+                              lines3D_in, lines3D_out);
+}
+
 void LineDetector::runCheckOn2DLines(const cv::Mat& cloud,
                                      const std::vector<cv::Vec4f>& lines2D_in,
                                      std::vector<cv::Vec4f>* lines2D_out) {
@@ -2843,6 +4033,13 @@ bool LineDetector::checkIfValidLineWith2DInfo(const cv::Mat& cloud,
   CHECK_NOTNULL(line);
   CHECK_EQ(cloud.type(), CV_32FC3);
   CHECK_EQ(camera_P.type(), CV_32FC1);
+  return checkIfValidReprojectedLine(
+      cloud, line_2D, projectSegment(toProjectionMatx(camera_P), *line), line);
+}
+
+bool LineDetector::checkIfValidReprojectedLine(
+    const cv::Mat& cloud, const cv::Vec4f& line_2D,
+    const cv::Vec4f& line_3D_reprojected, cv::Vec6f* line) {
   // First check: if one of the points near exactly on the origin, get rid of
   // it.
   if ((fabs((*line)[0]) < 1e-3 && fabs((*line)[1]) < 1e-3 &&
@@ -2873,10 +4070,6 @@ bool LineDetector::checkIfValidLineWith2DInfo(const cv::Mat& cloud,
     return false;
   }
 
-  cv::Vec4f line_3D_reprojected;
-
-  project3DLineTo2D(start_3D, end_3D, camera_P, &line_3D_reprojected);
-
   cv::Vec2f start_2D({line_3D_reprojected[0], line_3D_reprojected[1]});
   cv::Vec2f end_2D({line_3D_reprojected[2], line_3D_reprojected[3]});
 
@@ -2918,46 +4111,57 @@ bool LineDetector::checkIfValidLineBruteForce(const cv::Mat& cloud,
        fabs((*line)[5]) < 1e-3)) {
     return false;
   }
-  // Minimum number of inliers for the line to be valid.
-  const int num_of_points_required = params_->min_points_in_line;
-  // Maximum deviation for a point to count as an inlier.
-  double max_deviation = params_->max_deviation_inlier_line_check;
   // This point density measures the where the points lie on the line. It is
   // used to truncate the line on the ends, if one end lies in empty space.
-  int point_density[num_of_points_required];
-  for (int i = 0; i < num_of_points_required; ++i) {
-    point_density[i] = 0;
-  }
-
-  double dist;
-  cv::Vec3f start, end, point;
+  std::vector<int> point_density(params_->min_points_in_line, 0);
+  cv::Vec3f start, end;
   start = {(*line)[0], (*line)[1], (*line)[2]};
   end = {(*line)[3], (*line)[4], (*line)[5]};
-  double length = cv::norm(start - end);
   int count_inliers = 0;
   // For every point in the cloud: This is why it is called brute force
   // approach.
   for (int i = 0; i < cloud.rows; ++i) {
+    const cv::Vec3f* cloud_row = cloud.ptr<cv::Vec3f>(i);
     for (int j = 0; j < cloud.cols; ++j) {
-      point = cloud.at<cv::Vec3f>(i, j);
-      // Check if the distance to the line is below the threshold. This
-      // computes the distance to the infinite line.
-      if (distPointToLine(start, end, point) < max_deviation) {
-        // This is the distance from the start point projected on to the line.
-        // If its negative or larger the line length, the point may lie on the
-        // line, but not between the start and the end point.
-        dist = (end - start).dot(point - start) / length;
-        if (dist < 0 || length <= dist) {
-          continue;
-        }
-        // Now the histogramm like point_density is raised at the entry where
-        // the point lies.
-        point_density[(int)(dist / length * (double)num_of_points_required)] +=
-            1;
-        ++count_inliers;
-      }
+      addPointToLineDensity(start, end, cloud_row[j], &point_density,
+                            &count_inliers);
     }
   }
+  return truncateLineUsingPointDensity(point_density, count_inliers, line);
+}
+
+void LineDetector::addPointToLineDensity(const cv::Vec3f& start,
+                                         const cv::Vec3f& end,
+                                         const cv::Vec3f& point,
+                                         std::vector<int>* point_density,
+                                         int* count_inliers) {
+  // Maximum deviation for a point to count as an inlier.
+  const double max_deviation = params_->max_deviation_inlier_line_check;
+  // Check if the distance to the line is below the threshold. This computes the
+  // distance to the infinite line.
+  if (!(distPointToLine(start, end, point) < max_deviation)) {
+    return;
+  }
+  // This is the distance from the start point projected on to the line. If its
+  // negative or larger the line length, the point may lie on the line, but not
+  // between the start and the end point.
+  const double length = cv::norm(start - end);
+  const double dist = (end - start).dot(point - start) / length;
+  if (dist < 0 || length <= dist) {
+    return;
+  }
+  // Now the histogramm like point_density is raised at the entry where the
+  // point lies.
+  (*point_density)[(int)(dist / length * (double)point_density->size())] += 1;
+  ++(*count_inliers);
+}
+
+bool LineDetector::truncateLineUsingPointDensity(
+    const std::vector<int>& point_density, int count_inliers,
+    cv::Vec6f* line) {
+  CHECK_NOTNULL(line);
+  // Minimum number of inliers for the line to be valid.
+  const int num_of_points_required = point_density.size();
   // Only take lines with enough inliers.
   if (count_inliers <= num_of_points_required) {
     return false;
@@ -2967,7 +4171,9 @@ bool LineDetector::checkIfValidLineBruteForce(const cv::Mat& cloud,
   int back = num_of_points_required - 1;
   while (0 == point_density[front]) ++front;
   while (0 == point_density[back]) --back;
-  cv::Vec3f direction;
+  cv::Vec3f start, end, direction;
+  start = {(*line)[0], (*line)[1], (*line)[2]};
+  end = {(*line)[3], (*line)[4], (*line)[5]};
   direction = end - start;
   // This part will truncate the line, if the point_density was zero at either
   // the back or the front. Otherwise it has no influence.
@@ -2978,6 +4184,203 @@ bool LineDetector::checkIfValidLineBruteForce(const cv::Mat& cloud,
   return true;
 }
 
+bool LineDetector::checkIfValidLineInCorridor(const cv::Mat& cloud,
+                                              const cv::Mat& camera_P,
+                                              cv::Vec6f* line) {
+  voxel_hash_is_set_ = false;
+  return checkIfValidLineInCorridor(cloud, camera_P, nullptr, line);
+}
+
+CloudVoxelHash* LineDetector::getCorridorVoxelHash(const cv::Mat& cloud,
+                                                   FrameContext* frame) {
+  // The voxels have twice the size of the maximum deviation, so that the voxel
+  // hash returns all the points closer than max_deviation to a segment.
+  const double voxel_size = 2.0 * params_->max_deviation_inlier_line_check;
+  if (frame != nullptr) {
+    return frame->getVoxelHash(voxel_size).get();
+  }
+  if (!voxel_hash_is_set_) {
+    if (voxel_hash_ == nullptr) {
+      voxel_hash_ = std::make_shared<CloudVoxelHash>();
+    }
+    voxel_hash_->setCloud(cloud, voxel_size);
+    voxel_hash_is_set_ = true;
+  }
+  return voxel_hash_.get();
+}
+
+bool LineDetector::checkIfValidLineInCorridor(const cv::Mat& cloud,
+                                              const cv::Mat& camera_P,
+                                              FrameContext* frame,
+                                              cv::Vec6f* line) {
+  CHECK_NOTNULL(line);
+  CHECK_EQ(cloud.type(), CV_32FC3);
+  CHECK_EQ(camera_P.rows, 3);
+  CHECK_EQ(camera_P.cols, 4);
+  // Same first check as in checkIfValidLineBruteForce.
+  if ((fabs((*line)[0]) < 1e-3 && fabs((*line)[1]) < 1e-3 &&
+       fabs((*line)[2]) < 1e-3) ||
+      (fabs((*line)[3]) < 1e-3 && fabs((*line)[4]) < 1e-3 &&
+       fabs((*line)[5]) < 1e-3)) {
+    return false;
+  }
+  const double max_deviation = params_->max_deviation_inlier_line_check;
+  const cv::Matx34f P = toProjectionMatx(camera_P);
+  const cv::Vec4f depth_row(P(2, 0), P(2, 1), P(2, 2), P(2, 3));
+  const double depth_scale =
+      cv::norm(cv::Vec3f(depth_row[0], depth_row[1], depth_row[2]));
+  CHECK_GT(depth_scale, 0.0);
+  // Points closer than this to the camera plane are not searched through their
+  // projection: the corridor would be too wide there.
+  const double min_depth = std::max(0.1, 2.0 * max_deviation);
+
+  const cv::Vec3f start((*line)[0], (*line)[1], (*line)[2]);
+  const cv::Vec3f end((*line)[3], (*line)[4], (*line)[5]);
+  auto depth = [&depth_row, depth_scale](const cv::Vec3f& point) {
+    return (depth_row[0] * point[0] + depth_row[1] * point[1] +
+            depth_row[2] * point[2] + depth_row[3]) / depth_scale;
+  };
+  auto project = [&P](const cv::Vec3f& point) {
+    const cv::Vec3f homogeneous = P * cv::Vec4f(point[0], point[1], point[2],
+                                                1.0f);
+    return cv::Point2f(homogeneous[0] / homogeneous[2],
+                       homogeneous[1] / homogeneous[2]);
+  };
+
+  // The pixels are identified by their index row * cols + col.
+  const int cols = cloud.cols;
+  std::vector<int>& pixel_indices = corridor_pixel_indices_;
+  pixel_indices.clear();
+  // Part of the line, in the parametrization start + t * (end - start), that
+  // is searched through the corridor. All the rest is searched in the voxel
+  // hash.
+  double t_corridor_start = 0.0, t_corridor_end = 0.0;
+  // Restrict the line to the part that is far enough in front of the camera.
+  const double depth_start = depth(start);
+  const double depth_end = depth(end);
+  double t_front_start = 0.0, t_front_end = 1.0;
+  if (depth_start < min_depth && depth_end < min_depth) {
+    t_front_end = -1.0;
+  } else if (depth_start < min_depth) {
+    t_front_start = (min_depth - depth_start) / (depth_end - depth_start);
+  } else if (depth_end < min_depth) {
+    t_front_end = (min_depth - depth_start) / (depth_end - depth_start);
+  }
+  if (t_front_start < t_front_end) {
+    const cv::Vec3f front_start = start + (end - start) * t_front_start;
+    const cv::Vec3f front_end = start + (end - start) * t_front_end;
+    const cv::Point2f start_2D = project(front_start);
+    const cv::Point2f end_2D = project(front_end);
+    // Half width of the corridor: an upper bound of the displacement in the
+    // image of a point moved by max_deviation from the line. The depth along
+    // the line is linear, therefore the largest displacement is found at one
+    // of the ends. It is scaled up for the points that are up to max_deviation
+    // closer to the camera, and a safety factor and a margin are added.
+    double half_width = 0.0;
+    for (const cv::Vec3f& point : {front_start, front_end}) {
+      const cv::Point2f point_2D = project(point);
+      double displacement = 0.0;
+      for (size_t k = 0; k < 3; ++k) {
+        cv::Vec3f moved = point;
+        moved[k] += max_deviation;
+        displacement += cv::norm(project(moved) - point_2D);
+      }
+      const double point_depth = depth(point);
+      displacement *= point_depth / (point_depth - max_deviation);
+      half_width = std::max(half_width, displacement);
+    }
+    constexpr double kCorridorSafetyFactor = 1.5;
+    constexpr double kCorridorMarginPixels = 2.0;
+    half_width = kCorridorSafetyFactor * half_width + kCorridorMarginPixels;
+    // Clip the projected line to the image, enlarged by the half width
+    // (Liang-Barsky).
+    const cv::Point2f direction_2D = end_2D - start_2D;
+    double s_start = 0.0, s_end = 1.0;
+    const double p[4] = {-direction_2D.x, direction_2D.x, -direction_2D.y,
+                         direction_2D.y};
+    const double q[4] = {start_2D.x + half_width,
+                         cloud.cols - 1 + half_width - start_2D.x,
+                         start_2D.y + half_width,
+                         cloud.rows - 1 + half_width - start_2D.y};
+    for (size_t k = 0; k < 4 && s_start <= s_end; ++k) {
+      if (p[k] == 0.0) {
+        if (q[k] < 0.0) s_start = 2.0;
+        continue;
+      }
+      const double r = q[k] / p[k];
+      if (p[k] < 0.0) {
+        s_start = std::max(s_start, r);
+      } else {
+        s_end = std::min(s_end, r);
+      }
+    }
+    if (s_start <= s_end) {
+      // Go back from the parametrization of the 2D line to the one of the 3D
+      // line (the projection is not linear along the line).
+      const double w_start = depth(front_start);
+      const double w_end = depth(front_end);
+      auto to3D = [w_start, w_end](double s) {
+        return s * w_start / (w_end - s * (w_end - w_start));
+      };
+      t_corridor_start = t_front_start +
+                         to3D(s_start) * (t_front_end - t_front_start);
+      t_corridor_end = t_front_start +
+                       to3D(s_end) * (t_front_end - t_front_start);
+      // The corridor is a rectangle around the clipped line, prolonged by the
+      // half width at both ends.
+      const cv::Point2f corridor_start = start_2D + direction_2D * s_start;
+      const cv::Point2f corridor_end = start_2D + direction_2D * s_end;
+      cv::Point2f along = corridor_end - corridor_start;
+      const double length_2D = cv::norm(along);
+      if (length_2D > 1e-6) {
+        along *= 1.0 / length_2D;
+      } else {
+        along = cv::Point2f(1.0f, 0.0f);
+      }
+      along *= half_width;
+      const cv::Point2f across(-along.y, along.x);
+      const std::vector<cv::Point2f> corridor{
+          corridor_start - along - across, corridor_start - along + across,
+          corridor_end + along + across, corridor_end + along - across};
+      forEachValidPointInRectangle(
+          corridor, cloud,
+          [&pixel_indices, cols](int row, int col, const cv::Vec3f&) {
+            pixel_indices.push_back(row * cols + col);
+            return true;
+          });
+    }
+  }
+  // The parts of the line outside the corridor are searched in the voxel hash,
+  // which is only built if there are such parts.
+  if (t_corridor_start >= t_corridor_end) {
+    getCorridorVoxelHash(cloud, frame)
+        ->findPointsNearSegment(start, end, &pixel_indices);
+  } else {
+    if (t_corridor_start > 0.0) {
+      getCorridorVoxelHash(cloud, frame)->findPointsNearSegment(
+          start, start + (end - start) * t_corridor_start, &pixel_indices);
+    }
+    if (t_corridor_end < 1.0) {
+      getCorridorVoxelHash(cloud, frame)->findPointsNearSegment(
+          start + (end - start) * t_corridor_end, end, &pixel_indices);
+    }
+  }
+  // A point can be found both in the corridor and in the voxel hash.
+  std::sort(pixel_indices.begin(), pixel_indices.end());
+  pixel_indices.erase(std::unique(pixel_indices.begin(), pixel_indices.end()),
+                      pixel_indices.end());
+
+  std::vector<int> point_density(params_->min_points_in_line, 0);
+  int count_inliers = 0;
+  // The cloud is not necessarily continuous (e.g., a region of interest).
+  for (const int pixel_index : pixel_indices) {
+    const cv::Vec3f& point =
+        cloud.ptr<cv::Vec3f>(pixel_index / cols)[pixel_index % cols];
+    addPointToLineDensity(start, end, point, &point_density, &count_inliers);
+  }
+  return truncateLineUsingPointDensity(point_density, count_inliers, line);
+}
+
 bool LineDetector::checkIfValidLineDiscont(const cv::Mat& cloud,
                                            const cv::Vec4f& line) {
   CHECK_EQ(cloud.type(), CV_32FC3);
@@ -3077,15 +4480,12 @@ void LineDetector::getNearestPointToLine(const std::vector<cv::Vec3f>& points,
                                          cv::Vec3f* nearest_point) {
   CHECK_NOTNULL(nearest_point);
 
-  cv::Vec3f direction = end - start;
-  normalizeVector3D(&direction);
-
+  point_buffer_.assign(points);
+  distancesToLine(point_buffer_, start, end, &distances_);
   double min_dist = 1e9;
   for (size_t i = 0; i < points.size(); ++i) {
-    double dist = distPointToLine(start, end, points[i]);
-
-    if (dist < min_dist) {
-      min_dist = dist;
+    if (distances_[i] < min_dist) {
+      min_dist = distances_[i];
       *nearest_point = points[i];
     }
   }
@@ -3117,14 +4517,15 @@ bool LineDetector::adjustLineUsingInliers(const std::vector<cv::Vec3f>& points,
   double dist;
   double dist_min = 1e9;
   double dist_max = -1e9;
-  size_t count_inliers = 0u;
+  point_buffer_.assign(points);
+  const size_t count_inliers =
+      markLineInliers(point_buffer_, start_in, end_in,
+                      params_->max_deviation_inlier_line_check, &inlier_mask_);
+  positionsOnLine(point_buffer_, start_in, end_in, &positions_on_line_);
+  const double length = cv::norm(end_in - start_in);
   for (size_t i = 0u; i < points.size(); ++i) {
-    if (distPointToLine(start_in, end_in, points[i]) >
-        params_->max_deviation_inlier_line_check) {
-      continue;
-    }
-    ++count_inliers;
-    dist = direction.dot(points[i] - start_in);
+    if (!inlier_mask_[i]) continue;
+    dist = positions_on_line_[i] * length;
     if (dist < dist_min) {
       dist_min = dist;
     }
@@ -3185,18 +4586,16 @@ void LineDetector::fitDiscontLineToInliers(const std::vector<cv::Vec3f>& points,
   c = static_cast<float>(hessian[2]);
   d = static_cast<float>(hessian[3]);
 
+  const cv::Matx34f P = toProjectionMatx(camera_P);
   cv::Mat A(3, 3, CV_32F);
   for (size_t i = 0; i < 3; ++i) {
-    A.at<float>(i, 0) = camera_P.at<float>(i, 0) -
-                        a * camera_P.at<float>(i, 2) / c;
-    A.at<float>(i, 1) = camera_P.at<float>(i, 1) -
-                        b * camera_P.at<float>(i, 2) / c;
-    A.at<float>(i, 2) = camera_P.at<float>(i, 3) -
-                        d * camera_P.at<float>(i, 2) / c;
+    A.at<float>(i, 0) = P(i, 0) - a * P(i, 2) / c;
+    A.at<float>(i, 1) = P(i, 1) - b * P(i, 2) / c;
+    A.at<float>(i, 2) = P(i, 3) - d * P(i, 2) / c;
   }
   // Find projection in 2D of the reference line.
-  project3DPointTo2D(start_ref, camera_P, &start_ref_2D);
-  project3DPointTo2D(end_ref, camera_P, &end_ref_2D);
+  start_ref_2D = projectPoint(P, start_ref);
+  end_ref_2D = projectPoint(P, end_ref);
 
   // Find (X, Y, 1) on the inlier plane for both endpoints of the reference
   // line, as described above.
@@ -3224,7 +4623,7 @@ void LineDetector::fitDiscontLineToInliers(const std::vector<cv::Vec3f>& points,
   double min_dist_from_line_2D = 1e9;
   double temp_dist_from_line_2D;
   cv::Vec3f distance_vector_3D, projection_on_line_3D;
-  cv::Vec2f point_2D, projection_on_line_2D;
+  cv::Vec2f projection_on_line_2D;
   cv::Vec2f reference_line_direction_2D = (end_ref_2D - start_ref_2D);
   normalizeVector2D(&reference_line_direction_2D);
   cv::Vec3f reference_line_direction_3D = end_out_temp - start_out_temp;
@@ -3233,8 +4632,9 @@ void LineDetector::fitDiscontLineToInliers(const std::vector<cv::Vec3f>& points,
   int idx_point_closest_to_line;
   cv::Vec3f projection_of_closest_point_on_hessian;
   // Find the inlier point that is closer to the reference line in 2D.
+  projectPoints(P, points, &points_2D_buffer_);
   for (size_t i = 0; i < points.size(); ++i) {
-    project3DPointTo2D(points[i], camera_P, &point_2D);
+    const cv::Vec2f& point_2D = points_2D_buffer_[i];
     projection_on_line_2D =
         start_ref_2D + (point_2D - start_ref_2D).dot(
           reference_line_direction_2D) * reference_line_direction_2D;
@@ -3313,16 +4713,12 @@ bool LineDetector::checkIfValidLineUsingInliers(
     const std::vector<cv::Vec3f>& points, const cv::Vec3f& start,
     const cv::Vec3f& end) {
   std::vector<double> positions_on_line;
-  double length = cv::norm(start - end);
-  cv::Vec3f direction = end - start;
-  normalizeVector3D(&direction);
+  point_buffer_.assign(points);
+  markLineInliers(point_buffer_, start, end,
+                  params_->max_deviation_inlier_line_check, &inlier_mask_);
+  positionsOnLine(point_buffer_, start, end, &positions_on_line_);
   for (size_t i = 0u; i < points.size(); ++i) {
-    if (distPointToLine(start, end, points[i]) >
-        params_->max_deviation_inlier_line_check) {
-      continue;
-    }
-    double position_on_line = direction.dot(points[i] - start) / length;
-    positions_on_line.push_back(position_on_line);
+    if (inlier_mask_[i]) positions_on_line.push_back(positions_on_line_[i]);
   }
   const double ratio_mid = getRatioOfPointsAroundCenter(positions_on_line);
   // Most points are near the start and end points, reject this line.
@@ -3335,51 +4731,164 @@ bool LineDetector::checkIfValidLineUsingInliers(
 }
 
 void LineDetector::displayStatistics() {
-  int total_num_lines = num_discontinuity_lines + num_planar_lines +
-                        num_intersection_lines + num_edge_lines;
+  const LineDetectionStatistics& stats = statistics_;
+  int total_num_lines = stats.num_discontinuity_lines + stats.num_planar_lines +
+                        stats.num_intersection_lines + stats.num_edge_lines;
   LOG(INFO) << "Found " << total_num_lines << " total lines, of which:\n* "
-            << num_discontinuity_lines << " discontinuity lines\n* "
-            << num_planar_lines << " planar lines\n* "
-            << num_edge_lines << " edge lines\n* "
-            << num_intersection_lines << " intersection lines.";
-  LOG(INFO) << num_lines_discarded_for_convexity_concavity << " lines were "
-            << "discarded because it was not possible to determine convexity/"
-            << "concavity";
+            << stats.num_discontinuity_lines << " discontinuity lines\n* "
+            << stats.num_planar_lines << " planar lines\n* "
+            << stats.num_edge_lines << " edge lines\n* "
+            << stats.num_intersection_lines << " intersection lines.";
+  LOG(INFO) << stats.num_lines_discarded_for_convexity_concavity
+            << " lines were discarded because it was not possible to "
+            << "determine convexity/concavity";
   LOG(INFO) << "Among the edge/intersection lines that were assigned to their "
             << "type by looking at the prolonged lines/planes the following "
             << "occurrences for each configuration were found (format: "
             << "before_start [L][R]/[L][R] after end):"
             << "\n* [0][0]/[0][0]: "
-            << occurrences_config_prolonged_plane[0][0][0][0]
+            << stats.occurrences_config_prolonged_plane[0][0][0][0]
             << "\n* [0][0]/[0][1], [0][0]/[1][0], [0][1]/[0][0], "
             << "[1][0]/[0][0]: "
-            << occurrences_config_prolonged_plane[1][0][0][0]
+            << stats.occurrences_config_prolonged_plane[1][0][0][0]
             << "\n* [1][1]/[0][0], [0][0]/[1][1]: "
-            << occurrences_config_prolonged_plane[1][1][0][0]
+            << stats.occurrences_config_prolonged_plane[1][1][0][0]
             << "\n* [1][0]/[1][0], [0][1]/[0][1]: "
-            << occurrences_config_prolonged_plane[1][0][1][0]
+            << stats.occurrences_config_prolonged_plane[1][0][1][0]
             << "\n* [1][0]/[0][1], [0][1]/[1][0]: "
-            << occurrences_config_prolonged_plane[1][0][0][1]
+            << stats.occurrences_config_prolonged_plane[1][0][0][1]
             << "\n* [1][1]/[1][0], [1][1]/[0][1], [1][0]/[1][1], "
             << "[0][1]/[1][1]: "
-            << occurrences_config_prolonged_plane[1][1][1][0]
+            << stats.occurrences_config_prolonged_plane[1][1][1][0]
             << "\n* [1][1]/[1][1]: "
-            << occurrences_config_prolonged_plane[1][1][1][1];
+            << stats.occurrences_config_prolonged_plane[1][1][1][1];
+  if (params_->use_plane_hypothesis_cache) {
+    LOG(INFO) << "Plane hypothesis cache: "
+              << stats.num_plane_hypothesis_cache_hits << " hits, "
+              << stats.num_plane_hypothesis_cache_misses << " misses.";
+  }
+  LOG(INFO) << "Lines rejected before fitting the planes: "
+            << stats.num_lines_rejected_by_rating << " without 3D guess";
+  if (params_->use_line_prefilters) {
+    LOG(INFO) << "Lines rejected by the prefilters: "
+              << stats.num_lines_rejected_by_length_3D << " too short in 3D, "
+              << stats.num_lines_rejected_by_length_2D
+              << " without length in 2D, "
+              << stats.num_lines_rejected_by_rectangle_size
+              << " with too small rectangles, "
+              << stats.num_lines_rejected_by_missing_depth
+              << " with missing depth.";
+  }
 }
 
 void LineDetector::resetStatistics() {
+  statistics_.reset();
+}
+
+void LineDetectionStatistics::reset() {
   num_discontinuity_lines = 0;
   num_planar_lines = 0;
   num_intersection_lines = 0;
   num_edge_lines = 0;
   num_lines_discarded_for_convexity_concavity = 0;
-  occurrences_config_prolonged_plane[0][0][0][0] = 0;
-  occurrences_config_prolonged_plane[1][0][0][0] = 0;
-  occurrences_config_prolonged_plane[1][1][0][0] = 0;
-  occurrences_config_prolonged_plane[1][0][1][0] = 0;
-  occurrences_config_prolonged_plane[1][0][0][1] = 0;
-  occurrences_config_prolonged_plane[1][1][1][0] = 0;
-  occurrences_config_prolonged_plane[1][1][1][1] = 0;
+  int* occurrences = &occurrences_config_prolonged_plane[0][0][0][0];
+  std::fill(occurrences, occurrences + 16, 0);
+  num_lines_successfully_projected_to_3D = 0;
+  num_plane_hypothesis_cache_hits = 0;
+  num_plane_hypothesis_cache_misses = 0;
+  num_lines_rejected_by_rating = 0;
+  num_lines_rejected_by_length_3D = 0;
+  num_lines_rejected_by_length_2D = 0;
+  num_lines_rejected_by_rectangle_size = 0;
+  num_lines_rejected_by_missing_depth = 0;
+}
+
+void LineDetectionStatistics::merge(const LineDetectionStatistics& other) {
+  num_discontinuity_lines += other.num_discontinuity_lines;
+  num_planar_lines += other.num_planar_lines;
+  num_intersection_lines += other.num_intersection_lines;
+  num_edge_lines += other.num_edge_lines;
+  num_lines_discarded_for_convexity_concavity +=
+      other.num_lines_discarded_for_convexity_concavity;
+  int* occurrences = &occurrences_config_prolonged_plane[0][0][0][0];
+  const int* other_occurrences =
+      &other.occurrences_config_prolonged_plane[0][0][0][0];
+  for (size_t i = 0; i < 16; ++i) {
+    occurrences[i] += other_occurrences[i];
+  }
+  num_lines_successfully_projected_to_3D +=
+      other.num_lines_successfully_projected_to_3D;
+  num_plane_hypothesis_cache_hits += other.num_plane_hypothesis_cache_hits;
+  num_plane_hypothesis_cache_misses += other.num_plane_hypothesis_cache_misses;
+  num_lines_rejected_by_rating += other.num_lines_rejected_by_rating;
+  num_lines_rejected_by_length_3D += other.num_lines_rejected_by_length_3D;
+  num_lines_rejected_by_length_2D += other.num_lines_rejected_by_length_2D;
+  num_lines_rejected_by_rectangle_size +=
+      other.num_lines_rejected_by_rectangle_size;
+  num_lines_rejected_by_missing_depth +=
+      other.num_lines_rejected_by_missing_depth;
+}
+
+void ProjectionBudgetReport::reset() {
+  deadline_reached = false;
+  elapsed_ms = 0.0;
+  num_processed_lines = 0;
+  min_ransac_iteration_scale = 1.0;
+  skipped_lines2D.clear();
+}
+
+LineSet::LineSet(const std::vector<LineWithPlanes>& lines) {
+  reserve(lines.size());
+  for (const LineWithPlanes& line : lines) {
+    push_back(line);
+  }
+}
+
+void LineSet::clear() {
+  lines_.clear();
+  hessians_.clear();
+  colors_.clear();
+  types_.clear();
+}
+
+void LineSet::reserve(size_t num_lines) {
+  lines_.reserve(num_lines);
+  hessians_.reserve(num_lines);
+  colors_.reserve(num_lines);
+  types_.reserve(num_lines);
+}
+
+void LineSet::push_back(const LineWithPlanes& line) {
+  lines_.push_back(line.line);
+  hessians_.push_back(line.hessians);
+  colors_.push_back(line.colors);
+  types_.push_back(line.type);
+}
+
+LineWithPlanes LineSet::get(size_t i) const {
+  CHECK_LT(i, size());
+  LineWithPlanes line;
+  line.line = lines_[i];
+  line.hessians = hessians_[i];
+  line.colors = colors_[i];
+  line.type = types_[i];
+  return line;
+}
+
+void LineSet::set(size_t i, const LineWithPlanes& line) {
+  CHECK_LT(i, size());
+  lines_[i] = line.line;
+  hessians_[i] = line.hessians;
+  colors_[i] = line.colors;
+  types_[i] = line.type;
+}
+
+void LineSet::toVector(std::vector<LineWithPlanes>* lines) const {
+  CHECK_NOTNULL(lines);
+  lines->resize(size());
+  for (size_t i = 0; i < size(); ++i) {
+    (*lines)[i] = get(i);
+  }
 }
 
 }  // namespace line_detection
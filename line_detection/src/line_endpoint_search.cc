@@ -0,0 +1,229 @@
+#include "line_detection/line_endpoint_search.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "line_detection/line_detection.h"
+
+namespace line_detection {
+
+constexpr double LineEndpointSearch::kInvalidRating;
+
+namespace {
+
+inline bool isNaNPixel(const cv::Mat& cloud, const cv::Point& pixel) {
+  return std::isnan(cloud.ptr<cv::Vec3f>(pixel.y)[pixel.x][0]);
+}
+
+inline const cv::Vec3f& pixelPoint(const cv::Mat& cloud,
+                                   const cv::Point& pixel) {
+  return cloud.ptr<cv::Vec3f>(pixel.y)[pixel.x];
+}
+
+inline cv::Point clampPixel(const cv::Point& pixel, int cols, int rows) {
+  return cv::Point(fitToBoundaryInt(pixel.x, 0, cols - 1),
+                   fitToBoundaryInt(pixel.y, 0, rows - 1));
+}
+
+}  // namespace
+
+LineEndpointSearch::LineEndpointSearch() {}
+
+void LineEndpointSearch::rasterize(const cv::Mat& cloud,
+                                   const cv::Point& start,
+                                   const cv::Point& end,
+                                   std::vector<cv::Point>* path) {
+  path->clear();
+  cv::LineIterator it(cloud, start, end, 8);
+  path->reserve(it.count);
+  for (int i = 0; i < it.count; ++i, ++it) {
+    path->push_back(it.pos());
+  }
+}
+
+void LineEndpointSearch::rateCandidates(
+    const cv::Mat& cloud, const std::vector<cv::Point>& path,
+    std::vector<Candidate>* candidates) const {
+  const int path_length = path.size();
+  int first_index = path_length;
+  int last_index = 0;
+  for (Candidate& candidate : *candidates) {
+    candidate.rating = kInvalidRating;
+    // Walk from the start towards the end until a non-NaN point is found, then
+    // from the end towards that point. The two must be distinct.
+    int start = 0;
+    while (start < path_length - 1 &&
+           isNaNPixel(cloud, path[start] + candidate.offset)) {
+      ++start;
+    }
+    int end = path_length - 1;
+    while (end > start && isNaNPixel(cloud, path[end] + candidate.offset)) {
+      --end;
+    }
+    if (start >= end) {
+      candidate.start = candidate.end = 0;
+      continue;
+    }
+    const cv::Vec3f& start_3D =
+        pixelPoint(cloud, path[start] + candidate.offset);
+    const cv::Vec3f& end_3D = pixelPoint(cloud, path[end] + candidate.offset);
+    // A line with an endpoint on the origin cannot be reprojected to 2D.
+    if (checkEqualPoints(start_3D, {0.0f, 0.0f, 0.0f}) ||
+        checkEqualPoints(end_3D, {0.0f, 0.0f, 0.0f})) {
+      candidate.start = candidate.end = 0;
+      continue;
+    }
+    candidate.start = start;
+    candidate.end = end;
+    candidate.rating = 0.0;
+    candidate.line3D = cv::Vec6f(start_3D[0], start_3D[1], start_3D[2],
+                                 end_3D[0], end_3D[1], end_3D[2]);
+    first_index = std::min(first_index, start);
+    last_index = std::max(last_index, end);
+  }
+
+  // Rate all the candidates in one pass over the path. The rating of a
+  // candidate is the mean distance of the points from its start (included) to
+  // its end (excluded).
+  const size_t num_candidates = candidates->size();
+  int num_points[3] = {0, 0, 0};
+  CHECK_LE(num_candidates, 3u);
+  for (int i = first_index; i < last_index; ++i) {
+    for (size_t k = 0; k < num_candidates; ++k) {
+      Candidate& candidate = (*candidates)[k];
+      if (i < candidate.start || i >= candidate.end) continue;
+      const cv::Point pixel = path[i] + candidate.offset;
+      if (isNaNPixel(cloud, pixel)) continue;
+      const cv::Vec6f& line3D = candidate.line3D;
+      candidate.rating += distPointToLine(
+          {line3D[0], line3D[1], line3D[2]}, {line3D[3], line3D[4], line3D[5]},
+          pixelPoint(cloud, pixel));
+      ++num_points[k];
+    }
+  }
+  for (size_t k = 0; k < num_candidates; ++k) {
+    if (num_points[k] > 0) (*candidates)[k].rating /= num_points[k];
+  }
+}
+
+double LineEndpointSearch::findRatedLine(const cv::Mat& cloud,
+                                         const cv::Vec4f& line2D,
+                                         cv::Vec6f* line3D) {
+  CHECK_NOTNULL(line3D);
+  CHECK_EQ(cloud.type(), CV_32FC3);
+  const cv::Point start(floor(line2D[0]), floor(line2D[1]));
+  const cv::Point end(floor(line2D[2]), floor(line2D[3]));
+  if (start == end) return kInvalidRating;
+  const double dx = line2D[2] - line2D[0];
+  const double dy = line2D[3] - line2D[1];
+  const double length = sqrt(dx * dx + dy * dy);
+  // Offsets of the lower, middle and upper line, in the order in which ties
+  // are resolved.
+  const cv::Point offsets[3] = {
+      cv::Point(floor(-dy / length + 0.5), floor(dx / length + 0.5)),
+      cv::Point(0, 0),
+      cv::Point(floor(dy / length + 0.5), floor(-dx / length + 0.5))};
+
+  // The shifted lines are rasterized to the shifted pixels of the middle line,
+  // unless one of their endpoints had to be moved back into the image.
+  rasterize(cloud, start, end, &path_);
+  candidates_.clear();
+  int candidate_of_offset[3];
+  for (size_t k = 0; k < 3; ++k) {
+    if (clampPixel(start + offsets[k], cloud.cols, cloud.rows) ==
+            start + offsets[k] &&
+        clampPixel(end + offsets[k], cloud.cols, cloud.rows) ==
+            end + offsets[k]) {
+      candidate_of_offset[k] = candidates_.size();
+      candidates_.push_back(Candidate());
+      candidates_.back().offset = offsets[k];
+    } else {
+      candidate_of_offset[k] = -1;
+    }
+  }
+  rateCandidates(cloud, path_, &candidates_);
+
+  double ratings[3];
+  cv::Vec6f lines3D[3];
+  for (size_t k = 0; k < 3; ++k) {
+    if (candidate_of_offset[k] >= 0) {
+      ratings[k] = candidates_[candidate_of_offset[k]].rating;
+      lines3D[k] = candidates_[candidate_of_offset[k]].line3D;
+      continue;
+    }
+    // Only near the border of the image.
+    rasterize(cloud, clampPixel(start + offsets[k], cloud.cols, cloud.rows),
+              clampPixel(end + offsets[k], cloud.cols, cloud.rows),
+              &clamped_path_);
+    clamped_candidates_.assign(1, Candidate());
+    clamped_candidates_[0].offset = cv::Point(0, 0);
+    rateCandidates(cloud, clamped_path_, &clamped_candidates_);
+    ratings[k] = clamped_candidates_[0].rating;
+    lines3D[k] = clamped_candidates_[0].line3D;
+  }
+
+  size_t best;
+  if (ratings[2] < ratings[1] && ratings[2] < ratings[0]) {
+    best = 2;
+  } else if (ratings[0] < ratings[1]) {
+    best = 0;
+  } else {
+    best = 1;
+  }
+  *line3D = lines3D[best];
+  return ratings[best];
+}
+
+bool LineEndpointSearch::findShortestLine(const cv::Mat& cloud,
+                                          const cv::Vec4f& line2D,
+                                          int patch_size, cv::Vec6f* line3D) {
+  CHECK_NOTNULL(line3D);
+  CHECK_EQ(cloud.type(), CV_32FC3);
+  CHECK_GE(patch_size, 0);
+  // Collect the non-NaN points of both patches first, so that the pairwise
+  // comparison only visits valid points.
+  const cv::Point start(line2D[0], line2D[1]);
+  const cv::Point end(line2D[2], line2D[3]);
+  const cv::Point corners[2] = {start, end};
+  std::vector<cv::Vec3f>* patches[2] = {&start_patch_, &end_patch_};
+  for (size_t p = 0; p < 2; ++p) {
+    const cv::Point& center = corners[p];
+    const int x_min =
+        fitToBoundaryInt(center.x - patch_size, 0, cloud.cols - 1);
+    const int x_max =
+        fitToBoundaryInt(center.x + patch_size, 0, cloud.cols - 1);
+    const int y_min =
+        fitToBoundaryInt(center.y - patch_size, 0, cloud.rows - 1);
+    const int y_max =
+        fitToBoundaryInt(center.y + patch_size, 0, cloud.rows - 1);
+    patches[p]->clear();
+    for (int x = x_min; x <= x_max; ++x) {
+      for (int y = y_min; y <= y_max; ++y) {
+        const cv::Vec3f& point = cloud.ptr<cv::Vec3f>(y)[x];
+        if (!std::isnan(point[0])) patches[p]->push_back(point);
+      }
+    }
+  }
+  if (start_patch_.empty() || end_patch_.empty()) return false;
+  float min_sq_distance = std::numeric_limits<float>::max();
+  size_t best_start = 0, best_end = 0;
+  for (size_t i = 0; i < start_patch_.size(); ++i) {
+    for (size_t j = 0; j < end_patch_.size(); ++j) {
+      const cv::Vec3f difference = start_patch_[i] - end_patch_[j];
+      const float sq_distance = difference.dot(difference);
+      if (sq_distance < min_sq_distance) {
+        min_sq_distance = sq_distance;
+        best_start = i;
+        best_end = j;
+      }
+    }
+  }
+  const cv::Vec3f& start_3D = start_patch_[best_start];
+  const cv::Vec3f& end_3D = end_patch_[best_end];
+  *line3D = cv::Vec6f(start_3D[0], start_3D[1], start_3D[2], end_3D[0],
+                      end_3D[1], end_3D[2]);
+  return true;
+}
+
+}  // namespace line_detection
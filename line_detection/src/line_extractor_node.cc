@@ -19,6 +19,7 @@
 //    line_detection/KeyLine[] keylines
 //    uint8 frame_index
 
+#include <line_detection/frame_context.h>
 #include <line_detection/line_detection.h>
 
 #include <ros/ros.h>
@@ -51,6 +52,8 @@ cv_bridge::CvImageConstPtr cv_cloud_ptr;
 cv::Mat cv_cloud;
 // Projection matrix.
 cv::Mat camera_P;
+// Inputs of the current request and the products derived from them.
+line_detection::FrameContext frame;
 // Stores the index of the current frame.
 int frame_index;
 
@@ -59,7 +62,6 @@ bool detectLinesCallback(line_detection::ExtractLines::Request& req,
   // Convert to cv_ptr (which has a member ->image (cv::Mat)).
   image_cv_ptr = cv_bridge::toCvCopy(req.image, "rgb8");
   cv_image_rgb = image_cv_ptr->image;
-  cv::cvtColor(cv_image_rgb, cv_image_gray, CV_RGB2GRAY);
 
   // Obtain projection matrix.
   image_geometry::PinholeCameraModel camera_model;
@@ -71,19 +73,19 @@ bool detectLinesCallback(line_detection::ExtractLines::Request& req,
   cv_cloud_ptr = cv_bridge::toCvCopy(req.cloud, "32FC3");
   cv_cloud = cv_cloud_ptr->image;
   CHECK(cv_cloud.type() == CV_32FC3);
+  frame.setFrame(cv_image_rgb, cv_cloud, camera_P);
 
   // Detect 2D lines.
   lines_2D.clear();
-  line_detector.detectLines(cv_image_gray, req.detector, &lines_2D);
+  line_detector.detectLines(&frame, req.detector, &lines_2D);
   line_detector.fuseLines2D(lines_2D, &lines_2D_fused);
 
   // Project to 3D.
-  line_detector.project2Dto3DwithPlanes(cv_cloud, cv_image_rgb, camera_P,
-                                         lines_2D_fused, true, &lines_2D_tmp,
-                                         &lines_3D_tmp);
+  line_detector.project2Dto3DwithPlanes(&frame, lines_2D_fused, true,
+                                        &lines_2D_tmp, &lines_3D_tmp);
   // Perform checks.
-  line_detector.runCheckOn3DLines(cv_cloud, camera_P, lines_2D_tmp,
-                                  lines_3D_tmp, &lines_2D, &lines_3D);
+  line_detector.runCheckOn3DLines(&frame, lines_2D_tmp, lines_3D_tmp,
+                                  &lines_2D, &lines_3D);
 
   // Store lines to the response.
   res.lines.resize(lines_2D.size());
@@ -124,6 +126,8 @@ bool detectLinesCallback(line_detection::ExtractLines::Request& req,
         res.lines[i].line_type = 3;
         break;
       default:
+        // Includes UNCLASSIFIED, which is only returned if the planes of the
+        // lines are not fitted (cf. line_detection::kLineOutputEndpoints).
         ROS_ERROR("Illegal line type. Possible types are DISCONT, PLANE, EDGE "
                    "and INTERSECT");
         return false;
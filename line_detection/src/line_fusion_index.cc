@@ -0,0 +1,83 @@
+#include "line_detection/line_fusion_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glog/logging.h>
+
+namespace line_detection {
+
+LineFusionIndex::LineFusionIndex(double max_endpoint_distance,
+                                 double max_angle_difference) {
+  CHECK_GT(max_endpoint_distance, 0.0);
+  CHECK_GT(max_angle_difference, 0.0);
+  // With cells at least as large as max_endpoint_distance, an endpoint closer
+  // than max_endpoint_distance to a given endpoint is in one of the 3x3 cells
+  // around the cell of the latter. In the same way, lines with an angle
+  // difference less than max_angle_difference are in the same or in adjacent
+  // orientation bins. A small margin is kept for the rounding errors.
+  constexpr double kMargin = 1.05;
+  cell_size_ = kMargin * max_endpoint_distance;
+  num_orientation_bins_ = std::max(
+      1, static_cast<int>(floor(M_PI / (kMargin * max_angle_difference))));
+}
+
+void LineFusionIndex::clear() { buckets_.clear(); }
+
+int LineFusionIndex::orientationBin(const cv::Vec4f& line) const {
+  // Orientation in [0, pi), since the direction of the lines is not relevant.
+  double angle = atan2(line[3] - line[1], line[2] - line[0]);
+  if (angle < 0.0) angle += M_PI;
+  const int bin = static_cast<int>(angle / M_PI * num_orientation_bins_);
+  return std::min(std::max(bin, 0), num_orientation_bins_ - 1);
+}
+
+uint64_t LineFusionIndex::bucketKey(int orientation_bin, int cell_x,
+                                    int cell_y) {
+  // 24 bits per cell coordinate.
+  constexpr uint64_t kMask = (1u << 24) - 1u;
+  return (static_cast<uint64_t>(orientation_bin) << 48) |
+         ((static_cast<uint64_t>(cell_x) & kMask) << 24) |
+         (static_cast<uint64_t>(cell_y) & kMask);
+}
+
+void LineFusionIndex::insert(size_t id, const cv::Vec4f& line) {
+  const int bin = orientationBin(line);
+  for (size_t i = 0; i < 4; i += 2) {
+    const int cell_x = static_cast<int>(floor(line[i] / cell_size_));
+    const int cell_y = static_cast<int>(floor(line[i + 1] / cell_size_));
+    std::vector<size_t>& bucket = buckets_[bucketKey(bin, cell_x, cell_y)];
+    // Both endpoints can be in the same cell.
+    if (bucket.empty() || bucket.back() != id) bucket.push_back(id);
+  }
+}
+
+void LineFusionIndex::findCandidates(const cv::Vec4f& line,
+                                     std::vector<size_t>* ids) const {
+  CHECK_NOTNULL(ids);
+  ids->clear();
+  const int bin = orientationBin(line);
+  for (int bin_offset = -1; bin_offset <= 1; ++bin_offset) {
+    // The orientation wraps around.
+    const int neighbour_bin =
+        (bin + bin_offset + num_orientation_bins_) % num_orientation_bins_;
+    for (size_t i = 0; i < 4; i += 2) {
+      const int cell_x = static_cast<int>(floor(line[i] / cell_size_));
+      const int cell_y = static_cast<int>(floor(line[i + 1] / cell_size_));
+      for (int dx = -1; dx <= 1; ++dx) {
+        for (int dy = -1; dy <= 1; ++dy) {
+          const auto it = buckets_.find(
+              bucketKey(neighbour_bin, cell_x + dx, cell_y + dy));
+          if (it == buckets_.end()) continue;
+          ids->insert(ids->end(), it->second.begin(), it->second.end());
+        }
+      }
+    }
+    // With less than 3 bins, bin - 1 and bin + 1 are the same bin.
+    if (num_orientation_bins_ < 3 && bin_offset == 0) break;
+  }
+  std::sort(ids->begin(), ids->end());
+  ids->erase(std::unique(ids->begin(), ids->end()), ids->end());
+}
+
+}  // namespace line_detection
@@ -0,0 +1,143 @@
+#include "line_detection/line_refinement.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace line_detection {
+
+namespace {
+// Absolute value of the image gradient along direction at the pixel nearest to
+// point, computed with central differences. 0 outside the image.
+float gradientAlong(const cv::Mat& image, const cv::Point2f& point,
+                    const cv::Point2f& direction) {
+  const int x = cvRound(point.x);
+  const int y = cvRound(point.y);
+  if (x < 1 || y < 1 || x >= image.cols - 1 || y >= image.rows - 1) {
+    return 0.0f;
+  }
+  const uchar* row = image.ptr<uchar>(y);
+  const float gradient_x = 0.5f * (row[x + 1] - row[x - 1]);
+  const float gradient_y =
+      0.5f * (image.ptr<uchar>(y + 1)[x] - image.ptr<uchar>(y - 1)[x]);
+  return std::fabs(gradient_x * direction.x + gradient_y * direction.y);
+}
+
+// Largest gradient across the line in a band of 1 pixel on each side of
+// point, to be robust to the rounding to the nearest pixel.
+float responseAcross(const cv::Mat& image, const cv::Point2f& point,
+                     const cv::Point2f& normal) {
+  return std::max(gradientAlong(image, point, normal),
+                  std::max(gradientAlong(image, point + normal, normal),
+                           gradientAlong(image, point - normal, normal)));
+}
+
+// Moves an endpoint along the line, given the direction pointing out of the
+// line, to where the response across the line ends.
+cv::Point2f refineEndpoint(const cv::Mat& image, const cv::Point2f& endpoint,
+                           const cv::Point2f& outwards,
+                           const cv::Point2f& normal, float min_response,
+                           int max_shift) {
+  if (responseAcross(image, endpoint, normal) >= min_response) {
+    // Extend the line while the gradient continues.
+    int shift = 0;
+    while (shift < max_shift &&
+           responseAcross(image, endpoint + outwards * (shift + 1.0f),
+                          normal) >= min_response) {
+      ++shift;
+    }
+    return endpoint + outwards * static_cast<float>(shift);
+  }
+  // Shrink the line up to where the gradient starts.
+  for (int shift = 1; shift <= max_shift; ++shift) {
+    const cv::Point2f point = endpoint - outwards * static_cast<float>(shift);
+    if (responseAcross(image, point, normal) >= min_response) return point;
+  }
+  return endpoint;
+}
+}  // namespace
+
+bool refineLine2D(const cv::Mat& image, const cv::Vec4f& line,
+                  const LineRefinementParams& params,
+                  cv::Vec4f* refined_line) {
+  CHECK_NOTNULL(refined_line);
+  CHECK_EQ(image.type(), CV_8UC1);
+  const cv::Point2f start(line[0], line[1]);
+  const cv::Point2f end(line[2], line[3]);
+  const float length = cv::norm(end - start);
+  if (length < 1.0f) return false;
+  const cv::Point2f direction = (end - start) * (1.0f / length);
+  const cv::Point2f normal(-direction.y, direction.x);
+
+  // Offset across the line of the largest gradient at each sample, refined to
+  // sub-pixel accuracy with a parabola through the neighbouring responses.
+  const int num_samples = std::max(
+      2, static_cast<int>(length / std::max(params.sample_step, 1.0)));
+  std::vector<float> positions, offsets, responses;
+  positions.reserve(num_samples);
+  offsets.reserve(num_samples);
+  responses.reserve(num_samples);
+  std::vector<float> profile(2 * params.search_radius + 1);
+  for (int i = 0; i < num_samples; ++i) {
+    const float position = (i + 0.5f) * length / num_samples;
+    const cv::Point2f point = start + direction * position;
+    int best = -1;
+    for (int s = -params.search_radius; s <= params.search_radius; ++s) {
+      const size_t k = s + params.search_radius;
+      profile[k] = gradientAlong(image, point + normal * static_cast<float>(s),
+                                 normal);
+      if (profile[k] > 0.0f && (best < 0 || profile[k] > profile[best])) {
+        best = k;
+      }
+    }
+    if (best < 0) continue;
+    float offset = best - params.search_radius;
+    if (best > 0 && best + 1 < static_cast<int>(profile.size())) {
+      const float curvature =
+          profile[best - 1] - 2.0f * profile[best] + profile[best + 1];
+      if (curvature < 0.0f) {
+        offset += 0.5f * (profile[best - 1] - profile[best + 1]) / curvature;
+      }
+    }
+    positions.push_back(position);
+    offsets.push_back(offset);
+    responses.push_back(profile[best]);
+  }
+  if (positions.size() < 2) return false;
+
+  // Least-squares fit of offset = a + b * position.
+  const double n = positions.size();
+  double sum_p = 0.0, sum_o = 0.0, sum_pp = 0.0, sum_po = 0.0;
+  for (size_t i = 0; i < positions.size(); ++i) {
+    sum_p += positions[i];
+    sum_o += offsets[i];
+    sum_pp += positions[i] * positions[i];
+    sum_po += positions[i] * offsets[i];
+  }
+  const double denominator = n * sum_pp - sum_p * sum_p;
+  if (std::fabs(denominator) < 1e-9) return false;
+  const double b = (n * sum_po - sum_p * sum_o) / denominator;
+  const double a = (sum_o - b * sum_p) / n;
+  cv::Point2f new_start = start + normal * static_cast<float>(a);
+  cv::Point2f new_end = end + normal * static_cast<float>(a + b * length);
+  const float new_length = cv::norm(new_end - new_start);
+  if (new_length < 1.0f) return false;
+  const cv::Point2f new_direction = (new_end - new_start) * (1.0f / new_length);
+  const cv::Point2f new_normal(-new_direction.y, new_direction.x);
+
+  // Endpoints.
+  std::nth_element(responses.begin(),
+                   responses.begin() + responses.size() / 2, responses.end());
+  const float min_response =
+      params.min_relative_response * responses[responses.size() / 2];
+  new_start = refineEndpoint(image, new_start, -new_direction, new_normal,
+                             min_response, params.max_endpoint_shift);
+  new_end = refineEndpoint(image, new_end, new_direction, new_normal,
+                           min_response, params.max_endpoint_shift);
+  *refined_line = cv::Vec4f(new_start.x, new_start.y, new_end.x, new_end.y);
+  return true;
+}
+
+}  // namespace line_detection
@@ -0,0 +1,239 @@
+#include "line_detection/line_tracker.h"
+
+#include <cmath>
+
+#include <glog/logging.h>
+
+namespace line_detection {
+
+LineTracker::LineTracker(LineDetector* line_detector)
+    : line_detector_(CHECK_NOTNULL(line_detector)),
+      has_previous_frame_(false),
+      num_tracked_lines_(0),
+      num_new_lines_(0) {}
+
+void LineTracker::reset() {
+  has_previous_frame_ = false;
+  previous_lines3D_.clear();
+  num_tracked_lines_ = 0;
+  num_new_lines_ = 0;
+}
+
+void LineTracker::track(FrameContext* frame, int detector,
+                        const cv::Matx44f& T_current_previous,
+                        std::vector<cv::Vec4f>* lines2D,
+                        std::vector<LineWithPlanes>* lines3D) {
+  CHECK_NOTNULL(frame);
+  CHECK_NOTNULL(lines2D);
+  CHECK_NOTNULL(lines3D);
+  lines2D->clear();
+  lines3D->clear();
+  const LineDetectionParams detector_params =
+      line_detector_->get_line_detection_params();
+  const double max_residual =
+      params_.max_relative_residual * detector_params.max_error_inlier_ransac;
+
+  // Lines of the previous frame that are verified in the current one.
+  if (has_previous_frame_) {
+    LineWithPlanes predicted_line;
+    cv::Vec4f line2D;
+    for (const LineWithPlanes& line : previous_lines3D_) {
+      // Unclassified lines have no plane to be verified against.
+      if (line.type == LineType::UNCLASSIFIED) continue;
+      if (predictLine(line, T_current_previous, frame, &predicted_line,
+                      &line2D) &&
+          verifyLine(frame, max_residual, detector_params.min_points_in_rect,
+                     &line2D, &predicted_line)) {
+        lines2D->push_back(line2D);
+        lines3D->push_back(predicted_line);
+      }
+    }
+  }
+  num_tracked_lines_ = lines3D->size();
+
+  // The detected lines that are not covered by a tracked line go through the
+  // full pipeline.
+  std::vector<cv::Vec4f> detected_lines, fused_lines, new_lines2D;
+  line_detector_->detectLines(frame, detector, &detected_lines);
+  line_detector_->fuseLines2D(detected_lines, &fused_lines);
+  for (const cv::Vec4f& line : fused_lines) {
+    bool is_tracked = false;
+    for (size_t i = 0; i < num_tracked_lines_ && !is_tracked; ++i) {
+      is_tracked = areLinesCollinear2D(
+          line, (*lines2D)[i], params_.max_distance_to_tracked_line, 0.0);
+    }
+    if (!is_tracked) new_lines2D.push_back(line);
+  }
+  std::vector<cv::Vec4f> projected_lines2D, checked_lines2D;
+  std::vector<LineWithPlanes> projected_lines3D, checked_lines3D;
+  line_detector_->project2Dto3DwithPlanes(frame, new_lines2D, true,
+                                          &projected_lines2D,
+                                          &projected_lines3D);
+  line_detector_->runCheckOn3DLines(frame, projected_lines2D,
+                                    projected_lines3D, &checked_lines2D,
+                                    &checked_lines3D);
+  num_new_lines_ = checked_lines3D.size();
+  lines2D->insert(lines2D->end(), checked_lines2D.begin(),
+                  checked_lines2D.end());
+  lines3D->insert(lines3D->end(), checked_lines3D.begin(),
+                  checked_lines3D.end());
+
+  previous_lines3D_ = *lines3D;
+  has_previous_frame_ = true;
+}
+
+bool LineTracker::predictLine(const LineWithPlanes& line,
+                              const cv::Matx44f& T_current_previous,
+                              FrameContext* frame,
+                              LineWithPlanes* predicted_line,
+                              cv::Vec4f* line2D) const {
+  CHECK_NOTNULL(predicted_line);
+  CHECK_NOTNULL(line2D);
+  const cv::Matx33f R = T_current_previous.get_minor<3, 3>(0, 0);
+  const cv::Vec3f t(T_current_previous(0, 3), T_current_previous(1, 3),
+                    T_current_previous(2, 3));
+  *predicted_line = line;
+  for (size_t i = 0; i < 2; ++i) {
+    const cv::Vec3f endpoint =
+        R * cv::Vec3f(line.line[3 * i], line.line[3 * i + 1],
+                      line.line[3 * i + 2]) + t;
+    if (endpoint[2] <= 0.0f) return false;
+    const cv::Point2f projection = frame->project(endpoint);
+    if (projection.x < 0.0f || projection.x > frame->cols() - 1 ||
+        projection.y < 0.0f || projection.y > frame->rows() - 1) {
+      return false;
+    }
+    for (size_t j = 0; j < 3; ++j) {
+      predicted_line->line[3 * i + j] = endpoint[j];
+    }
+    (*line2D)[2 * i] = projection.x;
+    (*line2D)[2 * i + 1] = projection.y;
+  }
+  // A plane n.x + d = 0 becomes (R n).x' + d - (R n).t = 0.
+  for (size_t i = 0; i < line.hessians.size(); ++i) {
+    const cv::Vec4f& hessian = line.hessians[i];
+    if (hessian == cv::Vec4f(0.0f, 0.0f, 0.0f, 0.0f)) continue;
+    const cv::Vec3f normal = R * cv::Vec3f(hessian[0], hessian[1], hessian[2]);
+    predicted_line->hessians[i] = cv::Vec4f(normal[0], normal[1], normal[2],
+                                            hessian[3] - normal.dot(t));
+  }
+  return true;
+}
+
+bool LineTracker::verifyLine(FrameContext* frame, double max_residual,
+                             size_t min_num_points, cv::Vec4f* line2D,
+                             LineWithPlanes* line) {
+  CHECK_NOTNULL(line2D);
+  CHECK_NOTNULL(line);
+  if (!line_detector_->getRectanglesFromLine(*line2D, &rect_left_,
+                                             &rect_right_)) {
+    return false;
+  }
+  // hessians[0] is the plane on the right of the line, hessians[1] the one on
+  // the left.
+  const std::vector<cv::Point2f>* rects[2] = {&rect_right_, &rect_left_};
+  size_t num_planes = 0;
+  for (size_t i = 0; i < line->hessians.size() && i < 2; ++i) {
+    const cv::Vec4f hessian = line->hessians[i];
+    if (hessian == cv::Vec4f(0.0f, 0.0f, 0.0f, 0.0f)) continue;
+    ++num_planes;
+    cv::Vec4f refitted_hessian;
+    bool verified = verifyPlane(frame, *rects[i], hessian, max_residual,
+                                min_num_points, &refitted_hessian);
+    // The side of the plane of a discontinuity line is only known up to the
+    // orientation of the line.
+    if (!verified && line->type == LineType::DISCONT) {
+      verified = verifyPlane(frame, *rects[1 - i], hessian, max_residual,
+                             min_num_points, &refitted_hessian);
+    }
+    if (!verified) return false;
+    line->hessians[i] = refitted_hessian;
+  }
+  return num_planes > 0 && correctLine(frame, line2D, line);
+}
+
+bool LineTracker::correctLine(FrameContext* frame, cv::Vec4f* line2D,
+                              LineWithPlanes* line) const {
+  CHECK_NOTNULL(line2D);
+  CHECK_NOTNULL(line);
+  const cv::Vec4f zero(0.0f, 0.0f, 0.0f, 0.0f);
+  cv::Vec3f endpoints[2] = {
+      cv::Vec3f(line->line[0], line->line[1], line->line[2]),
+      cv::Vec3f(line->line[3], line->line[4], line->line[5])};
+  if ((line->type == LineType::EDGE || line->type == LineType::INTERSECT) &&
+      line->hessians.size() == 2 && line->hessians[0] != zero &&
+      line->hessians[1] != zero) {
+    // The endpoints are projected on the intersection line of the planes.
+    const cv::Vec4f& hessian1 = line->hessians[0];
+    const cv::Vec4f& hessian2 = line->hessians[1];
+    const cv::Vec3f normal1(hessian1[0], hessian1[1], hessian1[2]);
+    const cv::Vec3f normal2(hessian2[0], hessian2[1], hessian2[2]);
+    // The planes are parallel, as in find3DlineOnPlanes.
+    if (std::fabs(normal1.dot(normal2)) >
+        LineDetector::kMinCosAngleParallelPlanes) {
+      return false;
+    }
+    cv::Vec3f direction = normal1.cross(normal2);
+    normalizeVector3D(&direction);
+    cv::Vec3f x_0;
+    if (!getPointOnPlaneIntersectionLine(hessian1, hessian2, direction,
+                                         &x_0)) {
+      return false;
+    }
+    for (cv::Vec3f& endpoint : endpoints) {
+      endpoint = x_0 + direction * direction.dot(endpoint - x_0);
+    }
+  } else {
+    // The endpoints are projected on the (first) plane of the line.
+    size_t i = 0;
+    while (line->hessians[i] == zero) ++i;
+    for (cv::Vec3f& endpoint : endpoints) {
+      endpoint = projectPointOnPlane(line->hessians[i], endpoint);
+    }
+  }
+  for (size_t i = 0; i < 2; ++i) {
+    if (endpoints[i][2] <= 0.0f) return false;
+    const cv::Point2f projection = frame->project(endpoints[i]);
+    for (size_t j = 0; j < 3; ++j) {
+      line->line[3 * i + j] = endpoints[i][j];
+    }
+    (*line2D)[2 * i] = projection.x;
+    (*line2D)[2 * i + 1] = projection.y;
+  }
+  return true;
+}
+
+bool LineTracker::verifyPlane(FrameContext* frame,
+                              const std::vector<cv::Point2f>& rect,
+                              const cv::Vec4f& hessian, double max_residual,
+                              size_t min_num_points,
+                              cv::Vec4f* refitted_hessian) {
+  CHECK_NOTNULL(refitted_hessian);
+  gatherPointsInRectangle(rect, frame, false, &points_);
+  if (points_.size() < min_num_points) return false;
+  supporting_points_.clear();
+  for (const cv::Vec3f& point : points_) {
+    const double residual = hessian[0] * point[0] + hessian[1] * point[1] +
+                            hessian[2] * point[2] + hessian[3];
+    if (std::fabs(residual) <= max_residual) {
+      supporting_points_.push_back(point);
+    }
+  }
+  if (supporting_points_.size() <
+      params_.min_supporting_fraction * points_.size()) {
+    return false;
+  }
+  if (!line_detector_->hessianNormalFormOfPlane(supporting_points_,
+                                                refitted_hessian)) {
+    return false;
+  }
+  // Keep the orientation of the normal of the predicted plane.
+  if ((*refitted_hessian)[0] * hessian[0] +
+          (*refitted_hessian)[1] * hessian[1] +
+          (*refitted_hessian)[2] * hessian[2] < 0.0f) {
+    *refitted_hessian = -(*refitted_hessian);
+  }
+  return true;
+}
+
+}  // namespace line_detection
@@ -0,0 +1,85 @@
+#include "line_detection/plane_hypothesis_cache.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glog/logging.h>
+
+namespace line_detection {
+
+PlaneHypothesisCache::PlaneHypothesisCache()
+    : cell_size_(1), grid_rows_(0), grid_cols_(0), query_(0) {}
+
+void PlaneHypothesisCache::reset(int rows, int cols, int cell_size) {
+  CHECK_GT(cell_size, 0);
+  cell_size_ = cell_size;
+  grid_rows_ = (rows + cell_size - 1) / cell_size;
+  grid_cols_ = (cols + cell_size - 1) / cell_size;
+  planes_.clear();
+  last_query_.clear();
+  query_ = 0;
+  // Keep the memory of the cells of the previous frames.
+  cells_.resize(grid_rows_ * grid_cols_);
+  for (std::vector<int>& cell : cells_) {
+    cell.clear();
+  }
+}
+
+bool PlaneHypothesisCache::getCellRange(const std::vector<cv::Point2f>& corners,
+                                        int* first_row, int* first_col,
+                                        int* last_row, int* last_col) const {
+  CHECK_EQ(corners.size(), 4);
+  float x_min = corners[0].x, x_max = corners[0].x;
+  float y_min = corners[0].y, y_max = corners[0].y;
+  for (size_t i = 1; i < 4; ++i) {
+    x_min = std::min(x_min, corners[i].x);
+    x_max = std::max(x_max, corners[i].x);
+    y_min = std::min(y_min, corners[i].y);
+    y_max = std::max(y_max, corners[i].y);
+  }
+  *first_col = std::max(static_cast<int>(std::floor(x_min / cell_size_)), 0);
+  *first_row = std::max(static_cast<int>(std::floor(y_min / cell_size_)), 0);
+  *last_col = std::min(static_cast<int>(std::floor(x_max / cell_size_)),
+                       grid_cols_ - 1);
+  *last_row = std::min(static_cast<int>(std::floor(y_max / cell_size_)),
+                       grid_rows_ - 1);
+  return *first_col <= *last_col && *first_row <= *last_row;
+}
+
+void PlaneHypothesisCache::addPlane(const std::vector<cv::Point2f>& corners,
+                                    const cv::Vec4f& hessian) {
+  int first_row, first_col, last_row, last_col;
+  if (!getCellRange(corners, &first_row, &first_col, &last_row, &last_col)) {
+    return;
+  }
+  const int index = planes_.size();
+  planes_.push_back(hessian);
+  last_query_.push_back(query_);
+  for (int row = first_row; row <= last_row; ++row) {
+    for (int col = first_col; col <= last_col; ++col) {
+      cells_[row * grid_cols_ + col].push_back(index);
+    }
+  }
+}
+
+void PlaneHypothesisCache::findPlanes(const std::vector<cv::Point2f>& corners,
+                                      std::vector<cv::Vec4f>* planes) {
+  CHECK_NOTNULL(planes);
+  planes->clear();
+  int first_row, first_col, last_row, last_col;
+  if (!getCellRange(corners, &first_row, &first_col, &last_row, &last_col)) {
+    return;
+  }
+  ++query_;
+  for (int row = first_row; row <= last_row; ++row) {
+    for (int col = first_col; col <= last_col; ++col) {
+      for (int index : cells_[row * grid_cols_ + col]) {
+        if (last_query_[index] == query_) continue;
+        last_query_[index] = query_;
+        planes->push_back(planes_[index]);
+      }
+    }
+  }
+}
+
+}  // namespace line_detection
@@ -0,0 +1,253 @@
+#include "line_detection/plane_ransac.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "line_detection/line_detection.h"
+
+namespace line_detection {
+
+// Cost of generating and instantiating a hypothesis, in units of the cost of
+// verifying a single point. Used to compute the SPRT decision threshold.
+constexpr double kSprtModelCostInPointVerifications = 200.0;
+// Initial estimate of the fraction of points consistent with a bad model.
+constexpr double kSprtInitialDelta = 0.05;
+// Lower bound for the estimate of the inlier fraction of a good model.
+constexpr double kSprtMinEpsilon = 0.1;
+
+constexpr size_t PlaneRansac::kVerificationBlockSize;
+
+PlaneRansac::PlaneRansac() : num_iterations_(0) {}
+
+bool PlaneRansac::planeFromSample(const cv::Vec3f& p1, const cv::Vec3f& p2,
+                                  const cv::Vec3f& p3,
+                                  cv::Vec4f* hessian) const {
+  // Same as the exact case of LineDetector::hessianNormalFormOfPlane.
+  const cv::Vec3f vec1 = p2 - p1;
+  const cv::Vec3f vec2 = p3 - p1;
+  const double norms = cv::norm(vec1) * cv::norm(vec2);
+  if (norms < params_.min_distance_between_points_hessian) return false;
+  const double cos_theta = fabs(vec1.dot(vec2)) / norms;
+  if (cos_theta > params_.max_cos_theta_hessian_computation) return false;
+  const cv::Vec3f normal = vec1.cross(vec2);
+  *hessian = cv::Vec4f(normal[0], normal[1], normal[2],
+                       computeDfromPlaneNormal(normal, p1)) / cv::norm(normal);
+  return true;
+}
+
+void PlaneRansac::drawSample(size_t num_points, int forced_index,
+                             size_t sample[3]) {
+  typedef std::uniform_int_distribution<size_t>::param_type Range;
+  size_t num_to_draw = 3;
+  size_t upper = num_points - 1;
+  if (forced_index >= 0) {
+    sample[2] = forced_index;
+    num_to_draw = 2;
+    upper = forced_index - 1;
+  }
+  for (size_t i = 0; i < num_to_draw; ++i) {
+    bool duplicate;
+    do {
+      sample[i] = distribution_(generator_, Range(0, upper));
+      duplicate = false;
+      for (size_t j = 0; j < i; ++j) {
+        duplicate = duplicate || sample[j] == sample[i];
+      }
+    } while (duplicate);
+  }
+}
+
+double PlaneRansac::computeSprtThreshold(double epsilon, double delta) {
+  const double C = (1.0 - delta) * log((1.0 - delta) / (1.0 - epsilon)) +
+                   delta * log(delta / epsilon);
+  const double A_0 = kSprtModelCostInPointVerifications * C + 1.0;
+  double A = A_0;
+  for (size_t i = 0; i < 10; ++i) {
+    A = A_0 + log(A);
+  }
+  return A;
+}
+
+unsigned int PlaneRansac::adaptiveNumIterations(double inlier_fraction) const {
+  double probability_good_sample = pow(inlier_fraction, 3);
+  if (probability_good_sample <= 0.0) return params_.max_iterations;
+  if (probability_good_sample >= 1.0) return 1;
+  const double num_iterations = log(1.0 - params_.confidence) /
+                                log(1.0 - probability_good_sample);
+  if (num_iterations >= params_.max_iterations) return params_.max_iterations;
+  return std::max(1u, static_cast<unsigned int>(ceil(num_iterations)));
+}
+
+bool PlaneRansac::verifyHypothesis(const cv::Vec4f& hessian, double epsilon,
+                                   double delta, size_t best_num_inliers,
+                                   size_t* num_points_tested,
+                                   bool* rejected_by_sprt) {
+  const size_t num_points = ordered_points_.size();
+  const float max_deviation = params_.max_deviation;
+  const bool test_sprt = params_.use_sprt && epsilon > delta;
+  const double A = test_sprt ? computeSprtThreshold(epsilon, delta) : 0.0;
+  const double lambda_inlier = delta / epsilon;
+  const double lambda_outlier = (1.0 - delta) / (1.0 - epsilon);
+  double lambda = 1.0;
+  *rejected_by_sprt = false;
+  inlier_candidates_.clear();
+  for (size_t block_begin = 0; block_begin < num_points;
+       block_begin += kVerificationBlockSize) {
+    const size_t block_end =
+        std::min(num_points, block_begin + kVerificationBlockSize);
+    markPlaneInliers(ordered_buffer_, block_begin, block_end, hessian,
+                     max_deviation, block_inlier_mask_);
+    for (size_t j = block_begin; j < block_end; ++j) {
+      if (block_inlier_mask_[j - block_begin]) {
+        inlier_candidates_.push_back(ordered_points_[j]);
+        lambda *= lambda_inlier;
+      } else {
+        lambda *= lambda_outlier;
+      }
+      if (test_sprt && lambda > A) {
+        *num_points_tested = j + 1;
+        *rejected_by_sprt = true;
+        return false;
+      }
+      // The model can no longer have more inliers than the best one.
+      if (inlier_candidates_.size() + num_points - j - 1 <= best_num_inliers) {
+        *num_points_tested = j + 1;
+        return false;
+      }
+    }
+  }
+  *num_points_tested = num_points;
+  return true;
+}
+
+void PlaneRansac::run(const std::vector<cv::Vec3f>& points,
+                      const std::vector<float>* quality,
+                      std::vector<cv::Vec3f>* inliers) {
+  CHECK_NOTNULL(inliers);
+  const size_t N = points.size();
+  CHECK(N > 3) << "Not enough points to use RANSAC.";
+  inliers->clear();
+  num_iterations_ = 0;
+  generator_.seed(1);
+
+  // The hypotheses are verified on a shuffled copy of the points: the points
+  // come ordered by image rows and the SPRT assumes them to be independent.
+  ordered_points_.assign(points.begin(), points.end());
+  std::shuffle(ordered_points_.begin(), ordered_points_.end(), generator_);
+  ordered_buffer_.assign(ordered_points_);
+
+  if (params_.use_prosac) {
+    // Sort the points by quality.
+    scores_.resize(N);
+    if (quality != nullptr) {
+      CHECK_EQ(quality->size(), N);
+      std::copy(quality->begin(), quality->end(), scores_.begin());
+    } else {
+      for (size_t i = 0; i < N; ++i) {
+        scores_[i] = points[i][2];
+      }
+      std::nth_element(scores_.begin(), scores_.begin() + N / 2,
+                       scores_.end());
+      const float median_depth = scores_[N / 2];
+      for (size_t i = 0; i < N; ++i) {
+        scores_[i] = -fabs(points[i][2] - median_depth);
+      }
+    }
+    order_.resize(N);
+    std::iota(order_.begin(), order_.end(), 0);
+    std::sort(order_.begin(), order_.end(), [this](size_t a, size_t b) {
+      return scores_[a] > scores_[b] || (scores_[a] == scores_[b] && a < b);
+    });
+  }
+  const unsigned int min_num_inliers = params_.min_num_inliers;
+  ClusterDistanceFromMean cluster_distance_from_mean(
+      params_.max_discont_in_point_to_mean_distance_connected_components);
+  cluster_distance_histogram_.setDistanceThreshold(
+      params_.max_discont_in_point_to_mean_distance_connected_components);
+  bool single_connected_component;
+  double epsilon = std::max(kSprtMinEpsilon,
+                            static_cast<double>(min_num_inliers) / N);
+  double delta = kSprtInitialDelta;
+  size_t num_rejected = 0;
+  unsigned int max_iterations = params_.max_iterations;
+
+  // PROSAC: the samples are drawn among the n best points, the n-th being
+  // always part of the sample, and n grows so that after max_iterations the
+  // sampling is uniform over all the points.
+  size_t prosac_n = 3;
+  double prosac_T_n = params_.max_iterations;
+  for (size_t i = 0; i < 3; ++i) {
+    prosac_T_n *= static_cast<double>(prosac_n - i) / (N - i);
+  }
+  double prosac_T_prime_n = 1.0;
+
+  size_t sample[3];
+  cv::Vec4f hessian;
+  size_t num_points_tested;
+  bool rejected_by_sprt;
+  for (unsigned int iter = 0; iter < max_iterations; ++iter) {
+    num_iterations_++;
+    if (params_.use_prosac) {
+      if (iter + 1 > prosac_T_prime_n && prosac_n < N) {
+        const double prosac_T_n_next =
+            prosac_T_n * (prosac_n + 1) / (prosac_n + 1 - 3);
+        prosac_T_prime_n += ceil(prosac_T_n_next - prosac_T_n);
+        prosac_T_n = prosac_T_n_next;
+        prosac_n++;
+      }
+      if (prosac_n < N) {
+        drawSample(prosac_n, prosac_n - 1, sample);
+      } else {
+        drawSample(N, -1, sample);
+      }
+      if (!planeFromSample(points[order_[sample[0]]],
+                           points[order_[sample[1]]],
+                           points[order_[sample[2]]], &hessian)) {
+        continue;
+      }
+    } else {
+      drawSample(N, -1, sample);
+      if (!planeFromSample(ordered_points_[sample[0]],
+                           ordered_points_[sample[1]],
+                           ordered_points_[sample[2]], &hessian)) {
+        continue;
+      }
+    }
+
+    if (!verifyHypothesis(hessian, epsilon, delta, inliers->size(),
+                          &num_points_tested, &rejected_by_sprt)) {
+      if (!rejected_by_sprt) continue;
+      // Update the estimate of the fraction of points consistent with a bad
+      // model.
+      num_rejected++;
+      const double delta_model =
+          static_cast<double>(inlier_candidates_.size()) / num_points_tested;
+      delta = std::max(1e-3, std::min(0.5, delta + (delta_model - delta) /
+                                                       num_rejected));
+      continue;
+    }
+    if (inlier_candidates_.size() < min_num_inliers) continue;
+    if (params_.use_histogram_connectivity_check) {
+      cluster_distance_histogram_.clear();
+      cluster_distance_histogram_.addPoints(inlier_candidates_);
+      single_connected_component =
+          cluster_distance_histogram_.singleConnectedComponent();
+    } else {
+      cluster_distance_from_mean.clear();
+      cluster_distance_from_mean.addPoints(inlier_candidates_);
+      single_connected_component =
+          cluster_distance_from_mean.singleConnectedComponent();
+    }
+    if (!single_connected_component) continue;
+
+    // New best model.
+    *inliers = inlier_candidates_;
+    epsilon = std::max(epsilon, static_cast<double>(inliers->size()) / N);
+    max_iterations =
+        std::min(max_iterations, adaptiveNumIterations(epsilon));
+    if (inliers->size() > params_.inlier_fraction_max * N) break;
+  }
+}
+
+}  // namespace line_detection
@@ -0,0 +1,322 @@
+#include "line_detection/plane_segmentation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "line_detection/covariance_plane_fitter.h"
+#include "line_detection/line_detection.h"
+
+namespace line_detection {
+
+constexpr int PlaneSegmentation::kNoPlane;
+
+namespace {
+// Label of the points not yet visited by the region growing.
+constexpr int kUnvisited = -2;
+// Number of values per entry of the integral images: x, y, z and number of
+// points with valid depth.
+constexpr size_t kNumChannels = 4;
+// Number of points of a region after which its plane is first refitted. The
+// plane is then refitted each time the number of points doubles.
+constexpr size_t kFirstRefitSize = 16;
+
+bool hasValidDepth(const cv::Vec3f& point) {
+  return !std::isnan(point[0]) && !checkEqualPoints(point, {0.0f, 0.0f, 0.0f});
+}
+
+bool sameParams(const PlaneSegmentationParams& a,
+                const PlaneSegmentationParams& b) {
+  return a.normal_window_radius == b.normal_window_radius &&
+         a.max_distance_between_neighbours ==
+             b.max_distance_between_neighbours &&
+         a.min_cos_angle_normals == b.min_cos_angle_normals &&
+         a.max_distance_from_plane == b.max_distance_from_plane &&
+         a.min_region_size == b.min_region_size;
+}
+
+float errorToPlane(const cv::Vec4f& hessian, const cv::Vec3f& point) {
+  return std::fabs(hessian[0] * point[0] + hessian[1] * point[1] +
+                   hessian[2] * point[2] + hessian[3]);
+}
+}  // namespace
+
+PlaneSegmentation::PlaneSegmentation() {}
+
+bool PlaneSegmentation::isSetTo(const cv::Mat& cloud,
+                                const PlaneSegmentationParams& params) const {
+  return !cloud_.empty() && cloud.data == cloud_.data &&
+         cloud.rows == cloud_.rows && cloud.cols == cloud_.cols &&
+         sameParams(params, params_of_segmentation_);
+}
+
+void PlaneSegmentation::computeNormals() {
+  const int rows = cloud_.rows;
+  const int cols = cloud_.cols;
+  const size_t row_stride = (cols + 1) * kNumChannels;
+  integral_.assign((rows + 1) * row_stride, 0.0);
+  for (int r = 0; r < rows; ++r) {
+    const cv::Vec3f* cloud_row = cloud_.ptr<cv::Vec3f>(r);
+    const double* above = &integral_[r * row_stride];
+    double* current = &integral_[(r + 1) * row_stride];
+    double row_sum[kNumChannels] = {0.0, 0.0, 0.0, 0.0};
+    for (int c = 0; c < cols; ++c) {
+      const cv::Vec3f& point = cloud_row[c];
+      if (hasValidDepth(point)) {
+        row_sum[0] += point[0];
+        row_sum[1] += point[1];
+        row_sum[2] += point[2];
+        row_sum[3] += 1.0;
+      }
+      for (size_t k = 0; k < kNumChannels; ++k) {
+        current[(c + 1) * kNumChannels + k] =
+            above[(c + 1) * kNumChannels + k] + row_sum[k];
+      }
+    }
+  }
+  // Sums the channels over the box [row_start, row_end] x [col_start, col_end]
+  // (all included) and returns the mean point, or false if the box contains
+  // less than min_count points.
+  auto box_mean = [this, row_stride](int row_start, int row_end,
+                                     int col_start, int col_end,
+                                     double min_count, cv::Vec3d* mean) {
+    const double* top = &integral_[row_start * row_stride];
+    const double* bottom = &integral_[(row_end + 1) * row_stride];
+    double sum[kNumChannels];
+    for (size_t k = 0; k < kNumChannels; ++k) {
+      sum[k] = bottom[(col_end + 1) * kNumChannels + k] -
+               bottom[col_start * kNumChannels + k] -
+               top[(col_end + 1) * kNumChannels + k] +
+               top[col_start * kNumChannels + k];
+    }
+    if (sum[3] < min_count) return false;
+    *mean = cv::Vec3d(sum[0], sum[1], sum[2]) * (1.0 / sum[3]);
+    return true;
+  };
+
+  const int radius = std::max(params_.normal_window_radius, 1);
+  // Each half window must be at least half full.
+  const double min_count = 0.5 * radius * (2 * radius + 1);
+  // The centres of opposite half windows are about radius + 1 pixels apart.
+  const double max_gradient =
+      (radius + 1) * params_.max_distance_between_neighbours;
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  normals_.create(rows, cols, CV_32FC3);
+  normals_.setTo(cv::Scalar(nan, nan, nan));
+  for (int r = radius; r < rows - radius; ++r) {
+    const cv::Vec3f* cloud_row = cloud_.ptr<cv::Vec3f>(r);
+    cv::Vec3f* normals_row = normals_.ptr<cv::Vec3f>(r);
+    for (int c = radius; c < cols - radius; ++c) {
+      if (!hasValidDepth(cloud_row[c])) continue;
+      cv::Vec3d left, right, up, down;
+      if (!box_mean(r - radius, r + radius, c - radius, c - 1, min_count,
+                    &left) ||
+          !box_mean(r - radius, r + radius, c + 1, c + radius, min_count,
+                    &right) ||
+          !box_mean(r - radius, r - 1, c - radius, c + radius, min_count,
+                    &up) ||
+          !box_mean(r + 1, r + radius, c - radius, c + radius, min_count,
+                    &down)) {
+        continue;
+      }
+      const cv::Vec3d horizontal = right - left;
+      const cv::Vec3d vertical = down - up;
+      // Do not compute the normals across depth discontinuities.
+      if (cv::norm(horizontal) > max_gradient ||
+          cv::norm(vertical) > max_gradient) {
+        continue;
+      }
+      cv::Vec3d normal = horizontal.cross(vertical);
+      const double norm = cv::norm(normal);
+      if (norm < 1e-12) continue;
+      normal *= 1.0 / norm;
+      // Orient the normal towards the camera.
+      if (normal.dot(cv::Vec3d(cloud_row[c])) > 0.0) normal = -normal;
+      normals_row[c] = cv::Vec3f(normal);
+    }
+  }
+}
+
+size_t PlaneSegmentation::growRegion(int seed_row, int seed_col, int label) {
+  const int rows = cloud_.rows;
+  const int cols = cloud_.cols;
+  const cv::Vec3f seed_point = cloud_.at<cv::Vec3f>(seed_row, seed_col);
+  const cv::Vec3f seed_normal = normals_.at<cv::Vec3f>(seed_row, seed_col);
+  // The plane of the region starts as the tangent plane at the seed.
+  cv::Vec4f hessian(seed_normal[0], seed_normal[1], seed_normal[2],
+                    -seed_normal.dot(seed_point));
+  cv::Vec3f region_normal = seed_normal;
+  CovariancePlaneFitter fitter;
+  size_t next_refit = kFirstRefitSize;
+
+  queue_.clear();
+  region_points_.clear();
+  queue_.emplace_back(seed_col, seed_row);
+  labels_.at<int>(seed_row, seed_col) = label;
+  const int kNeighbourOffsets[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+  for (size_t i = 0; i < queue_.size(); ++i) {
+    const cv::Point pixel = queue_[i];
+    const cv::Vec3f& point = cloud_.at<cv::Vec3f>(pixel.y, pixel.x);
+    region_points_.push_back(pixel);
+    fitter.addPoint(point);
+    if (fitter.getNumPoints() == next_refit) {
+      cv::Vec4f refitted_hessian;
+      if (fitter.fit(&refitted_hessian)) {
+        hessian = refitted_hessian;
+        region_normal = cv::Vec3f(hessian[0], hessian[1], hessian[2]);
+      }
+      next_refit *= 2;
+    }
+    for (const auto& offset : kNeighbourOffsets) {
+      const int row = pixel.y + offset[1];
+      const int col = pixel.x + offset[0];
+      if (row < 0 || row >= rows || col < 0 || col >= cols) continue;
+      int& neighbour_label = labels_.at<int>(row, col);
+      if (neighbour_label != kUnvisited) continue;
+      const cv::Vec3f& normal = normals_.at<cv::Vec3f>(row, col);
+      if (std::isnan(normal[0])) continue;
+      const cv::Vec3f& neighbour = cloud_.at<cv::Vec3f>(row, col);
+      if (std::fabs(normal.dot(region_normal)) <
+              params_.min_cos_angle_normals ||
+          errorToPlane(hessian, neighbour) > params_.max_distance_from_plane ||
+          cv::norm(neighbour - point) >
+              params_.max_distance_between_neighbours) {
+        continue;
+      }
+      neighbour_label = label;
+      queue_.emplace_back(col, row);
+    }
+  }
+  if (region_points_.size() >= params_.min_region_size) {
+    Plane plane;
+    fitter.fit(&plane.hessian);
+    plane.num_points = region_points_.size();
+    planes_.push_back(plane);
+  }
+  return region_points_.size();
+}
+
+void PlaneSegmentation::segment(const cv::Mat& cloud) {
+  CHECK_EQ(cloud.type(), CV_32FC3);
+  cloud_ = cloud;
+  params_of_segmentation_ = params_;
+  planes_.clear();
+  computeNormals();
+  labels_.create(cloud.rows, cloud.cols, CV_32SC1);
+  labels_.setTo(kUnvisited);
+
+  // Grow the regions from the points with a valid normal, in scan order.
+  for (int r = 0; r < cloud.rows; ++r) {
+    const cv::Vec3f* normals_row = normals_.ptr<cv::Vec3f>(r);
+    int* labels_row = labels_.ptr<int>(r);
+    for (int c = 0; c < cloud.cols; ++c) {
+      if (labels_row[c] != kUnvisited || std::isnan(normals_row[c][0])) {
+        continue;
+      }
+      const int label = planes_.size();
+      if (growRegion(r, c, label) < params_.min_region_size) {
+        // The points of a small region are not seeds anymore.
+        for (const cv::Point& pixel : region_points_) {
+          labels_.at<int>(pixel.y, pixel.x) = kNoPlane;
+        }
+      }
+    }
+  }
+
+  // The points close to discontinuities and creases have no (or a wrong)
+  // normal and were therefore left out of the regions. Add them to the
+  // neighbouring regions whose plane they lie on.
+  queue_.clear();
+  for (int r = 0; r < cloud.rows; ++r) {
+    const int* labels_row = labels_.ptr<int>(r);
+    for (int c = 0; c < cloud.cols; ++c) {
+      if (labels_row[c] >= 0) queue_.emplace_back(c, r);
+    }
+  }
+  const int kNeighbourOffsets[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+  for (size_t i = 0; i < queue_.size(); ++i) {
+    const cv::Point pixel = queue_[i];
+    const int label = labels_.at<int>(pixel.y, pixel.x);
+    const cv::Vec3f& point = cloud_.at<cv::Vec3f>(pixel.y, pixel.x);
+    Plane& plane = planes_[label];
+    for (const auto& offset : kNeighbourOffsets) {
+      const int row = pixel.y + offset[1];
+      const int col = pixel.x + offset[0];
+      if (row < 0 || row >= cloud.rows || col < 0 || col >= cloud.cols) {
+        continue;
+      }
+      int& neighbour_label = labels_.at<int>(row, col);
+      if (neighbour_label >= 0) continue;
+      const cv::Vec3f& neighbour = cloud_.at<cv::Vec3f>(row, col);
+      if (!hasValidDepth(neighbour) ||
+          errorToPlane(plane.hessian, neighbour) >
+              params_.max_distance_from_plane ||
+          cv::norm(neighbour - point) >
+              params_.max_distance_between_neighbours) {
+        continue;
+      }
+      neighbour_label = label;
+      ++plane.num_points;
+      queue_.emplace_back(col, row);
+    }
+  }
+
+  for (int r = 0; r < cloud.rows; ++r) {
+    int* labels_row = labels_.ptr<int>(r);
+    for (int c = 0; c < cloud.cols; ++c) {
+      if (labels_row[c] == kUnvisited) labels_row[c] = kNoPlane;
+    }
+  }
+}
+
+int PlaneSegmentation::findDominantPlane(
+    const std::vector<cv::Point2f>& corners, cv::Vec4f* hessian,
+    double* fraction) const {
+  CHECK_NOTNULL(hessian);
+  CHECK_NOTNULL(fraction);
+  CHECK(!cloud_.empty()) << "No cloud was segmented.";
+  *fraction = 0.0;
+  // Number of points of each plane in the rectangle. A rectangle usually
+  // overlaps only a few planes, so a linear search is enough.
+  std::vector<std::pair<int, size_t>> counts;
+  size_t num_points = 0;
+  forEachValidPointInRectangle(
+      corners, cloud_,
+      [this, &counts, &num_points](int row, int col, const cv::Vec3f& point) {
+        if (checkEqualPoints(point, {0.0f, 0.0f, 0.0f})) return true;
+        ++num_points;
+        const int label = labels_.at<int>(row, col);
+        if (label == kNoPlane) return true;
+        for (auto& count : counts) {
+          if (count.first == label) {
+            ++count.second;
+            return true;
+          }
+        }
+        counts.emplace_back(label, 1u);
+        return true;
+      });
+  if (counts.empty()) return kNoPlane;
+  const auto dominant = std::max_element(
+      counts.begin(), counts.end(),
+      [](const std::pair<int, size_t>& a, const std::pair<int, size_t>& b) {
+        return a.second < b.second;
+      });
+  const int label = dominant->first;
+
+  // Fit the plane to the points of the rectangle only, since the plane of the
+  // whole region is less accurate locally.
+  CovariancePlaneFitter fitter;
+  forEachValidPointInRectangle(
+      corners, cloud_,
+      [this, label, &fitter](int row, int col, const cv::Vec3f& point) {
+        if (labels_.at<int>(row, col) == label) fitter.addPoint(point);
+        return true;
+      });
+  if (!fitter.fit(hessian)) return kNoPlane;
+  *fraction = static_cast<double>(dominant->second) / num_points;
+  return label;
+}
+
+}  // namespace line_detection
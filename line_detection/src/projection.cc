@@ -0,0 +1,64 @@
+#include "line_detection/projection.h"
+
+#include <glog/logging.h>
+
+namespace line_detection {
+
+cv::Matx34f toProjectionMatx(const cv::Mat& camera_P) {
+  CHECK_EQ(camera_P.rows, 3);
+  CHECK_EQ(camera_P.cols, 4);
+  CHECK_EQ(camera_P.channels(), 1);
+  cv::Matx34f P;
+  if (camera_P.type() == CV_32FC1) {
+    for (int i = 0; i < 3; ++i) {
+      const float* row = camera_P.ptr<float>(i);
+      for (int j = 0; j < 4; ++j) P(i, j) = row[j];
+    }
+  } else {
+    camera_P.convertTo(P, CV_32F);
+  }
+  return P;
+}
+
+void projectPoints(const cv::Matx34f& P, const std::vector<cv::Vec3f>& points,
+                   std::vector<cv::Vec2f>* points_2D) {
+  CHECK_NOTNULL(points_2D);
+  const size_t num_points = points.size();
+  points_2D->resize(num_points);
+  // Copy the matrix to locals, so that the compiler does not need to reload it
+  // after each store to the output.
+  const float p00 = P(0, 0), p01 = P(0, 1), p02 = P(0, 2), p03 = P(0, 3);
+  const float p10 = P(1, 0), p11 = P(1, 1), p12 = P(1, 2), p13 = P(1, 3);
+  const float p20 = P(2, 0), p21 = P(2, 1), p22 = P(2, 2), p23 = P(2, 3);
+  const float* in = num_points > 0 ? points[0].val : nullptr;
+  float* out = num_points > 0 ? (*points_2D)[0].val : nullptr;
+  for (size_t i = 0; i < num_points; ++i) {
+    const float x = in[3 * i], y = in[3 * i + 1], z = in[3 * i + 2];
+    const float w = p20 * x + p21 * y + p22 * z + p23;
+    out[2 * i] = (p00 * x + p01 * y + p02 * z + p03) / w;
+    out[2 * i + 1] = (p10 * x + p11 * y + p12 * z + p13) / w;
+  }
+}
+
+void projectSegments(const cv::Matx34f& P,
+                     const std::vector<cv::Vec6f>& segments,
+                     std::vector<cv::Vec4f>* segments_2D) {
+  CHECK_NOTNULL(segments_2D);
+  const size_t num_segments = segments.size();
+  segments_2D->resize(num_segments);
+  const float p00 = P(0, 0), p01 = P(0, 1), p02 = P(0, 2), p03 = P(0, 3);
+  const float p10 = P(1, 0), p11 = P(1, 1), p12 = P(1, 2), p13 = P(1, 3);
+  const float p20 = P(2, 0), p21 = P(2, 1), p22 = P(2, 2), p23 = P(2, 3);
+  // A segment is two consecutive points, both in the input and in the output.
+  const size_t num_points = 2 * num_segments;
+  const float* in = num_segments > 0 ? segments[0].val : nullptr;
+  float* out = num_segments > 0 ? (*segments_2D)[0].val : nullptr;
+  for (size_t i = 0; i < num_points; ++i) {
+    const float x = in[3 * i], y = in[3 * i + 1], z = in[3 * i + 2];
+    const float w = p20 * x + p21 * y + p22 * z + p23;
+    out[2 * i] = (p00 * x + p01 * y + p02 * z + p03) / w;
+    out[2 * i + 1] = (p10 * x + p11 * y + p12 * z + p13) / w;
+  }
+}
+
+}  // namespace line_detection
@@ -0,0 +1,356 @@
+#include "line_detection/wedge_estimator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include <glog/logging.h>
+
+namespace line_detection {
+
+namespace {
+// Initial steps of the pattern search of the line: rotation about the point of
+// the line (in radians) and translation on the viewing plane, relative to the
+// spread of the points.
+constexpr double kInitialAngleStep = 0.2;
+constexpr double kInitialRelativeOffsetStep = 0.5;
+// The pattern search stops when the steps have been reduced by this factor.
+constexpr double kMinRelativeStep = 1e-6;
+constexpr size_t kMaxCostEvaluations = 500;
+
+double distanceToPlane(const cv::Vec4d& plane, const cv::Vec3f& point) {
+  return plane[0] * point[0] + plane[1] * point[1] + plane[2] * point[2] +
+         plane[3];
+}
+
+size_t countInliers(const std::vector<cv::Vec3f>& points,
+                    const cv::Vec4d& plane, double max_deviation) {
+  size_t num_inliers = 0;
+  for (const cv::Vec3f& point : points) {
+    if (std::fabs(distanceToPlane(plane, point)) < max_deviation) {
+      ++num_inliers;
+    }
+  }
+  return num_inliers;
+}
+}  // namespace
+
+WedgeEstimator::WedgeEstimator()
+    : line_point_(0.0f, 0.0f, 0.0f), line_direction_(0.0f, 0.0f, 0.0f) {
+  num_inliers_[0] = num_inliers_[1] = 0;
+}
+
+bool WedgeEstimator::viewingPlane(const cv::Matx34f& P,
+                                  const cv::Vec4f& line_2D,
+                                  cv::Vec4f* hessian) {
+  CHECK_NOTNULL(hessian);
+  // Homogeneous coordinates of the 2D line, through its two endpoints.
+  const cv::Vec3d start(line_2D[0], line_2D[1], 1.0);
+  const cv::Vec3d end(line_2D[2], line_2D[3], 1.0);
+  const cv::Vec3d line = start.cross(end);
+  // The points X that project onto the line satisfy line^T * P * X = 0.
+  cv::Vec4d plane(0.0, 0.0, 0.0, 0.0);
+  for (int j = 0; j < 4; ++j) {
+    for (int i = 0; i < 3; ++i) {
+      plane[j] += line[i] * P(i, j);
+    }
+  }
+  const double norm = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] +
+                                plane[2] * plane[2]);
+  if (norm < 1e-12) return false;
+  *hessian = cv::Vec4f(plane * (1.0 / norm));
+  return true;
+}
+
+void WedgeEstimator::computeMoments(const std::vector<cv::Vec3f>& points,
+                                    const cv::Vec4d& plane, double threshold,
+                                    Moments* moments) {
+  moments->num_points = 0.0;
+  moments->sum = cv::Vec3d(0.0, 0.0, 0.0);
+  moments->sum_outer_products = cv::Matx33d::zeros();
+  for (const cv::Vec3f& point : points) {
+    if (!(std::fabs(distanceToPlane(plane, point)) < threshold)) continue;
+    const cv::Vec3d p(point[0], point[1], point[2]);
+    moments->num_points += 1.0;
+    moments->sum += p;
+    moments->sum_outer_products += p * p.t();
+  }
+}
+
+double WedgeEstimator::fitPlaneThroughLine(const Moments& moments,
+                                           const cv::Vec3d& point,
+                                           const cv::Vec3d& direction,
+                                           cv::Vec4d* plane) {
+  // Second moments of the points relative to the point of the line.
+  const cv::Matx33d moments_at_point =
+      moments.sum_outer_products - moments.sum * point.t() -
+      point * moments.sum.t() + moments.num_points * (point * point.t());
+  // Orthonormal basis of the normals of the planes through the line.
+  const cv::Vec3d axis = std::fabs(direction[0]) < 0.6
+                             ? cv::Vec3d(1.0, 0.0, 0.0)
+                             : cv::Vec3d(0.0, 1.0, 0.0);
+  cv::Vec3d e1 = direction.cross(axis);
+  e1 *= 1.0 / cv::norm(e1);
+  const cv::Vec3d e2 = direction.cross(e1);
+  // The normal is the eigenvector of the smallest eigenvalue of the moments
+  // restricted to the basis, and the eigenvalue is the cost.
+  const double m11 = e1.dot(moments_at_point * e1);
+  const double m12 = e1.dot(moments_at_point * e2);
+  const double m22 = e2.dot(moments_at_point * e2);
+  const double half_trace = 0.5 * (m11 + m22);
+  const double half_difference = 0.5 * (m11 - m22);
+  const double smallest_eigenvalue =
+      half_trace - std::sqrt(half_difference * half_difference + m12 * m12);
+  // Of the two expressions of the eigenvector, take the better conditioned.
+  double v1 = m12, v2 = smallest_eigenvalue - m11;
+  const double w1 = smallest_eigenvalue - m22, w2 = m12;
+  if (w1 * w1 + w2 * w2 > v1 * v1 + v2 * v2) {
+    v1 = w1;
+    v2 = w2;
+  }
+  const double norm = std::sqrt(v1 * v1 + v2 * v2);
+  if (norm < 1e-300) {
+    // The matrix is a multiple of the identity: any plane is as good.
+    v1 = 1.0;
+    v2 = 0.0;
+  } else {
+    v1 /= norm;
+    v2 /= norm;
+  }
+  const cv::Vec3d normal = e1 * v1 + e2 * v2;
+  *plane = cv::Vec4d(normal[0], normal[1], normal[2], -normal.dot(point));
+  return std::max(smallest_eigenvalue, 0.0);
+}
+
+void WedgeEstimator::optimizeLine(const Moments& moments_1,
+                                  const Moments& moments_2,
+                                  const cv::Vec3d& viewing_normal,
+                                  cv::Vec3d* point,
+                                  cv::Vec3d* direction) const {
+  // Rotate the line about the projection of the mean of the points, so that
+  // rotations and translations are decoupled as much as possible.
+  const double num_points = moments_1.num_points + moments_2.num_points;
+  const cv::Vec3d mean = (moments_1.sum + moments_2.sum) * (1.0 / num_points);
+  *point += *direction * direction->dot(mean - *point);
+  const cv::Matx33d second_moments =
+      (moments_1.sum_outer_products + moments_2.sum_outer_products) *
+      (1.0 / num_points);
+  const double variance = second_moments(0, 0) + second_moments(1, 1) +
+                          second_moments(2, 2) - mean.dot(mean);
+  const double spread = std::sqrt(std::max(variance, 1e-12));
+  // In-plane direction perpendicular to the line.
+  const cv::Vec3d normal_to_line = viewing_normal.cross(*direction);
+
+  cv::Vec4d plane;
+  auto cost = [&](double angle, double offset) {
+    const cv::Vec3d moved_direction =
+        *direction * std::cos(angle) + normal_to_line * std::sin(angle);
+    const cv::Vec3d moved_point = *point + normal_to_line * offset;
+    return fitPlaneThroughLine(moments_1, moved_point, moved_direction,
+                               &plane) +
+           fitPlaneThroughLine(moments_2, moved_point, moved_direction,
+                               &plane);
+  };
+  // Pattern search over the angle and the offset.
+  double best_angle = 0.0, best_offset = 0.0;
+  double best_cost = cost(0.0, 0.0);
+  size_t num_evaluations = 1;
+  const double angle_step = kInitialAngleStep;
+  const double offset_step = kInitialRelativeOffsetStep * spread;
+  const double moves[4][2] = {{1.0, 0.0}, {-1.0, 0.0}, {0.0, 1.0}, {0.0, -1.0}};
+  double step = 1.0;
+  while (step > kMinRelativeStep && num_evaluations < kMaxCostEvaluations) {
+    bool improved = false;
+    for (const auto& move : moves) {
+      const double angle = best_angle + move[0] * step * angle_step;
+      const double offset = best_offset + move[1] * step * offset_step;
+      const double new_cost = cost(angle, offset);
+      ++num_evaluations;
+      if (new_cost < best_cost) {
+        best_cost = new_cost;
+        best_angle = angle;
+        best_offset = offset;
+        improved = true;
+        break;
+      }
+    }
+    if (!improved) step *= 0.5;
+  }
+  *direction = *direction * std::cos(best_angle) +
+               normal_to_line * std::sin(best_angle);
+  *direction *= 1.0 / cv::norm(*direction);
+  *point += normal_to_line * best_offset;
+}
+
+bool WedgeEstimator::sampleModel(const std::vector<cv::Vec3f>& points_1,
+                                 const std::vector<cv::Vec3f>& points_2,
+                                 const cv::Vec4d& viewing_plane,
+                                 cv::Vec3d* point, cv::Vec3d* direction,
+                                 cv::Vec4d* plane_1,
+                                 cv::Vec4d* plane_2) const {
+  const cv::Vec3d viewing_normal(viewing_plane[0], viewing_plane[1],
+                                 viewing_plane[2]);
+  const double num_points = points_1.size() + points_2.size();
+  // Fixed seed, as in planeRANSAC, so that the results are repeatable.
+  std::default_random_engine generator(1);
+  size_t best_num_inliers = 0;
+  double num_hypotheses_needed = params_.max_hypotheses;
+  for (unsigned int hypothesis = 0;
+       hypothesis < params_.max_hypotheses &&
+       hypothesis < num_hypotheses_needed;
+       ++hypothesis) {
+    // Alternate the side whose plane gives the line.
+    const bool line_from_1 = hypothesis % 2 == 0;
+    const std::vector<cv::Vec3f>& line_side = line_from_1 ? points_1 : points_2;
+    const std::vector<cv::Vec3f>& other_side =
+        line_from_1 ? points_2 : points_1;
+    std::uniform_int_distribution<size_t> line_side_index(
+        0, line_side.size() - 1);
+    std::uniform_int_distribution<size_t> other_side_index(
+        0, other_side.size() - 1);
+    const size_t i = line_side_index(generator);
+    const size_t j = line_side_index(generator);
+    const size_t k = line_side_index(generator);
+    const cv::Vec3d q(other_side[other_side_index(generator)]);
+    if (i == j || i == k || j == k) continue;
+    // Plane of the 3 points of the first side.
+    const cv::Vec3d a(line_side[i]), b(line_side[j]), c(line_side[k]);
+    cv::Vec3d normal = (b - a).cross(c - a);
+    double norm = cv::norm(normal);
+    if (norm < 1e-12) continue;
+    normal *= 1.0 / norm;
+    const cv::Vec4d line_plane(normal[0], normal[1], normal[2],
+                               -normal.dot(a));
+    // Its intersection with the viewing plane.
+    cv::Vec3d line_direction = normal.cross(viewing_normal);
+    norm = cv::norm(line_direction);
+    if (norm < 1e-6) continue;
+    line_direction *= 1.0 / norm;
+    const cv::Vec3d line_point =
+        (viewing_normal.cross(line_direction) * (-line_plane[3]) +
+         line_direction.cross(normal) * (-viewing_plane[3])) *
+        (1.0 / normal.dot(viewing_normal.cross(line_direction)));
+    // Plane through the line and the point of the other side.
+    cv::Vec3d other_normal = line_direction.cross(q - line_point);
+    norm = cv::norm(other_normal);
+    if (norm < 1e-12) continue;
+    other_normal *= 1.0 / norm;
+    const cv::Vec4d other_plane(other_normal[0], other_normal[1],
+                                other_normal[2],
+                                -other_normal.dot(line_point));
+
+    const size_t num_inliers =
+        countInliers(line_side, line_plane, params_.max_deviation) +
+        countInliers(other_side, other_plane, params_.max_deviation);
+    if (num_inliers <= best_num_inliers) continue;
+    best_num_inliers = num_inliers;
+    *point = line_point;
+    *direction = line_direction;
+    *plane_1 = line_from_1 ? line_plane : other_plane;
+    *plane_2 = line_from_1 ? other_plane : line_plane;
+    // Number of hypotheses after which an all-inlier sample was drawn with
+    // the required confidence.
+    const double inlier_fraction = best_num_inliers / num_points;
+    const double all_inlier_probability = std::pow(inlier_fraction, 4);
+    if (all_inlier_probability >= 1.0) {
+      num_hypotheses_needed = 0.0;
+    } else {
+      num_hypotheses_needed = std::log(1.0 - params_.confidence) /
+                              std::log(1.0 - all_inlier_probability);
+    }
+  }
+  return best_num_inliers > 0;
+}
+
+bool WedgeEstimator::fit(const std::vector<cv::Vec3f>& points_1,
+                         const std::vector<cv::Vec3f>& points_2,
+                         const cv::Vec4f& viewing_plane) {
+  num_inliers_[0] = num_inliers_[1] = 0;
+  if (points_1.size() < 3 || points_2.size() < 3) return false;
+  cv::Vec3d viewing_normal(viewing_plane[0], viewing_plane[1],
+                           viewing_plane[2]);
+  const double viewing_normal_norm = cv::norm(viewing_normal);
+  if (viewing_normal_norm < 1e-12) return false;
+  viewing_normal *= 1.0 / viewing_normal_norm;
+  const cv::Vec4d normalized_viewing_plane(
+      viewing_normal[0], viewing_normal[1], viewing_normal[2],
+      viewing_plane[3] / viewing_normal_norm);
+
+  cv::Vec3d point, direction;
+  cv::Vec4d plane_1, plane_2;
+  if (!sampleModel(points_1, points_2, normalized_viewing_plane, &point,
+                   &direction, &plane_1, &plane_2)) {
+    return false;
+  }
+
+  // Refine the model on the inliers, with a decreasing threshold.
+  const double max_deviation = params_.max_deviation;
+  double threshold =
+      std::max(params_.initial_relative_threshold, 1.0) * max_deviation;
+  Moments moments_1, moments_2;
+  double previous_num_points_1 = -1.0, previous_num_points_2 = -1.0;
+  for (unsigned int iteration = 0; iteration < params_.max_iterations;
+       ++iteration) {
+    computeMoments(points_1, plane_1, threshold, &moments_1);
+    computeMoments(points_2, plane_2, threshold, &moments_2);
+    if (moments_1.num_points < 3.0 || moments_2.num_points < 3.0) {
+      return false;
+    }
+    optimizeLine(moments_1, moments_2, viewing_normal, &point, &direction);
+    fitPlaneThroughLine(moments_1, point, direction, &plane_1);
+    fitPlaneThroughLine(moments_2, point, direction, &plane_2);
+    // Stop when the inliers at the final threshold do not change anymore.
+    if (threshold == max_deviation &&
+        moments_1.num_points == previous_num_points_1 &&
+        moments_2.num_points == previous_num_points_2) {
+      break;
+    }
+    previous_num_points_1 = moments_1.num_points;
+    previous_num_points_2 = moments_2.num_points;
+    threshold = std::max(0.5 * threshold, max_deviation);
+  }
+
+  computeMoments(points_1, plane_1, max_deviation, &moments_1);
+  computeMoments(points_2, plane_2, max_deviation, &moments_2);
+  num_inliers_[0] = static_cast<size_t>(moments_1.num_points);
+  num_inliers_[1] = static_cast<size_t>(moments_2.num_points);
+  if (num_inliers_[0] < 3 || num_inliers_[1] < 3) return false;
+  planes_[0] = cv::Vec4f(plane_1);
+  planes_[1] = cv::Vec4f(plane_2);
+  const cv::Vec3d mean = (moments_1.sum + moments_2.sum) *
+                         (1.0 / (moments_1.num_points + moments_2.num_points));
+  point += direction * direction.dot(mean - point);
+  line_point_ = cv::Vec3f(point);
+  line_direction_ = cv::Vec3f(direction);
+  return true;
+}
+
+bool WedgeEstimator::getLineEndpoints(const cv::Matx34f& P,
+                                      const cv::Vec4f& line_2D,
+                                      cv::Vec3f* start, cv::Vec3f* end) const {
+  CHECK_NOTNULL(start);
+  CHECK_NOTNULL(end);
+  const float du = line_2D[2] - line_2D[0];
+  const float dv = line_2D[3] - line_2D[1];
+  cv::Vec3f* endpoints[2] = {start, end};
+  for (size_t i = 0; i < 2; ++i) {
+    // The endpoint is where the line crosses the viewing plane of the image
+    // line through the 2D endpoint, perpendicular to the 2D line.
+    const float u = line_2D[2 * i];
+    const float v = line_2D[2 * i + 1];
+    cv::Vec4f plane;
+    if (!viewingPlane(P, cv::Vec4f(u, v, u - dv, v + du), &plane)) {
+      return false;
+    }
+    const cv::Vec3d normal(plane[0], plane[1], plane[2]);
+    const cv::Vec3d point(line_point_);
+    const cv::Vec3d direction(line_direction_);
+    const double cos_angle = normal.dot(direction);
+    if (std::fabs(cos_angle) < 1e-6) return false;
+    const double t = -(normal.dot(point) + plane[3]) / cos_angle;
+    *endpoints[i] = cv::Vec3f(point + t * direction);
+  }
+  return true;
+}
+
+}  // namespace line_detection
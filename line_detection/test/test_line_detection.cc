@@ -1,11 +1,25 @@
+#include <algorithm>
+#include <limits>
+#include <list>
+
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 #include <Eigen/Core>
 #include <pcl_ros/point_cloud.h>
 
 #include "line_detection/common.h"
+#include "line_detection/covariance_plane_fitter.h"
+#include "line_detection/depth_edge_detector.h"
+#include "line_detection/frame_context.h"
+#include "line_detection/integral_plane_fitter.h"
 #include "line_detection/line_detection.h"
+#include "line_detection/line_endpoint_search.h"
+#include "line_detection/line_refinement.h"
+#include "line_detection/line_tracker.h"
+#include "line_detection/plane_hypothesis_cache.h"
+#include "line_detection/plane_segmentation.h"
 #include "line_detection/test/testing-entrypoint.h"
+#include "line_detection/wedge_estimator.h"
 
 namespace line_detection {
 
@@ -38,6 +52,68 @@ class LineDetectionTest : public ::testing::Test {
     else
       test_depth_ = test_depth_load_;
   }
+
+  // Synthetic scenes of 240 x 320 pixels shared by the tests below.
+
+  // Wedge with the ridge along the column 160: the point of the pixel (i, j)
+  // is (i, j, j) * 0.01 left of the ridge and (i, j, 320 - j) * 0.01 right of
+  // it.
+  static cv::Mat makeWedgeCloud() {
+    const int N = 240;
+    const int M = 320;
+    const double scale = 0.01;
+    cv::Mat cloud(N, M, CV_32FC3);
+    for (int i = 0; i < N; ++i) {
+      for (int j = 0; j < M; ++j) {
+        if (j <= (M / 2)) {
+          cloud.at<cv::Vec3f>(i, j) =
+              cv::Vec3f(i * scale, j * scale, j * scale);
+        } else {
+          cloud.at<cv::Vec3f>(i, j) =
+              cv::Vec3f(i * scale, j * scale, (M - j) * scale);
+        }
+      }
+    }
+    return cloud;
+  }
+
+  // Fronto-parallel wall at the given depth, seen by testCameraP().
+  static cv::Mat makeWallCloud(float depth) {
+    cv::Mat cloud(240, 320, CV_32FC3);
+    for (int i = 0; i < cloud.rows; ++i) {
+      for (int j = 0; j < cloud.cols; ++j) {
+        cloud.at<cv::Vec3f>(i, j) =
+            cv::Vec3f((j - 160) / 500.0f * depth, (i - 120) / 500.0f * depth,
+                      depth);
+      }
+    }
+    return cloud;
+  }
+
+  // Fronto-parallel box at depth 1.5 in front of a wall at depth 3, seen by
+  // testCameraP(). The box covers the columns 100 to 199 and the rows 60 to
+  // 179.
+  static cv::Mat makeBoxCloud() {
+    cv::Mat cloud = makeWallCloud(3.0f);
+    makeWallCloud(1.5f)(cv::Rect(100, 60, 100, 120))
+        .copyTo(cloud(cv::Rect(100, 60, 100, 120)));
+    return cloud;
+  }
+
+  // Camera matrix with the principal point at the center of the scenes.
+  static cv::Mat testCameraP() {
+    return (cv::Mat_<float>(3, 4) << 500, 0, 160, 0,
+                                     0, 500, 120, 0,
+                                     0, 0, 1, 0);
+  }
+
+  // Lines on the wedge of makeWedgeCloud: on its ridge and on both of its
+  // sides, vertical and horizontal.
+  static std::vector<cv::Vec4f> testLines2D() {
+    return {cv::Vec4f(160, 100, 160, 200), cv::Vec4f(100, 50, 100, 150),
+            cv::Vec4f(220, 60, 220, 180), cv::Vec4f(40, 40, 120, 40),
+            cv::Vec4f(200, 200, 300, 200), cv::Vec4f(160, 20, 160, 90)};
+  }
 };
 
 // TODO: update to current version of the code or remove.
@@ -71,6 +147,93 @@ TEST_F(LineDetectionTest, testFASTLineDetection) {
       << "Fast detection: Expected 598 lines to be found. Found " << n_lines;
 }
 
+TEST_F(LineDetectionTest, testTiledLineDetection) {
+  // Two pieces of a line cut at a seam, overlapping, and a duplicate.
+  EXPECT_TRUE(areLinesCollinear2D(cv::Vec4f(0, 0, 100, 0),
+                                  cv::Vec4f(90, 0.5, 200, 0.5), 1.5, 2.0));
+  EXPECT_TRUE(areLinesCollinear2D(cv::Vec4f(0, 0, 100, 100),
+                                  cv::Vec4f(100, 100, 0, 0), 1.5, 2.0));
+  EXPECT_FALSE(areLinesCollinear2D(cv::Vec4f(0, 0, 100, 0),
+                                   cv::Vec4f(110, 0, 200, 0), 1.5, 2.0));
+  EXPECT_FALSE(areLinesCollinear2D(cv::Vec4f(0, 0, 100, 0),
+                                   cv::Vec4f(50, 5, 200, 5), 1.5, 2.0));
+  std::vector<cv::Vec4f> lines_stitched;
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  line_detector.stitchLines2DAtTileSeams(
+      {cv::Vec4f(0, 0, 100, 0), cv::Vec4f(90, 0, 200, 0),
+       cv::Vec4f(0, 50, 100, 50)}, &lines_stitched);
+  ASSERT_EQ(lines_stitched.size(), 2);
+  EXPECT_EQ(lines_stitched[0], cv::Vec4f(0, 0, 200, 0));
+
+  // The lines detected on the tiles match those detected on the whole image:
+  // each long line of the single pass is covered by a line of the tiled
+  // detection.
+  for (const DetectorType detector : {DetectorType::LSD, DetectorType::FAST}) {
+    std::vector<cv::Vec4f> lines_single_pass, lines_tiled;
+    params.detection_tile_size = 0;
+    line_detector.detectLines(test_img_gray_, detector, &lines_single_pass);
+    params.detection_tile_size = 128;
+    params.detection_tile_overlap = 16;
+    params.num_threads_detection = 4;
+    line_detector.detectLines(test_img_gray_, detector, &lines_tiled);
+    constexpr double kMinLength = 20.0;
+    size_t num_long_lines = 0, num_matched = 0;
+    for (const cv::Vec4f& line : lines_single_pass) {
+      if (cv::norm(cv::Point2f(line[2] - line[0], line[3] - line[1])) <
+          kMinLength) {
+        continue;
+      }
+      ++num_long_lines;
+      for (const cv::Vec4f& line_tiled : lines_tiled) {
+        if (areLinesCollinear2D(line_tiled, line, 2.0, 0.0)) {
+          ++num_matched;
+          break;
+        }
+      }
+    }
+    ASSERT_GT(num_long_lines, 0);
+    EXPECT_GT(num_matched, 0.9 * num_long_lines);
+    EXPECT_GT(lines_tiled.size(), 0.8 * lines_single_pass.size());
+    EXPECT_LT(lines_tiled.size(), 1.2 * lines_single_pass.size());
+  }
+}
+
+TEST_F(LineDetectionTest, testPyramidLineDetection) {
+  // Vertical step edge between the columns 100 and 101, from row 40 to row
+  // 160.
+  cv::Mat image(240, 320, CV_8UC1, cv::Scalar(50));
+  image(cv::Rect(101, 40, 219, 121)).setTo(200);
+  LineRefinementParams refinement_params;
+  refinement_params.search_radius = 4;
+  refinement_params.max_endpoint_shift = 8;
+  cv::Vec4f refined_line;
+  ASSERT_TRUE(refineLine2D(image, cv::Vec4f(102, 35, 102, 165),
+                           refinement_params, &refined_line));
+  EXPECT_NEAR(refined_line[0], 100.5, 0.1);
+  EXPECT_NEAR(refined_line[2], 100.5, 0.1);
+  EXPECT_NEAR(refined_line[1], 40, 1.0);
+  EXPECT_NEAR(refined_line[3], 160, 1.0);
+  EXPECT_FALSE(refineLine2D(image, cv::Vec4f(250, 200, 250, 230),
+                            refinement_params, &refined_line));
+
+  // The lines detected on the downsampled image are refined to the edges of
+  // the full resolution image.
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  params.detection_pyramid_level = 1;
+  std::vector<cv::Vec4f> lines;
+  line_detector.detectLines(image, DetectorType::LSD, &lines);
+  bool found_edge = false;
+  for (const cv::Vec4f& line : lines) {
+    if (fabs(line[0] - 100.5) < 0.5 && fabs(line[2] - 100.5) < 0.5 &&
+        fabs(line[1] - line[3]) > 100) {
+      found_edge = true;
+    }
+  }
+  EXPECT_TRUE(found_edge);
+}
+
 // TODO: update to current version of the code or remove.
 /*TEST_F(LineDetectionTest, testHoughLineDetection) {
   size_t n_lines;
@@ -91,6 +254,91 @@ TEST_F(LineDetectionTest, testAreLinesEqual2D) {
                                                cv::Vec4f(0, 0, 0, 10)));
 }
 
+TEST_F(LineDetectionTest, testFuseLines2DOnTheFly) {
+  // Short segments around a few long lines, so that many of them are fused.
+  std::default_random_engine generator(1);
+  std::uniform_real_distribution<float> position(0.0f, 640.0f);
+  std::uniform_real_distribution<float> angle(0.0f, 2.0f * M_PI);
+  std::uniform_real_distribution<float> offset(-0.5f, 0.5f);
+  std::vector<cv::Vec4f> lines_in;
+  for (size_t i = 0; i < 20; ++i) {
+    const cv::Vec2f origin(position(generator), position(generator));
+    const float theta = angle(generator);
+    const cv::Vec2f direction(cos(theta), sin(theta));
+    for (size_t j = 0; j < 30; ++j) {
+      const cv::Vec2f start =
+          origin + direction * (j * 5.0f + offset(generator));
+      const cv::Vec2f end = start + direction * (5.0f + offset(generator));
+      lines_in.push_back(cv::Vec4f(start[0] + offset(generator), start[1],
+                                   end[0], end[1] + offset(generator)));
+    }
+  }
+  std::shuffle(lines_in.begin(), lines_in.end(), generator);
+  // Reference: compare each line with all the clusters.
+  std::list<cv::Vec4f> clusters;
+  for (const cv::Vec4f& line : lines_in) {
+    cv::Vec4f current_line = line;
+    bool current_line_is_in_cluster = false;
+    std::list<cv::Vec4f>::iterator current_line_it;
+    for (auto it = clusters.begin(); it != clusters.end(); ++it) {
+      if (areLinesEqual2D(current_line, *it)) {
+        *it = line_detector_.mergeLines2D(current_line, *it);
+        current_line = *it;
+        if (current_line_is_in_cluster) clusters.erase(current_line_it);
+        current_line_is_in_cluster = true;
+        current_line_it = it;
+      }
+    }
+    if (!current_line_is_in_cluster) clusters.push_back(current_line);
+  }
+  std::vector<cv::Vec4f> lines_out;
+  line_detector_.fuseLines2DOnTheFly(lines_in, &lines_out);
+  EXPECT_LT(lines_out.size(), lines_in.size());
+  ASSERT_EQ(lines_out.size(), clusters.size());
+  size_t i = 0;
+  for (const cv::Vec4f& cluster : clusters) {
+    EXPECT_EQ(lines_out[i], cluster) << "Cluster " << i;
+    ++i;
+  }
+}
+
+TEST_F(LineDetectionTest, testLineSet) {
+  std::vector<LineWithPlanes> lines(3);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    lines[i].line = cv::Vec6f(i, 0, 0, i, 1, 0);
+    lines[i].hessians.push_back(cv::Vec4f(1, 0, 0, -float(i)));
+    lines[i].hessians.push_back(cv::Vec4f(0, 0, 1, 0));
+    lines[i].colors.push_back(cv::Vec3b(i, 0, 0));
+    lines[i].colors.push_back(cv::Vec3b(0, i, 0));
+    lines[i].type = LineType::EDGE;
+  }
+  lines[2].hessians.resize(1);
+  lines[2].type = LineType::DISCONT;
+  EXPECT_EQ(lines[0].hessians.capacity(), 2u);
+
+  LineSet line_set(lines);
+  ASSERT_EQ(line_set.size(), lines.size());
+  EXPECT_EQ(line_set.getLines()[1], lines[1].line);
+  EXPECT_EQ(line_set.getHessians()[2].size(), 1u);
+  EXPECT_EQ(line_set.getTypes()[2], LineType::DISCONT);
+  std::vector<LineWithPlanes> lines_out;
+  line_set.toVector(&lines_out);
+  ASSERT_EQ(lines_out.size(), lines.size());
+  for (size_t i = 0; i < lines.size(); ++i) {
+    EXPECT_EQ(lines_out[i].line, lines[i].line);
+    ASSERT_EQ(lines_out[i].hessians.size(), lines[i].hessians.size());
+    for (size_t j = 0; j < lines[i].hessians.size(); ++j) {
+      EXPECT_EQ(lines_out[i].hessians[j], lines[i].hessians[j]);
+      EXPECT_EQ(lines_out[i].colors[j], lines[i].colors[j]);
+    }
+    EXPECT_EQ(lines_out[i].type, lines[i].type);
+  }
+  // Conversion for the interfaces that use std::vector.
+  const std::vector<cv::Vec4f> hessians = lines[0].hessians;
+  EXPECT_EQ(hessians.size(), 2u);
+  EXPECT_EQ(hessians[1], cv::Vec4f(0, 0, 1, 0));
+}
+
 TEST_F(LineDetectionTest, testfitToBoundary) {
   EXPECT_EQ(line_detection::fitToBoundary(1, 0, 3), 1);
   EXPECT_EQ(line_detection::fitToBoundary(-1, 0, 3), 0);
@@ -154,6 +402,84 @@ TEST_F(LineDetectionTest, testHessianNormalFormOfPlane) {
   EXPECT_FLOAT_EQ(hessian_normal_form[3], -1);
 }
 
+TEST_F(LineDetectionTest, testCovariancePlaneFitter) {
+  // Noisy points on a plane far from the origin.
+  std::default_random_engine generator(7);
+  std::uniform_real_distribution<float> coordinate(-0.5f, 0.5f);
+  std::normal_distribution<float> noise(0.0f, 0.005f);
+  const cv::Vec3f normal = cv::normalize(cv::Vec3f(0.2f, -0.3f, 1.0f));
+  const float d = -5.0f;
+  std::vector<cv::Vec3f> points;
+  for (size_t i = 0; i < 200; ++i) {
+    const float x = coordinate(generator) + 3.0f;
+    const float y = coordinate(generator) - 2.0f;
+    const float z =
+        -(d + normal[0] * x + normal[1] * y) / normal[2] + noise(generator);
+    points.push_back(cv::Vec3f(x, y, z));
+  }
+
+  // Reference solution with the SVD of the centered points.
+  cv::Vec3f mean = computeMean(points);
+  cv::Mat A(3, points.size(), CV_64FC1);
+  for (size_t i = 0; i < points.size(); ++i) {
+    for (int k = 0; k < 3; ++k) {
+      A.at<double>(k, i) = points[i][k] - mean[k];
+    }
+  }
+  cv::Mat U, W, Vt;
+  cv::SVD::compute(A, W, U, Vt);
+  cv::Vec4f hessian_svd(U.at<double>(0, 2), U.at<double>(1, 2),
+                        U.at<double>(2, 2), 0.0f);
+  hessian_svd[3] = computeDfromPlaneNormal(
+      cv::Vec3f(hessian_svd[0], hessian_svd[1], hessian_svd[2]), mean);
+  const double svd_mean_squared_residual =
+      W.at<double>(2) * W.at<double>(2) / points.size();
+
+  CovariancePlaneFitter fitter;
+  cv::Vec4f hessian;
+  double mean_squared_residual;
+  EXPECT_FALSE(fitter.fit(&hessian));
+  fitter.addPoints(points);
+  EXPECT_EQ(fitter.getNumPoints(), points.size());
+  ASSERT_TRUE(fitter.fit(&hessian, &mean_squared_residual));
+  // The sign of the normal is arbitrary.
+  const float sign = hessian.dot(hessian_svd) > 0.0f ? 1.0f : -1.0f;
+  for (size_t k = 0; k < 4; ++k) {
+    EXPECT_NEAR(hessian[k], sign * hessian_svd[k], 1e-4);
+  }
+  EXPECT_NEAR(mean_squared_residual, svd_mean_squared_residual, 1e-8);
+  cv::Vec4f hessian_detector;
+  ASSERT_TRUE(
+      line_detector_.hessianNormalFormOfPlane(points, &hessian_detector));
+  for (size_t k = 0; k < 4; ++k) {
+    EXPECT_FLOAT_EQ(hessian_detector[k], hessian[k]);
+  }
+
+  // Removing points gives the same plane as fitting the remaining ones.
+  for (size_t i = 0; i < 50; ++i) {
+    fitter.removePoint(points[i]);
+  }
+  std::vector<cv::Vec3f> remaining_points(points.begin() + 50, points.end());
+  CovariancePlaneFitter fresh_fitter;
+  fresh_fitter.addPoints(remaining_points);
+  cv::Vec4f hessian_fresh;
+  ASSERT_TRUE(fitter.fit(&hessian));
+  ASSERT_TRUE(fresh_fitter.fit(&hessian_fresh));
+  const float sign_fresh = hessian.dot(hessian_fresh) > 0.0f ? 1.0f : -1.0f;
+  for (size_t k = 0; k < 4; ++k) {
+    EXPECT_NEAR(hessian[k], sign_fresh * hessian_fresh[k], 1e-5);
+  }
+
+  // Eigenvector of a diagonal matrix.
+  cv::Vec3d eigenvector;
+  double eigenvalue;
+  CovariancePlaneFitter::smallestEigenvector(
+      cv::Matx33d(3.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 2.0), &eigenvector,
+      &eigenvalue);
+  EXPECT_DOUBLE_EQ(eigenvalue, 1.0);
+  EXPECT_DOUBLE_EQ(fabs(eigenvector[1]), 1.0);
+}
+
 TEST_F(LineDetectionTest, testPlaneRANSAC) {
   std::vector<cv::Vec3f> points;
   cv::Vec4f hessian_normal_form;
@@ -188,6 +514,121 @@ TEST_F(LineDetectionTest, testPlaneRANSAC) {
   EXPECT_FLOAT_EQ(hessian_normal_form[3], 0);
 }
 
+TEST_F(LineDetectionTest, testAdaptivePlaneRANSAC) {
+  // 100 points on the plane z = 1 + 0.5 * x and 20 outliers.
+  std::vector<cv::Vec3f> points;
+  for (int i = 0; i < 10; ++i) {
+    for (int j = 0; j < 10; ++j) {
+      const float x = i * 0.01f;
+      const float y = j * 0.01f;
+      points.push_back(cv::Vec3f(x, y, 1.0f + 0.5f * x));
+    }
+  }
+  for (int i = 0; i < 20; ++i) {
+    const float x = (i % 10) * 0.01f;
+    const float y = (i / 10) * 0.05f;
+    points.push_back(cv::Vec3f(x, y, 1.05f + 0.5f * x + 0.002f * i));
+  }
+
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  std::vector<cv::Vec3f> inliers;
+  line_detector.planeRANSAC(points, &inliers);
+  EXPECT_EQ(inliers.size(), 100);
+  params.use_adaptive_ransac = true;
+  for (bool use_prosac : {false, true}) {
+    params.ransac_use_prosac = use_prosac;
+    line_detector.planeRANSAC(points, &inliers);
+    EXPECT_EQ(inliers.size(), 100) << "PROSAC: " << use_prosac;
+    cv::Vec4f hessian_normal_form;
+    ASSERT_TRUE(line_detector.planeRANSAC(points, &hessian_normal_form));
+    EXPECT_NEAR(fabs(hessian_normal_form[2]), 2.0 / sqrt(5.0), 1e-4);
+    EXPECT_NEAR(hessian_normal_form[1], 0.0, 1e-4);
+  }
+
+  // With a high inlier fraction the engine needs only a few hypotheses.
+  PlaneRansacParams ransac_params;
+  ransac_params.inlier_fraction_max = 1.0;
+  PlaneRansac plane_ransac;
+  plane_ransac.setParams(ransac_params);
+  plane_ransac.run(points, nullptr, &inliers);
+  EXPECT_EQ(inliers.size(), 100);
+  EXPECT_LT(plane_ransac.getNumIterations(), ransac_params.max_iterations);
+  // The result only depends on the input.
+  std::vector<cv::Vec3f> inliers_again;
+  plane_ransac.run(points, nullptr, &inliers_again);
+  EXPECT_EQ(inliers, inliers_again);
+}
+
+TEST_F(LineDetectionTest, testClusterDistanceHistogram) {
+  constexpr double kThreshold = 0.05;
+  ClusterDistanceFromMean cluster_distance_from_mean(kThreshold);
+  ClusterDistanceHistogram cluster_distance_histogram(kThreshold);
+  // Points 1 cm apart.
+  std::vector<cv::Vec3f> points;
+  for (int i = 0; i < 30; ++i) {
+    points.push_back(cv::Vec3f(i * 0.01f, 0.0f, 1.0f));
+  }
+  cluster_distance_histogram.addPoints(points);
+  EXPECT_TRUE(cluster_distance_histogram.singleConnectedComponent());
+  // A second group of points far from the first one.
+  for (int i = 0; i < 5; ++i) {
+    points.push_back(cv::Vec3f(1.0f + i * 0.01f, 0.0f, 1.0f));
+  }
+  cluster_distance_histogram.clear();
+  cluster_distance_histogram.addPoints(points);
+  EXPECT_FALSE(cluster_distance_histogram.singleConnectedComponent());
+  cluster_distance_histogram.clear();
+  EXPECT_FALSE(cluster_distance_histogram.singleConnectedComponent());
+
+  // Same result as ClusterDistanceFromMean on random sets of points.
+  std::default_random_engine generator(3);
+  std::uniform_real_distribution<float> coordinate(0.0f, 0.3f);
+  std::uniform_int_distribution<int> num_points(1, 40);
+  size_t num_connected = 0;
+  for (int trial = 0; trial < 200; ++trial) {
+    points.resize(num_points(generator));
+    for (cv::Vec3f& point : points) {
+      point = cv::Vec3f(coordinate(generator), coordinate(generator),
+                        1.0f + coordinate(generator));
+    }
+    cluster_distance_from_mean.clear();
+    cluster_distance_from_mean.addPoints(points);
+    cluster_distance_histogram.clear();
+    cluster_distance_histogram.addPoints(points);
+    const bool connected =
+        cluster_distance_from_mean.singleConnectedComponent();
+    EXPECT_EQ(cluster_distance_histogram.singleConnectedComponent(), connected)
+        << "Trial " << trial;
+    if (connected) ++num_connected;
+  }
+  EXPECT_GT(num_connected, 0);
+  EXPECT_LT(num_connected, 200);
+
+  // planeRANSAC finds the same inliers with both checks.
+  points.clear();
+  for (int i = 0; i < 10; ++i) {
+    for (int j = 0; j < 10; ++j) {
+      points.push_back(cv::Vec3f(i * 0.01f, j * 0.01f, 1.0f));
+    }
+  }
+  for (int i = 0; i < 10; ++i) {
+    points.push_back(cv::Vec3f(0.5f + i * 0.01f, 0.0f, 1.0f));
+  }
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  for (bool use_adaptive_ransac : {false, true}) {
+    params.use_adaptive_ransac = use_adaptive_ransac;
+    std::vector<cv::Vec3f> inliers_heap, inliers_histogram;
+    params.use_histogram_connectivity_check = false;
+    line_detector.planeRANSAC(points, &inliers_heap);
+    params.use_histogram_connectivity_check = true;
+    line_detector.planeRANSAC(points, &inliers_histogram);
+    EXPECT_EQ(inliers_histogram, inliers_heap)
+        << "Adaptive RANSAC: " << use_adaptive_ransac;
+  }
+}
+
 TEST_F(LineDetectionTest, testFindXCoordOfPixelsOnVector) {
   cv::Point2f start(2.5, 0.3);
   cv::Point2f end(2.1, 3.9);
@@ -233,6 +674,93 @@ TEST_F(LineDetectionTest, testFindPointsInRectangle) {
   EXPECT_EQ(points.size(), 36);
 }
 
+TEST_F(LineDetectionTest, testGatherPointsInRectangle) {
+  cv::Mat cloud(20, 30, CV_32FC3);
+  for (int i = 0; i < cloud.rows; ++i) {
+    for (int j = 0; j < cloud.cols; ++j) {
+      cloud.at<cv::Vec3f>(i, j) = cv::Vec3f(j, i, 1.0f);
+    }
+  }
+  cloud.at<cv::Vec3f>(5, 6) = cv::Vec3f(NAN, NAN, NAN);
+  // Rotated rectangle partly outside of the cloud.
+  std::vector<cv::Point2f> corners{{-3.2, 4.1}, {10.3, -2.4}, {16.6, 10.7},
+                                   {3.1, 17.2}};
+  std::vector<cv::Point2i> pixels;
+  findPointsInRectangle(corners, &pixels);
+  std::vector<cv::Vec3f> expected_points;
+  std::vector<cv::Point2i> expected_pixels;
+  for (const cv::Point2i& pixel : pixels) {
+    if (pixel.x < 0 || pixel.x >= cloud.cols || pixel.y < 0 ||
+        pixel.y >= cloud.rows) {
+      continue;
+    }
+    if (std::isnan(cloud.at<cv::Vec3f>(pixel)[0])) continue;
+    expected_points.push_back(cloud.at<cv::Vec3f>(pixel));
+    expected_pixels.push_back(pixel);
+  }
+  std::vector<cv::Vec3f> points;
+  EXPECT_TRUE(gatherPointsInRectangle(corners, cloud, true, &points));
+  EXPECT_EQ(points, expected_points);
+  // The pixels of the points can be recorded as well.
+  std::vector<cv::Point2i> points_pixels;
+  EXPECT_TRUE(
+      gatherPointsInRectangle(corners, cloud, true, &points, &points_pixels));
+  EXPECT_EQ(points, expected_points);
+  EXPECT_EQ(points_pixels, expected_pixels);
+
+  // A point without depth information stops the gathering only if requested.
+  cloud.at<cv::Vec3f>(8, 8) = cv::Vec3f(0.0f, 0.0f, 0.0f);
+  EXPECT_FALSE(gatherPointsInRectangle(corners, cloud, true, &points));
+  EXPECT_TRUE(gatherPointsInRectangle(corners, cloud, false, &points));
+  EXPECT_EQ(points.size(), expected_points.size());
+}
+
+TEST_F(LineDetectionTest, testDepthCloud) {
+  const int N = 24;
+  const int M = 32;
+  const float f = 50.0f, cx = 16.0f, cy = 12.0f;
+  cv::Mat camera_P = (cv::Mat_<float>(3, 4) << f, 0, cx, 0, 0, f, cy, 0, 0, 0,
+                      1, 0);
+  // Depth in millimeters.
+  cv::Mat depth(N, M, CV_16UC1);
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < M; ++j) {
+      depth.at<uint16_t>(i, j) = 1000 + 10 * i + j;
+    }
+  }
+  depth.at<uint16_t>(5, 6) = 0;
+  DepthCloud depth_cloud;
+  depth_cloud.setDepth(depth, camera_P, 1e-3, false);
+  EXPECT_EQ(depth_cloud.getNumComputedRows(), 0u);
+  const cv::Vec3f& point = depth_cloud.at(3, 20);
+  const float z = 1.0f + 0.03f + 0.02f;
+  EXPECT_NEAR(point[0], (20 - cx) * z / f, 1e-6);
+  EXPECT_NEAR(point[1], (3 - cy) * z / f, 1e-6);
+  EXPECT_NEAR(point[2], z, 1e-6);
+  EXPECT_EQ(depth_cloud.getNumComputedRows(), 1u);
+  // Pixels without depth give the origin.
+  EXPECT_EQ(depth_cloud.at(5, 6), cv::Vec3f(0.0f, 0.0f, 0.0f));
+
+  // Only the rows of the rectangle are computed, and the points gathered are
+  // the same as the ones of the full cloud.
+  std::vector<cv::Point2f> corners{{2.2, 9.1}, {10.3, 7.4}, {11.1, 11.2},
+                                   {3.0, 12.9}};
+  std::vector<cv::Vec3f> points, expected_points;
+  EXPECT_TRUE(gatherPointsInRectangle(corners, &depth_cloud, true, &points));
+  const RectangleScanlines scanlines(corners);
+  EXPECT_LE(depth_cloud.getNumComputedRows(), 1u + scanlines.getNumRows());
+  EXPECT_GT(depth_cloud.getNumComputedRows(), 1u);
+  const cv::Mat& cloud = depth_cloud.getCloud();
+  EXPECT_EQ(depth_cloud.getNumComputedRows(), static_cast<size_t>(N));
+  EXPECT_TRUE(gatherPointsInRectangle(corners, cloud, true, &expected_points));
+  EXPECT_EQ(points, expected_points);
+
+  // Depth as distance from the camera center.
+  depth_cloud.setDepth(depth, camera_P, 1e-3, true);
+  EXPECT_EQ(depth_cloud.getNumComputedRows(), 0u);
+  EXPECT_NEAR(cv::norm(depth_cloud.at(3, 20)), z, 1e-6);
+}
+
 TEST_F(LineDetectionTest, testGetPointOnPlaneIntersectionLine) {
   cv::Vec4f hessian1(1, 0, 0, 1);
   cv::Vec4f hessian2(0, 1, 0, 0);
@@ -312,6 +840,1137 @@ TEST_F(LineDetectionTest, testProject2Dto3DwithPlanes) {
   EXPECT_NEAR(lines3D[0][5], 160 * scale, 1e-5);
 }
 
+TEST_F(LineDetectionTest, testProject2Dto3DwithPlanesParallel) {
+  cv::Mat cloud = makeWedgeCloud();
+  cv::Mat image(cloud.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+  const std::vector<cv::Vec4f> lines2D = testLines2D();
+
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  // With the plane hypothesis cache, the lines are always processed serially.
+  for (bool use_plane_hypothesis_cache : {false, true}) {
+    params.use_plane_hypothesis_cache = use_plane_hypothesis_cache;
+    std::vector<cv::Vec4f> lines2D_serial, lines2D_parallel;
+    std::vector<LineWithPlanes> lines3D_serial, lines3D_parallel;
+    params.num_threads_projection = 1;
+    line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D,
+                                          true, &lines2D_serial,
+                                          &lines3D_serial);
+    const LineDetectionStatistics statistics_serial =
+        line_detector.get_statistics();
+    params.num_threads_projection = 4;
+    line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D,
+                                          true, &lines2D_parallel,
+                                          &lines3D_parallel);
+    const LineDetectionStatistics& statistics_parallel =
+        line_detector.get_statistics();
+
+    ASSERT_FALSE(lines3D_serial.empty());
+    ASSERT_EQ(lines2D_serial.size(), lines2D_parallel.size());
+    ASSERT_EQ(lines3D_serial.size(), lines3D_parallel.size());
+    for (size_t i = 0; i < lines3D_serial.size(); ++i) {
+      EXPECT_EQ(lines2D_serial[i], lines2D_parallel[i]);
+      EXPECT_EQ(lines3D_serial[i].line, lines3D_parallel[i].line);
+      EXPECT_EQ(lines3D_serial[i].type, lines3D_parallel[i].type);
+      ASSERT_EQ(lines3D_serial[i].hessians.size(),
+                lines3D_parallel[i].hessians.size());
+      for (size_t j = 0; j < lines3D_serial[i].hessians.size(); ++j) {
+        EXPECT_EQ(lines3D_serial[i].hessians[j],
+                  lines3D_parallel[i].hessians[j])
+            << "Cache: " << use_plane_hypothesis_cache;
+      }
+      // Colors are assigned to each line separately.
+      EXPECT_EQ(lines3D_parallel[i].colors.size(), 2);
+    }
+    EXPECT_EQ(statistics_serial.num_lines_successfully_projected_to_3D,
+              statistics_parallel.num_lines_successfully_projected_to_3D);
+    EXPECT_EQ(statistics_serial.num_planar_lines,
+              statistics_parallel.num_planar_lines);
+    EXPECT_EQ(statistics_serial.num_discontinuity_lines,
+              statistics_parallel.num_discontinuity_lines);
+    EXPECT_EQ(statistics_serial.num_edge_lines,
+              statistics_parallel.num_edge_lines);
+    EXPECT_EQ(statistics_serial.num_intersection_lines,
+              statistics_parallel.num_intersection_lines);
+    if (use_plane_hypothesis_cache) {
+      EXPECT_EQ(statistics_serial.num_plane_hypothesis_cache_hits,
+                statistics_parallel.num_plane_hypothesis_cache_hits);
+    }
+  }
+}
+
+TEST_F(LineDetectionTest, testProject2Dto3DwithPlanesTimeBudget) {
+  cv::Mat cloud = makeWedgeCloud();
+  cv::Mat image(cloud.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+  const std::vector<cv::Vec4f> lines2D = testLines2D();
+
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  std::vector<cv::Vec4f> lines2D_unbounded, lines2D_budget;
+  std::vector<LineWithPlanes> lines3D_unbounded, lines3D_budget;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D,
+                                        false, &lines2D_unbounded,
+                                        &lines3D_unbounded);
+  const size_t num_processed_lines =
+      line_detector.get_projection_report().num_processed_lines;
+  ASSERT_FALSE(lines3D_unbounded.empty());
+  EXPECT_FALSE(line_detector.get_projection_report().deadline_reached);
+  EXPECT_TRUE(line_detector.get_projection_report().skipped_lines2D.empty());
+
+  // With a budget that is not reached, the same lines are found, only in
+  // another order.
+  params.projection_time_budget_ms = 1e6;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D,
+                                        false, &lines2D_budget,
+                                        &lines3D_budget);
+  EXPECT_FALSE(line_detector.get_projection_report().deadline_reached);
+  EXPECT_EQ(line_detector.get_projection_report().num_processed_lines,
+            num_processed_lines);
+  // The budget is so generous that the RANSAC iterations are not reduced.
+  EXPECT_EQ(line_detector.get_projection_report().min_ransac_iteration_scale,
+            1.0);
+  ASSERT_EQ(lines2D_budget.size(), lines2D_unbounded.size());
+  for (size_t i = 0; i < lines2D_budget.size(); ++i) {
+    const size_t j = std::find(lines2D_unbounded.begin(),
+                               lines2D_unbounded.end(), lines2D_budget[i]) -
+                     lines2D_unbounded.begin();
+    ASSERT_LT(j, lines2D_unbounded.size());
+    EXPECT_EQ(lines3D_budget[i].line, lines3D_unbounded[j].line);
+    EXPECT_EQ(lines3D_budget[i].type, lines3D_unbounded[j].type);
+  }
+
+  // With a budget that is exhausted before the first line, all the lines are
+  // skipped, the longest first.
+  params.projection_time_budget_ms = 1e-6;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D,
+                                        false, &lines2D_budget,
+                                        &lines3D_budget);
+  const ProjectionBudgetReport& report = line_detector.get_projection_report();
+  EXPECT_TRUE(lines3D_budget.empty());
+  EXPECT_TRUE(report.deadline_reached);
+  EXPECT_EQ(report.num_processed_lines, 0);
+  ASSERT_EQ(report.skipped_lines2D.size(), num_processed_lines);
+  EXPECT_EQ(report.skipped_lines2D[0], lines2D[2]);
+
+  // The budget can also be given per call.
+  params.projection_time_budget_ms = 0.0;
+  FrameContext frame;
+  frame.setFrame(image, cloud, camera_P);
+  line_detector.project2Dto3DwithPlanes(&frame, lines2D, false, 1e-6,
+                                        &lines2D_budget, &lines3D_budget);
+  EXPECT_TRUE(lines3D_budget.empty());
+  EXPECT_TRUE(line_detector.get_projection_report().deadline_reached);
+}
+
+TEST_F(LineDetectionTest, testProject2Dto3DwithPlanesLineOutputs) {
+  cv::Mat cloud = makeWedgeCloud();
+  cv::Mat image(cloud.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+  const std::vector<cv::Vec4f> lines2D = testLines2D();
+
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  std::vector<cv::Vec4f> lines2D_all, lines2D_planes, lines2D_endpoints;
+  std::vector<LineWithPlanes> lines3D_all, lines3D_planes, lines3D_endpoints;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, true,
+                                        &lines2D_all, &lines3D_all);
+  ASSERT_FALSE(lines3D_all.empty());
+
+  // Without the full classification, the planes and the lines are the same,
+  // but the prolonged planes are never tested.
+  params.line_outputs = kLineOutputEndpoints | kLineOutputPlanes;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, true,
+                                        &lines2D_planes, &lines3D_planes);
+  const LineDetectionStatistics& statistics = line_detector.get_statistics();
+  const int* occurrences =
+      &statistics.occurrences_config_prolonged_plane[0][0][0][0];
+  for (size_t i = 0; i < 16; ++i) {
+    EXPECT_EQ(occurrences[i], 0);
+  }
+  ASSERT_EQ(lines3D_planes.size(), lines3D_all.size());
+  for (size_t i = 0; i < lines3D_all.size(); ++i) {
+    EXPECT_EQ(lines2D_planes[i], lines2D_all[i]);
+    EXPECT_EQ(lines3D_planes[i].line, lines3D_all[i].line);
+    EXPECT_EQ(lines3D_planes[i].hessians.size(),
+              lines3D_all[i].hessians.size());
+    // Nor are the colors assigned.
+    EXPECT_EQ(lines3D_planes[i].colors.size(), 0);
+    if (lines3D_all[i].type == LineType::DISCONT ||
+        lines3D_all[i].type == LineType::PLANE) {
+      EXPECT_EQ(lines3D_planes[i].type, lines3D_all[i].type);
+    } else {
+      EXPECT_TRUE(lines3D_planes[i].type == LineType::EDGE ||
+                  lines3D_planes[i].type == LineType::INTERSECT);
+    }
+  }
+
+  // With only the endpoints, no line is discarded by the fitting of the
+  // planes, and the lines are unclassified, with two zero planes.
+  params.line_outputs = kLineOutputEndpoints;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_endpoints,
+                                        &lines3D_endpoints);
+  EXPECT_GE(lines3D_endpoints.size(), lines3D_all.size());
+  for (const LineWithPlanes& line3D : lines3D_endpoints) {
+    EXPECT_TRUE(line3D.type == LineType::UNCLASSIFIED);
+    ASSERT_EQ(line3D.hessians.size(), 2);
+    EXPECT_EQ(line3D.hessians[0], cv::Vec4f(0.0f, 0.0f, 0.0f, 0.0f));
+    EXPECT_EQ(line3D.hessians[1], cv::Vec4f(0.0f, 0.0f, 0.0f, 0.0f));
+  }
+}
+
+TEST_F(LineDetectionTest, testLinePrefilters) {
+  // Fronto-parallel wall at depth 2, with a patch without depth information
+  // and a band without measurements except for a single column.
+  cv::Mat cloud = makeWallCloud(2.0f);
+  cloud(cv::Rect(201, 90, 6, 20)).setTo(cv::Scalar(0.0f, 0.0f, 0.0f));
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  cloud(cv::Rect(241, 0, 9, cloud.rows)).setTo(cv::Scalar(nan, nan, nan));
+  cloud(cv::Rect(251, 0, 9, cloud.rows)).setTo(cv::Scalar(nan, nan, nan));
+  cv::Mat image(cloud.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+  std::vector<cv::Vec4f> lines2D;
+  // Valid line.
+  lines2D.push_back(cv::Vec4f(100, 50, 100, 150));
+  // Next to the patch without depth information.
+  lines2D.push_back(cv::Vec4f(200, 50, 200, 150));
+  // Too short in 3D.
+  lines2D.push_back(cv::Vec4f(50, 200, 56, 200));
+  // Without measurements on its sides: the rectangles are large enough, so it
+  // is only rejected after gathering their points.
+  lines2D.push_back(cv::Vec4f(250, 50, 250, 150));
+  // On the border of the image, with a rectangle of a single column.
+  lines2D.push_back(cv::Vec4f(0.2, 50, 0.2, 150));
+
+  LineDetectionParams params;
+  params.min_points_in_rect = 150;
+  LineDetector line_detector(&params);
+  std::vector<cv::Vec4f> lines2D_full, lines2D_prefiltered;
+  std::vector<LineWithPlanes> lines3D_full, lines3D_prefiltered;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_full, &lines3D_full);
+  params.use_line_prefilters = true;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_prefiltered,
+                                        &lines3D_prefiltered);
+  const LineDetectionStatistics& statistics = line_detector.get_statistics();
+  EXPECT_EQ(statistics.num_lines_rejected_by_length_3D, 1);
+  EXPECT_EQ(statistics.num_lines_rejected_by_length_2D, 0);
+  EXPECT_EQ(statistics.num_lines_rejected_by_rectangle_size, 1);
+  EXPECT_EQ(statistics.num_lines_rejected_by_missing_depth, 1);
+  // The prefilters only reject lines earlier.
+  ASSERT_EQ(lines2D_full.size(), 1);
+  ASSERT_EQ(lines2D_prefiltered.size(), lines2D_full.size());
+  for (size_t i = 0; i < lines2D_full.size(); ++i) {
+    EXPECT_EQ(lines2D_prefiltered[i], lines2D_full[i]);
+    EXPECT_EQ(lines3D_prefiltered[i].line, lines3D_full[i].line);
+  }
+
+  // A line without length has no rectangles.
+  line_detector.resetStatistics();
+  EXPECT_FALSE(line_detector.prefilterLineRectangles(
+      cloud, cv::Vec4f(100, 100, 100, 100)));
+  EXPECT_EQ(statistics.num_lines_rejected_by_length_2D, 1);
+  EXPECT_EQ(statistics.num_lines_rejected_by_rectangle_size, 0);
+}
+
+TEST_F(LineDetectionTest, testLinePrefiltersOnDepthEdges) {
+  // Box in front of a wall, with a shadow without depth information on the
+  // wall next to the left border of the box, as cast by the projector of a
+  // structured light sensor. The shadow covers the middle line of the left
+  // rectangle of a line on the border.
+  cv::Mat cloud = makeBoxCloud();
+  cloud(cv::Rect(95, 80, 4, 40)).setTo(cv::Scalar(0.0f, 0.0f, 0.0f));
+  cv::Mat image(cloud.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+  const std::vector<cv::Vec4f> lines2D{cv::Vec4f(100, 70, 100, 170)};
+
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  std::vector<cv::Vec4f> lines2D_full, lines2D_prefiltered;
+  std::vector<LineWithPlanes> lines3D_full, lines3D_prefiltered;
+  for (bool detect_depth_edge_lines : {true, false}) {
+    params.detect_depth_edge_lines = detect_depth_edge_lines;
+    params.use_line_prefilters = false;
+    line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D,
+                                          false, &lines2D_full, &lines3D_full);
+    params.use_line_prefilters = true;
+    line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D,
+                                          false, &lines2D_prefiltered,
+                                          &lines3D_prefiltered);
+    // Only the plane of the box is fitted on the depth edge, so the shadow
+    // does not reject the line. Otherwise the points of the shadow are
+    // gathered, and the line is rejected by the prefilters already.
+    EXPECT_EQ(lines3D_full.size(), detect_depth_edge_lines ? 1 : 0);
+    EXPECT_EQ(line_detector.get_statistics()
+                  .num_lines_rejected_by_missing_depth,
+              detect_depth_edge_lines ? 0 : 1);
+    ASSERT_EQ(lines3D_prefiltered.size(), lines3D_full.size());
+    for (size_t i = 0; i < lines3D_full.size(); ++i) {
+      EXPECT_EQ(lines2D_prefiltered[i], lines2D_full[i]);
+      EXPECT_EQ(lines3D_prefiltered[i].type, LineType::DISCONT);
+      EXPECT_EQ(lines3D_prefiltered[i].line, lines3D_full[i].line);
+    }
+  }
+}
+
+TEST_F(LineDetectionTest, testLinePrefiltersSampleRectanglePixels) {
+  // Fronto-parallel wall at depth 2, without depth information everywhere
+  // except in the rectangles around an oblique line: the pixels without depth
+  // just outside the rectangles must not reject the line.
+  const cv::Mat wall = makeWallCloud(2.0f);
+  cv::Mat image(wall.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+  const std::vector<cv::Vec4f> lines2D{cv::Vec4f(60.3, 50.6, 170.8, 131.2)};
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  std::vector<cv::Point2f> rect_left, rect_right;
+  ASSERT_TRUE(line_detector.getRectanglesFromLine(lines2D[0], &rect_left,
+                                                  &rect_right));
+  cv::Mat cloud(wall.size(), CV_32FC3, cv::Scalar(0.0f, 0.0f, 0.0f));
+  for (const std::vector<cv::Point2f>* rect : {&rect_left, &rect_right}) {
+    forEachValidPointInRectangle(
+        *rect, wall, [&cloud](int row, int col, const cv::Vec3f& point) {
+          cloud.at<cv::Vec3f>(row, col) = point;
+          return true;
+        });
+  }
+
+  std::vector<cv::Vec4f> lines2D_full, lines2D_prefiltered;
+  std::vector<LineWithPlanes> lines3D_full, lines3D_prefiltered;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_full, &lines3D_full);
+  params.use_line_prefilters = true;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_prefiltered,
+                                        &lines3D_prefiltered);
+  EXPECT_EQ(line_detector.get_statistics().num_lines_rejected_by_missing_depth,
+            0);
+  ASSERT_EQ(lines2D_prefiltered.size(), lines2D_full.size());
+  for (size_t i = 0; i < lines2D_full.size(); ++i) {
+    EXPECT_EQ(lines2D_prefiltered[i], lines2D_full[i]);
+    EXPECT_EQ(lines3D_prefiltered[i].line, lines3D_full[i].line);
+  }
+
+  // Pixels without depth on the middle line of a rectangle still reject it.
+  const cv::Point2f middle =
+      0.25f * (rect_left[0] + rect_left[1] + rect_left[2] + rect_left[3]);
+  for (int i = -1; i <= 1; ++i) {
+    for (int j = -1; j <= 1; ++j) {
+      cloud.at<cv::Vec3f>(floor(middle.y) + i, floor(middle.x) + j) =
+          cv::Vec3f(0.0f, 0.0f, 0.0f);
+    }
+  }
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_prefiltered,
+                                        &lines3D_prefiltered);
+  EXPECT_EQ(line_detector.get_statistics().num_lines_rejected_by_missing_depth,
+            1);
+}
+
+TEST_F(LineDetectionTest, testStratifiedSamplingOfRectangles) {
+  cv::Mat cloud = makeWedgeCloud();
+  cv::Mat image(cloud.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+  const std::vector<cv::Vec4f> lines2D = testLines2D();
+
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+
+  // The samples of a rectangle of 100 x 5 pixels cover its whole length.
+  std::vector<cv::Point2f> rect_left, rect_right;
+  line_detector.getRectanglesFromLine(lines2D[1], &rect_left, &rect_right);
+  std::vector<cv::Vec3f> points, samples;
+  std::vector<cv::Point2i> pixels;
+  gatherPointsInRectangle(rect_left, cloud, false, &points, &pixels);
+  ASSERT_EQ(pixels.size(), points.size());
+  constexpr size_t kMaxPoints = 50;
+  ASSERT_GT(points.size(), kMaxPoints);
+  sampleStratifiedPointsInRectangle(rect_left, points, pixels, kMaxPoints,
+                                    &samples);
+  EXPECT_LE(samples.size(), kMaxPoints);
+  EXPECT_GE(samples.size(), kMaxPoints / 2);
+  float min_row = std::numeric_limits<float>::max();
+  float max_row = -std::numeric_limits<float>::max();
+  for (const cv::Vec3f& sample : samples) {
+    // The first coordinate of the points is their row (times 0.01).
+    min_row = std::min(min_row, sample[0]);
+    max_row = std::max(max_row, sample[0]);
+  }
+  EXPECT_LT(min_row, 0.55);
+  EXPECT_GT(max_row, 1.45);
+
+  // The lines found with the planes fitted on samples are the same.
+  std::vector<cv::Vec4f> lines2D_all, lines2D_sampled;
+  std::vector<LineWithPlanes> lines3D_all, lines3D_sampled;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_all, &lines3D_all);
+  params.max_points_per_rect = 100;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_sampled, &lines3D_sampled);
+  ASSERT_FALSE(lines3D_all.empty());
+  ASSERT_EQ(lines3D_sampled.size(), lines3D_all.size());
+  for (size_t i = 0; i < lines3D_all.size(); ++i) {
+    EXPECT_EQ(lines2D_sampled[i], lines2D_all[i]);
+    EXPECT_EQ(lines3D_sampled[i].type, lines3D_all[i].type);
+    for (size_t j = 0; j < 6; ++j) {
+      EXPECT_NEAR(lines3D_sampled[i].line[j], lines3D_all[i].line[j], 1e-2);
+    }
+  }
+}
+
+TEST_F(LineDetectionTest, testIntegralPlaneFitter) {
+  cv::Mat cloud = makeWedgeCloud();
+  // Invalidate some points.
+  cloud.at<cv::Vec3f>(52, 41) = cv::Vec3f(NAN, NAN, NAN);
+  cloud.at<cv::Vec3f>(60, 70) = cv::Vec3f(0, 0, 0);
+  IntegralPlaneFitter fitter;
+  fitter.setCloud(cloud);
+  EXPECT_TRUE(fitter.isSetTo(cloud));
+  EXPECT_FALSE(fitter.isSetTo(cloud.clone()));
+
+  // Rotated rectangle on the left half of the wedge (plane y - z = 0).
+  std::vector<cv::Point2f> corners{{40.3, 30.2}, {90.7, 60.1}, {75.2, 85.4},
+                                   {24.8, 55.5}};
+  std::vector<cv::Point2i> points;
+  findPointsInRectangle(corners, &points);
+  size_t num_points = 0, num_points_without_depth = 0;
+  cv::Vec3d sum(0.0, 0.0, 0.0);
+  for (const cv::Point2i& point : points) {
+    const cv::Vec3f& point_3D = cloud.at<cv::Vec3f>(point);
+    if (std::isnan(point_3D[0])) continue;
+    if (checkEqualPoints(point_3D, {0.0f, 0.0f, 0.0f})) {
+      num_points_without_depth++;
+      continue;
+    }
+    num_points++;
+    sum += cv::Vec3d(point_3D);
+  }
+  PlaneMoments moments;
+  fitter.computeMomentsInRectangle(corners, &moments);
+  EXPECT_EQ(moments.num_points, num_points);
+  EXPECT_EQ(moments.num_points_without_depth, num_points_without_depth);
+  EXPECT_NEAR(moments.sum[0], sum[0], 1e-6);
+  EXPECT_NEAR(moments.sum[1], sum[1], 1e-6);
+  EXPECT_NEAR(moments.sum[2], sum[2], 1e-6);
+
+  cv::Vec4f hessian;
+  double mean_squared_residual;
+  ASSERT_TRUE(IntegralPlaneFitter::fitPlane(moments, &hessian,
+                                            &mean_squared_residual));
+  EXPECT_NEAR(mean_squared_residual, 0.0, 1e-8);
+  EXPECT_NEAR(fabs(hessian[0]), 0.0, 1e-4);
+  EXPECT_NEAR(fabs(hessian[1]), 1.0 / sqrt(2.0), 1e-4);
+  EXPECT_NEAR(fabs(hessian[2]), 1.0 / sqrt(2.0), 1e-4);
+  EXPECT_NEAR(hessian[1], -hessian[2], 1e-4);
+  EXPECT_NEAR(hessian[3], 0.0, 1e-4);
+
+  // Rectangle across the ridge of the wedge: the points are not on a plane.
+  corners = {{140, 50}, {180, 50.5}, {180, 90.5}, {140, 90}};
+  fitter.computeMomentsInRectangle(corners, &moments);
+  ASSERT_TRUE(IntegralPlaneFitter::fitPlane(moments, &hessian,
+                                            &mean_squared_residual));
+  EXPECT_GT(mean_squared_residual, 1e-5);
+}
+
+TEST_F(LineDetectionTest, testProject2Dto3DwithPlanesIntegralPlaneFitting) {
+  cv::Mat cloud = makeWedgeCloud();
+  cv::Mat image(cloud.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+  std::vector<cv::Vec4f> lines2D{cv::Vec4f(160, 100, 160, 200)};
+
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  std::vector<cv::Vec4f> lines2D_out;
+  std::vector<LineWithPlanes> lines3D_ransac, lines3D_integral;
+  params.use_integral_plane_fitting = false;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_out, &lines3D_ransac);
+  params.use_integral_plane_fitting = true;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_out, &lines3D_integral);
+  ASSERT_EQ(lines3D_ransac.size(), 1);
+  ASSERT_EQ(lines3D_integral.size(), 1);
+  EXPECT_EQ(lines3D_ransac[0].type, lines3D_integral[0].type);
+  for (size_t i = 0; i < 6; ++i) {
+    EXPECT_NEAR(lines3D_ransac[0].line[i], lines3D_integral[0].line[i], 1e-3);
+  }
+}
+
+TEST_F(LineDetectionTest, testWedgeEstimator) {
+  cv::Matx34f P(500, 0, 160, 0,
+                0, 500, 120, 0,
+                0, 0, 1, 0);
+  // The viewing plane of a vertical line through the principal point is the
+  // plane x = 0.
+  cv::Vec4f viewing_plane;
+  ASSERT_TRUE(WedgeEstimator::viewingPlane(P, cv::Vec4f(160, 100, 160, 200),
+                                           &viewing_plane));
+  EXPECT_NEAR(fabs(viewing_plane[0]), 1.0, 1e-6);
+  EXPECT_NEAR(viewing_plane[1], 0.0, 1e-6);
+  EXPECT_NEAR(viewing_plane[2], 0.0, 1e-6);
+  EXPECT_NEAR(viewing_plane[3], 0.0, 1e-6);
+
+  // Ridge along the line x = 0, z = 2: planes z = 2 - 0.5 * x for x > 0 and
+  // z = 2 + 0.5 * x for x < 0, with noise and 20% of outliers.
+  std::default_random_engine generator(7);
+  std::uniform_real_distribution<float> coordinate(0.01f, 0.2f);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  std::normal_distribution<float> noise(0.0f, 0.001f);
+  std::vector<cv::Vec3f> points_1, points_2;
+  for (int i = 0; i < 300; ++i) {
+    const float x = coordinate(generator);
+    const float y = coordinate(generator) - 0.1f;
+    float z = 2.0f - 0.5f * x + noise(generator);
+    if (uniform(generator) < 0.2f) z += 0.1f + uniform(generator);
+    points_1.push_back(cv::Vec3f(x, y, z));
+    z = 2.0f - 0.5f * x + noise(generator);
+    if (uniform(generator) < 0.2f) z -= 0.1f + uniform(generator);
+    points_2.push_back(cv::Vec3f(-x, y, z));
+  }
+  WedgeEstimator estimator;
+  ASSERT_TRUE(estimator.fit(points_1, points_2, viewing_plane));
+  const cv::Vec3f normal_1 = cv::normalize(cv::Vec3f(0.5f, 0.0f, 1.0f));
+  const cv::Vec3f normal_2 = cv::normalize(cv::Vec3f(-0.5f, 0.0f, 1.0f));
+  const cv::Vec4f& plane_1 = estimator.getPlane(0);
+  const cv::Vec4f& plane_2 = estimator.getPlane(1);
+  EXPECT_GT(fabs(normal_1.dot(cv::Vec3f(plane_1[0], plane_1[1], plane_1[2]))),
+            0.999);
+  EXPECT_GT(fabs(normal_2.dot(cv::Vec3f(plane_2[0], plane_2[1], plane_2[2]))),
+            0.999);
+  const cv::Vec3f& point = estimator.getLinePoint();
+  const cv::Vec3f& direction = estimator.getLineDirection();
+  EXPECT_NEAR(point[0], 0.0, 2e-3);
+  EXPECT_NEAR(point[2], 2.0, 2e-3);
+  EXPECT_NEAR(fabs(direction[1]), 1.0, 1e-3);
+  EXPECT_GT(estimator.getNumInliers(0), 200);
+  EXPECT_GT(estimator.getNumInliers(1), 200);
+  EXPECT_LT(estimator.getNumInliers(0), 260);
+  EXPECT_LT(estimator.getNumInliers(1), 260);
+  // The endpoints of the line project onto those of the 2D line.
+  cv::Vec3f start, end;
+  ASSERT_TRUE(estimator.getLineEndpoints(P, cv::Vec4f(160, 100, 160, 200),
+                                         &start, &end));
+  EXPECT_NEAR(start[0], 0.0, 2e-3);
+  EXPECT_NEAR(start[1], -0.08, 2e-3);
+  EXPECT_NEAR(start[2], 2.0, 2e-3);
+  EXPECT_NEAR(end[0], 0.0, 2e-3);
+  EXPECT_NEAR(end[1], 0.32, 2e-3);
+  EXPECT_NEAR(end[2], 2.0, 2e-3);
+
+  // Too few points on one side.
+  points_2.resize(2);
+  EXPECT_FALSE(estimator.fit(points_1, points_2, viewing_plane));
+}
+
+TEST_F(LineDetectionTest, testProject2Dto3DwithPlanesWedgeEstimator) {
+  // Ridge seen by the camera along the column u = 160: the cloud is
+  // back-projected from the depth of the planes z = 2 -/+ 0.5 * x, so that
+  // the 3D line projects onto the 2D line.
+  int N = 240;
+  int M = 320;
+  cv::Mat cloud(N, M, CV_32FC3);
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < M; ++j) {
+      const float x_ray = (j - 160) / 500.0f;
+      const float y_ray = (i - 120) / 500.0f;
+      const float z = 2.0f / (1.0f + 0.5f * fabs(x_ray));
+      cloud.at<cv::Vec3f>(i, j) = cv::Vec3f(x_ray * z, y_ray * z, z);
+    }
+  }
+  cv::Mat image(N, M, CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+  std::vector<cv::Vec4f> lines2D{cv::Vec4f(160, 100, 160, 200)};
+
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  std::vector<cv::Vec4f> lines2D_out;
+  std::vector<LineWithPlanes> lines3D_separate, lines3D_wedge;
+  params.use_wedge_estimator = false;
+  auto start_time = std::chrono::steady_clock::now();
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_out, &lines3D_separate);
+  const double time_separate = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time).count();
+  params.use_wedge_estimator = true;
+  start_time = std::chrono::steady_clock::now();
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_out, &lines3D_wedge);
+  const double time_wedge = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time).count();
+  LOG(INFO) << "Planes fitted separately in " << time_separate
+            << " s, jointly in " << time_wedge << " s.";
+  ASSERT_EQ(lines3D_separate.size(), 1);
+  ASSERT_EQ(lines3D_wedge.size(), 1);
+  EXPECT_EQ(lines3D_separate[0].type, lines3D_wedge[0].type);
+  for (size_t i = 0; i < 6; ++i) {
+    EXPECT_NEAR(lines3D_separate[0].line[i], lines3D_wedge[0].line[i], 1e-2);
+  }
+  // The 3D line is on the ridge, and its endpoints are those of the model,
+  // which project onto the endpoints of the 2D line. They are at least as
+  // close to the true endpoints as those readjusted on the inliers.
+  const cv::Vec3f true_endpoints[2] = {cv::Vec3f(0.0f, -0.08f, 2.0f),
+                                       cv::Vec3f(0.0f, 0.32f, 2.0f)};
+  double error_separate = 0.0;
+  double error_wedge = 0.0;
+  for (size_t i = 0; i < 2; ++i) {
+    EXPECT_NEAR(lines3D_wedge[0].line[3 * i], 0.0, 1e-3);
+    EXPECT_NEAR(lines3D_wedge[0].line[3 * i + 2], 2.0, 1e-3);
+    error_separate += cv::norm(
+        cv::Vec3f(lines3D_separate[0].line[3 * i],
+                  lines3D_separate[0].line[3 * i + 1],
+                  lines3D_separate[0].line[3 * i + 2]) - true_endpoints[i]);
+    error_wedge += cv::norm(
+        cv::Vec3f(lines3D_wedge[0].line[3 * i],
+                  lines3D_wedge[0].line[3 * i + 1],
+                  lines3D_wedge[0].line[3 * i + 2]) - true_endpoints[i]);
+  }
+  EXPECT_LE(error_wedge, error_separate);
+}
+
+TEST_F(LineDetectionTest, testDepthEdgeLines) {
+  // Box in front of a wall, cf. makeBoxCloud.
+  cv::Mat cloud = makeBoxCloud();
+  cv::Mat image(cloud.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+
+  // The discontinuities are on the border of the box.
+  DepthEdgeDetector depth_edge_detector;
+  std::vector<cv::Vec4f> lines2D;
+  depth_edge_detector.detect(cloud, &lines2D);
+  EXPECT_EQ(depth_edge_detector.getEdgeMask().at<uchar>(100, 100), 255);
+  EXPECT_EQ(depth_edge_detector.getEdgeMask().at<uchar>(100, 99), 0);
+  EXPECT_EQ(depth_edge_detector.getEdgeMask().at<uchar>(100, 150), 0);
+  bool found_left_border = false;
+  for (const cv::Vec4f& line : lines2D) {
+    if (fabs(line[0] - 100) < 1.0 && fabs(line[2] - 100) < 1.0 &&
+        fabs(line[1] - line[3]) > 100) {
+      found_left_border = true;
+    }
+  }
+  EXPECT_TRUE(found_left_border);
+  // The right side of a line going down is in front.
+  bool left_in_front;
+  ASSERT_TRUE(depth_edge_detector.findForegroundSide(
+      cloud, cv::Vec4f(100, 70, 100, 170), 3.0, &left_in_front));
+  EXPECT_FALSE(left_in_front);
+  EXPECT_FALSE(depth_edge_detector.findForegroundSide(
+      cloud, cv::Vec4f(150, 70, 150, 170), 3.0, &left_in_front));
+
+  // Same results through LineDetector, also when the lines are detected
+  // together with those of the (empty) image.
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  std::vector<cv::Vec4f> lines2D_detector;
+  line_detector.detectLines(cloud, DetectorType::DEPTH, &lines2D_detector);
+  EXPECT_EQ(lines2D_detector.size(), lines2D.size());
+  FrameContext frame;
+  frame.setFrame(image, cloud, camera_P);
+  params.detect_depth_edge_lines = true;
+  line_detector.detectLines(&frame, 0, &lines2D_detector);
+  EXPECT_EQ(lines2D_detector.size(), lines2D.size());
+
+  // The line is a discontinuity line on the box, whose plane is the only one
+  // fitted.
+  std::vector<cv::Vec4f> lines2D_out;
+  std::vector<LineWithPlanes> lines3D;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P,
+                                        {cv::Vec4f(100, 70, 100, 170)}, false,
+                                        &lines2D_out, &lines3D);
+  ASSERT_EQ(lines3D.size(), 1);
+  EXPECT_EQ(lines3D[0].type, LineType::DISCONT);
+  EXPECT_NEAR(lines3D[0].line[2], 1.5, 1e-2);
+  EXPECT_NEAR(lines3D[0].line[5], 1.5, 1e-2);
+  ASSERT_EQ(lines3D[0].hessians.size(), 2);
+  EXPECT_EQ(lines3D[0].hessians[0], cv::Vec4f(0.0f, 0.0f, 0.0f, 0.0f));
+  EXPECT_NEAR(fabs(lines3D[0].hessians[1][2]), 1.0, 1e-4);
+  EXPECT_NEAR(fabs(lines3D[0].hessians[1][3]), 1.5, 1e-3);
+}
+
+TEST_F(LineDetectionTest, testLineTracker) {
+  // Scene of makeBoxCloud, seen twice from the same pose.
+  cv::Mat cloud = makeBoxCloud();
+  cv::Mat image(cloud.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+  FrameContext frame;
+  frame.setFrame(image, cloud, camera_P);
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  LineTracker line_tracker(&line_detector);
+  const int detector = static_cast<int>(DetectorType::DEPTH);
+
+  // The lines of the first frame are all new.
+  std::vector<cv::Vec4f> lines2D_first, lines2D;
+  std::vector<LineWithPlanes> lines3D_first, lines3D;
+  line_tracker.track(&frame, detector, cv::Matx44f::eye(), &lines2D_first,
+                     &lines3D_first);
+  ASSERT_GT(lines3D_first.size(), 0);
+  EXPECT_EQ(line_tracker.getNumTrackedLines(), 0);
+  EXPECT_EQ(line_tracker.getNumNewLines(), lines3D_first.size());
+
+  // Without motion, all the lines are tracked and none is fitted anew.
+  frame.setFrame(image, cloud, camera_P);
+  line_tracker.track(&frame, detector, cv::Matx44f::eye(), &lines2D,
+                     &lines3D);
+  EXPECT_EQ(line_tracker.getNumTrackedLines(), lines3D_first.size());
+  EXPECT_EQ(line_tracker.getNumNewLines(), 0);
+  ASSERT_EQ(lines3D.size(), lines3D_first.size());
+  for (size_t i = 0; i < lines3D.size(); ++i) {
+    for (size_t j = 0; j < 4; ++j) {
+      EXPECT_NEAR(lines2D[i][j], lines2D_first[i][j], 1e-2);
+    }
+    EXPECT_EQ(lines3D[i].type, lines3D_first[i].type);
+  }
+
+  // With a wrong pose the predicted planes are not verified, and the lines are
+  // detected and fitted again.
+  cv::Matx44f T_current_previous = cv::Matx44f::eye();
+  T_current_previous(2, 3) = 0.5f;
+  frame.setFrame(image, cloud, camera_P);
+  line_tracker.track(&frame, detector, T_current_previous, &lines2D,
+                     &lines3D);
+  EXPECT_EQ(line_tracker.getNumTrackedLines(), 0);
+  EXPECT_EQ(line_tracker.getNumNewLines(), lines3D_first.size());
+
+  // With a slightly wrong pose the lines are still tracked, and their
+  // endpoints are moved back onto the refitted planes instead of keeping the
+  // error of the pose.
+  T_current_previous(2, 3) = -0.01f;
+  frame.setFrame(image, cloud, camera_P);
+  line_tracker.track(&frame, detector, T_current_previous, &lines2D,
+                     &lines3D);
+  EXPECT_EQ(line_tracker.getNumTrackedLines(), lines3D_first.size());
+  ASSERT_EQ(lines3D.size(), lines3D_first.size());
+  for (size_t i = 0; i < lines3D.size(); ++i) {
+    for (size_t k = 0; k < 6; ++k) {
+      EXPECT_NEAR(lines3D[i].line[k], lines3D_first[i].line[k], 1e-3);
+    }
+  }
+
+  // After a reset, the next frame is processed from scratch.
+  line_tracker.reset();
+  line_tracker.track(&frame, detector, cv::Matx44f::eye(), &lines2D,
+                     &lines3D);
+  EXPECT_EQ(line_tracker.getNumTrackedLines(), 0);
+}
+
+TEST_F(LineDetectionTest, testPlaneSegmentation) {
+  cv::Mat cloud = makeWedgeCloud();
+  cloud.at<cv::Vec3f>(52, 41) = cv::Vec3f(NAN, NAN, NAN);
+  cloud.at<cv::Vec3f>(60, 70) = cv::Vec3f(0, 0, 0);
+
+  PlaneSegmentation segmentation;
+  segmentation.segment(cloud);
+  EXPECT_TRUE(segmentation.isSetTo(cloud, PlaneSegmentationParams()));
+  ASSERT_EQ(segmentation.getPlanes().size(), 2);
+  const cv::Mat& labels = segmentation.getLabels();
+  const int label_left = labels.at<int>(100, 50);
+  const int label_right = labels.at<int>(100, 250);
+  EXPECT_NE(label_left, PlaneSegmentation::kNoPlane);
+  EXPECT_NE(label_right, PlaneSegmentation::kNoPlane);
+  EXPECT_NE(label_left, label_right);
+  EXPECT_EQ(labels.at<int>(52, 41), PlaneSegmentation::kNoPlane);
+  EXPECT_EQ(labels.at<int>(60, 70), PlaneSegmentation::kNoPlane);
+  // Except for the three points without depth (including the origin), all the
+  // points are on a plane, also those close to the crease.
+  EXPECT_EQ(cv::countNonZero(labels == PlaneSegmentation::kNoPlane), 3);
+  const cv::Vec4f& plane_left = segmentation.getPlanes()[label_left].hessian;
+  EXPECT_NEAR(errorPointToPlane(plane_left, cloud.at<cv::Vec3f>(10, 10)), 0.0,
+              1e-4);
+  EXPECT_NEAR(errorPointToPlane(plane_left, cloud.at<cv::Vec3f>(200, 150)),
+              0.0, 1e-4);
+
+  // Rectangles on one side of the crease are covered by a single plane,
+  // those across the crease by two.
+  cv::Vec4f hessian;
+  double fraction;
+  const std::vector<cv::Point2f> rect_right{{170.0, 90.0}, {200.0, 90.0},
+                                            {200.0, 130.0}, {170.0, 130.0}};
+  EXPECT_EQ(segmentation.findDominantPlane(rect_right, &hessian, &fraction),
+            label_right);
+  EXPECT_DOUBLE_EQ(fraction, 1.0);
+  EXPECT_NEAR(errorPointToPlane(hessian, cloud.at<cv::Vec3f>(100, 180)), 0.0,
+              1e-4);
+  const std::vector<cv::Point2f> rect_crease{{140.0, 90.0}, {180.0, 90.0},
+                                             {180.0, 130.0}, {140.0, 130.0}};
+  segmentation.findDominantPlane(rect_crease, &hessian, &fraction);
+  EXPECT_GT(fraction, 0.4);
+  EXPECT_LT(fraction, 0.6);
+
+  // The detector gives the same lines with and without the segmentation.
+  cv::Mat image(cloud.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+  std::vector<cv::Vec4f> lines2D{cv::Vec4f(160, 100, 160, 200)};
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  std::vector<cv::Vec4f> lines2D_out;
+  std::vector<LineWithPlanes> lines3D_ransac, lines3D_segmentation;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_out, &lines3D_ransac);
+  params.use_plane_segmentation = true;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_out, &lines3D_segmentation);
+  ASSERT_EQ(lines3D_ransac.size(), 1);
+  ASSERT_EQ(lines3D_segmentation.size(), 1);
+  EXPECT_EQ(lines3D_ransac[0].type, lines3D_segmentation[0].type);
+  for (size_t i = 0; i < 6; ++i) {
+    EXPECT_NEAR(lines3D_ransac[0].line[i], lines3D_segmentation[0].line[i],
+                1e-3);
+  }
+}
+
+TEST_F(LineDetectionTest, testPlaneHypothesisCache) {
+  PlaneHypothesisCache cache;
+  cache.reset(240, 320, 40);
+  const cv::Vec4f plane_1(1.0, 0.0, 0.0, -1.0);
+  const cv::Vec4f plane_2(0.0, 1.0, 0.0, -2.0);
+  cache.addPlane({{10.0, 10.0}, {100.0, 10.0}, {100.0, 50.0}, {10.0, 50.0}},
+                 plane_1);
+  cache.addPlane({{300.0, 200.0}, {330.0, 200.0}, {330.0, 250.0},
+                  {300.0, 250.0}}, plane_2);
+  EXPECT_EQ(cache.size(), 2);
+  std::vector<cv::Vec4f> planes;
+  cache.findPlanes({{50.0, 20.0}, {60.0, 20.0}, {60.0, 30.0}, {50.0, 30.0}},
+                   &planes);
+  ASSERT_EQ(planes.size(), 1);
+  EXPECT_EQ(planes[0], plane_1);
+  // Each plane is reported once, even if it is in several cells.
+  cache.findPlanes({{0.0, 0.0}, {320.0, 0.0}, {320.0, 240.0}, {0.0, 240.0}},
+                   &planes);
+  EXPECT_EQ(planes.size(), 2);
+  cache.findPlanes({{-50.0, -20.0}, {-10.0, -20.0}, {-10.0, -3.0},
+                    {-50.0, -3.0}}, &planes);
+  EXPECT_TRUE(planes.empty());
+
+  // Neighbouring lines on the same plane reuse the planes found by RANSAC.
+  cv::Mat cloud = makeWedgeCloud();
+  cv::Mat image(cloud.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+  std::vector<cv::Vec4f> lines2D{cv::Vec4f(40, 100, 40, 200),
+                                 cv::Vec4f(60, 100, 60, 200),
+                                 cv::Vec4f(160, 100, 160, 200)};
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  std::vector<cv::Vec4f> lines2D_out;
+  std::vector<LineWithPlanes> lines3D_ransac, lines3D_cache;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_out, &lines3D_ransac);
+  EXPECT_EQ(line_detector.get_statistics().num_plane_hypothesis_cache_hits, 0);
+  params.use_plane_hypothesis_cache = true;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_out, &lines3D_cache);
+  EXPECT_GT(line_detector.get_statistics().num_plane_hypothesis_cache_hits, 0);
+  EXPECT_GT(line_detector.get_statistics().num_plane_hypothesis_cache_misses,
+            0);
+  ASSERT_EQ(lines3D_ransac.size(), lines3D_cache.size());
+  for (size_t i = 0; i < lines3D_ransac.size(); ++i) {
+    EXPECT_EQ(lines3D_ransac[i].type, lines3D_cache[i].type);
+    for (size_t k = 0; k < 6; ++k) {
+      EXPECT_NEAR(lines3D_ransac[i].line[k], lines3D_cache[i].line[k], 1e-3);
+    }
+  }
+}
+
+TEST_F(LineDetectionTest, testFrameContext) {
+  // Wedge moved away from the camera.
+  const int N = 240;
+  const int M = 320;
+  cv::Mat cloud = makeWedgeCloud() + cv::Scalar(0.0, 0.0, 1.0);
+  cloud.at<cv::Vec3f>(52, 41) = cv::Vec3f(NAN, NAN, NAN);
+  cloud.at<cv::Vec3f>(60, 70) = cv::Vec3f(0, 0, 0);
+  cv::Mat image(N, M, CV_8UC3);
+  cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+  cv::Mat camera_P = testCameraP();
+  FrameContext frame;
+  frame.setFrame(image, cloud, camera_P);
+  EXPECT_EQ(frame.rows(), N);
+  EXPECT_EQ(frame.cols(), M);
+  EXPECT_EQ(frame.getDepthCloud(), nullptr);
+  EXPECT_EQ(frame.getCloud().data, cloud.data);
+
+  // The derived products are computed once.
+  cv::Mat gray;
+  cv::cvtColor(image, gray, CV_RGB2GRAY);
+  const cv::Mat& frame_gray = frame.getGrayImage();
+  EXPECT_EQ(cv::norm(frame_gray, gray, cv::NORM_INF), 0.0);
+  EXPECT_EQ(frame.getGrayImage().data, frame_gray.data);
+  EXPECT_EQ(frame.getIntegralPlaneFitter(), frame.getIntegralPlaneFitter());
+  EXPECT_TRUE(frame.getIntegralPlaneFitter()->isSetTo(cloud));
+  EXPECT_TRUE(frame.getVoxelHash(0.04)->isSetTo(cloud, 0.04));
+  const PlaneSegmentationParams segmentation_params;
+  EXPECT_EQ(frame.getPlaneSegmentation(segmentation_params),
+            frame.getPlaneSegmentation(segmentation_params));
+  EXPECT_TRUE(frame.getPlaneSegmentation(segmentation_params)
+                  ->isSetTo(cloud, segmentation_params));
+
+  const cv::Mat& validity_mask = frame.getValidityMask();
+  EXPECT_EQ(validity_mask.at<uchar>(52, 41), 0);
+  EXPECT_EQ(validity_mask.at<uchar>(60, 70), FrameContext::kPointWithoutDepth);
+  EXPECT_EQ(validity_mask.at<uchar>(10, 10), FrameContext::kValidPoint);
+
+  // Projection and back-projection.
+  const cv::Vec3f point(0.3, -0.2, 2.5);
+  cv::Vec2f point_2D;
+  line_detector_.project3DPointTo2D(point, camera_P, &point_2D);
+  const cv::Point2f projection = frame.project(point);
+  EXPECT_NEAR(projection.x, point_2D[0], 1e-4);
+  EXPECT_NEAR(projection.y, point_2D[1], 1e-4);
+  const cv::Vec3f ray = frame.getInverseIntrinsics() *
+                        cv::Vec3f(projection.x, projection.y, 1.0f);
+  EXPECT_NEAR(ray[0] * point[2], point[0], 1e-5);
+  EXPECT_NEAR(ray[1] * point[2], point[1], 1e-5);
+
+  // Normals of the two halves of the wedge, oriented towards the camera.
+  const cv::Mat& normals = frame.getNormals();
+  const cv::Vec3f normal_left = normals.at<cv::Vec3f>(100, 50);
+  const cv::Vec3f normal_right = normals.at<cv::Vec3f>(100, 250);
+  EXPECT_NEAR(normal_left[0], 0.0, 1e-5);
+  EXPECT_NEAR(normal_left[1], sqrt(0.5), 1e-5);
+  EXPECT_NEAR(normal_left[2], -sqrt(0.5), 1e-5);
+  EXPECT_NEAR(normal_right[0], 0.0, 1e-5);
+  EXPECT_NEAR(normal_right[1], -sqrt(0.5), 1e-5);
+  EXPECT_NEAR(normal_right[2], -sqrt(0.5), 1e-5);
+  EXPECT_TRUE(std::isnan(normals.at<cv::Vec3f>(0, 50)[0]));
+  EXPECT_TRUE(std::isnan(normals.at<cv::Vec3f>(52, 42)[0]));
+
+  // The points gathered with the validity mask are the same.
+  const std::vector<cv::Point2f> corners{{40.3, 30.2}, {90.7, 60.1},
+                                         {75.2, 85.4}, {24.8, 55.5}};
+  std::vector<cv::Vec3f> points_cloud, points_frame;
+  for (bool stop : {false, true}) {
+    EXPECT_EQ(gatherPointsInRectangle(corners, cloud, stop, &points_cloud),
+              gatherPointsInRectangle(corners, &frame, stop, &points_frame));
+    ASSERT_EQ(points_cloud.size(), points_frame.size());
+    for (size_t i = 0; i < points_cloud.size(); ++i) {
+      EXPECT_EQ(points_cloud[i], points_frame[i]);
+    }
+  }
+
+  // The pipeline gives the same lines as with the raw inputs.
+  LineDetectionParams params;
+  params.use_integral_plane_fitting = true;
+  LineDetector line_detector(&params);
+  std::vector<cv::Vec4f> lines2D{cv::Vec4f(160, 100, 160, 200),
+                                 cv::Vec4f(20, 20, 120, 150)};
+  std::vector<cv::Vec4f> lines2D_mat, lines2D_frame;
+  std::vector<LineWithPlanes> lines3D_mat, lines3D_frame;
+  line_detector.project2Dto3DwithPlanes(cloud, image, camera_P, lines2D, false,
+                                        &lines2D_mat, &lines3D_mat);
+  line_detector.project2Dto3DwithPlanes(&frame, lines2D, false, &lines2D_frame,
+                                        &lines3D_frame);
+  ASSERT_EQ(lines3D_mat.size(), lines3D_frame.size());
+  for (size_t i = 0; i < lines3D_mat.size(); ++i) {
+    EXPECT_EQ(lines3D_mat[i].type, lines3D_frame[i].type);
+    for (size_t k = 0; k < 6; ++k) {
+      EXPECT_EQ(lines3D_mat[i].line[k], lines3D_frame[i].line[k]);
+    }
+  }
+  // The integral images of the frame are not modified by the detector.
+  cv::Mat other_cloud = cloud.clone();
+  line_detector.project2Dto3DwithPlanes(other_cloud, image, camera_P, lines2D,
+                                        false, &lines2D_mat, &lines3D_mat);
+  EXPECT_TRUE(frame.getIntegralPlaneFitter()->isSetTo(cloud));
+
+  // A new frame invalidates the derived products.
+  frame.setFrame(image, other_cloud, camera_P);
+  EXPECT_TRUE(frame.getIntegralPlaneFitter()->isSetTo(other_cloud));
+}
+
+TEST_F(LineDetectionTest, testProjectionFromDepthFrame) {
+  // Scene of makeBoxCloud, given as a depth image.
+  int N = 240;
+  int M = 320;
+  cv::Mat depth(N, M, CV_16UC1);
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < M; ++j) {
+      const bool on_box = i >= 60 && i < 180 && j >= 100 && j < 200;
+      depth.at<uint16_t>(i, j) = on_box ? 1500 : 3000;
+    }
+  }
+  cv::Mat image(N, M, CV_8UC3, cv::Scalar(0, 0, 0));
+  cv::Mat camera_P = testCameraP();
+  FrameContext dense_frame;
+  dense_frame.setFrameFromDepth(image, depth, camera_P, 1e-3, false);
+  const cv::Mat cloud = dense_frame.getCloud().clone();
+  dense_frame.setFrame(image, cloud, camera_P);
+  FrameContext frame;
+  frame.setFrameFromDepth(image, depth, camera_P, 1e-3, false);
+
+  // The points are gathered from the depth image, without the validity mask.
+  const std::vector<cv::Point2f> corners{{90.3, 100.2}, {110.7, 100.1},
+                                         {110.2, 120.4}, {90.8, 120.5}};
+  std::vector<cv::Vec3f> points_dense, points;
+  EXPECT_EQ(gatherPointsInRectangle(corners, &dense_frame, true, &points_dense),
+            gatherPointsInRectangle(corners, &frame, true, &points));
+  EXPECT_EQ(points, points_dense);
+  EXPECT_LT(frame.getDepthCloud()->getNumComputedRows(),
+            static_cast<size_t>(N));
+
+  // Only the rows around the lines are computed, and the lines are the same
+  // as with the whole cloud, also with several threads.
+  const std::vector<cv::Vec4f> lines2D{cv::Vec4f(100, 80, 100, 160),
+                                       cv::Vec4f(120, 60, 180, 60)};
+  LineDetectionParams params;
+  LineDetector line_detector(&params);
+  std::vector<cv::Vec4f> lines2D_dense, lines2D_out, lines2D_checked_dense,
+      lines2D_checked;
+  std::vector<LineWithPlanes> lines3D_dense, lines3D, lines3D_checked_dense,
+      lines3D_checked;
+  line_detector.project2Dto3DwithPlanes(&dense_frame, lines2D, false,
+                                        &lines2D_dense, &lines3D_dense);
+  line_detector.runCheckOn3DLines(&dense_frame, lines2D_dense, lines3D_dense,
+                                  &lines2D_checked_dense,
+                                  &lines3D_checked_dense);
+  ASSERT_GT(lines3D_checked_dense.size(), 0);
+  for (unsigned int num_threads : {1u, 2u}) {
+    params.num_threads_projection = num_threads;
+    frame.setFrameFromDepth(image, depth, camera_P, 1e-3, false);
+    line_detector.project2Dto3DwithPlanes(&frame, lines2D, false, &lines2D_out,
+                                          &lines3D);
+    line_detector.runCheckOn3DLines(&frame, lines2D_out, lines3D,
+                                    &lines2D_checked, &lines3D_checked);
+    EXPECT_GT(frame.getDepthCloud()->getNumComputedRows(), 0u);
+    EXPECT_LT(frame.getDepthCloud()->getNumComputedRows(),
+              static_cast<size_t>(N));
+    EXPECT_EQ(lines2D_checked, lines2D_checked_dense);
+    ASSERT_EQ(lines3D_checked.size(), lines3D_checked_dense.size());
+    for (size_t i = 0; i < lines3D_checked.size(); ++i) {
+      EXPECT_EQ(lines3D_checked[i].type, lines3D_checked_dense[i].type);
+      EXPECT_EQ(lines3D_checked[i].line, lines3D_checked_dense[i].line);
+      ASSERT_EQ(lines3D_checked[i].hessians.size(),
+                lines3D_checked_dense[i].hessians.size());
+      for (size_t k = 0; k < lines3D_checked[i].hessians.size(); ++k) {
+        EXPECT_EQ(lines3D_checked[i].hessians[k],
+                  lines3D_checked_dense[i].hessians[k]);
+      }
+    }
+  }
+}
+
+TEST_F(LineDetectionTest, testProjectionKernels) {
+  cv::Mat camera_P = (cv::Mat_<double>(3, 4) << 520.5, 0.5, 318.2, 12.0,
+                                                0, 525.1, 241.7, -3.0,
+                                                0.01, 0, 1, 0.2);
+  const cv::Matx34f P = toProjectionMatx(camera_P);
+  cv::Mat camera_P_float;
+  camera_P.convertTo(camera_P_float, CV_32F);
+  std::vector<cv::Vec3f> points;
+  for (int i = 0; i < 37; ++i) {
+    points.push_back(cv::Vec3f(0.1 * i - 1.5, 0.05 * i - 0.7, 1.0 + 0.1 * i));
+  }
+  std::vector<cv::Vec2f> points_2D;
+  projectPoints(P, points, &points_2D);
+  ASSERT_EQ(points_2D.size(), points.size());
+  for (size_t i = 0; i < points.size(); ++i) {
+    // Reference: product with cv::Mat.
+    const cv::Vec4f point_homo(points[i][0], points[i][1], points[i][2], 1.0f);
+    cv::Mat reference = camera_P_float * cv::Mat(point_homo);
+    const float u = reference.at<float>(0, 0) / reference.at<float>(2, 0);
+    const float v = reference.at<float>(1, 0) / reference.at<float>(2, 0);
+    EXPECT_NEAR(points_2D[i][0], u, 1e-3);
+    EXPECT_NEAR(points_2D[i][1], v, 1e-3);
+    const cv::Vec2f point_2D = projectPoint(P, points[i]);
+    EXPECT_FLOAT_EQ(point_2D[0], points_2D[i][0]);
+    EXPECT_FLOAT_EQ(point_2D[1], points_2D[i][1]);
+    cv::Vec2f point_2D_detector;
+    line_detector_.project3DPointTo2D(points[i], camera_P_float,
+                                      &point_2D_detector);
+    EXPECT_FLOAT_EQ(point_2D_detector[0], point_2D[0]);
+    EXPECT_FLOAT_EQ(point_2D_detector[1], point_2D[1]);
+  }
+
+  std::vector<cv::Vec6f> segments;
+  for (size_t i = 0; i + 1 < points.size(); ++i) {
+    segments.push_back(cv::Vec6f(points[i][0], points[i][1], points[i][2],
+                                 points[i + 1][0], points[i + 1][1],
+                                 points[i + 1][2]));
+  }
+  std::vector<cv::Vec4f> segments_2D;
+  projectSegments(P, segments, &segments_2D);
+  ASSERT_EQ(segments_2D.size(), segments.size());
+  for (size_t i = 0; i < segments.size(); ++i) {
+    const cv::Vec4f segment_2D = projectSegment(P, segments[i]);
+    for (size_t k = 0; k < 4; ++k) {
+      EXPECT_FLOAT_EQ(segments_2D[i][k], segment_2D[k]);
+    }
+    EXPECT_FLOAT_EQ(segments_2D[i][2], points_2D[i + 1][0]);
+    EXPECT_FLOAT_EQ(segments_2D[i][3], points_2D[i + 1][1]);
+  }
+  projectSegments(P, std::vector<cv::Vec6f>(), &segments_2D);
+  EXPECT_TRUE(segments_2D.empty());
+}
+
+TEST_F(LineDetectionTest, testGeometryKernels) {
+  // The number of points is not a multiple of the SIMD width, so that both the
+  // vectorized loops and their remainders are tested.
+  std::vector<cv::Vec3f> points;
+  cv::RNG rng(7);
+  for (size_t i = 0; i < 203; ++i) {
+    points.push_back(cv::Vec3f(rng.uniform(-1.0f, 1.0f),
+                               rng.uniform(-1.0f, 1.0f),
+                               rng.uniform(1.0f, 3.0f)));
+  }
+  PointBuffer buffer;
+  buffer.assign(points);
+  ASSERT_EQ(buffer.size(), points.size());
+  const cv::Vec4f hessian(0.6f, 0.0f, 0.8f, -1.6f);
+  const cv::Vec3f start(-0.5f, 0.2f, 1.5f);
+  const cv::Vec3f end(0.7f, -0.1f, 2.5f);
+  constexpr float kMaxError = 0.1f;
+
+  const bool use_optimized = cv::useOptimized();
+  for (const bool optimized : {false, true}) {
+    cv::setUseOptimized(optimized);
+    std::vector<uchar> plane_inliers, line_inliers;
+    std::vector<float> distances, positions;
+    const size_t num_plane_inliers =
+        markPlaneInliers(buffer, hessian, kMaxError, &plane_inliers);
+    EXPECT_EQ(countPlaneInliers(buffer, hessian, kMaxError),
+              num_plane_inliers);
+    const size_t num_line_inliers =
+        markLineInliers(buffer, start, end, kMaxError, &line_inliers);
+    distancesToLine(buffer, start, end, &distances);
+    positionsOnLine(buffer, start, end, &positions);
+    size_t expected_plane_inliers = 0, expected_line_inliers = 0;
+    for (size_t i = 0; i < points.size(); ++i) {
+      const double plane_error = errorPointToPlane(hessian, points[i]);
+      // Points too close to the threshold might be classified differently
+      // because of the rounding.
+      if (fabs(plane_error - kMaxError) > 1e-5) {
+        EXPECT_EQ(plane_inliers[i] != 0, plane_error < kMaxError);
+      }
+      expected_plane_inliers += plane_inliers[i];
+      const double line_distance = distPointToLine(start, end, points[i]);
+      EXPECT_NEAR(distances[i], line_distance, 1e-5);
+      if (fabs(line_distance - kMaxError) > 1e-5) {
+        EXPECT_EQ(line_inliers[i] != 0, line_distance <= kMaxError);
+      }
+      expected_line_inliers += line_inliers[i];
+      EXPECT_NEAR(positions[i], (end - start).dot(points[i] - start) /
+                                    (end - start).dot(end - start),
+                  1e-5);
+    }
+    EXPECT_EQ(num_plane_inliers, expected_plane_inliers);
+    EXPECT_EQ(num_line_inliers, expected_line_inliers);
+    EXPECT_GT(num_plane_inliers, 0u);
+    EXPECT_GT(num_line_inliers, 0u);
+
+    // Range version.
+    std::vector<uchar> range_inliers(50);
+    const size_t num_range_inliers = markPlaneInliers(
+        buffer, 101, 151, hessian, kMaxError, range_inliers.data());
+    size_t expected_range_inliers = 0;
+    for (size_t i = 0; i < 50; ++i) {
+      EXPECT_EQ(range_inliers[i], plane_inliers[101 + i]);
+      expected_range_inliers += plane_inliers[101 + i];
+    }
+    EXPECT_EQ(num_range_inliers, expected_range_inliers);
+  }
+  cv::setUseOptimized(use_optimized);
+}
+
 TEST_F(LineDetectionTest, testProjectPointOnPlane) {
   cv::Vec4f hessian(1, 0, 0, 0);
   cv::Vec3f point(456, 3, 2);
@@ -353,6 +2012,111 @@ TEST_F(LineDetectionTest, testProjectPointOnPlane) {
   EXPECT_FALSE(line_detector_.checkIfValidLineBruteForce(cloud, &line3D)) << 3;
 }*/
 
+TEST_F(LineDetectionTest, testCheckIfValidLineInCorridor) {
+  // Organized cloud consistent with camera_P: a wedge seen from the front.
+  const int N = 240;
+  const int M = 320;
+  const float f = 500.0f, cx = 160.0f, cy = 120.0f;
+  cv::Mat camera_P = (cv::Mat_<float>(3, 4) << f, 0, cx, 0, 0, f, cy, 0, 0, 0,
+                      1, 0);
+  auto point_at = [&](float u, float v) {
+    const float z = 2.0f + 0.01f * fabs(u - cx);
+    return cv::Vec3f((u - cx) * z / f, (v - cy) * z / f, z);
+  };
+  cv::Mat cloud(N, M, CV_32FC3);
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < M; ++j) {
+      cloud.at<cv::Vec3f>(i, j) = point_at(j, i);
+    }
+  }
+  for (int i = 100; i < 110; ++i) {
+    for (int j = 250; j < 260; ++j) {
+      cloud.at<cv::Vec3f>(i, j) = cv::Vec3f(NAN, NAN, NAN);
+    }
+  }
+  const cv::Vec3f start_on_plane = point_at(200, 60);
+  const cv::Vec3f end_on_plane = point_at(500, 60);
+  const cv::Vec3f start_on_plane_2 = point_at(20, 30);
+  const cv::Vec3f end_on_plane_2 = point_at(150, 230);
+  std::vector<cv::Vec6f> lines{
+      // Crease of the wedge, leaving the image at the top and at the bottom.
+      {0.0f, -1.0f, 2.0f, 0.0f, 1.0f, 2.0f},
+      // Lines on the surface, partly outside of the image.
+      {start_on_plane[0], start_on_plane[1], start_on_plane[2], end_on_plane[0],
+       end_on_plane[1], end_on_plane[2]},
+      {start_on_plane_2[0], start_on_plane_2[1], start_on_plane_2[2],
+       end_on_plane_2[0], end_on_plane_2[1], end_on_plane_2[2]},
+      // Line through the camera, starting behind it and crossing the wedge.
+      {0.0f, 0.01f, -1.0f, 0.0f, 0.01f, 3.0f},
+      // Line behind the camera.
+      {-1.0f, 0.0f, -2.0f, 1.0f, 0.0f, -2.0f},
+      // Line in front of the wedge.
+      {-0.3f, 0.0f, 1.5f, 0.3f, 0.0f, 1.5f}};
+  std::vector<bool> expected_valid{true, true, true, true, false, false};
+  for (size_t i = 0; i < lines.size(); ++i) {
+    cv::Vec6f line_brute_force = lines[i];
+    cv::Vec6f line_corridor = lines[i];
+    const bool valid_brute_force =
+        line_detector_.checkIfValidLineBruteForce(cloud, &line_brute_force);
+    const bool valid_corridor = line_detector_.checkIfValidLineInCorridor(
+        cloud, camera_P, &line_corridor);
+    EXPECT_EQ(valid_brute_force, expected_valid[i]) << "Line " << i;
+    EXPECT_EQ(valid_corridor, valid_brute_force) << "Line " << i;
+    if (valid_brute_force && valid_corridor) {
+      for (size_t k = 0; k < 6; ++k) {
+        EXPECT_EQ(line_corridor[k], line_brute_force[k]) << "Line " << i;
+      }
+    }
+  }
+  // The crease is truncated to the part visible in the image.
+  cv::Vec6f crease = lines[0];
+  EXPECT_TRUE(line_detector_.checkIfValidLineInCorridor(cloud, camera_P,
+                                                        &crease));
+  EXPECT_GT(crease[1], -0.6f);
+  EXPECT_LT(crease[4], 0.6f);
+
+  std::vector<LineWithPlanes> lines3D_in, lines3D_out;
+  for (const cv::Vec6f& line : lines) {
+    lines3D_in.push_back(LineWithPlanes());
+    lines3D_in.back().line = line;
+  }
+  line_detector_.runCheckOn3DLines(cloud, camera_P, lines3D_in, &lines3D_out);
+  EXPECT_EQ(lines3D_out.size(), 4u);
+
+  // A line too close to the camera is only searched in the voxel hash, which
+  // must be rebuilt when new points are written into the same buffer.
+  const cv::Vec3f near_start(-0.01f, 0.0f, 0.02f), near_end(0.01f, 0.0f, 0.05f);
+  lines3D_in.assign(1, LineWithPlanes());
+  lines3D_in[0].line = cv::Vec6f(near_start[0], near_start[1], near_start[2],
+                                 near_end[0], near_end[1], near_end[2]);
+  line_detector_.runCheckOn3DLines(cloud, camera_P, lines3D_in, &lines3D_out);
+  EXPECT_TRUE(lines3D_out.empty());
+  for (int j = 0; j < 100; ++j) {
+    cloud.at<cv::Vec3f>(0, j) =
+        near_start + (near_end - near_start) * (j / 99.0f);
+  }
+  cv::Vec6f near_line = lines3D_in[0].line;
+  ASSERT_TRUE(line_detector_.checkIfValidLineBruteForce(cloud, &near_line));
+  line_detector_.runCheckOn3DLines(cloud, camera_P, lines3D_in, &lines3D_out);
+  EXPECT_EQ(lines3D_out.size(), 1u);
+
+  // Same results on a cloud that is a region of interest of a larger one.
+  cv::Mat larger_cloud(N, M + 10, CV_32FC3, cv::Scalar(NAN, NAN, NAN));
+  cv::Mat roi_cloud = larger_cloud(cv::Rect(0, 0, M, N));
+  cloud.copyTo(roi_cloud);
+  ASSERT_FALSE(roi_cloud.isContinuous());
+  lines.push_back(lines3D_in[0].line);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    cv::Vec6f line_brute_force = lines[i];
+    cv::Vec6f line_corridor = lines[i];
+    EXPECT_EQ(line_detector_.checkIfValidLineInCorridor(roi_cloud, camera_P,
+                                                        &line_corridor),
+              line_detector_.checkIfValidLineBruteForce(roi_cloud,
+                                                        &line_brute_force))
+        << "Line " << i;
+  }
+}
+
 TEST_F(LineDetectionTest, testCheckIfValidLineDiscont) {
   int N = 240;
   int M = 320;
@@ -377,6 +2141,120 @@ TEST_F(LineDetectionTest, testCheckIfValidLineDiscont) {
   line2D = {20, 50, 300, 50};
 }
 
+TEST_F(LineDetectionTest, testLineEndpointSearch) {
+  int N = 240;
+  int M = 320;
+  double scale = 0.01;
+  cv::Mat cloud(N, M, CV_32FC3);
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < M; ++j) {
+      const double bump = 0.02 * sin(0.3 * i) * cos(0.2 * j);
+      if (j <= (M / 2)) {
+        cloud.at<cv::Vec3f>(i, j) =
+            cv::Vec3f(i * scale, j * scale, j * scale + bump);
+      } else {
+        cloud.at<cv::Vec3f>(i, j) =
+            cv::Vec3f(i * scale, j * scale, (M - j) * scale + bump);
+      }
+    }
+  }
+  // Reference: each of the three lines rated separately.
+  auto rate_separately = [&](const cv::Vec4f& line2D,
+                             cv::Vec6f* line3D) -> double {
+    const float dx = line2D[2] - line2D[0];
+    const float dy = line2D[3] - line2D[1];
+    const double norm = sqrt(dx * dx + dy * dy);
+    cv::Vec4f upper, lower;
+    for (size_t k = 0; k < 4; k += 2) {
+      upper[k] = fitToBoundary(
+          floor(line2D[k]) + floor(dy / norm + 0.5), 0.0, M - 1);
+      upper[k + 1] = fitToBoundary(
+          floor(line2D[k + 1]) + floor(-dx / norm + 0.5), 0.0, N - 1);
+      lower[k] = fitToBoundary(
+          floor(line2D[k]) + floor(-dy / norm + 0.5), 0.0, M - 1);
+      lower[k + 1] = fitToBoundary(
+          floor(line2D[k + 1]) + floor(dx / norm + 0.5), 0.0, N - 1);
+    }
+    cv::Vec6f line3D_low, line3D_mid, line3D_up;
+    const double rate_low =
+        line_detector_.findAndRate3DLine(cloud, lower, &line3D_low);
+    const double rate_mid =
+        line_detector_.findAndRate3DLine(cloud, line2D, &line3D_mid);
+    const double rate_up =
+        line_detector_.findAndRate3DLine(cloud, upper, &line3D_up);
+    if (rate_up < rate_mid && rate_up < rate_low) {
+      *line3D = line3D_up;
+      return rate_up;
+    } else if (rate_low < rate_mid) {
+      *line3D = line3D_low;
+      return rate_low;
+    }
+    *line3D = line3D_mid;
+    return rate_mid;
+  };
+  // Lines in the interior, along the ridge and touching the border.
+  std::vector<cv::Vec4f> lines2D{{20.5, 30.2, 140.7, 90.1},
+                                 {160, 100, 160, 200},
+                                 {300.3, 10.8, 250.1, 200.4},
+                                 {0, 0, 0, 100},
+                                 {10, 239, 300, 239},
+                                 {319, 5, 200, 239}};
+  LineEndpointSearch endpoint_search;
+  std::vector<cv::Vec6f> lines3D;
+  std::vector<double> rating;
+  line_detector_.find3DlinesRated(cloud, lines2D, &lines3D, &rating);
+  ASSERT_EQ(lines3D.size(), lines2D.size());
+  ASSERT_EQ(rating.size(), lines2D.size());
+  for (size_t i = 0; i < lines2D.size(); ++i) {
+    cv::Vec6f line3D_expected;
+    const double rating_expected = rate_separately(lines2D[i],
+                                                   &line3D_expected);
+    EXPECT_NEAR(rating[i], rating_expected, 1e-9) << "line " << i;
+    for (size_t k = 0; k < 6; ++k) {
+      EXPECT_EQ(lines3D[i][k], line3D_expected[k]) << "line " << i;
+    }
+  }
+
+  // NaN points at the start of a line are skipped.
+  for (int i = 100; i < 110; ++i) {
+    for (int j = 49; j <= 51; ++j) {
+      cloud.at<cv::Vec3f>(i, j) = cv::Vec3f(NAN, NAN, NAN);
+    }
+  }
+  cv::Vec6f line3D;
+  const double line_rating =
+      endpoint_search.findRatedLine(cloud, {50, 100, 50, 150}, &line3D);
+  EXPECT_LT(line_rating, LineEndpointSearch::kInvalidRating);
+  EXPECT_NEAR(line3D[0], 110 * scale, 1e-6);
+  EXPECT_NEAR(line3D[3], 150 * scale, 1e-6);
+  // A line with only NaN points has no valid 3D line.
+  EXPECT_EQ(endpoint_search.findRatedLine(cloud, {50, 100, 50, 109}, &line3D),
+            LineEndpointSearch::kInvalidRating);
+
+  // The shortest line between the patches is the one between their closest
+  // points.
+  const cv::Vec4f line2D(50, 120, 200, 140);
+  ASSERT_TRUE(endpoint_search.findShortestLine(cloud, line2D, 1, &line3D));
+  float min_sq_distance = std::numeric_limits<float>::max();
+  for (int y_start = 119; y_start <= 121; ++y_start) {
+    for (int x_start = 49; x_start <= 51; ++x_start) {
+      for (int y_end = 139; y_end <= 141; ++y_end) {
+        for (int x_end = 199; x_end <= 201; ++x_end) {
+          const cv::Vec3f difference = cloud.at<cv::Vec3f>(y_start, x_start) -
+                                       cloud.at<cv::Vec3f>(y_end, x_end);
+          min_sq_distance = std::min(min_sq_distance,
+                                     difference.dot(difference));
+        }
+      }
+    }
+  }
+  const cv::Vec3f difference(line3D[0] - line3D[3], line3D[1] - line3D[4],
+                             line3D[2] - line3D[5]);
+  EXPECT_FLOAT_EQ(difference.dot(difference), min_sq_distance);
+  EXPECT_FALSE(endpoint_search.findShortestLine(cloud, {50, 105, 200, 140}, 1,
+                                                &line3D));
+}
+
 // TODO: update to current version of the code or remove.
 /*TEST_F(LineDetectionTest, testFind3DlinesRated) {
   int N = 240;
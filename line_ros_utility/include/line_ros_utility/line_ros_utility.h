@@ -24,6 +24,7 @@
 #include <visualization_msgs/Marker.h>
 
 #include <line_clustering/line_clustering.h>
+#include <line_detection/frame_context.h>
 #include <line_detection/line_detection.h>
 #include <line_detection/line_detection_inl.h>
 #include <line_ros_utility/common.h>
@@ -41,6 +42,12 @@ namespace line_ros_utility {
     sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::Image,
     sensor_msgs::CameraInfo, sensor_msgs::Image>
             MySyncPolicy;
+    // Same as MySyncPolicy, without the point cloud, that is computed from the
+    // depth image instead.
+    typedef message_filters::sync_policies::ExactTime<
+    sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::Image,
+    sensor_msgs::CameraInfo>
+            MySyncPolicyWithoutCloud;
 
     struct SearchTree {
         std::vector<size_t> children_right;
@@ -281,6 +288,15 @@ namespace line_ros_utility {
                             const sensor_msgs::ImageConstPtr& rosmsg_classes,
                             const sensor_msgs::CameraInfoConstPtr& camera_info,
                             const sensor_msgs::ImageConstPtr& rosmsg_cloud);
+        // This callback is called by sync_without_cloud_ instead, if the point
+        // cloud is computed from the depth image. It calls masterCallback without
+        // cloud message.
+        void masterCallbackWithoutCloud(
+                const sensor_msgs::ImageConstPtr& rosmsg_image,
+                const sensor_msgs::ImageConstPtr& rosmsg_depth,
+                const sensor_msgs::ImageConstPtr& rosmsg_instances,
+                const sensor_msgs::ImageConstPtr& rosmsg_classes,
+                const sensor_msgs::CameraInfoConstPtr& camera_info);
 
         // (Deprecated). Old version of labelLinesWithInstances.
         // This function labels with an instances image.
@@ -514,6 +530,15 @@ namespace line_ros_utility {
         // The callback function to save the path where the lines should be saved to.
         void pathCallback(const std_msgs::String::ConstPtr& path_msg);
 
+        // Returns the camera model for camera_info. The model is only rebuilt
+        // when a different camera info is given, i.e. once per frame.
+        const image_geometry::PinholeCameraModel& getCameraModel(
+                const sensor_msgs::CameraInfoConstPtr& camera_info);
+        // Returns the projection matrix of the camera model for camera_info,
+        // for the projection kernels of line_detection.
+        const cv::Matx34f& getProjectionMatx(
+                const sensor_msgs::CameraInfoConstPtr& camera_info);
+
 
     private:
         // True if lines should be displayed, once labelled, overlapped on the
@@ -523,6 +548,13 @@ namespace line_ros_utility {
         bool inliers_visualization_mode_on_ = false;
         // True if detailed prints about the lines labelled should be displayed.
         bool verbose_mode_on_ = false;
+        // True if the point cloud is not received, but computed from the depth
+        // image and the camera info (ROS parameter ~use_depth_instead_of_cloud).
+        bool use_depth_instead_of_cloud_ = false;
+        // True if the depth image stores the distances of the points from the
+        // camera center, false if it stores their z coordinates (ROS parameter
+        // ~depth_is_distance).
+        bool depth_is_distance_ = true;
 
         // Data storage.
         std::string output_path_;
@@ -530,8 +562,14 @@ namespace line_ros_utility {
         size_t frame_step_;
         cv::Mat cv_image_;
         cv::Mat cv_img_gray_;
+        // Point cloud of the message, not set if the frame is set from
+        // cv_depth_.
         cv::Mat cv_cloud_;
         cv::Mat cv_depth_;
+        // Inputs of the current frame and the products derived from them
+        // (grayscale image, point cloud computed from cv_depth_ if
+        // use_depth_instead_of_cloud_, integral images, ...).
+        line_detection::FrameContext frame_;
         cv::Mat cv_instances_;
         cv::Mat cv_classes_;
         // To store the color value in the instance image(1 channel). If the instance
@@ -557,6 +595,12 @@ namespace line_ros_utility {
         std::vector<std::vector<bool>> line_opens_;
         std::vector<int> labels_rf_kmedoids_;
         sensor_msgs::CameraInfoConstPtr camera_info_;
+        // Camera model returned by getCameraModel and the camera info from
+        // which it was built.
+        image_geometry::PinholeCameraModel camera_model_;
+        sensor_msgs::CameraInfoConstPtr camera_model_info_;
+        // Projection matrix of camera_model_.
+        cv::Matx34f camera_model_P_;
         // Camera projection matrix.
         cv::Mat camera_P_;
         // Publishers and Subscribers.
@@ -565,7 +609,9 @@ namespace line_ros_utility {
         tf::TransformListener tf_listener_;
         ros::Publisher pcl_pub_;
         ros::Subscriber path_sub_;
-        message_filters::Synchronizer<MySyncPolicy>* sync_;
+        message_filters::Synchronizer<MySyncPolicy>* sync_ = nullptr;
+        message_filters::Synchronizer<MySyncPolicyWithoutCloud>*
+                sync_without_cloud_ = nullptr;
         message_filters::Subscriber<sensor_msgs::Image> image_sub_;
         message_filters::Subscriber<sensor_msgs::Image> depth_sub_;
         message_filters::Subscriber<sensor_msgs::Image> instances_sub_;
@@ -19,6 +19,10 @@ class convertInteriorNetToLineTools {
 public:
     convertInteriorNetToLineTools() {
         ros::NodeHandle node_handle_;
+        // If false, the point cloud is not converted nor published: the line tools
+        // compute it from the depth image (~use_depth_instead_of_cloud).
+        ros::NodeHandle("~").param("publish_point_cloud", publish_point_cloud_,
+                                   true);
 
         image_pub_ =
                 node_handle_.advertise<sensor_msgs::Image>("/line_tools/image/rgb", 2);
@@ -78,14 +82,16 @@ public:
         ros::Time stamp;
         tf::StampedTransform transform;
         geometry_msgs::TransformStamped transform_msg;
-        pcl::fromROSMsg(*rosmsg_cloud, pcl_cloud_);
-        const size_t height = rosmsg_image->height;
-        const size_t width = rosmsg_image->width;
-        pclFromInteriorNetToMat(pcl_cloud_, height, width, &(cvimage_cloud_.image));
-        cvimage_cloud_.header = rosmsg_cloud->header;
-        cvimage_cloud_.encoding = "32FC3";
+        if (publish_point_cloud_) {
+            pcl::fromROSMsg(*rosmsg_cloud, pcl_cloud_);
+            const size_t height = rosmsg_image->height;
+            const size_t width = rosmsg_image->width;
+            pclFromInteriorNetToMat(pcl_cloud_, height, width, &(cvimage_cloud_.image));
+            cvimage_cloud_.header = rosmsg_cloud->header;
+            cvimage_cloud_.encoding = "32FC3";
 
-        cloud_pub_.publish(cvimage_cloud_.toImageMsg());
+            cloud_pub_.publish(cvimage_cloud_.toImageMsg());
+        }
         image_pub_.publish(*rosmsg_image);
         depth_pub_.publish(*rosmsg_depth);
         info_pub_.publish(*camera_info);
@@ -125,6 +131,7 @@ protected:
     pcl::PointCloud<pcl::PointXYZRGB> pcl_cloud_;
     cv_bridge::CvImage cvimage_cloud_;
     cv::Mat cv_cloud_;
+    bool publish_point_cloud_;
 };
 
 int main(int argc, char** argv) {
@@ -205,9 +205,12 @@ namespace line_ros_utility {
       case line_detection::DetectorType::HOUGH:
         service_extract_lines_.request.detector = 3;
         break;
+      case line_detection::DetectorType::DEPTH:
+        service_extract_lines_.request.detector = 4;
+        break;
       default:
-        ROS_ERROR("Illegal detector type. Valid types are LSD, EDL, FAST and "
-                  "HOUGH.");
+        ROS_ERROR("Illegal detector type. Valid types are LSD, EDL, FAST, "
+                  "HOUGH and DEPTH.");
         return;
     }
     // Call line extraction service.
@@ -321,6 +324,8 @@ namespace line_ros_utility {
         line_type = 3;
         break;
       default:
+        // Includes UNCLASSIFIED, which is only returned if the planes of the
+        // lines are not fitted (cf. line_detection::kLineOutputEndpoints).
         ROS_ERROR("Illegal line type. Possible types are DISCONT, PLANE, EDGE "
                   "and INTERSECT");
         return;
@@ -171,6 +171,8 @@ namespace line_ros_utility {
             // 33-36: camera rotation
             for (size_t i = 0u; i < lines3D.size(); ++i) {
                 for (int j = 0; j < 6; ++j) file << lines3D[i].line[j] << " ";
+                // Both planes are always set, since the planes are fitted
+                // (cf. the constructor of ListenAndPublish).
                 for (int j = 0; j < 4; ++j) file << lines3D[i].hessians[0][j] << " ";
                 for (int j = 0; j < 4; ++j) file << lines3D[i].hessians[1][j] << " ";
                 for (int j = 0; j < 3; ++j) file << (int)lines3D[i].colors[0][j] << " ";
@@ -248,7 +250,13 @@ namespace line_ros_utility {
         image_sub_.subscribe(node_handle_, "/line_tools/image/rgb", 100);
         depth_sub_.subscribe(node_handle_, "/line_tools/image/depth", 100);
         info_sub_.subscribe(node_handle_, "/line_tools/camera_info", 100);
-        cloud_sub_.subscribe(node_handle_, "/line_tools/point_cloud", 100);
+        ros::NodeHandle private_node_handle("~");
+        private_node_handle.param("use_depth_instead_of_cloud",
+                                  use_depth_instead_of_cloud_, false);
+        private_node_handle.param("depth_is_distance", depth_is_distance_, true);
+        if (!use_depth_instead_of_cloud_) {
+            cloud_sub_.subscribe(node_handle_, "/line_tools/point_cloud", 100);
+        }
         instances_sub_.subscribe(node_handle_, "/line_tools/image/instances", 100);
         classes_sub_.subscribe(node_handle_, "/line_tools/image/classes", 100);
 
@@ -259,12 +267,20 @@ namespace line_ros_utility {
 
         // Add the parameters utility to line_detection.
         line_detector_ = line_detection::LineDetector(&params_);
+        // The labelling, the clustering, the written lines and the random
+        // forest all read the planes and the type of the lines, which are only
+        // set if the planes are fitted: lines of type UNCLASSIFIED are never
+        // handled here.
+        CHECK(params_.line_outputs & line_detection::kLineOutputPlanes);
         // Retrieve trees.
         if (clustering_with_random_forest) {
             tree_classifier_.getTrees();
         }
     }
-    ListenAndPublish::~ListenAndPublish() { delete sync_; }
+    ListenAndPublish::~ListenAndPublish() {
+        delete sync_;
+        delete sync_without_cloud_;
+    }
 
     void ListenAndPublish::instanceToClassIDMap(const cv::Mat& instances, const cv::Mat& classes,
             std::map<uint16_t, uint16_t>* instance_to_class_map) {
@@ -329,6 +345,16 @@ namespace line_ros_utility {
         // that receives messages of all five topics above synchronized. This means
         // every call of the callback function receives three messages that have the
         // same timestamp.
+        if (use_depth_instead_of_cloud_) {
+            sync_without_cloud_ =
+                    new message_filters::Synchronizer<MySyncPolicyWithoutCloud>(
+                            MySyncPolicyWithoutCloud(10), image_sub_, depth_sub_,
+                            instances_sub_, classes_sub_, info_sub_);
+            sync_without_cloud_->registerCallback(
+                    boost::bind(&ListenAndPublish::masterCallbackWithoutCloud, this,
+                                _1, _2, _3, _4, _5));
+            return;
+        }
         sync_ = new message_filters::Synchronizer<MySyncPolicy>(
                 MySyncPolicy(10), image_sub_, depth_sub_, instances_sub_, classes_sub_, info_sub_,
                 cloud_sub_);
@@ -341,7 +367,7 @@ namespace line_ros_utility {
         std::vector<cv::Vec4f> lines2D_not_fused;
 
         start_time_ = std::chrono::system_clock::now();
-        line_detector_.detectLines(cv_img_gray_, detector_method_,
+        line_detector_.detectLines(&frame_, detector_method_,
                                    &lines2D_not_fused);
         ROS_INFO("Lines found before fusing: %lu", lines2D_not_fused.size());
         lines2D_.clear();
@@ -355,8 +381,8 @@ namespace line_ros_utility {
     void ListenAndPublish::projectTo3D() {
         lines3D_temp_wp_.clear();
         start_time_ = std::chrono::system_clock::now();
-        line_detector_.project2Dto3DwithPlanes(cv_cloud_, cv_image_, camera_P_,
-                                               lines2D_, true, &lines2D_kept_tmp_,
+        line_detector_.project2Dto3DwithPlanes(&frame_, lines2D_, true,
+                                               &lines2D_kept_tmp_,
                                                &lines3D_temp_wp_);
         end_time_ = std::chrono::system_clock::now();
         elapsed_seconds_ = end_time_ - start_time_;
@@ -367,7 +393,7 @@ namespace line_ros_utility {
     void ListenAndPublish::checkLines() {
         lines3D_with_planes_.clear();
         start_time_ = std::chrono::system_clock::now();
-        line_detector_.runCheckOn3DLines(cv_cloud_, camera_P_, lines2D_kept_tmp_,
+        line_detector_.runCheckOn3DLines(&frame_, lines2D_kept_tmp_,
                                          lines3D_temp_wp_, &lines2D_kept_,
                                          &lines3D_with_planes_);
         end_time_ = std::chrono::system_clock::now();
@@ -488,11 +514,14 @@ namespace line_ros_utility {
         tf_listener_.lookupTransform("world", "/interiornet_camera_frame",
                                      ros::Time(0), transform);
 
-        // Extract the point cloud from the message.
-        cv_bridge::CvImageConstPtr cv_cloud_ptr =
-                cv_bridge::toCvShare(rosmsg_cloud, "32FC3");
-        cv_cloud_ = cv_cloud_ptr->image;
-        CHECK(cv_cloud_.type() == CV_32FC3);
+        // Extract the point cloud from the message (if there is none, it is
+        // computed from the depth image below).
+        if (rosmsg_cloud) {
+            cv_bridge::CvImageConstPtr cv_cloud_ptr =
+                    cv_bridge::toCvShare(rosmsg_cloud, "32FC3");
+            cv_cloud_ = cv_cloud_ptr->image;
+            CHECK(cv_cloud_.type() == CV_32FC3);
+        }
         // Extract image from message.
         cv_bridge::CvImageConstPtr cv_img_ptr =
                 cv_bridge::toCvShare(rosmsg_image, "rgb8");
@@ -514,12 +543,18 @@ namespace line_ros_utility {
         // Store camera message.
         camera_info_ = rosmsg_info;
         // Get camera projection matrix
-        image_geometry::PinholeCameraModel camera_model;
-        camera_model.fromCameraInfo(camera_info_);
-        camera_P_ = cv::Mat(camera_model.projectionMatrix());
+        camera_P_ = cv::Mat(getCameraModel(camera_info_).projectionMatrix());
         camera_P_.convertTo(camera_P_, CV_32F);
-        // Convert image to grayscale. That is needed for the line detection.
-        cv::cvtColor(cv_image_, cv_img_gray_, CV_RGB2GRAY);
+        if (rosmsg_cloud) {
+            frame_.setFrame(cv_image_, cv_cloud_, camera_P_);
+        } else {
+            // The depth is in millimeters. The points are only computed
+            // where they are read, i.e. around the lines.
+            frame_.setFrameFromDepth(cv_image_, cv_depth_, camera_P_, 1e-3,
+                                     depth_is_distance_);
+        }
+        // Grayscale image, needed for the line detection.
+        cv_img_gray_ = frame_.getGrayImage();
 
         ROS_INFO("**** New Image**** Frame %lu****", iteration_);
         detectLines();
@@ -581,7 +616,12 @@ namespace line_ros_utility {
             printToFile(lines2D_, path_2D);
         }
         initDisplay();
-        writeMatToPclCloud(cv_cloud_, cv_image_, &pcl_cloud_);
+        // The whole cloud is only needed to display it.
+        if (pcl_pub_.getNumSubscribers() > 0) {
+            writeMatToPclCloud(frame_.getCloud(), cv_image_, &pcl_cloud_);
+        } else {
+            pcl_cloud_.clear();
+        }
 
         // The timestamp is set to 0 because RVIZ is not able to find the right
         // transformation otherwise.
@@ -591,6 +631,32 @@ namespace line_ros_utility {
         iteration_ += frame_step_;
     }
 
+    void ListenAndPublish::masterCallbackWithoutCloud(
+            const sensor_msgs::ImageConstPtr& rosmsg_image,
+            const sensor_msgs::ImageConstPtr& rosmsg_depth,
+            const sensor_msgs::ImageConstPtr& rosmsg_instances,
+            const sensor_msgs::ImageConstPtr& rosmsg_classes,
+            const sensor_msgs::CameraInfoConstPtr& rosmsg_info) {
+        masterCallback(rosmsg_image, rosmsg_depth, rosmsg_instances, rosmsg_classes,
+                       rosmsg_info, sensor_msgs::ImageConstPtr());
+    }
+
+    const image_geometry::PinholeCameraModel& ListenAndPublish::getCameraModel(
+            const sensor_msgs::CameraInfoConstPtr& camera_info) {
+        if (camera_info != camera_model_info_) {
+            camera_model_.fromCameraInfo(camera_info);
+            camera_model_info_ = camera_info;
+            camera_model_P_ = camera_model_.projectionMatrix();
+        }
+        return camera_model_;
+    }
+
+    const cv::Matx34f& ListenAndPublish::getProjectionMatx(
+            const sensor_msgs::CameraInfoConstPtr& camera_info) {
+        getCameraModel(camera_info);
+        return camera_model_P_;
+    }
+
     void ListenAndPublish::pathCallback(const std_msgs::String::ConstPtr& path_msg) {
         ROS_INFO("Changed line_file path to: [%s]", path_msg->data.c_str());
         output_path_ = path_msg->data.c_str();
@@ -604,9 +670,8 @@ namespace line_ros_utility {
         CHECK_NOTNULL(labels);
         CHECK_EQ(instances.type(), CV_16UC1);
         labels->resize(lines.size());
-        // This class is used to perform the backprojection.
-        image_geometry::PinholeCameraModel camera_model;
-        camera_model.fromCameraInfo(camera_info);
+        // Projection matrix used to perform the backprojection.
+        const cv::Matx34f& P = getProjectionMatx(camera_info);
         // This is a voting vector, where all points on a line vote for one label and
         // the one with the highest votes wins.
         std::vector<int> labels_count;
@@ -614,23 +679,32 @@ namespace line_ros_utility {
         cv::Point2f point2D;
         unsigned short color;
 
-        cv::Vec3f start, end, line, point3D;
+        cv::Vec3f start, end, line;
         // num_checks + 1 points are reprojected onto the image.
         constexpr size_t num_checks = 10;
-        // Iterate over all lines.
+        // Compute the points on all lines and reproject them in one pass.
+        std::vector<cv::Vec3f> points3D;
+        std::vector<cv::Vec2f> points2D;
+        points3D.reserve(lines.size() * (num_checks + 1));
         for (size_t i = 0u; i < lines.size(); ++i) {
             start = {lines[i].line[0], lines[i].line[1], lines[i].line[2]};
             end = {lines[i].line[3], lines[i].line[4], lines[i].line[5]};
             line = end - start;
+            for (size_t k = 0u; k <= num_checks; ++k) {
+                points3D.push_back(start + line * (k / (double)num_checks));
+            }
+        }
+        line_detection::projectPoints(P, points3D, &points2D);
+        // Iterate over all lines.
+        for (size_t i = 0u; i < lines.size(); ++i) {
             // Set the labels size equal to the known_colors size and initialize them
             // with 0.
             labels_count = std::vector<int>(known_colors_.size(), 0);
             for (size_t k = 0u; k <= num_checks; ++k) {
-                // Compute a point on a line.
-                point3D = start + line * (k / (double)num_checks);
-                // Compute its reprojection.
-                point2D =
-                        camera_model.project3dToPixel({point3D[0], point3D[1], point3D[2]});
+                // Get the reprojection of the k-th point on the line.
+                const cv::Vec2f& reprojection =
+                        points2D[i * (num_checks + 1) + k];
+                point2D = {reprojection[0], reprojection[1]};
                 // Check that the point2D lies within the image boundaries.
                 point2D.x = line_detection::fitToBoundary(floor(point2D.x), 0,
                                                           instances.cols - 1);
@@ -747,6 +821,9 @@ namespace line_ros_utility {
                     case line_detection::LineType::INTERSECT:
                         LOG(INFO) << "Line is of type INTERSECT.";
                         break;
+                    case line_detection::LineType::UNCLASSIFIED:
+                        LOG(INFO) << "Line is of type UNCLASSIFIED.";
+                        break;
                     default:
                         LOG(INFO) << "Line is of type EDGE.";
                         break;
@@ -880,9 +957,12 @@ namespace line_ros_utility {
 
                     break;
                 case line_detection::LineType::EDGE:
+                case line_detection::LineType::UNCLASSIFIED:
                     // For edge lines the two planes, although not parallel to each other,
                     // should still belong to the same object, by definition of edge line.
-                    // Therefore, the majority-vote approach can be applied.
+                    // Therefore, the majority-vote approach can be applied. It only
+                    // uses the endpoints of the line, and is therefore also the only
+                    // one that applies to unclassified lines, whose planes are zero.
                     edge_line.clear();
                     edge_line.push_back(lines[i]);
                     labelLinesWithInstancesByMajorityVoting(edge_line, instances,
@@ -893,7 +973,7 @@ namespace line_ros_utility {
                     break;
                 default:
                     ROS_ERROR("Found line type that is not any of PLANE, DISCONT, EDGE, "
-                              "INTERSECTION.");
+                              "INTERSECTION, UNCLASSIFIED.");
             }
             if (labelled_line_visualization_mode_on_) {
                 // Display labelled line.
@@ -982,20 +1062,12 @@ namespace line_ros_utility {
         }
 
         CHECK_EQ(instances.type(), CV_16UC1);
-        CHECK(cv_cloud_.type() == CV_32FC3);
-
-        // Camera model for reprojection.
-        image_geometry::PinholeCameraModel camera_model;
-        camera_model.fromCameraInfo(camera_info);
 
         // Reproject line in 2D.
         cv::Vec3f start = {line.line[0], line.line[1], line.line[2]};
         cv::Vec3f end = {line.line[3], line.line[4], line.line[5]};
-        cv::Point2f start_2D = camera_model.project3dToPixel({start[0], start[1],
-                                                              start[2]});
-        cv::Point2f end_2D = camera_model.project3dToPixel({end[0], end[1],
-                                                            end[2]});
-        cv::Vec4f line_2D = {start_2D.x, start_2D.y, end_2D.x, end_2D.y};
+        cv::Vec4f line_2D = line_detection::projectSegment(
+                getProjectionMatx(camera_info), start, end);
         // Fit line to the image bounds.
         line_2D = line_detector_.fitLineToBounds(line_2D, instances.cols,
                                                  instances.rows);
@@ -1023,7 +1095,6 @@ namespace line_ros_utility {
 
         // Take rectangles and find points within them.
         std::vector<cv::Point2f> rect_left, rect_right;
-        std::vector<cv::Point2i> points_in_rect;
         // Each point in the vectors is a pair of a cv::Vec3f (coordinates) and of
         // an unsigned short representing the instance label.
         std::vector<std::pair<cv::Vec3f, unsigned short>> points_left_plane,
@@ -1033,33 +1104,45 @@ namespace line_ros_utility {
         unsigned short instance_label;
 
         line_detector_.getRectanglesFromLine(line_2D, &rect_left, &rect_right);
+        // The points are read directly from the cloud of the frame, span by
+        // span (the instances image has the same size as the cloud). If the
+        // frame was set from a depth image, only the rows of the rectangles
+        // are computed.
+        CHECK_EQ(instances.rows, frame_.rows());
+        CHECK_EQ(instances.cols, frame_.cols());
+        line_detection::DepthCloud* depth_cloud = frame_.getDepthCloud();
+        // The points are also stored as structure of arrays, to be tested
+        // against the planes with the geometry kernels.
+        line_detection::PointBuffer buffer_left_plane, buffer_right_plane;
         // (Left side)
-        line_detection::findPointsInRectangle(rect_left, &points_in_rect);
         points_left_plane.clear();
-        for (size_t j = 0; j < points_in_rect.size(); ++j) {
-            if (points_in_rect[j].x < 0 || points_in_rect[j].x >= instances.cols ||
-                points_in_rect[j].y < 0 || points_in_rect[j].y >= instances.rows) {
-                continue;
-            }
-            if (std::isnan(cv_cloud_.at<cv::Vec3f>(points_in_rect[j])[0])) continue;
-            instance_label = instances.at<unsigned short>(points_in_rect[j]);
-            points_left_plane.push_back(
-                    std::make_pair(cv_cloud_.at<cv::Vec3f>(points_in_rect[j]),
-                                   instance_label));
+        auto add_left_point = [&](int row, int col, const cv::Vec3f& point) {
+            instance_label = instances.at<unsigned short>(row, col);
+            points_left_plane.push_back(std::make_pair(point, instance_label));
+            buffer_left_plane.push_back(point);
+            return true;
+        };
+        if (depth_cloud != nullptr) {
+            line_detection::forEachValidPointInRectangle(
+                    rect_left, depth_cloud, add_left_point);
+        } else {
+            line_detection::forEachValidPointInRectangle(
+                    rect_left, frame_.getCloud(), add_left_point);
         }
         // (Right side)
-        line_detection::findPointsInRectangle(rect_right, &points_in_rect);
         points_right_plane.clear();
-        for (size_t j = 0; j < points_in_rect.size(); ++j) {
-            if (points_in_rect[j].x < 0 || points_in_rect[j].x >= instances.cols ||
-                points_in_rect[j].y < 0 || points_in_rect[j].y >= instances.rows) {
-                continue;
-            }
-            if (std::isnan(cv_cloud_.at<cv::Vec3f>(points_in_rect[j])[0])) continue;
-            instance_label = instances.at<unsigned short>(points_in_rect[j]);
-            points_right_plane.push_back(
-                    std::make_pair(cv_cloud_.at<cv::Vec3f>(points_in_rect[j]),
-                                   instance_label));
+        auto add_right_point = [&](int row, int col, const cv::Vec3f& point) {
+            instance_label = instances.at<unsigned short>(row, col);
+            points_right_plane.push_back(std::make_pair(point, instance_label));
+            buffer_right_plane.push_back(point);
+            return true;
+        };
+        if (depth_cloud != nullptr) {
+            line_detection::forEachValidPointInRectangle(
+                    rect_right, depth_cloud, add_right_point);
+        } else {
+            line_detection::forEachValidPointInRectangle(
+                    rect_right, frame_.getCloud(), add_right_point);
         }
 
         // Find which of the two sets of inliers belong to each plane, i.e., which
@@ -1068,24 +1151,21 @@ namespace line_ros_utility {
                 line_detector_.get_line_detection_params();
         double max_deviation = params_.max_error_inlier_ransac;
         int num_valid_points_left_plane = 0, num_valid_points_right_plane = 0;
-
-        std::vector<std::pair<cv::Vec3f, unsigned short>>::iterator it;
+        std::vector<uchar> inlier_mask;
 
         if (first_plane_only) {
             // Find inliers only for plane_1.
-            for (it = points_left_plane.begin(); it != points_left_plane.end();
-                 ++it) {
-                if (line_detection::errorPointToPlane(plane_1, it->first) <
-                    max_deviation) {
-                    valid_points_left_plane.push_back(*it);
-                }
+            line_detection::markPlaneInliers(buffer_left_plane, plane_1,
+                                             max_deviation, &inlier_mask);
+            for (size_t i = 0; i < points_left_plane.size(); ++i) {
+                if (inlier_mask[i])
+                    valid_points_left_plane.push_back(points_left_plane[i]);
             }
-            for (it = points_right_plane.begin(); it != points_right_plane.end();
-                 ++it) {
-                if (line_detection::errorPointToPlane(plane_1, it->first) <
-                    max_deviation) {
-                    valid_points_right_plane.push_back(*it);
-                }
+            line_detection::markPlaneInliers(buffer_right_plane, plane_1,
+                                             max_deviation, &inlier_mask);
+            for (size_t i = 0; i < points_right_plane.size(); ++i) {
+                if (inlier_mask[i])
+                    valid_points_right_plane.push_back(points_right_plane[i]);
             }
             num_valid_points_left_plane = valid_points_left_plane.size();
             num_valid_points_right_plane = valid_points_right_plane.size();
@@ -1099,12 +1179,11 @@ namespace line_ros_utility {
             }
         } else {
             // Find inliers for both planes.
-            for (it = points_left_plane.begin(); it != points_left_plane.end();
-                 ++it) {
-                if (line_detection::errorPointToPlane(plane_2, it->first) <
-                    max_deviation) {
-                    valid_points_left_plane.push_back(*it);
-                }
+            line_detection::markPlaneInliers(buffer_left_plane, plane_2,
+                                             max_deviation, &inlier_mask);
+            for (size_t i = 0; i < points_left_plane.size(); ++i) {
+                if (inlier_mask[i])
+                    valid_points_left_plane.push_back(points_left_plane[i]);
             }
             // The following is a trick that should in principle be never used, but
             // is in fact sometimes needed. What might happen, indeed, is that the 3D
@@ -1123,12 +1202,11 @@ namespace line_ros_utility {
             if (valid_points_left_plane.size() == 0)
                 valid_points_left_plane = points_left_plane;
 
-            for (it = points_right_plane.begin(); it != points_right_plane.end();
-                 ++it) {
-                if (line_detection::errorPointToPlane(plane_1, it->first) <
-                    max_deviation) {
-                    valid_points_right_plane.push_back(*it);
-                }
+            line_detection::markPlaneInliers(buffer_right_plane, plane_1,
+                                             max_deviation, &inlier_mask);
+            for (size_t i = 0; i < points_right_plane.size(); ++i) {
+                if (inlier_mask[i])
+                    valid_points_right_plane.push_back(points_right_plane[i]);
             }
 
             inliers_right->setInliersWithLabels(valid_points_right_plane);
@@ -1165,27 +1243,26 @@ namespace line_ros_utility {
             sensor_msgs::CameraInfoConstPtr camera_info) {
         cv::Point2f start_2D = {line_2D[0], line_2D[1]};
         cv::Point2f end_2D = {line_2D[2], line_2D[3]};
-        // Camera model for reprojection.
-        image_geometry::PinholeCameraModel camera_model;
-        camera_model.fromCameraInfo(camera_info);
+        // Projection matrix for reprojection.
+        const cv::Matx34f& P = getProjectionMatx(camera_info);
         // Display image of line with inliers.
         cv::Mat background_image(instances.rows, instances.cols, CV_8UC3);
         cv_image_.copyTo(background_image);
         // Set right inliers to cyan, left to magenta.
-        cv::Point2f inlier_2D;
+        std::vector<cv::Vec2f> inliers_2D;
         size_t i, j;
-        for (const auto& it : inliers_right) {
-            inlier_2D = camera_model.project3dToPixel({it[0], it[1], it[2]});
-            i = static_cast<size_t>(inlier_2D.y);
-            j = static_cast<size_t>(inlier_2D.x);
+        line_detection::projectPoints(P, inliers_right, &inliers_2D);
+        for (const auto& inlier_2D : inliers_2D) {
+            i = static_cast<size_t>(inlier_2D[1]);
+            j = static_cast<size_t>(inlier_2D[0]);
             background_image.at<cv::Vec3b>(i, j)[0] = 255;
             background_image.at<cv::Vec3b>(i, j)[1] = 255;
             background_image.at<cv::Vec3b>(i, j)[2] = 0;
         }
-        for (const auto& it: inliers_left) {
-            inlier_2D = camera_model.project3dToPixel({it[0], it[1], it[2]});
-            i = static_cast<size_t>(inlier_2D.y);
-            j = static_cast<size_t>(inlier_2D.x);
+        line_detection::projectPoints(P, inliers_left, &inliers_2D);
+        for (const auto& inlier_2D : inliers_2D) {
+            i = static_cast<size_t>(inlier_2D[1]);
+            j = static_cast<size_t>(inlier_2D[0]);
             background_image.at<cv::Vec3b>(i, j)[0] = 255;
             background_image.at<cv::Vec3b>(i, j)[1] = 0;
             background_image.at<cv::Vec3b>(i, j)[2] = 255;
@@ -1215,16 +1292,9 @@ namespace line_ros_utility {
             sensor_msgs::CameraInfoConstPtr camera_info) {
         int cols = image.cols;
         int rows = image.rows;
-        image_geometry::PinholeCameraModel camera_model;
-        camera_model.fromCameraInfo(camera_info);
         // Project the line in 2D.
-        cv::Point2f start_2D = camera_model.project3dToPixel({line.line[0],
-                                                              line.line[1],
-                                                              line.line[2]});
-        cv::Point2f end_2D = camera_model.project3dToPixel({line.line[3],
-                                                            line.line[4],
-                                                            line.line[5]});
-        cv::Vec4f line_2D = {start_2D.x, start_2D.y, end_2D.x, end_2D.y};
+        cv::Vec4f line_2D = line_detection::projectSegment(
+                getProjectionMatx(camera_info), line.line);
         // Fit line to the image bounds.
         line_2D = line_detector_.fitLineToBounds(line_2D, instances.cols,
                                                  instances.rows);
@@ -1293,9 +1363,11 @@ namespace line_ros_utility {
             if (start_point.dot(normal2) > 0.0f)
                 normal2 = -normal2;
 
-            if (lines[i].type == line_detection::LineType::DISCONT) {
+            if (lines[i].type == line_detection::LineType::DISCONT ||
+                lines[i].type == line_detection::LineType::UNCLASSIFIED) {
                 // For discontinuity lines we have only one normal, the other
-                // one is zero. So nothing needs to be done.
+                // one is zero, and for unclassified lines both are zero. So
+                // nothing needs to be done.
                 normals->at(i) = {normal1, normal2};
             } else {
                 // For lines with two normals, we have to sort them according
@@ -1331,15 +1403,14 @@ namespace line_ros_utility {
                                          const cv::Mat& depth_map, sensor_msgs::CameraInfoConstPtr camera_info) {
         int cols = depth_map.cols;
         int rows = depth_map.rows;
-        image_geometry::PinholeCameraModel camera_model;
-        camera_model.fromCameraInfo(camera_info);
+        const image_geometry::PinholeCameraModel& camera_model =
+                getCameraModel(camera_info);
+        const cv::Matx34f& P = getProjectionMatx(camera_info);
 
-        cv::Point2f start_2D = camera_model.project3dToPixel({start_point[0],
-                                                              start_point[1],
-                                                              start_point[2]});
-        cv::Point2f end_2D = camera_model.project3dToPixel({end_point[0],
-                                                            end_point[1],
-                                                            end_point[2]});
+        const cv::Vec4f line_reprojected =
+                line_detection::projectSegment(P, start_point, end_point);
+        cv::Point2f start_2D(line_reprojected[0], line_reprojected[1]);
+        cv::Point2f end_2D(line_reprojected[2], line_reprojected[3]);
 
         cv::Point2f line_2D = end_2D - start_2D;
         float line_length_2D = cv::norm(line_2D);
@@ -1351,9 +1422,9 @@ namespace line_ros_utility {
         // This probably not correct, but since the distance is so small, acceptable.
         cv::Vec3f check_3D = end_point + line_3D / line_length_2D * offset_length_2D;
 
-        cv::Point2f check_3D_to_2D = camera_model.project3dToPixel({check_3D[0],
-                                                                    check_3D[1],
-                                                                    check_3D[2]});
+        const cv::Vec2f check_reprojected =
+                line_detection::projectPoint(P, check_3D);
+        cv::Point2f check_3D_to_2D(check_reprojected[0], check_reprojected[1]);
 
         const float threshold = 0.1f;
         float depth_check = cv::norm(check_3D);
@@ -1714,6 +1785,8 @@ namespace line_ros_utility {
             for (size_t j = 0u; j < 6; ++j) {
                 service.request.lines.push_back(lines[i].line[j]);
             }
+            // The planes and the type of the lines are always set, since the
+            // planes are fitted (cf. the constructor of ListenAndPublish).
             for (size_t j = 0u; j < 4; ++j) {
                 service.request.lines.push_back(lines[i].hessians[0][j]);
             }
@@ -1867,17 +1940,10 @@ namespace line_ros_utility {
 
     void EvalData::projectLinesTo2D(
             const sensor_msgs::CameraInfoConstPtr& camera_info) {
-        cv::Point2f p1, p2;
         image_geometry::PinholeCameraModel camera_model;
         camera_model.fromCameraInfo(camera_info);
-        lines2D_.clear();
-        for (size_t i = 0u; i < lines3D_.size(); ++i) {
-            p1 = camera_model.project3dToPixel(
-                    {lines3D_[i][0], lines3D_[i][1], lines3D_[i][2]});
-            p2 = camera_model.project3dToPixel(
-                    {lines3D_[i][3], lines3D_[i][4], lines3D_[i][5]});
-            lines2D_.push_back({p1.x, p1.y, p2.x, p2.y});
-        }
+        const cv::Matx34f P = camera_model.projectionMatrix();
+        line_detection::projectSegments(P, lines3D_, &lines2D_);
     }
 
 // Copied from: